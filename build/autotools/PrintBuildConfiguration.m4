@@ -49,6 +49,7 @@ Build configuration:
   SSL                                              : ${enable_ssl}
   Snappy Compression                               : ${with_snappy}
   Zlib Compression                                 : ${with_zlib}
+  Zstd Compression                                 : ${with_zstd}
   Libbson                                          : ${with_libbson}
 ${experimental_features}
 Documentation:
@@ -39,6 +39,9 @@ struct _mongoc_apm_callbacks_t {
    mongoc_apm_server_heartbeat_started_cb_t server_heartbeat_started;
    mongoc_apm_server_heartbeat_succeeded_cb_t server_heartbeat_succeeded;
    mongoc_apm_server_heartbeat_failed_cb_t server_heartbeat_failed;
+   mongoc_apm_connection_created_cb_t connection_created;
+   mongoc_apm_connection_closed_cb_t connection_closed;
+   mongoc_apm_pool_checkout_cb_t pool_checkout;
 };
 
 /*
@@ -139,6 +142,36 @@ struct _mongoc_apm_server_heartbeat_failed_t {
    void *context;
 };
 
+/*
+ * connection pool monitoring events
+ */
+
+/* reasons a pooled client's connection was closed */
+#define MONGOC_CONNECTION_CLOSED_IDLE "idle"
+#define MONGOC_CONNECTION_CLOSED_ERROR "error"
+#define MONGOC_CONNECTION_CLOSED_STALE "stale"
+#define MONGOC_CONNECTION_CLOSED_CLIENT "clientClosed"
+
+struct _mongoc_apm_connection_created_t {
+   const mongoc_host_list_t *host;
+   uint32_t server_id;
+   void *context;
+};
+
+struct _mongoc_apm_connection_closed_t {
+   const mongoc_host_list_t *host;
+   uint32_t server_id;
+   const char *reason;
+   int64_t age_usec;
+   void *context;
+};
+
+struct _mongoc_apm_pool_checkout_t {
+   const char *partition;
+   int64_t duration_usec;
+   void *context;
+};
+
 void
 mongoc_apm_command_started_init (mongoc_apm_command_started_t *event,
                                  const bson_t *command,
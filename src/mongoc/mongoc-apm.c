@@ -590,6 +590,97 @@ mongoc_apm_server_heartbeat_failed_get_context (
 }
 
 
+/* connection-created event fields */
+
+const mongoc_host_list_t *
+mongoc_apm_connection_created_get_host (
+   const mongoc_apm_connection_created_t *event)
+{
+   return event->host;
+}
+
+
+uint32_t
+mongoc_apm_connection_created_get_server_id (
+   const mongoc_apm_connection_created_t *event)
+{
+   return event->server_id;
+}
+
+
+void *
+mongoc_apm_connection_created_get_context (
+   const mongoc_apm_connection_created_t *event)
+{
+   return event->context;
+}
+
+
+/* connection-closed event fields */
+
+const mongoc_host_list_t *
+mongoc_apm_connection_closed_get_host (
+   const mongoc_apm_connection_closed_t *event)
+{
+   return event->host;
+}
+
+
+uint32_t
+mongoc_apm_connection_closed_get_server_id (
+   const mongoc_apm_connection_closed_t *event)
+{
+   return event->server_id;
+}
+
+
+const char *
+mongoc_apm_connection_closed_get_reason (
+   const mongoc_apm_connection_closed_t *event)
+{
+   return event->reason;
+}
+
+
+int64_t
+mongoc_apm_connection_closed_get_age (
+   const mongoc_apm_connection_closed_t *event)
+{
+   return event->age_usec;
+}
+
+
+void *
+mongoc_apm_connection_closed_get_context (
+   const mongoc_apm_connection_closed_t *event)
+{
+   return event->context;
+}
+
+
+/* pool-checkout event fields */
+
+const char *
+mongoc_apm_pool_checkout_get_partition (const mongoc_apm_pool_checkout_t *event)
+{
+   return event->partition;
+}
+
+
+int64_t
+mongoc_apm_pool_checkout_get_duration (const mongoc_apm_pool_checkout_t *event)
+{
+   return event->duration_usec;
+}
+
+
+void *
+mongoc_apm_pool_checkout_get_context (const mongoc_apm_pool_checkout_t *event)
+{
+   return event->context;
+}
+
+
 /*
  * registering callbacks
  */
@@ -706,3 +797,27 @@ mongoc_apm_set_server_heartbeat_failed_cb (
 {
    callbacks->server_heartbeat_failed = cb;
 }
+
+
+void
+mongoc_apm_set_connection_created_cb (mongoc_apm_callbacks_t *callbacks,
+                                      mongoc_apm_connection_created_cb_t cb)
+{
+   callbacks->connection_created = cb;
+}
+
+
+void
+mongoc_apm_set_connection_closed_cb (mongoc_apm_callbacks_t *callbacks,
+                                     mongoc_apm_connection_closed_cb_t cb)
+{
+   callbacks->connection_closed = cb;
+}
+
+
+void
+mongoc_apm_set_pool_checkout_cb (mongoc_apm_callbacks_t *callbacks,
+                                 mongoc_apm_pool_checkout_cb_t cb)
+{
+   callbacks->pool_checkout = cb;
+}
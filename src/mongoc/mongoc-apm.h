@@ -75,6 +75,16 @@ typedef struct _mongoc_apm_server_heartbeat_succeeded_t
 typedef struct _mongoc_apm_server_heartbeat_failed_t
    mongoc_apm_server_heartbeat_failed_t;
 
+
+/*
+ * connection pool monitoring events
+ */
+
+typedef struct _mongoc_apm_connection_created_t
+   mongoc_apm_connection_created_t;
+typedef struct _mongoc_apm_connection_closed_t mongoc_apm_connection_closed_t;
+typedef struct _mongoc_apm_pool_checkout_t mongoc_apm_pool_checkout_t;
+
 /*
  * event field accessors
  */
@@ -269,6 +279,48 @@ MONGOC_EXPORT (void *)
 mongoc_apm_server_heartbeat_failed_get_context (
    const mongoc_apm_server_heartbeat_failed_t *event);
 
+/* connection-created event fields */
+
+MONGOC_EXPORT (const mongoc_host_list_t *)
+mongoc_apm_connection_created_get_host (
+   const mongoc_apm_connection_created_t *event);
+MONGOC_EXPORT (uint32_t)
+mongoc_apm_connection_created_get_server_id (
+   const mongoc_apm_connection_created_t *event);
+MONGOC_EXPORT (void *)
+mongoc_apm_connection_created_get_context (
+   const mongoc_apm_connection_created_t *event);
+
+/* connection-closed event fields */
+
+MONGOC_EXPORT (const mongoc_host_list_t *)
+mongoc_apm_connection_closed_get_host (
+   const mongoc_apm_connection_closed_t *event);
+MONGOC_EXPORT (uint32_t)
+mongoc_apm_connection_closed_get_server_id (
+   const mongoc_apm_connection_closed_t *event);
+MONGOC_EXPORT (const char *)
+mongoc_apm_connection_closed_get_reason (
+   const mongoc_apm_connection_closed_t *event);
+MONGOC_EXPORT (int64_t)
+mongoc_apm_connection_closed_get_age (
+   const mongoc_apm_connection_closed_t *event);
+MONGOC_EXPORT (void *)
+mongoc_apm_connection_closed_get_context (
+   const mongoc_apm_connection_closed_t *event);
+
+/* pool-checkout event fields */
+
+MONGOC_EXPORT (const char *)
+mongoc_apm_pool_checkout_get_partition (
+   const mongoc_apm_pool_checkout_t *event);
+MONGOC_EXPORT (int64_t)
+mongoc_apm_pool_checkout_get_duration (
+   const mongoc_apm_pool_checkout_t *event);
+MONGOC_EXPORT (void *)
+mongoc_apm_pool_checkout_get_context (
+   const mongoc_apm_pool_checkout_t *event);
+
 
 /*
  * callbacks
@@ -298,6 +350,12 @@ typedef void (*mongoc_apm_server_heartbeat_succeeded_cb_t) (
    const mongoc_apm_server_heartbeat_succeeded_t *event);
 typedef void (*mongoc_apm_server_heartbeat_failed_cb_t) (
    const mongoc_apm_server_heartbeat_failed_t *event);
+typedef void (*mongoc_apm_connection_created_cb_t) (
+   const mongoc_apm_connection_created_t *event);
+typedef void (*mongoc_apm_connection_closed_cb_t) (
+   const mongoc_apm_connection_closed_t *event);
+typedef void (*mongoc_apm_pool_checkout_cb_t) (
+   const mongoc_apm_pool_checkout_t *event);
 
 /*
  * registering callbacks
@@ -346,6 +404,15 @@ MONGOC_EXPORT (void)
 mongoc_apm_set_server_heartbeat_failed_cb (
    mongoc_apm_callbacks_t *callbacks,
    mongoc_apm_server_heartbeat_failed_cb_t cb);
+MONGOC_EXPORT (void)
+mongoc_apm_set_connection_created_cb (mongoc_apm_callbacks_t *callbacks,
+                                      mongoc_apm_connection_created_cb_t cb);
+MONGOC_EXPORT (void)
+mongoc_apm_set_connection_closed_cb (mongoc_apm_callbacks_t *callbacks,
+                                     mongoc_apm_connection_closed_cb_t cb);
+MONGOC_EXPORT (void)
+mongoc_apm_set_pool_checkout_cb (mongoc_apm_callbacks_t *callbacks,
+                                 mongoc_apm_pool_checkout_cb_t cb);
 BSON_END_DECLS
 
 #endif /* MONGOC_APM_H */
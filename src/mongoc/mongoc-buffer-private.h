@@ -80,6 +80,9 @@ _mongoc_buffer_destroy (mongoc_buffer_t *buffer);
 void
 _mongoc_buffer_clear (mongoc_buffer_t *buffer, bool zero);
 
+size_t
+_mongoc_buffer_trim (mongoc_buffer_t *buffer, size_t max_size, size_t min_size);
+
 
 BSON_END_DECLS
 
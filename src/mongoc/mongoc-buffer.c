@@ -124,6 +124,51 @@ _mongoc_buffer_clear (mongoc_buffer_t *buffer, bool zero)
 }
 
 
+/**
+ * _mongoc_buffer_trim:
+ * @buffer: A mongoc_buffer_t.
+ * @max_size: The largest allocation @buffer may keep.
+ * @min_size: The size to shrink @buffer to, if it must shrink.
+ *
+ * Releases memory held by @buffer if its allocation has grown beyond
+ * @max_size, for example after reading a single very large reply. Any unread
+ * data is preserved and moved to the start of the buffer.
+ *
+ * Returns: The number of bytes released.
+ */
+size_t
+_mongoc_buffer_trim (mongoc_buffer_t *buffer, size_t max_size, size_t min_size)
+{
+   size_t newlen;
+   size_t released;
+
+   BSON_ASSERT (buffer);
+   BSON_ASSERT (min_size);
+
+   if (buffer->datalen <= max_size || !buffer->realloc_func) {
+      return 0;
+   }
+
+   if (buffer->len && buffer->off) {
+      memmove (&buffer->data[0], &buffer->data[buffer->off], buffer->len);
+   }
+
+   buffer->off = 0;
+   newlen = BSON_MAX (min_size, buffer->len);
+
+   if (newlen >= buffer->datalen) {
+      return 0;
+   }
+
+   buffer->data = (uint8_t *) buffer->realloc_func (
+      buffer->data, newlen, buffer->realloc_data);
+   released = buffer->datalen - newlen;
+   buffer->datalen = newlen;
+
+   return released;
+}
+
+
 bool
 _mongoc_buffer_append (mongoc_buffer_t *buffer,
                        const uint8_t *data,
@@ -24,11 +24,32 @@
 #include <bson.h>
 
 #include "mongoc-client-pool.h"
+#include "mongoc-queue-private.h"
+#include "mongoc-thread-private.h"
 #include "mongoc-topology-description.h"
 #include "mongoc-topology-private.h"
 
 BSON_BEGIN_DECLS
 
+/* a named set of clients with its own size limits, all partitions of a pool
+ * share the pool's topology and background scanner */
+typedef struct _mongoc_client_pool_partition_t {
+   char *name; /* NULL for the default partition */
+   mongoc_cond_t cond;
+   mongoc_queue_t queue;
+   uint32_t min_pool_size;
+   uint32_t max_pool_size;
+   uint32_t size;
+   uint32_t num_waiting;
+   int64_t total_checkouts;
+   int64_t total_waits;
+   int64_t total_wait_usec;
+   int64_t max_wait_usec;
+   int64_t total_created;
+   int64_t total_destroyed;
+   struct _mongoc_client_pool_partition_t *next;
+} mongoc_client_pool_partition_t;
+
 /* for tests */
 void
 _mongoc_client_pool_set_stream_initiator (mongoc_client_pool_t *pool,
@@ -29,16 +29,19 @@
 #ifdef MONGOC_ENABLE_SSL
 #include "mongoc-ssl-private.h"
 #endif
+#ifdef MONGOC_ENABLE_CRYPTO
+#include "mongoc-scram-private.h"
+#endif
+#ifdef MONGOC_ENABLE_SSL_OPENSSL
+#include "mongoc-openssl-private.h"
+#endif
 
 struct _mongoc_client_pool_t {
    mongoc_mutex_t mutex;
-   mongoc_cond_t cond;
-   mongoc_queue_t queue;
+   /* the default partition comes first, named partitions follow */
+   mongoc_client_pool_partition_t *partitions;
    mongoc_topology_t *topology;
    mongoc_uri_t *uri;
-   uint32_t min_pool_size;
-   uint32_t max_pool_size;
-   uint32_t size;
 #ifdef MONGOC_ENABLE_SSL
    bool ssl_opts_set;
    mongoc_ssl_opt_t ssl_opts;
@@ -48,9 +51,91 @@ struct _mongoc_client_pool_t {
    void *apm_context;
    int32_t error_api_version;
    bool error_api_set;
+   /* shrink buffers of pushed clients above this size, 0 means never */
+   size_t max_idle_buffer_size;
+   /* incremented by mongoc_client_pool_reset_after_fork */
+   uint32_t generation;
 };
 
 
+static mongoc_client_pool_partition_t *
+_partition_new (const char *name,
+                uint32_t min_pool_size,
+                uint32_t max_pool_size)
+{
+   mongoc_client_pool_partition_t *partition;
+
+   partition = (mongoc_client_pool_partition_t *) bson_malloc0 (
+      sizeof *partition);
+   partition->name = bson_strdup (name);
+   mongoc_cond_init (&partition->cond);
+   _mongoc_queue_init (&partition->queue);
+   partition->min_pool_size = min_pool_size;
+   partition->max_pool_size = max_pool_size;
+
+   return partition;
+}
+
+
+static void
+_partition_destroy (mongoc_client_pool_partition_t *partition)
+{
+   mongoc_client_t *client;
+
+   while ((client = (mongoc_client_t *) _mongoc_queue_pop_head (
+              &partition->queue))) {
+      mongoc_counter_client_pool_idle_dec ();
+      mongoc_client_destroy (client);
+   }
+
+   mongoc_cond_destroy (&partition->cond);
+   bson_free (partition->name);
+   bson_free (partition);
+}
+
+
+/* bytes of scratch memory held by the idle clients in @partition */
+static size_t
+_partition_retained (mongoc_client_pool_partition_t *partition)
+{
+   mongoc_queue_item_t *item;
+   mongoc_client_t *client;
+   size_t retained = 0;
+
+   for (item = partition->queue.head; item; item = item->next) {
+      client = (mongoc_client_t *) item->data;
+      retained += _mongoc_cluster_get_retained (&client->cluster);
+   }
+
+   return retained;
+}
+
+
+/*
+ * Find a partition by name, NULL means the default partition.
+ *
+ * This function assumes the pool's mutex is locked
+ */
+static mongoc_client_pool_partition_t *
+_find_partition (mongoc_client_pool_t *pool, const char *name)
+{
+   mongoc_client_pool_partition_t *partition;
+
+   if (!name) {
+      return pool->partitions;
+   }
+
+   for (partition = pool->partitions->next; partition;
+        partition = partition->next) {
+      if (!strcmp (partition->name, name)) {
+         return partition;
+      }
+   }
+
+   return NULL;
+}
+
+
 #ifdef MONGOC_ENABLE_SSL
 void
 mongoc_client_pool_set_ssl_opts (mongoc_client_pool_t *pool,
@@ -102,11 +187,8 @@ mongoc_client_pool_new (const mongoc_uri_t *uri)
 
    pool = (mongoc_client_pool_t *) bson_malloc0 (sizeof *pool);
    mongoc_mutex_init (&pool->mutex);
-   _mongoc_queue_init (&pool->queue);
+   pool->partitions = _partition_new (NULL, 0, 100);
    pool->uri = mongoc_uri_copy (uri);
-   pool->min_pool_size = 0;
-   pool->max_pool_size = 100;
-   pool->size = 0;
 
    topology = mongoc_topology_new (uri, false);
    pool->topology = topology;
@@ -116,13 +198,15 @@ mongoc_client_pool_new (const mongoc_uri_t *uri)
 
    if (bson_iter_init_find_case (&iter, b, MONGOC_URI_MINPOOLSIZE)) {
       if (BSON_ITER_HOLDS_INT32 (&iter)) {
-         pool->min_pool_size = BSON_MAX (0, bson_iter_int32 (&iter));
+         pool->partitions->min_pool_size =
+            BSON_MAX (0, bson_iter_int32 (&iter));
       }
    }
 
    if (bson_iter_init_find_case (&iter, b, MONGOC_URI_MAXPOOLSIZE)) {
       if (BSON_ITER_HOLDS_INT32 (&iter)) {
-         pool->max_pool_size = BSON_MAX (1, bson_iter_int32 (&iter));
+         pool->partitions->max_pool_size =
+            BSON_MAX (1, bson_iter_int32 (&iter));
       }
    }
 
@@ -151,22 +235,21 @@ mongoc_client_pool_new (const mongoc_uri_t *uri)
 void
 mongoc_client_pool_destroy (mongoc_client_pool_t *pool)
 {
-   mongoc_client_t *client;
+   mongoc_client_pool_partition_t *partition;
 
    ENTRY;
 
    BSON_ASSERT (pool);
 
-   while (
-      (client = (mongoc_client_t *) _mongoc_queue_pop_head (&pool->queue))) {
-      mongoc_client_destroy (client);
+   while ((partition = pool->partitions)) {
+      pool->partitions = partition->next;
+      _partition_destroy (partition);
    }
 
    mongoc_topology_destroy (pool->topology);
 
    mongoc_uri_destroy (pool->uri);
    mongoc_mutex_destroy (&pool->mutex);
-   mongoc_cond_destroy (&pool->cond);
 
 #ifdef MONGOC_ENABLE_SSL
    _mongoc_ssl_opts_cleanup (&pool->ssl_opts);
@@ -195,54 +278,82 @@ _start_scanner_if_needed (mongoc_client_pool_t *pool)
    }
 }
 
-mongoc_client_t *
-mongoc_client_pool_pop (mongoc_client_pool_t *pool)
+/*
+ * Create a new client for @partition.
+ *
+ * This function assumes the pool's mutex is locked
+ */
+static mongoc_client_t *
+_new_client (mongoc_client_pool_t *pool,
+             mongoc_client_pool_partition_t *partition)
 {
    mongoc_client_t *client;
 
-   ENTRY;
+   client = _mongoc_client_new_from_uri (pool->uri, pool->topology);
 
-   BSON_ASSERT (pool);
-
-   mongoc_mutex_lock (&pool->mutex);
+   /* for tests */
+   mongoc_client_set_stream_initiator (
+      client,
+      pool->topology->scanner->initiator,
+      pool->topology->scanner->initiator_context);
 
-again:
-   if (!(client = (mongoc_client_t *) _mongoc_queue_pop_head (&pool->queue))) {
-      if (pool->size < pool->max_pool_size) {
-         client = _mongoc_client_new_from_uri (pool->uri, pool->topology);
-
-         /* for tests */
-         mongoc_client_set_stream_initiator (
-            client,
-            pool->topology->scanner->initiator,
-            pool->topology->scanner->initiator_context);
-
-         client->error_api_version = pool->error_api_version;
-         _mongoc_client_set_apm_callbacks_private (
-            client, &pool->apm_callbacks, pool->apm_context);
+   client->error_api_version = pool->error_api_version;
+   _mongoc_client_set_apm_callbacks_private (
+      client, &pool->apm_callbacks, pool->apm_context);
 #ifdef MONGOC_ENABLE_SSL
-         if (pool->ssl_opts_set) {
-            mongoc_client_set_ssl_opts (client, &pool->ssl_opts);
-         }
-#endif
-         pool->size++;
-      } else {
-         mongoc_cond_wait (&pool->cond, &pool->mutex);
-         GOTO (again);
-      }
+   if (pool->ssl_opts_set) {
+      mongoc_client_set_ssl_opts (client, &pool->ssl_opts);
    }
+#endif
 
-   _start_scanner_if_needed (pool);
-   mongoc_mutex_unlock (&pool->mutex);
+   client->pool_partition = partition;
+   client->pool_generation = pool->generation;
+   partition->size++;
+   partition->total_created++;
 
-   RETURN (client);
+   return client;
 }
 
 
-mongoc_client_t *
-mongoc_client_pool_try_pop (mongoc_client_pool_t *pool)
+/*
+ * Record a checkout in the shared memory counters: the checkout wait
+ * histogram buckets are <1ms, <10ms, <100ms, <1s, and longer.
+ */
+static void
+_record_checkout (int64_t wait_usec, bool waited)
+{
+   mongoc_counter_client_pool_checkouts_inc ();
+   mongoc_counter_client_pool_in_use_inc ();
+
+   if (!waited) {
+      mongoc_counter_client_pool_wait_0ms_inc ();
+      return;
+   }
+
+   mongoc_counter_client_pool_wait_usec_add (wait_usec);
+
+   if (wait_usec < 1000) {
+      mongoc_counter_client_pool_wait_1ms_inc ();
+   } else if (wait_usec < 10 * 1000) {
+      mongoc_counter_client_pool_wait_10ms_inc ();
+   } else if (wait_usec < 100 * 1000) {
+      mongoc_counter_client_pool_wait_100ms_inc ();
+   } else if (wait_usec < 1000 * 1000) {
+      mongoc_counter_client_pool_wait_1s_inc ();
+   } else {
+      mongoc_counter_client_pool_wait_long_inc ();
+   }
+}
+
+
+static mongoc_client_t *
+_pop (mongoc_client_pool_t *pool, const char *name, bool blocking)
 {
+   mongoc_client_pool_partition_t *partition;
    mongoc_client_t *client;
+   mongoc_apm_pool_checkout_t event;
+   int64_t wait_started = 0;
+   int64_t wait_usec = 0;
 
    ENTRY;
 
@@ -250,54 +361,267 @@ mongoc_client_pool_try_pop (mongoc_client_pool_t *pool)
 
    mongoc_mutex_lock (&pool->mutex);
 
-   if (!(client = (mongoc_client_t *) _mongoc_queue_pop_head (&pool->queue))) {
-      if (pool->size < pool->max_pool_size) {
-         client = _mongoc_client_new_from_uri (pool->uri, pool->topology);
-#ifdef MONGOC_ENABLE_SSL
-         if (pool->ssl_opts_set) {
-            mongoc_client_set_ssl_opts (client, &pool->ssl_opts);
+   partition = _find_partition (pool, name);
+   if (!partition) {
+      mongoc_mutex_unlock (&pool->mutex);
+      MONGOC_ERROR ("No client pool partition named \"%s\"", name);
+      RETURN (NULL);
+   }
+
+again:
+   if ((client = (mongoc_client_t *) _mongoc_queue_pop_head (
+           &partition->queue))) {
+      mongoc_counter_client_pool_idle_dec ();
+   } else {
+      if (partition->size < partition->max_pool_size) {
+         client = _new_client (pool, partition);
+      } else if (blocking) {
+         if (!wait_started) {
+            wait_started = bson_get_monotonic_time ();
+            partition->total_waits++;
          }
-#endif
-         pool->size++;
+
+         partition->num_waiting++;
+         mongoc_cond_wait (&partition->cond, &pool->mutex);
+         partition->num_waiting--;
+         GOTO (again);
       }
    }
 
+   if (wait_started) {
+      wait_usec = bson_get_monotonic_time () - wait_started;
+      partition->total_wait_usec += wait_usec;
+      partition->max_wait_usec = BSON_MAX (partition->max_wait_usec, wait_usec);
+   }
+
    if (client) {
+      partition->total_checkouts++;
+      _record_checkout (wait_usec, wait_started != 0);
       _start_scanner_if_needed (pool);
    }
+
    mongoc_mutex_unlock (&pool->mutex);
 
+   if (client && pool->apm_callbacks.pool_checkout) {
+      event.partition = name;
+      event.duration_usec = wait_usec;
+      event.context = pool->apm_context;
+      pool->apm_callbacks.pool_checkout (&event);
+   }
+
    RETURN (client);
 }
 
 
+mongoc_client_t *
+mongoc_client_pool_pop (mongoc_client_pool_t *pool)
+{
+   return _pop (pool, NULL, true);
+}
+
+
+mongoc_client_t *
+mongoc_client_pool_try_pop (mongoc_client_pool_t *pool)
+{
+   return _pop (pool, NULL, false);
+}
+
+
+mongoc_client_t *
+mongoc_client_pool_pop_partition (mongoc_client_pool_t *pool,
+                                  const char *name)
+{
+   BSON_ASSERT (name);
+
+   return _pop (pool, name, true);
+}
+
+
+mongoc_client_t *
+mongoc_client_pool_try_pop_partition (mongoc_client_pool_t *pool,
+                                      const char *name)
+{
+   BSON_ASSERT (name);
+
+   return _pop (pool, name, false);
+}
+
+
 void
 mongoc_client_pool_push (mongoc_client_pool_t *pool, mongoc_client_t *client)
 {
+   mongoc_client_pool_partition_t *partition;
+
    ENTRY;
 
    BSON_ASSERT (pool);
    BSON_ASSERT (client);
 
    mongoc_mutex_lock (&pool->mutex);
-   _mongoc_queue_push_head (&pool->queue, client);
 
-   if (pool->min_pool_size &&
-       _mongoc_queue_get_length (&pool->queue) > pool->min_pool_size) {
+   if (client->pool_generation != pool->generation) {
+      /* checked out before fork (), its connections belong to the parent */
+      mongoc_mutex_unlock (&pool->mutex);
+      _mongoc_cluster_close_inherited (&client->cluster);
+      mongoc_client_destroy (client);
+      EXIT;
+   }
+
+   /* return the client to the partition it was popped from */
+   partition = client->pool_partition;
+   BSON_ASSERT (partition);
+
+   if (pool->max_idle_buffer_size) {
+      _mongoc_cluster_trim (&client->cluster, pool->max_idle_buffer_size);
+   }
+
+   _mongoc_queue_push_head (&partition->queue, client);
+   mongoc_counter_client_pool_in_use_dec ();
+   mongoc_counter_client_pool_idle_inc ();
+
+   if (partition->min_pool_size &&
+       _mongoc_queue_get_length (&partition->queue) >
+          partition->min_pool_size) {
       mongoc_client_t *old_client;
-      old_client = (mongoc_client_t *) _mongoc_queue_pop_tail (&pool->queue);
+      old_client =
+         (mongoc_client_t *) _mongoc_queue_pop_tail (&partition->queue);
       if (old_client) {
+         mongoc_counter_client_pool_idle_dec ();
+         old_client->cluster.close_reason = MONGOC_CONNECTION_CLOSED_IDLE;
          mongoc_client_destroy (old_client);
-         pool->size--;
+         partition->size--;
+         partition->total_destroyed++;
       }
    }
 
-   mongoc_cond_signal (&pool->cond);
+   mongoc_cond_signal (&partition->cond);
    mongoc_mutex_unlock (&pool->mutex);
 
    EXIT;
 }
 
+
+bool
+mongoc_client_pool_add_partition (mongoc_client_pool_t *pool,
+                                  const char *name,
+                                  uint32_t min_pool_size,
+                                  uint32_t max_pool_size,
+                                  bson_error_t *error)
+{
+   mongoc_client_pool_partition_t *partition;
+   bool ret = false;
+
+   ENTRY;
+
+   BSON_ASSERT (pool);
+
+   if (!name || !*name) {
+      bson_set_error (error,
+                      MONGOC_ERROR_COMMAND,
+                      MONGOC_ERROR_COMMAND_INVALID_ARG,
+                      "Client pool partition name must be a non-empty string");
+      RETURN (false);
+   }
+
+   if (!max_pool_size || min_pool_size > max_pool_size) {
+      bson_set_error (error,
+                      MONGOC_ERROR_COMMAND,
+                      MONGOC_ERROR_COMMAND_INVALID_ARG,
+                      "Invalid size limits for client pool partition \"%s\":"
+                      " min %" PRIu32 ", max %" PRIu32,
+                      name,
+                      min_pool_size,
+                      max_pool_size);
+      RETURN (false);
+   }
+
+   mongoc_mutex_lock (&pool->mutex);
+
+   if (_find_partition (pool, name)) {
+      bson_set_error (error,
+                      MONGOC_ERROR_COMMAND,
+                      MONGOC_ERROR_COMMAND_INVALID_ARG,
+                      "Client pool partition \"%s\" already exists",
+                      name);
+      GOTO (done);
+   }
+
+   /* append, so the default partition stays at the head of the list */
+   partition = pool->partitions;
+   while (partition->next) {
+      partition = partition->next;
+   }
+
+   partition->next = _partition_new (name, min_pool_size, max_pool_size);
+   ret = true;
+
+done:
+   mongoc_mutex_unlock (&pool->mutex);
+
+   RETURN (ret);
+}
+
+
+bool
+mongoc_client_pool_get_partition_stats (mongoc_client_pool_t *pool,
+                                        const char *name,
+                                        bson_t *stats,
+                                        bson_error_t *error)
+{
+   mongoc_client_pool_partition_t *partition;
+   uint32_t idle;
+   bool ret = false;
+
+   ENTRY;
+
+   BSON_ASSERT (pool);
+   BSON_ASSERT (stats);
+
+   bson_init (stats);
+
+   mongoc_mutex_lock (&pool->mutex);
+
+   partition = _find_partition (pool, name);
+   if (!partition) {
+      bson_set_error (error,
+                      MONGOC_ERROR_COMMAND,
+                      MONGOC_ERROR_COMMAND_INVALID_ARG,
+                      "No client pool partition named \"%s\"",
+                      name);
+      GOTO (done);
+   }
+
+   idle = _mongoc_queue_get_length (&partition->queue);
+
+   if (partition->name) {
+      BSON_APPEND_UTF8 (stats, "name", partition->name);
+   } else {
+      BSON_APPEND_NULL (stats, "name");
+   }
+
+   BSON_APPEND_INT64 (stats, "minPoolSize", partition->min_pool_size);
+   BSON_APPEND_INT64 (stats, "maxPoolSize", partition->max_pool_size);
+   BSON_APPEND_INT64 (stats, "size", partition->size);
+   BSON_APPEND_INT64 (stats, "inUse", partition->size - idle);
+   BSON_APPEND_INT64 (stats, "idle", idle);
+   BSON_APPEND_INT64 (stats, "waiting", partition->num_waiting);
+   BSON_APPEND_INT64 (stats, "checkouts", partition->total_checkouts);
+   BSON_APPEND_INT64 (stats, "waits", partition->total_waits);
+   BSON_APPEND_INT64 (stats, "totalWaitMicros", partition->total_wait_usec);
+   BSON_APPEND_INT64 (stats, "maxWaitMicros", partition->max_wait_usec);
+   BSON_APPEND_INT64 (stats, "created", partition->total_created);
+   BSON_APPEND_INT64 (stats, "destroyed", partition->total_destroyed);
+   BSON_APPEND_INT64 (
+      stats, "idleRetainedBytes", (int64_t) _partition_retained (partition));
+
+   ret = true;
+
+done:
+   mongoc_mutex_unlock (&pool->mutex);
+
+   RETURN (ret);
+}
+
 /* for tests */
 void
 _mongoc_client_pool_set_stream_initiator (mongoc_client_pool_t *pool,
@@ -317,7 +641,7 @@ mongoc_client_pool_get_size (mongoc_client_pool_t *pool)
    ENTRY;
 
    mongoc_mutex_lock (&pool->mutex);
-   size = pool->size;
+   size = pool->partitions->size;
    mongoc_mutex_unlock (&pool->mutex);
 
    RETURN (size);
@@ -332,7 +656,7 @@ mongoc_client_pool_num_pushed (mongoc_client_pool_t *pool)
    ENTRY;
 
    mongoc_mutex_lock (&pool->mutex);
-   num_pushed = pool->queue.length;
+   num_pushed = pool->partitions->queue.length;
    mongoc_mutex_unlock (&pool->mutex);
 
    RETURN (num_pushed);
@@ -352,7 +676,7 @@ mongoc_client_pool_max_size (mongoc_client_pool_t *pool, uint32_t max_pool_size)
    ENTRY;
 
    mongoc_mutex_lock (&pool->mutex);
-   pool->max_pool_size = max_pool_size;
+   pool->partitions->max_pool_size = max_pool_size;
    mongoc_mutex_unlock (&pool->mutex);
 
    EXIT;
@@ -364,12 +688,93 @@ mongoc_client_pool_min_size (mongoc_client_pool_t *pool, uint32_t min_pool_size)
    ENTRY;
 
    mongoc_mutex_lock (&pool->mutex);
-   pool->min_pool_size = min_pool_size;
+   pool->partitions->min_pool_size = min_pool_size;
+   mongoc_mutex_unlock (&pool->mutex);
+
+   EXIT;
+}
+
+
+void
+mongoc_client_pool_set_max_idle_buffer_size (mongoc_client_pool_t *pool,
+                                             size_t max_size)
+{
+   ENTRY;
+
+   BSON_ASSERT (pool);
+
+   mongoc_mutex_lock (&pool->mutex);
+   pool->max_idle_buffer_size = max_size;
    mongoc_mutex_unlock (&pool->mutex);
 
    EXIT;
 }
 
+
+size_t
+mongoc_client_pool_get_idle_retained_bytes (mongoc_client_pool_t *pool)
+{
+   mongoc_client_pool_partition_t *partition;
+   size_t retained = 0;
+
+   ENTRY;
+
+   BSON_ASSERT (pool);
+
+   mongoc_mutex_lock (&pool->mutex);
+   for (partition = pool->partitions; partition; partition = partition->next) {
+      retained += _partition_retained (partition);
+   }
+   mongoc_mutex_unlock (&pool->mutex);
+
+   RETURN (retained);
+}
+
+
+void
+mongoc_client_pool_reset_after_fork (mongoc_client_pool_t *pool)
+{
+   mongoc_client_pool_partition_t *partition;
+   mongoc_client_t *client;
+
+   ENTRY;
+
+   BSON_ASSERT (pool);
+
+   /* threads that may have held the mutex do not exist in the child */
+   mongoc_mutex_init (&pool->mutex);
+   pool->generation++;
+
+   for (partition = pool->partitions; partition; partition = partition->next) {
+      mongoc_cond_init (&partition->cond);
+      partition->num_waiting = 0;
+
+      while ((client = (mongoc_client_t *) _mongoc_queue_pop_head (
+                 &partition->queue))) {
+         _mongoc_cluster_close_inherited (&client->cluster);
+         client->cluster.close_reason = MONGOC_CONNECTION_CLOSED_STALE;
+         mongoc_client_destroy (client);
+         mongoc_counter_client_pool_idle_dec ();
+      }
+
+      /* clients still checked out are destroyed when they are pushed */
+      partition->size = 0;
+   }
+
+   _mongoc_topology_reset_after_fork (pool->topology);
+
+   /* process-wide caches, once per child however many pools it resets */
+   _mongoc_client_local_host_cache_reset_after_fork ();
+#ifdef MONGOC_ENABLE_CRYPTO
+   _mongoc_scram_reset_after_fork ();
+#endif
+#ifdef MONGOC_ENABLE_SSL_OPENSSL
+   _mongoc_openssl_reset_after_fork ();
+#endif
+
+   EXIT;
+}
+
 bool
 mongoc_client_pool_set_apm_callbacks (mongoc_client_pool_t *pool,
                                       mongoc_apm_callbacks_t *callbacks,
@@ -423,6 +828,21 @@ mongoc_client_pool_set_error_api (mongoc_client_pool_t *pool, int32_t version)
    return true;
 }
 
+bool
+mongoc_client_pool_set_shared_monitoring (mongoc_client_pool_t *pool,
+                                          bool enabled)
+{
+   bool ret;
+
+   BSON_ASSERT (pool);
+
+   mongoc_mutex_lock (&pool->mutex);
+   ret = _mongoc_topology_set_shared_monitoring (pool->topology, enabled);
+   mongoc_mutex_unlock (&pool->mutex);
+
+   return ret;
+}
+
 bool
 mongoc_client_pool_set_appname (mongoc_client_pool_t *pool, const char *appname)
 {
@@ -69,6 +69,33 @@ mongoc_client_pool_set_error_api (mongoc_client_pool_t *pool, int32_t version);
 MONGOC_EXPORT (bool)
 mongoc_client_pool_set_appname (mongoc_client_pool_t *pool,
                                 const char *appname);
+MONGOC_EXPORT (bool)
+mongoc_client_pool_add_partition (mongoc_client_pool_t *pool,
+                                  const char *name,
+                                  uint32_t min_pool_size,
+                                  uint32_t max_pool_size,
+                                  bson_error_t *error);
+MONGOC_EXPORT (mongoc_client_t *)
+mongoc_client_pool_pop_partition (mongoc_client_pool_t *pool,
+                                  const char *name);
+MONGOC_EXPORT (mongoc_client_t *)
+mongoc_client_pool_try_pop_partition (mongoc_client_pool_t *pool,
+                                      const char *name);
+MONGOC_EXPORT (bool)
+mongoc_client_pool_get_partition_stats (mongoc_client_pool_t *pool,
+                                        const char *name,
+                                        bson_t *stats,
+                                        bson_error_t *error);
+MONGOC_EXPORT (void)
+mongoc_client_pool_set_max_idle_buffer_size (mongoc_client_pool_t *pool,
+                                             size_t max_size);
+MONGOC_EXPORT (size_t)
+mongoc_client_pool_get_idle_retained_bytes (mongoc_client_pool_t *pool);
+MONGOC_EXPORT (void)
+mongoc_client_pool_reset_after_fork (mongoc_client_pool_t *pool);
+MONGOC_EXPORT (bool)
+mongoc_client_pool_set_shared_monitoring (mongoc_client_pool_t *pool,
+                                          bool enabled);
 BSON_END_DECLS
 
 
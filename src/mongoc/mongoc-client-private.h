@@ -96,6 +96,11 @@ struct _mongoc_client_t {
 
    int32_t error_api_version;
    bool error_api_set;
+
+   /* the pool partition this client was popped from, or NULL */
+   struct _mongoc_client_pool_partition_t *pool_partition;
+   /* the pool's fork generation when this client was created */
+   uint32_t pool_generation;
 };
 
 
@@ -135,6 +140,19 @@ _mongoc_client_create_stream (mongoc_client_t *client,
                               const mongoc_host_list_t *host,
                               bson_error_t *error);
 
+mongoc_stream_t *
+_mongoc_client_connect_local_unix (const mongoc_uri_t *uri,
+                                   const mongoc_host_list_t *host);
+
+void
+_mongoc_client_local_host_cache_init (void);
+
+void
+_mongoc_client_local_host_cache_cleanup (void);
+
+void
+_mongoc_client_local_host_cache_reset_after_fork (void);
+
 bool
 _mongoc_client_recv (mongoc_client_t *client,
                      mongoc_rpc_t *rpc,
@@ -31,6 +31,12 @@
 #endif
 #endif
 
+#ifndef _WIN32
+#include <ifaddrs.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include "mongoc-cursor-array-private.h"
 #include "mongoc-client-private.h"
 #include "mongoc-collection-private.h"
@@ -57,6 +63,7 @@
 
 #ifdef MONGOC_ENABLE_SSL
 #include "mongoc-stream-tls.h"
+#include "mongoc-stream-tls-private.h"
 #include "mongoc-ssl-private.h"
 #include "mongoc-cmd-private.h"
 
@@ -417,6 +424,7 @@ mongoc_client_connect_tcp (const mongoc_uri_t *uri,
    }
 
    freeaddrinfo (result);
+   mongoc_counter_transport_tcp_inc ();
 
    return mongoc_stream_socket_new (sock);
 }
@@ -485,6 +493,7 @@ mongoc_client_connect_unix (const mongoc_uri_t *uri,
       RETURN (NULL);
    }
 
+   mongoc_counter_transport_unix_inc ();
    ret = mongoc_stream_socket_new (sock);
 
    RETURN (ret);
@@ -492,6 +501,268 @@ mongoc_client_connect_unix (const mongoc_uri_t *uri,
 }
 
 
+#ifndef _WIN32
+/* how many hosts _mongoc_host_is_local remembers, and for how long */
+#define MONGOC_LOCAL_HOST_CACHE_SIZE 64
+#define MONGOC_LOCAL_HOST_CACHE_TTL_USEC (60 * 1000 * 1000)
+
+typedef struct {
+   bool used;
+   char host[BSON_HOST_NAME_MAX + 1];
+   bool local;
+   int64_t expires;
+} mongoc_local_host_cache_entry_t;
+
+static mongoc_local_host_cache_entry_t
+   gLocalHostCache[MONGOC_LOCAL_HOST_CACHE_SIZE];
+static int gLocalHostCacheNext;
+static mongoc_mutex_t gLocalHostCacheMutex;
+static int gLocalHostCachePid;
+#endif
+
+
+void
+_mongoc_client_local_host_cache_init (void)
+{
+#ifndef _WIN32
+   mongoc_mutex_init (&gLocalHostCacheMutex);
+   gLocalHostCachePid = (int) getpid ();
+#endif
+}
+
+
+/* a parent thread may have held the mutex at fork() time. the cached
+ * answers stay valid in the child */
+void
+_mongoc_client_local_host_cache_reset_after_fork (void)
+{
+#ifndef _WIN32
+   if (gLocalHostCachePid == (int) getpid ()) {
+      return;
+   }
+
+   gLocalHostCachePid = (int) getpid ();
+   mongoc_mutex_init (&gLocalHostCacheMutex);
+#endif
+}
+
+
+void
+_mongoc_client_local_host_cache_cleanup (void)
+{
+#ifndef _WIN32
+   mongoc_mutex_destroy (&gLocalHostCacheMutex);
+   memset (gLocalHostCache, 0, sizeof gLocalHostCache);
+   gLocalHostCacheNext = 0;
+#endif
+}
+
+
+#ifndef _WIN32
+static bool
+_mongoc_sockaddr_equal (const struct sockaddr *a, const struct sockaddr *b)
+{
+   if (a->sa_family != b->sa_family) {
+      return false;
+   }
+
+   if (a->sa_family == AF_INET) {
+      return !memcmp (&((const struct sockaddr_in *) a)->sin_addr,
+                      &((const struct sockaddr_in *) b)->sin_addr,
+                      sizeof (struct in_addr));
+   }
+
+#if defined(AF_INET6)
+   if (a->sa_family == AF_INET6) {
+      return !memcmp (&((const struct sockaddr_in6 *) a)->sin6_addr,
+                      &((const struct sockaddr_in6 *) b)->sin6_addr,
+                      sizeof (struct in6_addr));
+   }
+#endif
+
+   return false;
+}
+
+
+/* does @hostname resolve to a loopback address or an address of one of this
+ * machine's network interfaces? */
+static bool
+_mongoc_host_is_local_lookup (const char *hostname)
+{
+   struct addrinfo hints;
+   struct addrinfo *result, *rp;
+   struct ifaddrs *ifaddrs, *ifa;
+   uint32_t addr;
+   bool local = false;
+
+   memset (&hints, 0, sizeof hints);
+   hints.ai_family = AF_UNSPEC;
+   hints.ai_socktype = SOCK_STREAM;
+
+   if (getaddrinfo (hostname, NULL, &hints, &result) != 0) {
+      return false;
+   }
+
+   if (getifaddrs (&ifaddrs) != 0) {
+      ifaddrs = NULL;
+   }
+
+   for (rp = result; rp && !local; rp = rp->ai_next) {
+      if (rp->ai_family == AF_INET) {
+         addr = ntohl (((struct sockaddr_in *) rp->ai_addr)->sin_addr.s_addr);
+         /* 127.0.0.0/8 */
+         local = (addr >> 24) == 127;
+      }
+#if defined(AF_INET6)
+      else if (rp->ai_family == AF_INET6) {
+         local = IN6_IS_ADDR_LOOPBACK (
+            &((struct sockaddr_in6 *) rp->ai_addr)->sin6_addr);
+      }
+#endif
+
+      for (ifa = ifaddrs; ifa && !local; ifa = ifa->ifa_next) {
+         local = ifa->ifa_addr &&
+                 _mongoc_sockaddr_equal (ifa->ifa_addr, rp->ai_addr);
+      }
+   }
+
+   if (ifaddrs) {
+      freeifaddrs (ifaddrs);
+   }
+
+   freeaddrinfo (result);
+
+   return local;
+}
+
+
+/* _mongoc_host_is_local_lookup blocks on the resolver, remember its answer
+ * for each host for a while instead of asking on every connection */
+static bool
+_mongoc_host_is_local (const char *hostname)
+{
+   mongoc_local_host_cache_entry_t *entry;
+   int64_t now;
+   bool local;
+   int i;
+
+   if (!strcasecmp (hostname, "localhost")) {
+      return true;
+   }
+
+   now = bson_get_monotonic_time ();
+
+   mongoc_mutex_lock (&gLocalHostCacheMutex);
+   for (i = 0; i < MONGOC_LOCAL_HOST_CACHE_SIZE; i++) {
+      entry = &gLocalHostCache[i];
+      if (entry->used && entry->expires > now &&
+          !strcasecmp (entry->host, hostname)) {
+         local = entry->local;
+         mongoc_mutex_unlock (&gLocalHostCacheMutex);
+         return local;
+      }
+   }
+   mongoc_mutex_unlock (&gLocalHostCacheMutex);
+
+   /* don't hold the lock while resolving */
+   local = _mongoc_host_is_local_lookup (hostname);
+
+   mongoc_mutex_lock (&gLocalHostCacheMutex);
+   for (i = 0; i < MONGOC_LOCAL_HOST_CACHE_SIZE; i++) {
+      entry = &gLocalHostCache[i];
+      if (entry->used && !strcasecmp (entry->host, hostname)) {
+         break;
+      }
+   }
+
+   if (i == MONGOC_LOCAL_HOST_CACHE_SIZE) {
+      /* replace the oldest entry */
+      entry = &gLocalHostCache[gLocalHostCacheNext];
+      gLocalHostCacheNext =
+         (gLocalHostCacheNext + 1) % MONGOC_LOCAL_HOST_CACHE_SIZE;
+   }
+
+   entry->used = true;
+   bson_strncpy (entry->host, hostname, sizeof entry->host);
+   entry->local = local;
+   entry->expires = now + MONGOC_LOCAL_HOST_CACHE_TTL_USEC;
+   mongoc_mutex_unlock (&gLocalHostCacheMutex);
+
+   return local;
+}
+#endif
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_client_connect_local_unix --
+ *
+ *       If the "localUnixSocket" URI option is true and @host is a server
+ *       on this machine that listens on the conventional UNIX domain
+ *       socket /tmp/mongodb-<port>.sock, connect to the socket instead of
+ *       over TCP loopback. Not used with TLS.
+ *
+ * Returns:
+ *       A newly allocated mongoc_stream_t, or NULL if the caller should
+ *       connect over TCP.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+mongoc_stream_t *
+_mongoc_client_connect_local_unix (const mongoc_uri_t *uri,
+                                   const mongoc_host_list_t *host)
+{
+#ifdef _WIN32
+   return NULL;
+#else
+   mongoc_host_list_t unix_host;
+   mongoc_stream_t *stream;
+   struct stat st;
+   bson_error_t error;
+
+   ENTRY;
+
+   if (!uri || host->family == AF_UNIX || mongoc_uri_get_ssl (uri)) {
+      RETURN (NULL);
+   }
+
+   if (!mongoc_uri_get_option_as_bool (
+          uri, MONGOC_URI_LOCALUNIXSOCKET, false)) {
+      RETURN (NULL);
+   }
+
+   memset (&unix_host, 0, sizeof unix_host);
+   bson_snprintf (unix_host.host,
+                  sizeof unix_host.host,
+                  "/tmp/mongodb-%hu.sock",
+                  host->port);
+
+   /* check for the socket file first, it is cheaper than resolving */
+   if (stat (unix_host.host, &st) != 0 || !S_ISSOCK (st.st_mode) ||
+       !_mongoc_host_is_local (host->host)) {
+      RETURN (NULL);
+   }
+
+   bson_strncpy (unix_host.host_and_port,
+                 unix_host.host,
+                 sizeof unix_host.host_and_port);
+   unix_host.family = AF_UNIX;
+
+   stream = mongoc_client_connect_unix (uri, &unix_host, &error);
+   if (!stream) {
+      mongoc_counter_transport_unix_fallback_inc ();
+      TRACE ("falling back to TCP for %s: %s",
+             host->host_and_port,
+             error.message);
+   }
+
+   RETURN (stream);
+#endif
+}
+
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -545,7 +816,10 @@ mongoc_client_default_stream_initiator (const mongoc_uri_t *uri,
    case AF_INET6:
 #endif
    case AF_INET:
-      base_stream = mongoc_client_connect_tcp (uri, host, error);
+      base_stream = _mongoc_client_connect_local_unix (uri, host);
+      if (!base_stream) {
+         base_stream = mongoc_client_connect_tcp (uri, host, error);
+      }
       break;
    case AF_UNIX:
       base_stream = mongoc_client_connect_unix (uri, host, error);
@@ -567,8 +841,14 @@ mongoc_client_default_stream_initiator (const mongoc_uri_t *uri,
           (mechanism && (0 == strcmp (mechanism, "MONGODB-X509")))) {
          mongoc_stream_t *original = base_stream;
 
-         base_stream = mongoc_stream_tls_new_with_hostname (
-            base_stream, host->host, &client->ssl_opts, true);
+         base_stream = _mongoc_stream_tls_new_with_hostname (
+            base_stream,
+            host->host,
+            &client->ssl_opts,
+            true,
+            mongoc_uri_get_option_as_bool (
+               uri, MONGOC_URI_SSLKERNELTLS, false),
+            host->host_and_port);
 
          if (!base_stream) {
             mongoc_stream_destroy (original);
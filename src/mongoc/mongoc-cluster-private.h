@@ -27,6 +27,7 @@
 #include "mongoc-buffer-private.h"
 #include "mongoc-config.h"
 #include "mongoc-client.h"
+#include "mongoc-compression-private.h"
 #include "mongoc-list-private.h"
 #include "mongoc-opcode.h"
 #include "mongoc-rpc-private.h"
@@ -45,6 +46,10 @@ BSON_BEGIN_DECLS
 typedef struct _mongoc_cluster_node_t {
    mongoc_stream_t *stream;
    char *connection_address;
+   mongoc_host_list_t host;
+   uint32_t server_id;
+   /* why the node is removed from the cluster, for connection monitoring */
+   const char *close_reason;
 
    int32_t max_wire_version;
    int32_t min_wire_version;
@@ -63,6 +68,10 @@ typedef struct _mongoc_cluster_t {
    uint8_t scram_server_key[MONGOC_SCRAM_HASH_SIZE];
    uint8_t scram_salted_password[MONGOC_SCRAM_HASH_SIZE];
    uint32_t socketcheckintervalms;
+   /* repeat slow reads on a second server after hedge_delay_ms, or after
+    * a percentile of the server's read latency if it is 0 */
+   bool hedged_reads;
+   int32_t hedge_delay_ms;
    mongoc_uri_t *uri;
    unsigned requires_auth : 1;
 
@@ -70,6 +79,11 @@ typedef struct _mongoc_cluster_t {
 
    mongoc_set_t *nodes;
    mongoc_array_t iov;
+   mongoc_compression_policy_t compression_policy;
+   mongoc_compression_scratch_t compression_scratch;
+
+   /* reason reported for nodes still open when the cluster is destroyed */
+   const char *close_reason;
 } mongoc_cluster_t;
 
 void
@@ -80,6 +94,21 @@ mongoc_cluster_init (mongoc_cluster_t *cluster,
 void
 mongoc_cluster_destroy (mongoc_cluster_t *cluster);
 
+size_t
+_mongoc_cluster_trim (mongoc_cluster_t *cluster, size_t max_size);
+
+size_t
+_mongoc_cluster_get_retained (mongoc_cluster_t *cluster);
+
+void
+_mongoc_cluster_close_inherited (mongoc_cluster_t *cluster);
+
+bool
+_mongoc_cluster_auth_stream (mongoc_cluster_t *cluster,
+                             mongoc_stream_t *stream,
+                             mongoc_server_description_t *sd,
+                             bson_error_t *error);
+
 void
 mongoc_cluster_disconnect_node (mongoc_cluster_t *cluster,
                                 uint32_t id,
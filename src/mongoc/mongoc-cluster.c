@@ -70,6 +70,18 @@
 
 #define IS_NOT_COMMAND(_name) (!!strcasecmp (cmd->command_name, _name))
 
+/* the first step of authentication, sent in the ismaster of a new connection
+ * as "speculativeAuthenticate". a server that supports it replies with the
+ * result of that step, and authentication continues from there. */
+typedef struct {
+   const char *mechanism; /* NULL if not speculating */
+   bson_t cmd;
+   bson_t reply; /* the server's reply, empty if it didn't speculate */
+#ifdef MONGOC_ENABLE_CRYPTO
+   mongoc_scram_t scram;
+#endif
+} mongoc_cluster_speculative_auth_t;
+
 static mongoc_server_stream_t *
 mongoc_cluster_fetch_stream_single (mongoc_cluster_t *cluster,
                                     uint32_t server_id,
@@ -82,6 +94,11 @@ mongoc_cluster_fetch_stream_pooled (mongoc_cluster_t *cluster,
                                     bool reconnect_ok,
                                     bson_error_t *error);
 
+static void
+_mongoc_cluster_remove_node (mongoc_cluster_t *cluster,
+                             uint32_t server_id,
+                             const char *reason);
+
 static void
 _bson_error_message_printf (bson_error_t *error, const char *format, ...)
    BSON_GNUC_PRINTF (2, 3);
@@ -171,6 +188,107 @@ _bson_error_message_printf (bson_error_t *error, const char *format, ...)
  *--------------------------------------------------------------------------
  */
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_cluster_compress --
+ *
+ *       Compress the message gathered in cluster->iov with @compressor_id,
+ *       unless the cluster's compression policy expects it not to pay off
+ *       for a message of @command_name, which may be NULL. With
+ *       adaptiveCompression, the policy instead chooses the compressor and
+ *       level for the server @sd among those it negotiated, or sends the
+ *       message uncompressed if that is faster. The compressed message is
+ *       in the cluster's compression scratch buffer, and is valid until
+ *       the next message is compressed.
+ *
+ * Returns:
+ *       false on error and @error is set.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_mongoc_cluster_compress (mongoc_cluster_t *cluster,
+                          int32_t compressor_id,
+                          const mongoc_server_description_t *sd,
+                          const char *command_name,
+                          mongoc_rpc_t *rpc,
+                          bson_error_t *error)
+{
+   mongoc_compression_policy_t *policy = &cluster->compression_policy;
+   uint32_t uncompressed_len;
+   uint32_t compressed_len;
+   int32_t level;
+   int64_t started;
+
+   if (compressor_id == -1 ||
+       !_mongoc_compression_policy_should_compress (
+          &cluster->compression_policy,
+          command_name,
+          (const mongoc_iovec_t *) cluster->iov.data,
+          cluster->iov.len,
+          16 /* message header */)) {
+      return true;
+   }
+
+   uncompressed_len = BSON_UINT32_FROM_LE (rpc->header.msg_len);
+
+   if (!policy->adaptive) {
+      level = _mongoc_compression_scratch_level (&cluster->compression_scratch,
+                                                 compressor_id);
+   } else if (!_mongoc_compression_policy_select (policy,
+                                                  sd->id,
+                                                  &sd->compressors,
+                                                  uncompressed_len,
+                                                  &compressor_id,
+                                                  &level)) {
+      return true;
+   }
+
+   started = bson_get_monotonic_time ();
+   if (!_mongoc_rpc_compress (cluster, compressor_id, level, rpc, error)) {
+      return false;
+   }
+
+   compressed_len = BSON_UINT32_FROM_LE (rpc->header.msg_len);
+   _mongoc_compression_policy_record (
+      policy, command_name, uncompressed_len, compressed_len);
+
+   if (policy->adaptive) {
+      _mongoc_compression_policy_record_codec (
+         policy,
+         compressor_id,
+         level,
+         uncompressed_len,
+         compressed_len,
+         bson_get_monotonic_time () - started);
+   }
+
+   return true;
+}
+
+
+/* with adaptiveCompression, measure the link to a server from a transfer
+ * of @len bytes in direction @dir that began at @started */
+static void
+_mongoc_cluster_record_link (mongoc_cluster_t *cluster,
+                             uint32_t server_id,
+                             mongoc_compression_link_dir_t dir,
+                             size_t len,
+                             int64_t started)
+{
+   if (cluster->compression_policy.adaptive) {
+      _mongoc_compression_policy_record_link (&cluster->compression_policy,
+                                              server_id,
+                                              dir,
+                                              len,
+                                              bson_get_monotonic_time () -
+                                                 started);
+   }
+}
+
+
 static bool
 mongoc_cluster_run_command_opquery (mongoc_cluster_t *cluster,
                                     mongoc_cmd_t *cmd,
@@ -191,8 +309,8 @@ mongoc_cluster_run_command_opquery (mongoc_cluster_t *cluster,
    int32_t msg_len;
    size_t doc_len;
    bool ret = false;
-   char *output = NULL;
    uint32_t server_id;
+   int64_t started;
 
    ENTRY;
 
@@ -229,8 +347,12 @@ mongoc_cluster_run_command_opquery (mongoc_cluster_t *cluster,
        IS_NOT_COMMAND ("createuser") && IS_NOT_COMMAND ("updateuser") &&
        IS_NOT_COMMAND ("copydbsaslstart") &&
        IS_NOT_COMMAND ("copydbgetnonce") && IS_NOT_COMMAND ("copydb")) {
-      output = _mongoc_rpc_compress (cluster, compressor_id, &rpc, error);
-      if (output == NULL) {
+      if (!_mongoc_cluster_compress (cluster,
+                                     compressor_id,
+                                     cmd->server_stream->sd,
+                                     cmd->command_name,
+                                     &rpc,
+                                     error)) {
          GOTO (done);
       }
    }
@@ -246,6 +368,7 @@ mongoc_cluster_run_command_opquery (mongoc_cluster_t *cluster,
    /*
     * send and receive
     */
+   started = bson_get_monotonic_time ();
    if (!_mongoc_stream_writev_full (stream,
                                     cluster->iov.data,
                                     cluster->iov.len,
@@ -264,6 +387,12 @@ mongoc_cluster_run_command_opquery (mongoc_cluster_t *cluster,
       GOTO (done);
    }
 
+   _mongoc_cluster_record_link (cluster,
+                                server_id,
+                                MONGOC_COMPRESSION_LINK_SEND,
+                                BSON_UINT32_FROM_LE (rpc.header.msg_len),
+                                started);
+
    if (reply_header_size != mongoc_stream_read (stream,
                                                 &reply_header_buf,
                                                 reply_header_size,
@@ -295,11 +424,12 @@ mongoc_cluster_run_command_opquery (mongoc_cluster_t *cluster,
 
    if (BSON_UINT32_FROM_LE (rpc.header.opcode) == MONGOC_OPCODE_COMPRESSED) {
       bson_t tmp = BSON_INITIALIZER;
-      uint8_t *buf = NULL;
       size_t len = BSON_UINT32_FROM_LE (rpc.compressed.uncompressed_size) +
                    sizeof (mongoc_rpc_header_t);
 
-      reply_buf = bson_malloc0 (msg_len);
+      /* the reply is copied out, so both buffers can be scratch */
+      reply_buf = _mongoc_compression_scratch_compressed (
+         &cluster->compression_scratch, (size_t) msg_len);
       memcpy (reply_buf, reply_header_buf, reply_header_size);
 
       if (doc_len != mongoc_stream_read (stream,
@@ -317,13 +447,13 @@ mongoc_cluster_run_command_opquery (mongoc_cluster_t *cluster,
          GOTO (done);
       }
 
-      buf = bson_malloc0 (len);
-      if (!_mongoc_rpc_decompress (&rpc, buf, len)) {
+      if (!_mongoc_rpc_decompress (&rpc,
+                                   _mongoc_compression_scratch_uncompressed (
+                                      &cluster->compression_scratch, len),
+                                   len)) {
          RUN_CMD_ERR (MONGOC_ERROR_PROTOCOL,
                       MONGOC_ERROR_PROTOCOL_INVALID_REPLY,
                       "Could not decompress server reply");
-         bson_free (reply_buf);
-         bson_free (buf);
          GOTO (done);
       }
 
@@ -331,8 +461,6 @@ mongoc_cluster_run_command_opquery (mongoc_cluster_t *cluster,
 
       _mongoc_rpc_get_first_document (&rpc, &tmp);
       bson_copy_to (&tmp, reply_ptr);
-      bson_free (reply_buf);
-      bson_free (buf);
    } else if (BSON_UINT32_FROM_LE (rpc.header.opcode) == MONGOC_OPCODE_REPLY &&
               BSON_UINT32_FROM_LE (rpc.reply_header.n_returned) == 1) {
       reply_buf = bson_reserve_buffer (reply_ptr, (uint32_t) doc_len);
@@ -375,11 +503,26 @@ done:
    if (reply_ptr == &reply_local) {
       bson_destroy (reply_ptr);
    }
-   bson_free (output);
 
    RETURN (ret);
 }
 
+/* whether a command failed because its server isn't the primary */
+static bool
+_mongoc_cluster_is_not_master_error (const bson_error_t *error)
+{
+   if (error->domain != MONGOC_ERROR_SERVER &&
+       error->domain != MONGOC_ERROR_QUERY) {
+      return false;
+   }
+
+   return error->code == 10107 /* NotMaster */ ||
+          error->code == 13435 /* NotMasterNoSlaveOk */ ||
+          error->code == 13436 /* NotMasterOrSecondary */ ||
+          !strncmp (error->message, "not master", strlen ("not master"));
+}
+
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -415,8 +558,10 @@ mongoc_cluster_run_command_monitored (mongoc_cluster_t *cluster,
    bson_t reply_local;
    bson_error_t error_local;
    int32_t compressor_id;
+   uint32_t server_id;
 
    server_stream = cmd->server_stream;
+   server_id = server_stream->sd->id;
    compressor_id = mongoc_server_description_compressor_id (server_stream->sd);
 
    callbacks = &cluster->client->apm_callbacks;
@@ -453,6 +598,19 @@ mongoc_cluster_run_command_monitored (mongoc_cluster_t *cluster,
                                                    reply,
                                                    error);
    }
+   /* don't time a hedged read that the second server answered */
+   if (retval && server_stream->sd->id == server_id) {
+      _mongoc_topology_record_latency (
+         cluster->client->topology,
+         server_stream->sd->id,
+         _mongoc_latency_class (cmd->command_name),
+         bson_get_monotonic_time () - started);
+   }
+
+   if (!retval && _mongoc_cluster_is_not_master_error (error)) {
+      _mongoc_topology_handle_not_master (cluster->client->topology);
+   }
+
    if (retval && callbacks->succeeded) {
       mongoc_apm_command_succeeded_init (&succeeded_event,
                                          bson_get_monotonic_time () - started,
@@ -573,7 +731,10 @@ mongoc_cluster_run_command_parts (mongoc_cluster_t *cluster,
  *
  * _mongoc_stream_run_ismaster --
  *
- *       Run an ismaster command on the given stream.
+ *       Run an ismaster command on the given stream. If
+ *       @speculative_auth is not NULL and has a mechanism, the first step
+ *       of authentication is sent with the ismaster, and the server's
+ *       reply to it is stored in @speculative_auth->reply.
  *
  * Returns:
  *       A mongoc_server_description_t you must destroy. If the call failed
@@ -582,14 +743,19 @@ mongoc_cluster_run_command_parts (mongoc_cluster_t *cluster,
  *--------------------------------------------------------------------------
  */
 static mongoc_server_description_t *
-_mongoc_stream_run_ismaster (mongoc_cluster_t *cluster,
-                             mongoc_stream_t *stream,
-                             const char *address,
-                             uint32_t server_id)
+_mongoc_stream_run_ismaster (
+   mongoc_cluster_t *cluster,
+   mongoc_stream_t *stream,
+   const char *address,
+   uint32_t server_id,
+   mongoc_cluster_speculative_auth_t *speculative_auth)
 {
    const bson_t *command;
    mongoc_cmd_parts_t parts;
+   bson_t command_with_auth = BSON_INITIALIZER;
    bson_t reply;
+   bson_t speculative_reply;
+   bson_iter_t iter;
    bson_error_t error;
    int64_t start;
    int64_t rtt_msec;
@@ -605,10 +771,20 @@ _mongoc_stream_run_ismaster (mongoc_cluster_t *cluster,
    command = _mongoc_topology_scanner_get_ismaster (
       cluster->client->topology->scanner);
 
+   if (speculative_auth && speculative_auth->mechanism) {
+      bson_copy_to_excluding_noinit (
+         command, &command_with_auth, "speculativeAuthenticate", NULL);
+      BSON_APPEND_DOCUMENT (&command_with_auth,
+                            "speculativeAuthenticate",
+                            &speculative_auth->cmd);
+      command = &command_with_auth;
+   }
+
    start = bson_get_monotonic_time ();
    server_stream = _mongoc_cluster_create_server_stream (
       cluster->client->topology, server_id, stream, &error);
    if (!server_stream) {
+      bson_destroy (&command_with_auth);
       RETURN (NULL);
    }
 
@@ -616,11 +792,25 @@ _mongoc_stream_run_ismaster (mongoc_cluster_t *cluster,
    if (!mongoc_cluster_run_command_parts (
           cluster, server_stream, &parts, &reply, &error)) {
       mongoc_server_stream_cleanup (server_stream);
+      bson_destroy (&command_with_auth);
       RETURN (NULL);
    }
 
    rtt_msec = (bson_get_monotonic_time () - start) / 1000;
 
+   if (speculative_auth && speculative_auth->mechanism &&
+       bson_iter_init_find (&iter, &reply, "speculativeAuthenticate") &&
+       BSON_ITER_HOLDS_DOCUMENT (&iter)) {
+      uint32_t len;
+      const uint8_t *data;
+
+      bson_iter_document (&iter, &len, &data);
+      if (bson_init_static (&speculative_reply, data, len)) {
+         bson_destroy (&speculative_auth->reply);
+         bson_copy_to (&speculative_reply, &speculative_auth->reply);
+      }
+   }
+
    sd = (mongoc_server_description_t *) bson_malloc0 (
       sizeof (mongoc_server_description_t));
 
@@ -642,6 +832,7 @@ _mongoc_stream_run_ismaster (mongoc_cluster_t *cluster,
 
    mongoc_cmd_parts_cleanup (&parts);
    mongoc_server_stream_cleanup (server_stream);
+   bson_destroy (&command_with_auth);
 
    RETURN (sd);
 }
@@ -664,10 +855,12 @@ _mongoc_stream_run_ismaster (mongoc_cluster_t *cluster,
  *--------------------------------------------------------------------------
  */
 static mongoc_server_description_t *
-_mongoc_cluster_run_ismaster (mongoc_cluster_t *cluster,
-                              mongoc_cluster_node_t *node,
-                              uint32_t server_id,
-                              bson_error_t *error /* OUT */)
+_mongoc_cluster_run_ismaster (
+   mongoc_cluster_t *cluster,
+   mongoc_cluster_node_t *node,
+   uint32_t server_id,
+   mongoc_cluster_speculative_auth_t *speculative_auth,
+   bson_error_t *error /* OUT */)
 {
    mongoc_server_description_t *sd;
 
@@ -677,8 +870,11 @@ _mongoc_cluster_run_ismaster (mongoc_cluster_t *cluster,
    BSON_ASSERT (node);
    BSON_ASSERT (node->stream);
 
-   sd = _mongoc_stream_run_ismaster (
-      cluster, node->stream, node->connection_address, server_id);
+   sd = _mongoc_stream_run_ismaster (cluster,
+                                     node->stream,
+                                     node->connection_address,
+                                     server_id,
+                                     speculative_auth);
 
    if (sd->type == MONGOC_SERVER_UNKNOWN) {
       memcpy (error, &sd->error, sizeof (bson_error_t));
@@ -961,22 +1157,17 @@ _mongoc_cluster_auth_node_plain (mongoc_cluster_t *cluster,
 
 
 #ifdef MONGOC_ENABLE_SSL
+/* build the MONGODB-X509 authenticate command, with the username from the URI
+ * or else from the client certificate's subject */
 static bool
-_mongoc_cluster_auth_node_x509 (mongoc_cluster_t *cluster,
-                                mongoc_stream_t *stream,
-                                mongoc_server_description_t *sd,
-                                bson_error_t *error)
+_mongoc_cluster_get_auth_cmd_x509 (mongoc_cluster_t *cluster,
+                                   bson_t *cmd /* OUT */,
+                                   bson_error_t *error /* OUT */)
 {
-   mongoc_cmd_parts_t parts;
    const char *username_from_uri = NULL;
    char *username_from_subject = NULL;
-   bson_t cmd;
-   bson_t reply;
-   bool ret;
-   mongoc_server_stream_t *server_stream;
 
    BSON_ASSERT (cluster);
-   BSON_ASSERT (stream);
 
    username_from_uri = mongoc_uri_get_username (cluster->uri);
    if (username_from_uri) {
@@ -1004,14 +1195,41 @@ _mongoc_cluster_auth_node_x509 (mongoc_cluster_t *cluster,
       TRACE ("%s", "X509: got username from certificate");
    }
 
-   bson_init (&cmd);
-   BSON_APPEND_INT32 (&cmd, "authenticate", 1);
-   BSON_APPEND_UTF8 (&cmd, "mechanism", "MONGODB-X509");
-   BSON_APPEND_UTF8 (&cmd,
+   bson_init (cmd);
+   BSON_APPEND_INT32 (cmd, "authenticate", 1);
+   BSON_APPEND_UTF8 (cmd, "mechanism", "MONGODB-X509");
+   BSON_APPEND_UTF8 (cmd,
                      "user",
                      username_from_uri ? username_from_uri
                                        : username_from_subject);
 
+   if (username_from_subject) {
+      bson_free (username_from_subject);
+   }
+
+   return true;
+}
+
+
+static bool
+_mongoc_cluster_auth_node_x509 (mongoc_cluster_t *cluster,
+                                mongoc_stream_t *stream,
+                                mongoc_server_description_t *sd,
+                                bson_error_t *error)
+{
+   mongoc_cmd_parts_t parts;
+   bson_t cmd;
+   bson_t reply;
+   bool ret;
+   mongoc_server_stream_t *server_stream;
+
+   BSON_ASSERT (cluster);
+   BSON_ASSERT (stream);
+
+   if (!_mongoc_cluster_get_auth_cmd_x509 (cluster, &cmd, error)) {
+      return false;
+   }
+
    mongoc_cmd_parts_init (&parts, "$external", MONGOC_QUERY_SLAVE_OK, &cmd);
    server_stream = _mongoc_cluster_create_server_stream (
       cluster->client->topology, sd->id, stream, error);
@@ -1024,10 +1242,6 @@ _mongoc_cluster_auth_node_x509 (mongoc_cluster_t *cluster,
       error->code = MONGOC_ERROR_CLIENT_AUTHENTICATE;
    }
 
-   if (username_from_subject) {
-      bson_free (username_from_subject);
-   }
-
    mongoc_cmd_parts_cleanup (&parts);
    bson_destroy (&cmd);
    bson_destroy (&reply);
@@ -1038,94 +1252,141 @@ _mongoc_cluster_auth_node_x509 (mongoc_cluster_t *cluster,
 
 
 #ifdef MONGOC_ENABLE_CRYPTO
-static bool
-_mongoc_cluster_auth_node_scram (mongoc_cluster_t *cluster,
-                                 mongoc_stream_t *stream,
-                                 mongoc_server_description_t *sd,
-                                 bson_error_t *error)
+static const char *
+_mongoc_cluster_get_scram_auth_source (mongoc_cluster_t *cluster)
 {
-   mongoc_cmd_parts_t parts;
-   uint32_t buflen = 0;
-   mongoc_scram_t scram;
-   bson_iter_t iter;
-   bool ret = false;
-   const char *tmpstr;
    const char *auth_source;
-   uint8_t buf[4096] = {0};
-   bson_t cmd;
-   bson_t reply;
-   int conv_id = 0;
-   bson_subtype_t btype;
-   mongoc_server_stream_t *server_stream;
-
-   BSON_ASSERT (cluster);
-   BSON_ASSERT (stream);
 
    if (!(auth_source = mongoc_uri_get_auth_source (cluster->uri)) ||
        (*auth_source == '\0')) {
       auth_source = "admin";
    }
 
-   _mongoc_scram_init (&scram);
+   return auth_source;
+}
+
+
+static void
+_mongoc_cluster_init_scram (mongoc_cluster_t *cluster, mongoc_scram_t *scram)
+{
+   _mongoc_scram_init (scram);
 
-   _mongoc_scram_set_pass (&scram, mongoc_uri_get_password (cluster->uri));
-   _mongoc_scram_set_user (&scram, mongoc_uri_get_username (cluster->uri));
+   _mongoc_scram_set_pass (scram, mongoc_uri_get_password (cluster->uri));
+   _mongoc_scram_set_user (scram, mongoc_uri_get_username (cluster->uri));
    if (*cluster->scram_client_key) {
       _mongoc_scram_set_client_key (
-         &scram, cluster->scram_client_key, sizeof (cluster->scram_client_key));
+         scram, cluster->scram_client_key, sizeof (cluster->scram_client_key));
    }
    if (*cluster->scram_server_key) {
       _mongoc_scram_set_server_key (
-         &scram, cluster->scram_server_key, sizeof (cluster->scram_server_key));
+         scram, cluster->scram_server_key, sizeof (cluster->scram_server_key));
    }
    if (*cluster->scram_salted_password) {
       _mongoc_scram_set_salted_password (
-         &scram,
+         scram,
          cluster->scram_salted_password,
          sizeof (cluster->scram_salted_password));
    }
+}
 
-   for (;;) {
-      if (!_mongoc_scram_step (
-             &scram, buf, buflen, buf, sizeof buf, &buflen, error)) {
-         goto failure;
-      }
 
-      bson_init (&cmd);
+/* take the first step of @scram and build the saslStart command for it */
+static bool
+_mongoc_cluster_get_auth_cmd_scram (mongoc_scram_t *scram,
+                                    bson_t *cmd /* OUT */,
+                                    bson_error_t *error /* OUT */)
+{
+   uint8_t buf[4096] = {0};
+   uint32_t buflen = 0;
 
-      if (scram.step == 1) {
-         BSON_APPEND_INT32 (&cmd, "saslStart", 1);
-         BSON_APPEND_UTF8 (&cmd, "mechanism", "SCRAM-SHA-1");
-         bson_append_binary (
-            &cmd, "payload", 7, BSON_SUBTYPE_BINARY, buf, buflen);
-         BSON_APPEND_INT32 (&cmd, "autoAuthorize", 1);
-      } else {
-         BSON_APPEND_INT32 (&cmd, "saslContinue", 1);
-         BSON_APPEND_INT32 (&cmd, "conversationId", conv_id);
-         bson_append_binary (
-            &cmd, "payload", 7, BSON_SUBTYPE_BINARY, buf, buflen);
-      }
+   if (!_mongoc_scram_step (scram, buf, 0, buf, sizeof buf, &buflen, error)) {
+      return false;
+   }
 
-      TRACE ("SCRAM: authenticating (step %d)", scram.step);
+   BSON_ASSERT (scram->step == 1);
 
-      mongoc_cmd_parts_init (&parts, auth_source, MONGOC_QUERY_SLAVE_OK, &cmd);
-      server_stream = _mongoc_cluster_create_server_stream (
-         cluster->client->topology, sd->id, stream, error);
-      if (!mongoc_cluster_run_command_parts (
-             cluster, server_stream, &parts, &reply, error)) {
+   bson_init (cmd);
+   BSON_APPEND_INT32 (cmd, "saslStart", 1);
+   BSON_APPEND_UTF8 (cmd, "mechanism", "SCRAM-SHA-1");
+   bson_append_binary (cmd, "payload", 7, BSON_SUBTYPE_BINARY, buf, buflen);
+   BSON_APPEND_INT32 (cmd, "autoAuthorize", 1);
+
+   return true;
+}
+
+
+/* run the SCRAM conversation of @scram to its end. if @first_reply is not
+ * NULL, the first step was already taken and this is the server's reply. */
+static bool
+_mongoc_cluster_run_scram (mongoc_cluster_t *cluster,
+                           mongoc_stream_t *stream,
+                           mongoc_server_description_t *sd,
+                           mongoc_scram_t *scram,
+                           const bson_t *first_reply,
+                           bson_error_t *error)
+{
+   mongoc_cmd_parts_t parts;
+   uint32_t buflen = 0;
+   bson_iter_t iter;
+   const char *tmpstr;
+   const char *auth_source;
+   uint8_t buf[4096] = {0};
+   bson_t cmd;
+   bson_t reply;
+   int conv_id = 0;
+   bson_subtype_t btype;
+   mongoc_server_stream_t *server_stream;
+
+   BSON_ASSERT (cluster);
+   BSON_ASSERT (stream);
+
+   auth_source = _mongoc_cluster_get_scram_auth_source (cluster);
+
+   for (;;) {
+      if (first_reply) {
+         TRACE ("%s", "SCRAM: continuing speculative authentication");
+         bson_copy_to (first_reply, &reply);
+         first_reply = NULL;
+      } else {
+         if (scram->step == 0) {
+            if (!_mongoc_cluster_get_auth_cmd_scram (scram, &cmd, error)) {
+               return false;
+            }
+         } else {
+            if (!_mongoc_scram_step (
+                   scram, buf, buflen, buf, sizeof buf, &buflen, error)) {
+               return false;
+            }
+
+            bson_init (&cmd);
+            BSON_APPEND_INT32 (&cmd, "saslContinue", 1);
+            BSON_APPEND_INT32 (&cmd, "conversationId", conv_id);
+            bson_append_binary (
+               &cmd, "payload", 7, BSON_SUBTYPE_BINARY, buf, buflen);
+         }
+
+         TRACE ("SCRAM: authenticating (step %d)", scram->step);
+
+         mongoc_cmd_parts_init (
+            &parts, auth_source, MONGOC_QUERY_SLAVE_OK, &cmd);
+         server_stream = _mongoc_cluster_create_server_stream (
+            cluster->client->topology, sd->id, stream, error);
+         if (!mongoc_cluster_run_command_parts (
+                cluster, server_stream, &parts, &reply, error)) {
+            mongoc_server_stream_cleanup (server_stream);
+            bson_destroy (&cmd);
+            bson_destroy (&reply);
+
+            /* error->message is already set */
+            error->domain = MONGOC_ERROR_CLIENT;
+            error->code = MONGOC_ERROR_CLIENT_AUTHENTICATE;
+            return false;
+         }
          mongoc_server_stream_cleanup (server_stream);
-         bson_destroy (&cmd);
-         bson_destroy (&reply);
 
-         /* error->message is already set */
-         error->domain = MONGOC_ERROR_CLIENT;
-         error->code = MONGOC_ERROR_CLIENT_AUTHENTICATE;
-         goto failure;
+         mongoc_cmd_parts_cleanup (&parts);
+         bson_destroy (&cmd);
       }
-      mongoc_server_stream_cleanup (server_stream);
-
-      mongoc_cmd_parts_cleanup (&parts);
-      bson_destroy (&cmd);
 
       if (bson_iter_init_find (&iter, &reply, "done") &&
           bson_iter_as_bool (&iter)) {
@@ -1154,7 +1415,7 @@ _mongoc_cluster_auth_node_scram (mongoc_cluster_t *cluster,
                          "%s",
                          errmsg);
          bson_destroy (&reply);
-         goto failure;
+         return false;
       }
 
       bson_iter_binary (&iter, &btype, &buflen, (const uint8_t **) &tmpstr);
@@ -1165,7 +1426,7 @@ _mongoc_cluster_auth_node_scram (mongoc_cluster_t *cluster,
                          MONGOC_ERROR_CLIENT_AUTHENTICATE,
                          "SCRAM reply from MongoDB is too large.");
          bson_destroy (&reply);
-         goto failure;
+         return false;
       }
 
       memcpy (buf, tmpstr, buflen);
@@ -1175,18 +1436,31 @@ _mongoc_cluster_auth_node_scram (mongoc_cluster_t *cluster,
 
    TRACE ("%s", "SCRAM: authenticated");
 
-   ret = true;
    memcpy (cluster->scram_client_key,
-           scram.client_key,
+           scram->client_key,
            sizeof (cluster->scram_client_key));
    memcpy (cluster->scram_server_key,
-           scram.server_key,
+           scram->server_key,
            sizeof (cluster->scram_server_key));
    memcpy (cluster->scram_salted_password,
-           scram.salted_password,
+           scram->salted_password,
            sizeof (cluster->scram_salted_password));
 
-failure:
+   return true;
+}
+
+
+static bool
+_mongoc_cluster_auth_node_scram (mongoc_cluster_t *cluster,
+                                 mongoc_stream_t *stream,
+                                 mongoc_server_description_t *sd,
+                                 bson_error_t *error)
+{
+   mongoc_scram_t scram;
+   bool ret;
+
+   _mongoc_cluster_init_scram (cluster, &scram);
+   ret = _mongoc_cluster_run_scram (cluster, stream, sd, &scram, NULL, error);
    _mongoc_scram_destroy (&scram);
 
    return ret;
@@ -1194,12 +1468,128 @@ failure:
 #endif
 
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_cluster_speculative_auth_init --
+ *
+ *       Prepare the first step of authentication for the ismaster of a new
+ *       connection. Only SCRAM-SHA-1, also when it's the default, and
+ *       MONGODB-X509 can start speculatively; for other mechanisms, or if
+ *       the first step can't be prepared, @speculative_auth->mechanism is
+ *       left NULL and authentication takes its usual course.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_mongoc_cluster_speculative_auth_init (
+   mongoc_cluster_t *cluster,
+   mongoc_cluster_speculative_auth_t *speculative_auth)
+{
+   const char *mechanism;
+   bson_error_t error;
+
+   memset (speculative_auth, 0, sizeof *speculative_auth);
+   bson_init (&speculative_auth->cmd);
+   bson_init (&speculative_auth->reply);
+
+   if (!cluster->requires_auth) {
+      return;
+   }
+
+   mechanism = mongoc_uri_get_auth_mechanism (cluster->uri);
+
+#ifdef MONGOC_ENABLE_SSL
+   if (mechanism && 0 == strcasecmp (mechanism, "MONGODB-X509")) {
+      bson_destroy (&speculative_auth->cmd);
+      if (!_mongoc_cluster_get_auth_cmd_x509 (
+             cluster, &speculative_auth->cmd, &error)) {
+         bson_init (&speculative_auth->cmd);
+         return;
+      }
+
+      BSON_APPEND_UTF8 (&speculative_auth->cmd, "db", "$external");
+      speculative_auth->mechanism = "MONGODB-X509";
+      return;
+   }
+#endif
+
+#ifdef MONGOC_ENABLE_CRYPTO
+   /* a server too old for SCRAM-SHA-1 ignores speculativeAuthenticate */
+   if (!mechanism || 0 == strcasecmp (mechanism, "SCRAM-SHA-1")) {
+      _mongoc_cluster_init_scram (cluster, &speculative_auth->scram);
+      bson_destroy (&speculative_auth->cmd);
+      if (!_mongoc_cluster_get_auth_cmd_scram (
+             &speculative_auth->scram, &speculative_auth->cmd, &error)) {
+         bson_init (&speculative_auth->cmd);
+         _mongoc_scram_destroy (&speculative_auth->scram);
+         return;
+      }
+
+      BSON_APPEND_UTF8 (&speculative_auth->cmd,
+                        "db",
+                        _mongoc_cluster_get_scram_auth_source (cluster));
+      speculative_auth->mechanism = "SCRAM-SHA-1";
+   }
+#endif
+}
+
+
+static void
+_mongoc_cluster_speculative_auth_cleanup (
+   mongoc_cluster_speculative_auth_t *speculative_auth)
+{
+#ifdef MONGOC_ENABLE_CRYPTO
+   if (speculative_auth->mechanism &&
+       0 == strcmp (speculative_auth->mechanism, "SCRAM-SHA-1")) {
+      _mongoc_scram_destroy (&speculative_auth->scram);
+   }
+#endif
+
+   bson_destroy (&speculative_auth->cmd);
+   bson_destroy (&speculative_auth->reply);
+}
+
+
+/* finish authentication the server began in its ismaster reply */
+static bool
+_mongoc_cluster_auth_node_speculative (
+   mongoc_cluster_t *cluster,
+   mongoc_stream_t *stream,
+   mongoc_server_description_t *sd,
+   mongoc_cluster_speculative_auth_t *speculative_auth,
+   bson_error_t *error)
+{
+   mongoc_counter_auth_speculative_inc ();
+
+#ifdef MONGOC_ENABLE_CRYPTO
+   if (0 == strcmp (speculative_auth->mechanism, "SCRAM-SHA-1")) {
+      return _mongoc_cluster_run_scram (cluster,
+                                        stream,
+                                        sd,
+                                        &speculative_auth->scram,
+                                        &speculative_auth->reply,
+                                        error);
+   }
+#endif
+
+   /* MONGODB-X509: the reply is the result of the authenticate command */
+   BSON_ASSERT (0 == strcmp (speculative_auth->mechanism, "MONGODB-X509"));
+   TRACE ("%s", "X509: authenticated speculatively");
+
+   return true;
+}
+
+
 /*
  *--------------------------------------------------------------------------
  *
  * _mongoc_cluster_auth_node --
  *
  *       Authenticate a cluster node depending on the required mechanism.
+ *       If the server began authentication in its reply to the ismaster
+ *       sent with @speculative_auth, authentication continues from there.
  *
  * Returns:
  *       true if authenticated. false on failure and @error is set.
@@ -1211,10 +1601,12 @@ failure:
  */
 
 static bool
-_mongoc_cluster_auth_node (mongoc_cluster_t *cluster,
-                           mongoc_stream_t *stream,
-                           mongoc_server_description_t *sd,
-                           bson_error_t *error)
+_mongoc_cluster_auth_node (
+   mongoc_cluster_t *cluster,
+   mongoc_stream_t *stream,
+   mongoc_server_description_t *sd,
+   mongoc_cluster_speculative_auth_t *speculative_auth,
+   bson_error_t *error)
 {
    bool ret = false;
    const char *mechanism;
@@ -1234,7 +1626,11 @@ _mongoc_cluster_auth_node (mongoc_cluster_t *cluster,
       }
    }
 
-   if (0 == strcasecmp (mechanism, "MONGODB-CR")) {
+   if (speculative_auth && speculative_auth->mechanism &&
+       !bson_empty (&speculative_auth->reply)) {
+      ret = _mongoc_cluster_auth_node_speculative (
+         cluster, stream, sd, speculative_auth, error);
+   } else if (0 == strcasecmp (mechanism, "MONGODB-CR")) {
       ret = _mongoc_cluster_auth_node_cr (cluster, stream, sd, error);
    } else if (0 == strcasecmp (mechanism, "MONGODB-X509")) {
 #ifdef MONGOC_ENABLE_SSL
@@ -1291,6 +1687,36 @@ _mongoc_cluster_auth_node (mongoc_cluster_t *cluster,
 }
 
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_cluster_auth_stream --
+ *
+ *       Authenticate a connection that is not part of @cluster, using the
+ *       credentials of @cluster. Used by the connection broker to prepare
+ *       connections it hands to other processes.
+ *
+ * Returns:
+ *       true if @cluster requires no authentication or if authentication
+ *       succeeded; otherwise false and @error is set.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+_mongoc_cluster_auth_stream (mongoc_cluster_t *cluster,
+                             mongoc_stream_t *stream,
+                             mongoc_server_description_t *sd,
+                             bson_error_t *error)
+{
+   if (!cluster->requires_auth) {
+      return true;
+   }
+
+   return _mongoc_cluster_auth_node (cluster, stream, sd, NULL, error);
+}
+
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -1335,7 +1761,10 @@ mongoc_cluster_disconnect_node (mongoc_cluster_t *cluster,
          mongoc_topology_scanner_node_disconnect (scanner_node, true);
       }
    } else {
-      mongoc_set_rm (cluster->nodes, server_id);
+      _mongoc_cluster_remove_node (cluster,
+                                   server_id,
+                                   why ? MONGOC_CONNECTION_CLOSED_ERROR
+                                       : MONGOC_CONNECTION_CLOSED_CLIENT);
    }
 
    if (invalidate) {
@@ -1352,20 +1781,75 @@ _mongoc_cluster_node_destroy (mongoc_cluster_node_t *node)
    mongoc_stream_failed (node->stream);
    bson_free (node->connection_address);
 
-   bson_free (node);
+   bson_free (node);
+}
+
+static void
+_mongoc_cluster_node_dtor (void *data_, void *ctx_)
+{
+   mongoc_cluster_node_t *node = (mongoc_cluster_node_t *) data_;
+   mongoc_cluster_t *cluster = (mongoc_cluster_t *) ctx_;
+   mongoc_apm_connection_closed_t event;
+   mongoc_client_t *client = cluster->client;
+   const char *reason;
+   int64_t age_usec;
+
+   reason = node->close_reason ? node->close_reason : cluster->close_reason;
+   age_usec = bson_get_monotonic_time () - node->timestamp;
+
+   if (!strcmp (reason, MONGOC_CONNECTION_CLOSED_IDLE)) {
+      mongoc_counter_connections_closed_idle_inc ();
+   } else if (!strcmp (reason, MONGOC_CONNECTION_CLOSED_ERROR)) {
+      mongoc_counter_connections_closed_error_inc ();
+   } else if (!strcmp (reason, MONGOC_CONNECTION_CLOSED_STALE)) {
+      mongoc_counter_connections_closed_stale_inc ();
+   } else {
+      mongoc_counter_connections_closed_client_inc ();
+   }
+
+   mongoc_counter_connections_closed_age_msec_add (age_usec / 1000);
+
+   if (client->apm_callbacks.connection_closed) {
+      event.host = &node->host;
+      event.server_id = node->server_id;
+      event.reason = reason;
+      event.age_usec = age_usec;
+      event.context = client->apm_context;
+      client->apm_callbacks.connection_closed (&event);
+   }
+
+   _mongoc_cluster_node_destroy (node);
 }
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_cluster_remove_node --
+ *
+ *       Remove a pooled client's node and close its connection, reporting
+ *       @reason to connection monitoring.
+ *
+ *--------------------------------------------------------------------------
+ */
+
 static void
-_mongoc_cluster_node_dtor (void *data_, void *ctx_)
+_mongoc_cluster_remove_node (mongoc_cluster_t *cluster,
+                             uint32_t server_id,
+                             const char *reason)
 {
-   mongoc_cluster_node_t *node = (mongoc_cluster_node_t *) data_;
+   mongoc_cluster_node_t *node;
 
-   _mongoc_cluster_node_destroy (node);
+   node = (mongoc_cluster_node_t *) mongoc_set_get (cluster->nodes, server_id);
+   if (node) {
+      node->close_reason = reason;
+      mongoc_set_rm (cluster->nodes, server_id);
+   }
 }
 
 static mongoc_cluster_node_t *
 _mongoc_cluster_node_new (mongoc_stream_t *stream,
-                          const char *connection_address)
+                          const mongoc_host_list_t *host,
+                          uint32_t server_id)
 {
    mongoc_cluster_node_t *node;
 
@@ -1376,7 +1860,10 @@ _mongoc_cluster_node_new (mongoc_stream_t *stream,
    node = (mongoc_cluster_node_t *) bson_malloc0 (sizeof *node);
 
    node->stream = stream;
-   node->connection_address = bson_strdup (connection_address);
+   node->connection_address = bson_strdup (host->host_and_port);
+   memcpy (&node->host, host, sizeof (mongoc_host_list_t));
+   node->host.next = NULL;
+   node->server_id = server_id;
    node->timestamp = bson_get_monotonic_time ();
 
    node->max_wire_version = MONGOC_DEFAULT_WIRE_VERSION;
@@ -1415,12 +1902,15 @@ _mongoc_cluster_add_node (mongoc_cluster_t *cluster,
    mongoc_cluster_node_t *cluster_node = NULL;
    mongoc_stream_t *stream;
    mongoc_server_description_t *sd;
+   mongoc_cluster_speculative_auth_t speculative_auth;
 
    ENTRY;
 
    BSON_ASSERT (cluster);
    BSON_ASSERT (!cluster->client->topology->single_threaded);
 
+   _mongoc_cluster_speculative_auth_init (cluster, &speculative_auth);
+
    host =
       _mongoc_topology_host_by_id (cluster->client->topology, server_id, error);
 
@@ -1439,16 +1929,17 @@ _mongoc_cluster_add_node (mongoc_cluster_t *cluster,
    }
 
    /* take critical fields from a fresh ismaster */
-   cluster_node = _mongoc_cluster_node_new (stream, host->host_and_port);
+   cluster_node = _mongoc_cluster_node_new (stream, host, server_id);
 
-   sd = _mongoc_cluster_run_ismaster (cluster, cluster_node, server_id, error);
+   sd = _mongoc_cluster_run_ismaster (
+      cluster, cluster_node, server_id, &speculative_auth, error);
    if (!sd) {
       GOTO (error);
    }
 
    if (cluster->requires_auth) {
       if (!_mongoc_cluster_auth_node (
-             cluster, cluster_node->stream, sd, error)) {
+             cluster, cluster_node->stream, sd, &speculative_auth, error)) {
          MONGOC_WARNING ("Failed authentication to %s (%s)",
                          host->host_and_port,
                          error->message);
@@ -1457,14 +1948,27 @@ _mongoc_cluster_add_node (mongoc_cluster_t *cluster,
       }
    }
    mongoc_server_description_destroy (sd);
+   _mongoc_cluster_speculative_auth_cleanup (&speculative_auth);
 
    mongoc_set_add (cluster->nodes, server_id, cluster_node);
    _mongoc_host_list_destroy_all (host);
 
+   mongoc_counter_connections_created_inc ();
+
+   if (cluster->client->apm_callbacks.connection_created) {
+      mongoc_apm_connection_created_t event;
+
+      event.host = &cluster_node->host;
+      event.server_id = server_id;
+      event.context = cluster->client->apm_context;
+      cluster->client->apm_callbacks.connection_created (&event);
+   }
+
    RETURN (stream);
 
 error:
    _mongoc_host_list_destroy_all (host); /* null ok */
+   _mongoc_cluster_speculative_auth_cleanup (&speculative_auth);
 
    if (cluster_node) {
       _mongoc_cluster_node_destroy (cluster_node); /* also destroys stream */
@@ -1530,13 +2034,45 @@ stream_not_found (mongoc_topology_t *topology,
    }
 }
 
+/* fetch a stream to @server_id, connecting if @reconnect_ok, without
+ * invalidating the server if that fails */
+static mongoc_server_stream_t *
+_mongoc_cluster_fetch_stream (mongoc_cluster_t *cluster,
+                              uint32_t server_id,
+                              bool reconnect_ok,
+                              bson_error_t *error /* OUT */)
+{
+   mongoc_topology_t *topology;
+   mongoc_server_stream_t *server_stream;
+
+   topology = cluster->client->topology;
+
+   /* in the single-threaded use case we share topology's streams */
+   if (topology->single_threaded) {
+      server_stream = mongoc_cluster_fetch_stream_single (
+         cluster, server_id, reconnect_ok, error);
+
+   } else {
+      server_stream = mongoc_cluster_fetch_stream_pooled (
+         cluster, server_id, reconnect_ok, error);
+   }
+
+   if (server_stream && topology->least_outstanding) {
+      /* counts as in progress until mongoc_server_stream_cleanup */
+      server_stream->in_flight =
+         _mongoc_topology_in_flight_count (&topology->in_flight, server_id);
+      bson_atomic_int_add (server_stream->in_flight, 1);
+   }
+
+   return server_stream;
+}
+
 mongoc_server_stream_t *
 _mongoc_cluster_stream_for_server (mongoc_cluster_t *cluster,
                                    uint32_t server_id,
                                    bool reconnect_ok,
                                    bson_error_t *error /* OUT */)
 {
-   mongoc_topology_t *topology;
    mongoc_server_stream_t *server_stream;
    bson_error_t err_local;
    /* if fetch_stream fails we need a place to receive error details and pass
@@ -1545,17 +2081,8 @@ _mongoc_cluster_stream_for_server (mongoc_cluster_t *cluster,
 
    ENTRY;
 
-   topology = cluster->client->topology;
-
-   /* in the single-threaded use case we share topology's streams */
-   if (topology->single_threaded) {
-      server_stream = mongoc_cluster_fetch_stream_single (
-         cluster, server_id, reconnect_ok, err_ptr);
-
-   } else {
-      server_stream = mongoc_cluster_fetch_stream_pooled (
-         cluster, server_id, reconnect_ok, err_ptr);
-   }
+   server_stream =
+      _mongoc_cluster_fetch_stream (cluster, server_id, reconnect_ok, err_ptr);
 
    if (!server_stream) {
       /* Server Discovery And Monitoring Spec: "When an application operation
@@ -1633,7 +2160,10 @@ mongoc_cluster_fetch_stream_single (mongoc_cluster_t *cluster,
    mongoc_server_description_t *sd;
    mongoc_stream_t *stream;
    mongoc_topology_scanner_node_t *scanner_node;
+   mongoc_cluster_speculative_auth_t speculative_auth;
+   mongoc_cluster_speculative_auth_t *speculative = NULL;
    int64_t expire_at;
+   bool r;
 
    topology = cluster->client->topology;
    scanner_node =
@@ -1672,7 +2202,6 @@ mongoc_cluster_fetch_stream_single (mongoc_cluster_t *cluster,
 
 #ifdef MONGOC_ENABLE_SSL
       if (cluster->client->use_ssl) {
-         bool r;
          mongoc_stream_t *tls_stream;
 
          for (tls_stream = stream; tls_stream->type != MONGOC_STREAM_TLS;
@@ -1692,10 +2221,18 @@ mongoc_cluster_fetch_stream_single (mongoc_cluster_t *cluster,
       }
 #endif
 
-      sd = _mongoc_stream_run_ismaster (
-         cluster, stream, scanner_node->host.host_and_port, server_id);
+      /* a new connection, begin authenticating in its ismaster */
+      speculative = &speculative_auth;
+      _mongoc_cluster_speculative_auth_init (cluster, speculative);
+
+      sd = _mongoc_stream_run_ismaster (cluster,
+                                        stream,
+                                        scanner_node->host.host_and_port,
+                                        server_id,
+                                        speculative);
 
       if (!sd) {
+         _mongoc_cluster_speculative_auth_cleanup (speculative);
          return NULL;
       }
    }
@@ -1703,20 +2240,34 @@ mongoc_cluster_fetch_stream_single (mongoc_cluster_t *cluster,
    if (sd->type == MONGOC_SERVER_UNKNOWN) {
       memcpy (error, &sd->error, sizeof *error);
       mongoc_server_description_destroy (sd);
-      return NULL;
+      r = false;
+      goto done;
    }
 
+   r = true;
+
    /* stream open but not auth'ed: first use since connect or reconnect */
    if (cluster->requires_auth && !scanner_node->has_auth) {
-      if (!_mongoc_cluster_auth_node (cluster, stream, sd, &sd->error)) {
+      r = _mongoc_cluster_auth_node (
+         cluster, stream, sd, speculative, &sd->error);
+      if (!r) {
          memcpy (error, &sd->error, sizeof *error);
          mongoc_server_description_destroy (sd);
-         return NULL;
+         goto done;
       }
 
       scanner_node->has_auth = true;
    }
 
+done:
+   if (speculative) {
+      _mongoc_cluster_speculative_auth_cleanup (speculative);
+   }
+
+   if (!r) {
+      return NULL;
+   }
+
    return mongoc_server_stream_new (&topology->description, sd, stream);
 }
 
@@ -1727,8 +2278,34 @@ _mongoc_cluster_create_server_stream (mongoc_topology_t *topology,
                                       mongoc_stream_t *stream,
                                       bson_error_t *error /* OUT */)
 {
+   mongoc_topology_snapshot_t *snapshot;
    mongoc_server_description_t *sd;
    mongoc_server_stream_t *server_stream = NULL;
+   int32_t epoch;
+
+   if (!topology->single_threaded) {
+      /* borrow the server description from the latest snapshot, and copy
+       * the cluster time published with it, without the topology's lock */
+      epoch = _mongoc_topology_rcu_read_lock (&topology->rcu);
+      snapshot = topology->snapshot;
+      if (snapshot) {
+         sd = mongoc_topology_description_server_by_id (
+            &snapshot->td, server_id, error);
+         if (sd) {
+            server_stream = _mongoc_server_stream_new_from_snapshot (
+               _mongoc_topology_snapshot_ref (snapshot),
+               sd,
+               topology->cluster_time,
+               stream);
+         }
+      }
+
+      _mongoc_topology_rcu_read_unlock (&topology->rcu, epoch);
+
+      if (snapshot) {
+         return server_stream;
+      }
+   }
 
    /* can't just use mongoc_topology_server_by_id(), since we must hold the
     * lock while copying topology->description.logical_time below */
@@ -1772,8 +2349,8 @@ mongoc_cluster_fetch_stream_pooled (mongoc_cluster_t *cluster,
       if (timestamp == -1 || cluster_node->timestamp < timestamp) {
          /* topology change or net error during background scan made us remove
           * or replace server description since node's birth. destroy node. */
-         mongoc_cluster_disconnect_node (
-            cluster, server_id, false /* invalidate */, NULL);
+         _mongoc_cluster_remove_node (
+            cluster, server_id, MONGOC_CONNECTION_CLOSED_STALE);
       } else {
          return _mongoc_cluster_create_server_stream (
             topology, server_id, cluster_node->stream, error);
@@ -1839,10 +2416,25 @@ mongoc_cluster_init (mongoc_cluster_t *cluster,
                                       MONGOC_URI_SOCKETCHECKINTERVALMS,
                                       MONGOC_TOPOLOGY_SOCKET_CHECK_INTERVAL_MS);
 
+   cluster->hedged_reads =
+      mongoc_uri_get_option_as_bool (uri, MONGOC_URI_HEDGEDREADS, false);
+   cluster->hedge_delay_ms =
+      mongoc_uri_get_option_as_int32 (uri, MONGOC_URI_HEDGEDELAYMS, 0);
+
    /* TODO for single-threaded case we don't need this */
-   cluster->nodes = mongoc_set_new (8, _mongoc_cluster_node_dtor, NULL);
+   cluster->nodes = mongoc_set_new (8, _mongoc_cluster_node_dtor, cluster);
+   cluster->close_reason = MONGOC_CONNECTION_CLOSED_CLIENT;
 
    _mongoc_array_init (&cluster->iov, sizeof (mongoc_iovec_t));
+   _mongoc_compression_policy_init (&cluster->compression_policy);
+   cluster->compression_policy.adaptive = mongoc_uri_get_option_as_bool (
+      uri, MONGOC_URI_ADAPTIVECOMPRESSION, false);
+   _mongoc_compression_scratch_init (
+      &cluster->compression_scratch,
+      mongoc_uri_get_option_as_int32 (uri, MONGOC_URI_ZLIBCOMPRESSIONLEVEL, -1),
+      mongoc_uri_get_option_as_int32 (
+         uri, MONGOC_URI_ZLIBCOMPRESSIONTHREADS, 1),
+      mongoc_uri_get_option_as_int32 (uri, MONGOC_URI_ZSTDCOMPRESSIONLEVEL, 0));
 
    cluster->operation_id = rand ();
 
@@ -1878,11 +2470,155 @@ mongoc_cluster_destroy (mongoc_cluster_t *cluster) /* INOUT */
    mongoc_set_destroy (cluster->nodes);
 
    _mongoc_array_destroy (&cluster->iov);
+   _mongoc_compression_scratch_destroy (&cluster->compression_scratch);
 
    EXIT;
 }
 
 
+typedef struct {
+   size_t max_size;
+   size_t bytes;
+} _mongoc_cluster_trim_ctx_t;
+
+
+static bool
+_mongoc_cluster_trim_node_cb (void *item, void *ctx)
+{
+   mongoc_cluster_node_t *node = (mongoc_cluster_node_t *) item;
+   _mongoc_cluster_trim_ctx_t *trim_ctx = (_mongoc_cluster_trim_ctx_t *) ctx;
+
+   trim_ctx->bytes +=
+      _mongoc_stream_buffered_trim (node->stream, trim_ctx->max_size);
+
+   return true;
+}
+
+
+static bool
+_mongoc_cluster_retained_node_cb (void *item, void *ctx)
+{
+   mongoc_cluster_node_t *node = (mongoc_cluster_node_t *) item;
+   _mongoc_cluster_trim_ctx_t *trim_ctx = (_mongoc_cluster_trim_ctx_t *) ctx;
+
+   trim_ctx->bytes += _mongoc_stream_buffered_get_allocated (node->stream);
+
+   return true;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_cluster_trim --
+ *
+ *       Release scratch memory that grew beyond @max_size while @cluster
+ *       was in use: the read buffers of pooled connections, the iovec
+ *       array used to gather outgoing messages, and the compression
+ *       scratch buffers. Connections stay open.
+ *
+ * Returns:
+ *       The number of bytes released.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+size_t
+_mongoc_cluster_trim (mongoc_cluster_t *cluster, /* INOUT */
+                      size_t max_size)           /* IN */
+{
+   _mongoc_cluster_trim_ctx_t ctx;
+
+   BSON_ASSERT (cluster);
+
+   ctx.max_size = max_size;
+   ctx.bytes = 0;
+
+   if (cluster->client->topology->single_threaded) {
+      return 0;
+   }
+
+   mongoc_set_for_each (cluster->nodes, _mongoc_cluster_trim_node_cb, &ctx);
+
+   if (cluster->iov.allocated > max_size) {
+      ctx.bytes += cluster->iov.allocated;
+      _mongoc_array_destroy (&cluster->iov);
+      _mongoc_array_init (&cluster->iov, sizeof (mongoc_iovec_t));
+      ctx.bytes -= cluster->iov.allocated;
+   }
+
+   ctx.bytes += _mongoc_compression_scratch_trim (
+      &cluster->compression_scratch, max_size);
+
+   return ctx.bytes;
+}
+
+
+static bool
+_mongoc_cluster_close_inherited_cb (void *item, void *ctx)
+{
+   _mongoc_stream_close_inherited (((mongoc_cluster_node_t *) item)->stream);
+
+   return true;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_cluster_close_inherited --
+ *
+ *       Close the sockets of a pooled @cluster that this process inherited
+ *       across fork(), without sending anything on them. The cluster can
+ *       then be destroyed without disturbing the parent's connections.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_cluster_close_inherited (mongoc_cluster_t *cluster) /* INOUT */
+{
+   BSON_ASSERT (cluster);
+
+   if (!cluster->client->topology->single_threaded) {
+      mongoc_set_for_each (
+         cluster->nodes, _mongoc_cluster_close_inherited_cb, NULL);
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_cluster_get_retained --
+ *
+ *       The number of bytes of scratch memory @cluster currently holds in
+ *       connection read buffers and its iovec array.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+size_t
+_mongoc_cluster_get_retained (mongoc_cluster_t *cluster) /* IN */
+{
+   _mongoc_cluster_trim_ctx_t ctx;
+
+   BSON_ASSERT (cluster);
+
+   ctx.max_size = 0;
+   ctx.bytes = cluster->iov.allocated +
+               cluster->compression_scratch.compressed_size +
+               cluster->compression_scratch.uncompressed_size;
+
+   if (!cluster->client->topology->single_threaded) {
+      mongoc_set_for_each (
+         cluster->nodes, _mongoc_cluster_retained_node_cb, &ctx);
+   }
+
+   return ctx.bytes;
+}
+
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -2242,7 +2978,7 @@ mongoc_cluster_legacy_rpc_sendv_to_server (
    int32_t max_msg_size;
    bool ret = false;
    int32_t compressor_id = 0;
-   char *output = NULL;
+   int64_t started;
 
    ENTRY;
 
@@ -2266,11 +3002,9 @@ mongoc_cluster_legacy_rpc_sendv_to_server (
    _mongoc_rpc_gather (rpc, &cluster->iov);
    _mongoc_rpc_swab_to_le (rpc);
 
-   if (compressor_id != -1) {
-      output = _mongoc_rpc_compress (cluster, compressor_id, rpc, error);
-      if (output == NULL) {
-         GOTO (done);
-      }
+   if (!_mongoc_cluster_compress (
+          cluster, compressor_id, server_stream->sd, NULL, rpc, error)) {
+      GOTO (done);
    }
 
    max_msg_size = mongoc_server_stream_max_msg_size (server_stream);
@@ -2286,6 +3020,7 @@ mongoc_cluster_legacy_rpc_sendv_to_server (
       GOTO (done);
    }
 
+   started = bson_get_monotonic_time ();
    if (!_mongoc_stream_writev_full (server_stream->stream,
                                     cluster->iov.data,
                                     cluster->iov.len,
@@ -2294,6 +3029,12 @@ mongoc_cluster_legacy_rpc_sendv_to_server (
       GOTO (done);
    }
 
+   _mongoc_cluster_record_link (cluster,
+                                server_id,
+                                MONGOC_COMPRESSION_LINK_SEND,
+                                BSON_UINT32_FROM_LE (rpc->header.msg_len),
+                                started);
+
    if (cluster->client->topology->single_threaded) {
       scanner_node = mongoc_topology_scanner_get_node (
          cluster->client->topology->scanner, server_id);
@@ -2307,10 +3048,6 @@ mongoc_cluster_legacy_rpc_sendv_to_server (
 
 done:
 
-   if (compressor_id) {
-      bson_free (output);
-   }
-
    RETURN (ret);
 }
 
@@ -2350,6 +3087,7 @@ mongoc_cluster_try_recv (mongoc_cluster_t *cluster,
    int32_t msg_len;
    int32_t max_msg_size;
    off_t pos;
+   int64_t started;
 
    ENTRY;
 
@@ -2402,6 +3140,7 @@ mongoc_cluster_try_recv (mongoc_cluster_t *cluster,
    /*
     * Read the rest of the message from the stream.
     */
+   started = bson_get_monotonic_time ();
    if (!_mongoc_buffer_append_from_stream (buffer,
                                            server_stream->stream,
                                            msg_len - 4,
@@ -2416,6 +3155,12 @@ mongoc_cluster_try_recv (mongoc_cluster_t *cluster,
       RETURN (false);
    }
 
+   _mongoc_cluster_record_link (cluster,
+                                server_id,
+                                MONGOC_COMPRESSION_LINK_RECV,
+                                (size_t) msg_len - 4,
+                                started);
+
    /*
     * Scatter the buffer into the rpc structure.
     */
@@ -2430,13 +3175,16 @@ mongoc_cluster_try_recv (mongoc_cluster_t *cluster,
    }
 
    if (BSON_UINT32_FROM_LE (rpc->header.opcode) == MONGOC_OPCODE_COMPRESSED) {
-      uint8_t *buf = NULL;
+      mongoc_compression_scratch_t *scratch = &cluster->compression_scratch;
       size_t len = BSON_UINT32_FROM_LE (rpc->compressed.uncompressed_size) +
                    sizeof (mongoc_rpc_header_t);
+      uint8_t *data;
+      size_t datalen;
 
-      buf = bson_malloc0 (len);
-      if (!_mongoc_rpc_decompress (rpc, buf, len)) {
-         bson_free (buf);
+      if (!_mongoc_rpc_decompress (
+             rpc,
+             _mongoc_compression_scratch_uncompressed (scratch, len),
+             len)) {
          bson_set_error (error,
                          MONGOC_ERROR_PROTOCOL,
                          MONGOC_ERROR_PROTOCOL_INVALID_REPLY,
@@ -2444,14 +3192,185 @@ mongoc_cluster_try_recv (mongoc_cluster_t *cluster,
          RETURN (false);
       }
 
-      _mongoc_buffer_destroy (buffer);
-      _mongoc_buffer_init (buffer, buf, len, NULL, NULL);
+      /* @rpc must outlive the next message, so @buffer takes the scratch
+       * buffer, and the scratch buffer takes @buffer's old memory if it
+       * was allocated the same way */
+      data = buffer->data;
+      datalen = buffer->datalen;
+      if (buffer->realloc_func != bson_realloc_ctx) {
+         _mongoc_buffer_destroy (buffer);
+         data = NULL;
+         datalen = 0;
+      }
+
+      _mongoc_buffer_init (
+         buffer, scratch->uncompressed, scratch->uncompressed_size, NULL, NULL);
+      scratch->uncompressed = data;
+      scratch->uncompressed_size = datalen;
    }
    _mongoc_rpc_swab_from_le (rpc);
 
    RETURN (true);
 }
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_cluster_hedge_delay --
+ *
+ *       Decide whether to hedge @cmd: repeat it on a second server if
+ *       the first hasn't begun to answer within a delay. Only reads whose
+ *       server was selected for them are hedged, and only with a read
+ *       preference that other servers can satisfy.
+ *
+ * Returns:
+ *       The delay in milliseconds, or -1 to not hedge @cmd.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static int64_t
+_mongoc_cluster_hedge_delay (mongoc_cluster_t *cluster,
+                             const mongoc_cmd_t *cmd)
+{
+   if (!cluster->hedged_reads || !cmd->hedge_read_prefs ||
+       mongoc_read_prefs_get_mode (cmd->hedge_read_prefs) ==
+          MONGOC_READ_PRIMARY) {
+      return -1;
+   }
+
+   /* an aggregate may write with $out */
+   if (_mongoc_latency_class (cmd->command_name) != MONGOC_LATENCY_READ ||
+       !strcmp (cmd->command_name, "aggregate")) {
+      return -1;
+   }
+
+   if (cluster->hedge_delay_ms > 0) {
+      return cluster->hedge_delay_ms;
+   }
+
+   return _mongoc_topology_hedge_delay_msec (cluster->client->topology,
+                                             cmd->server_stream->sd->id);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_cluster_hedge --
+ *
+ *       Called after the message in @cluster->iov is sent for @cmd. Wait
+ *       up to @delay_msec for the server to begin to answer. If it doesn't,
+ *       send the message to a second suitable server, if this client is
+ *       already connected to one, and wait for the first of the two to
+ *       answer. The other's connection is closed, which discards its
+ *       reply and cancels the read on its end; the next operation on that
+ *       server pays for a new connection and authentication.
+ *
+ * Side effects:
+ *       If the second server answers first, the contents of
+ *       @cmd->server_stream are replaced by a stream to it, from which the
+ *       caller reads the reply.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_mongoc_cluster_hedge (mongoc_cluster_t *cluster,
+                       mongoc_cmd_t *cmd,
+                       int64_t delay_msec)
+{
+   mongoc_server_stream_t *server_stream;
+   mongoc_server_stream_t *hedge_stream;
+   mongoc_server_stream_t tmp;
+   mongoc_stream_poll_t poller[2];
+   int32_t compressor_id;
+   int32_t timeout_msec;
+   uint32_t hedge_id;
+   bson_error_t error;
+   bool ok;
+
+   ENTRY;
+
+   /* the caller's stream, which this function may redirect */
+   server_stream = (mongoc_server_stream_t *) cmd->server_stream;
+
+   poller[0].stream = server_stream->stream;
+   poller[0].events = POLLIN;
+   poller[0].revents = 0;
+
+   if (mongoc_stream_poll (poller, 1, (int32_t) delay_msec) != 0) {
+      /* the reply is arriving, or polling failed; read as usual */
+      EXIT;
+   }
+
+   hedge_id = _mongoc_topology_select_hedge_server_id (
+      cluster->client->topology, cmd->hedge_read_prefs, server_stream->sd->id);
+   if (!hedge_id) {
+      EXIT;
+   }
+
+   /* connecting while the first reply waits would only add latency */
+   hedge_stream = _mongoc_cluster_fetch_stream (
+      cluster, hedge_id, false /* reconnect_ok */, &error);
+   if (!hedge_stream) {
+      EXIT;
+   }
+
+   /* the message may be compressed for the first server */
+   compressor_id = mongoc_server_description_compressor_id (server_stream->sd);
+   if (hedge_stream->sd->max_wire_version < WIRE_VERSION_OP_MSG ||
+       (compressor_id != -1 &&
+        compressor_id !=
+           mongoc_server_description_compressor_id (hedge_stream->sd))) {
+      mongoc_server_stream_cleanup (hedge_stream);
+      EXIT;
+   }
+
+   ok = _mongoc_stream_writev_full (hedge_stream->stream,
+                                    (mongoc_iovec_t *) cluster->iov.data,
+                                    cluster->iov.len,
+                                    cluster->sockettimeoutms,
+                                    &error);
+
+   if (!ok) {
+      mongoc_cluster_disconnect_node (cluster, hedge_id, true, &error);
+      mongoc_server_stream_cleanup (hedge_stream);
+      EXIT;
+   }
+
+   mongoc_counter_hedge_fired_inc ();
+
+   poller[0].revents = 0;
+   poller[1].stream = hedge_stream->stream;
+   poller[1].events = POLLIN;
+   poller[1].revents = 0;
+
+   timeout_msec =
+      cluster->sockettimeoutms ? (int32_t) cluster->sockettimeoutms : -1;
+
+   /* the hedge wins only with a reply to read. otherwise, or if its
+    * connection broke, read from the first server as usual */
+   if (mongoc_stream_poll (poller, 2, timeout_msec) > 0 &&
+       !poller[0].revents && (poller[1].revents & POLLIN) &&
+       !(poller[1].revents & (POLLERR | POLLHUP))) {
+      mongoc_counter_hedge_won_inc ();
+      mongoc_cluster_disconnect_node (
+         cluster, server_stream->sd->id, false, NULL);
+
+      tmp = *server_stream;
+      *server_stream = *hedge_stream;
+      *hedge_stream = tmp;
+   } else {
+      mongoc_cluster_disconnect_node (cluster, hedge_id, false, NULL);
+   }
+
+   mongoc_server_stream_cleanup (hedge_stream);
+
+   EXIT;
+}
+
+
 bool
 mongoc_cluster_run_opmsg (mongoc_cluster_t *cluster,
                           mongoc_cmd_t *cmd,
@@ -2461,10 +3380,11 @@ mongoc_cluster_run_opmsg (mongoc_cluster_t *cluster,
    mongoc_rpc_section_t section[2];
    mongoc_buffer_t buffer;
    bson_t reply_local;
-   char *output = NULL;
    mongoc_rpc_t rpc;
    int32_t msg_len;
    bool ok;
+   int64_t started;
+   int64_t hedge_delay_msec;
    const mongoc_server_stream_t *server_stream;
 
    server_stream = cmd->server_stream;
@@ -2519,14 +3439,18 @@ mongoc_cluster_run_opmsg (mongoc_cluster_t *cluster,
 
       TRACE (
          "Function '%s' is compressable: %d", cmd->command_name, compressor_id);
-      if (compressor_id != -1) {
-         output = _mongoc_rpc_compress (cluster, compressor_id, &rpc, error);
-         if (output == NULL) {
-            bson_init (reply);
-            return false;
-         }
+      if (!_mongoc_cluster_compress (cluster,
+                                     compressor_id,
+                                     server_stream->sd,
+                                     cmd->command_name,
+                                     &rpc,
+                                     error)) {
+         bson_init (reply);
+         return false;
       }
    }
+
+   started = bson_get_monotonic_time ();
    ok = _mongoc_stream_writev_full (server_stream->stream,
                                     (mongoc_iovec_t *) cluster->iov.data,
                                     cluster->iov.len,
@@ -2535,17 +3459,26 @@ mongoc_cluster_run_opmsg (mongoc_cluster_t *cluster,
    if (!ok) {
       mongoc_cluster_disconnect_node (
          cluster, server_stream->sd->id, true, error);
-      bson_free (output);
       bson_init (reply);
       return false;
    }
 
+   _mongoc_cluster_record_link (cluster,
+                                server_stream->sd->id,
+                                MONGOC_COMPRESSION_LINK_SEND,
+                                BSON_UINT32_FROM_LE (rpc.header.msg_len),
+                                started);
+
+   hedge_delay_msec = _mongoc_cluster_hedge_delay (cluster, cmd);
+   if (hedge_delay_msec >= 0) {
+      _mongoc_cluster_hedge (cluster, cmd, hedge_delay_msec);
+   }
+
    ok = _mongoc_buffer_append_from_stream (
       &buffer, server_stream->stream, 4, cluster->sockettimeoutms, error);
    if (!ok) {
       mongoc_cluster_disconnect_node (
          cluster, server_stream->sd->id, true, error);
-      bson_free (output);
       bson_init (reply);
       return false;
    }
@@ -2563,11 +3496,11 @@ mongoc_cluster_run_opmsg (mongoc_cluster_t *cluster,
          server_stream->sd->max_msg_size);
       mongoc_cluster_disconnect_node (
          cluster, server_stream->sd->id, true, error);
-      bson_free (output);
       bson_init (reply);
       return false;
    }
 
+   started = bson_get_monotonic_time ();
    ok = _mongoc_buffer_append_from_stream (&buffer,
                                            server_stream->stream,
                                            (size_t) msg_len - 4,
@@ -2576,18 +3509,22 @@ mongoc_cluster_run_opmsg (mongoc_cluster_t *cluster,
    if (!ok) {
       mongoc_cluster_disconnect_node (
          cluster, server_stream->sd->id, true, error);
-      bson_free (output);
       bson_init (reply);
       return false;
    }
 
+   _mongoc_cluster_record_link (cluster,
+                                server_stream->sd->id,
+                                MONGOC_COMPRESSION_LINK_RECV,
+                                (size_t) msg_len - 4,
+                                started);
+
    ok = _mongoc_rpc_scatter (&rpc, buffer.data, buffer.len);
    if (!ok) {
       bson_set_error (error,
                       MONGOC_ERROR_PROTOCOL,
                       MONGOC_ERROR_PROTOCOL_INVALID_REPLY,
                       "Malformed message from server");
-      bson_free (output);
       bson_init (reply);
       return false;
    }
@@ -2595,15 +3532,17 @@ mongoc_cluster_run_opmsg (mongoc_cluster_t *cluster,
       size_t len = BSON_UINT32_FROM_LE (rpc.compressed.uncompressed_size) +
                    sizeof (mongoc_rpc_header_t);
 
-      output = bson_realloc (output, len);
-      if (!_mongoc_rpc_decompress (&rpc, (uint8_t *) output, len)) {
+      if (!_mongoc_rpc_decompress (
+             &rpc,
+             _mongoc_compression_scratch_uncompressed (
+                &cluster->compression_scratch, len),
+             len)) {
          bson_set_error (error,
                          MONGOC_ERROR_PROTOCOL,
                          MONGOC_ERROR_PROTOCOL_INVALID_REPLY,
                          "Could not decompress message from server");
          mongoc_cluster_disconnect_node (
             cluster, server_stream->sd->id, true, error);
-         bson_free (output);
          bson_init (reply);
          return false;
       }
@@ -2625,7 +3564,6 @@ mongoc_cluster_run_opmsg (mongoc_cluster_t *cluster,
    }
 
    _mongoc_buffer_destroy (&buffer);
-   bson_free (output);
 
    return ok;
 }
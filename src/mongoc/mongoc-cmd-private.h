@@ -47,6 +47,9 @@ typedef struct _mongoc_cmd_t {
    const char *payload_identifier;
    const mongoc_server_stream_t *server_stream;
    int64_t operation_id;
+   /* if not NULL, a read that the client may repeat on another server
+    * suitable for these read preferences, see mongoc_cluster_run_opmsg */
+   const mongoc_read_prefs_t *hedge_read_prefs;
 } mongoc_cmd_t;
 
 
@@ -45,6 +45,7 @@ mongoc_cmd_parts_init (mongoc_cmd_parts_t *parts,
    parts->assembled.query_flags = MONGOC_QUERY_NONE;
    parts->assembled.payload_identifier = NULL;
    parts->assembled.payload = NULL;
+   parts->assembled.hedge_read_prefs = NULL;
 }
 
 
@@ -23,6 +23,7 @@
 #endif
 #include <bson.h>
 
+#include "mongoc-iovec.h"
 
 /* Compressor IDs */
 #define MONGOC_COMPRESSOR_NOOP_ID 0
@@ -34,10 +35,106 @@
 #define MONGOC_COMPRESSOR_ZLIB_ID 2
 #define MONGOC_COMPRESSOR_ZLIB_STR "zlib"
 
+#define MONGOC_COMPRESSOR_ZSTD_ID 3
+#define MONGOC_COMPRESSOR_ZSTD_STR "zstd"
+
+/* messages smaller than this are sent uncompressed */
+#define MONGOC_COMPRESSION_MIN_SIZE 512
+/* bytes of a message sampled to estimate whether it compresses */
+#define MONGOC_COMPRESSION_SAMPLE_SIZE 1024
+/* command names whose compression ratios are tracked */
+#define MONGOC_COMPRESSION_STATS_MAX 16
+/* stop compressing a command whose messages keep more than this per mille of
+ * their size, once it has this many samples */
+#define MONGOC_COMPRESSION_MAX_RATIO 900
+#define MONGOC_COMPRESSION_MIN_SAMPLES 4
+/* retry compressing such a command once in this many messages */
+#define MONGOC_COMPRESSION_PROBE_INTERVAL 64
+
+/* with zlibCompressionThreads, messages this large are split into blocks of
+ * at least MONGOC_COMPRESSION_PARALLEL_BLOCK_SIZE, compressed in parallel */
+#define MONGOC_COMPRESSION_PARALLEL_MIN_SIZE (1024 * 1024)
+#define MONGOC_COMPRESSION_PARALLEL_BLOCK_SIZE (128 * 1024)
+
+/* with adaptiveCompression: the most codecs and levels to choose among, the
+ * most servers whose links are measured, and the smallest transfer that
+ * measures a link's throughput */
+#define MONGOC_COMPRESSION_CODECS_MAX 8
+#define MONGOC_COMPRESSION_LINKS_MAX 16
+#define MONGOC_COMPRESSION_LINK_MIN_SIZE (64 * 1024)
+
 
 BSON_BEGIN_DECLS
 
 
+typedef struct {
+   char command_name[32];
+   /* moving average of compressed / uncompressed size, per mille */
+   uint32_t ratio;
+   uint32_t samples;
+   /* messages sent uncompressed since the last probe */
+   uint32_t skipped;
+} mongoc_compression_stats_t;
+
+/* buffers reused for every message a client compresses or decompresses,
+ * grown as needed and never zeroed */
+typedef struct {
+   int32_t zlib_level;
+   int32_t zlib_threads;
+   int32_t zstd_level;
+   uint8_t *compressed;
+   size_t compressed_size;
+   uint8_t *uncompressed;
+   size_t uncompressed_size;
+   /* a ZSTD_CCtx, created on first use */
+   void *zstd_cctx;
+} mongoc_compression_scratch_t;
+
+typedef struct {
+   int32_t compressor_id;
+   int32_t level;
+   /* moving averages of uncompressed bytes compressed per microsecond, and
+    * of compressed / uncompressed size, per mille */
+   double speed;
+   uint32_t ratio;
+   uint32_t samples;
+} mongoc_compression_codec_stats_t;
+
+/* which way a transfer that measures a link went */
+typedef enum {
+   MONGOC_COMPRESSION_LINK_SEND,
+   MONGOC_COMPRESSION_LINK_RECV,
+} mongoc_compression_link_dir_t;
+
+typedef struct {
+   uint32_t server_id;
+   /* moving averages of bytes sent and received per microsecond. a write
+    * returns once its bytes are in the socket buffer, so send samples
+    * overestimate the link unless the write blocked */
+   double send_bandwidth;
+   uint32_t send_samples;
+   double recv_bandwidth;
+   uint32_t recv_samples;
+   /* compression choices for this server since the last probe */
+   uint32_t choices;
+   /* the policy's clock when this server was last measured */
+   uint64_t used;
+} mongoc_compression_link_stats_t;
+
+/* decides, per client, which messages are worth compressing */
+typedef struct {
+   mongoc_compression_stats_t stats[MONGOC_COMPRESSION_STATS_MAX];
+   int n_stats;
+   /* with adaptiveCompression, choose the codec and level per server */
+   bool adaptive;
+   mongoc_compression_codec_stats_t codecs[MONGOC_COMPRESSION_CODECS_MAX];
+   int n_codecs;
+   mongoc_compression_link_stats_t links[MONGOC_COMPRESSION_LINKS_MAX];
+   int n_links;
+   uint64_t clock;
+} mongoc_compression_policy_t;
+
+
 size_t
 mongoc_compressor_max_compressed_length (int32_t compressor_id, size_t size);
 
@@ -65,6 +162,87 @@ mongoc_compress (int32_t compressor_id,
                  char *compressed,
                  size_t *compressed_len);
 
+bool
+_mongoc_compress_iovec (mongoc_compression_scratch_t *scratch,
+                        int32_t compressor_id,
+                        int32_t level,
+                        const mongoc_iovec_t *iov,
+                        size_t iovcnt,
+                        size_t skip,
+                        size_t *compressed_len);
+
+bool
+_mongoc_compress_zlib_parallel (mongoc_compression_scratch_t *scratch,
+                                int32_t level,
+                                const uint8_t *uncompressed,
+                                size_t uncompressed_len,
+                                size_t *compressed_len);
+
+void
+_mongoc_compression_scratch_init (mongoc_compression_scratch_t *scratch,
+                                  int32_t zlib_level,
+                                  int32_t zlib_threads,
+                                  int32_t zstd_level);
+
+uint8_t *
+_mongoc_compression_scratch_compressed (mongoc_compression_scratch_t *scratch,
+                                        size_t size);
+
+uint8_t *
+_mongoc_compression_scratch_uncompressed (
+   mongoc_compression_scratch_t *scratch, size_t size);
+
+int32_t
+_mongoc_compression_scratch_level (const mongoc_compression_scratch_t *scratch,
+                                   int32_t compressor_id);
+
+size_t
+_mongoc_compression_scratch_trim (mongoc_compression_scratch_t *scratch,
+                                  size_t max_size);
+
+void
+_mongoc_compression_scratch_destroy (mongoc_compression_scratch_t *scratch);
+
+void
+_mongoc_compression_policy_init (mongoc_compression_policy_t *policy);
+
+bool
+_mongoc_compression_policy_should_compress (
+   mongoc_compression_policy_t *policy,
+   const char *command_name,
+   const mongoc_iovec_t *iov,
+   size_t iovcnt,
+   size_t skip);
+
+void
+_mongoc_compression_policy_record (mongoc_compression_policy_t *policy,
+                                   const char *command_name,
+                                   size_t uncompressed_len,
+                                   size_t compressed_len);
+
+bool
+_mongoc_compression_policy_select (mongoc_compression_policy_t *policy,
+                                   uint32_t server_id,
+                                   const bson_t *server_compressors,
+                                   size_t uncompressed_len,
+                                   int32_t *compressor_id,
+                                   int32_t *level);
+
+void
+_mongoc_compression_policy_record_codec (mongoc_compression_policy_t *policy,
+                                         int32_t compressor_id,
+                                         int32_t level,
+                                         size_t uncompressed_len,
+                                         size_t compressed_len,
+                                         int64_t usec);
+
+void
+_mongoc_compression_policy_record_link (mongoc_compression_policy_t *policy,
+                                        uint32_t server_id,
+                                        mongoc_compression_link_dir_t dir,
+                                        size_t len,
+                                        int64_t usec);
+
 BSON_END_DECLS
 
 #endif
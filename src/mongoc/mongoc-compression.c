@@ -18,8 +18,10 @@
 #include "mongoc-config.h"
 
 #include "mongoc-compression-private.h"
+#include "mongoc-counters-private.h"
 #include "mongoc-trace-private.h"
 #include "mongoc-util-private.h"
+#include "mongoc-worker-pool-private.h"
 
 #ifdef MONGOC_ENABLE_COMPRESSION
 #ifdef MONGOC_ENABLE_COMPRESSION_ZLIB
@@ -28,6 +30,9 @@
 #ifdef MONGOC_ENABLE_COMPRESSION_SNAPPY
 #include <snappy-c.h>
 #endif
+#ifdef MONGOC_ENABLE_COMPRESSION_ZSTD
+#include <zstd.h>
+#endif
 #endif
 
 size_t
@@ -49,6 +54,12 @@ mongoc_compressor_max_compressed_length (int32_t compressor_id, size_t len)
       break;
 #endif
 
+#ifdef MONGOC_ENABLE_COMPRESSION_ZSTD
+   case MONGOC_COMPRESSOR_ZSTD_ID:
+      return ZSTD_compressBound (len);
+      break;
+#endif
+
    case MONGOC_COMPRESSOR_NOOP_ID:
       return len;
       break;
@@ -72,6 +83,12 @@ mongoc_compressor_supported (const char *compressor)
    }
 #endif
 
+#ifdef MONGOC_ENABLE_COMPRESSION_ZSTD
+   if (!strcasecmp (compressor, MONGOC_COMPRESSOR_ZSTD_STR)) {
+      return true;
+   }
+#endif
+
    if (!strcasecmp (compressor, MONGOC_COMPRESSOR_NOOP_STR)) {
       return true;
    }
@@ -89,6 +106,9 @@ mongoc_compressor_id_to_name (int32_t compressor_id)
    case MONGOC_COMPRESSOR_ZLIB_ID:
       return MONGOC_COMPRESSOR_ZLIB_STR;
 
+   case MONGOC_COMPRESSOR_ZSTD_ID:
+      return MONGOC_COMPRESSOR_ZSTD_STR;
+
    case MONGOC_COMPRESSOR_NOOP_ID:
       return MONGOC_COMPRESSOR_NOOP_STR;
 
@@ -112,6 +132,12 @@ mongoc_compressor_name_to_id (const char *compressor)
    }
 #endif
 
+#ifdef MONGOC_ENABLE_COMPRESSION_ZSTD
+   if (strcasecmp (MONGOC_COMPRESSOR_ZSTD_STR, compressor) == 0) {
+      return MONGOC_COMPRESSOR_ZSTD_ID;
+   }
+#endif
+
    if (strcasecmp (MONGOC_COMPRESSOR_NOOP_STR, compressor) == 0) {
       return MONGOC_COMPRESSOR_NOOP_ID;
    }
@@ -164,6 +190,27 @@ mongoc_uncompress (int32_t compressor_id,
 #endif
       break;
    }
+
+   case MONGOC_COMPRESSOR_ZSTD_ID: {
+#ifdef MONGOC_ENABLE_COMPRESSION_ZSTD
+      size_t ret;
+
+      ret = ZSTD_decompress (
+         uncompressed, *uncompressed_len, compressed, compressed_len);
+
+      if (ZSTD_isError (ret)) {
+         return false;
+      }
+
+      *uncompressed_len = ret;
+      return true;
+#else
+      MONGOC_WARNING ("Received zstd compressed opcode, but zstd "
+                      "compression is not compiled in");
+      return false;
+#endif
+      break;
+   }
    case MONGOC_COMPRESSOR_NOOP_ID:
       memcpy (uncompressed, compressed, compressed_len);
       *uncompressed_len = compressed_len;
@@ -214,6 +261,29 @@ mongoc_compress (int32_t compressor_id,
                     "compression is not compiled in");
       return false;
 #endif
+
+   case MONGOC_COMPRESSOR_ZSTD_ID: {
+#ifdef MONGOC_ENABLE_COMPRESSION_ZSTD
+      size_t ret;
+
+      ret = ZSTD_compress ((void *) compressed,
+                           *compressed_len,
+                           (const void *) uncompressed,
+                           uncompressed_len,
+                           compression_level);
+
+      if (ZSTD_isError (ret)) {
+         return false;
+      }
+
+      *compressed_len = ret;
+      return true;
+#else
+      MONGOC_ERROR ("Client attempting to use compress with zstd, but zstd "
+                    "compression is not compiled in");
+      return false;
+#endif
+   }
    case MONGOC_COMPRESSOR_NOOP_ID:
       memcpy (compressed, uncompressed, uncompressed_len);
       *compressed_len = uncompressed_len;
@@ -223,3 +293,1028 @@ mongoc_compress (int32_t compressor_id,
       return false;
    }
 }
+
+
+void
+_mongoc_compression_scratch_init (mongoc_compression_scratch_t *scratch,
+                                  int32_t zlib_level,
+                                  int32_t zlib_threads,
+                                  int32_t zstd_level)
+{
+   BSON_ASSERT (scratch);
+
+   memset (scratch, 0, sizeof *scratch);
+   scratch->zlib_level = zlib_level;
+   scratch->zlib_threads = zlib_threads;
+   scratch->zstd_level = zstd_level;
+}
+
+
+/* the level the URI configures for @compressor_id */
+int32_t
+_mongoc_compression_scratch_level (const mongoc_compression_scratch_t *scratch,
+                                   int32_t compressor_id)
+{
+   BSON_ASSERT (scratch);
+
+   switch (compressor_id) {
+   case MONGOC_COMPRESSOR_ZLIB_ID:
+      return scratch->zlib_level;
+   case MONGOC_COMPRESSOR_ZSTD_ID:
+      return scratch->zstd_level;
+   default:
+      return 0;
+   }
+}
+
+
+/* grow *buf to hold at least @size bytes, discarding its contents */
+static uint8_t *
+_mongoc_compression_scratch_reserve (uint8_t **buf,
+                                     size_t *buf_size,
+                                     size_t size)
+{
+   if (*buf_size < size) {
+      /* no realloc, the old contents needn't be copied */
+      bson_free (*buf);
+      *buf_size = BSON_MAX (size, *buf_size * 2);
+      *buf = (uint8_t *) bson_malloc (*buf_size);
+   }
+
+   return *buf;
+}
+
+
+uint8_t *
+_mongoc_compression_scratch_compressed (mongoc_compression_scratch_t *scratch,
+                                        size_t size)
+{
+   return _mongoc_compression_scratch_reserve (
+      &scratch->compressed, &scratch->compressed_size, size);
+}
+
+
+uint8_t *
+_mongoc_compression_scratch_uncompressed (
+   mongoc_compression_scratch_t *scratch, size_t size)
+{
+   return _mongoc_compression_scratch_reserve (
+      &scratch->uncompressed, &scratch->uncompressed_size, size);
+}
+
+
+/* free the buffers if they've grown beyond @max_size, return bytes freed */
+size_t
+_mongoc_compression_scratch_trim (mongoc_compression_scratch_t *scratch,
+                                  size_t max_size)
+{
+   size_t freed = 0;
+
+   if (scratch->compressed_size > max_size) {
+      freed += scratch->compressed_size;
+      bson_free (scratch->compressed);
+      scratch->compressed = NULL;
+      scratch->compressed_size = 0;
+   }
+
+   if (scratch->uncompressed_size > max_size) {
+      freed += scratch->uncompressed_size;
+      bson_free (scratch->uncompressed);
+      scratch->uncompressed = NULL;
+      scratch->uncompressed_size = 0;
+   }
+
+   return freed;
+}
+
+
+void
+_mongoc_compression_scratch_destroy (mongoc_compression_scratch_t *scratch)
+{
+   BSON_ASSERT (scratch);
+
+   bson_free (scratch->compressed);
+   bson_free (scratch->uncompressed);
+#ifdef MONGOC_ENABLE_COMPRESSION_ZSTD
+   ZSTD_freeCCtx ((ZSTD_CCtx *) scratch->zstd_cctx);
+#endif
+}
+
+
+/* the part of iov[@i] after the first @skip bytes of the message, if it
+ * is not empty; *pos is the offset of iov[@i] in the message and is
+ * advanced past it. callers need not handle empty parts, which deflate
+ * rejects with Z_BUF_ERROR */
+static bool
+_mongoc_compression_iovec_part (const mongoc_iovec_t *iov,
+                                size_t i,
+                                size_t skip,
+                                size_t *pos,
+                                const uint8_t **data,
+                                size_t *len)
+{
+   size_t start = *pos;
+
+   *pos += iov[i].iov_len;
+   if (*pos <= skip || iov[i].iov_len == 0) {
+      return false;
+   }
+
+   start = skip > start ? skip - start : 0;
+   *data = (const uint8_t *) iov[i].iov_base + start;
+   *len = iov[i].iov_len - start;
+
+   return true;
+}
+
+
+#ifdef MONGOC_ENABLE_COMPRESSION_ZLIB
+static bool
+_mongoc_compress_iovec_zlib (int32_t level,
+                             const mongoc_iovec_t *iov,
+                             size_t iovcnt,
+                             size_t skip,
+                             uint8_t *compressed,
+                             size_t *compressed_len)
+{
+   z_stream strm;
+   const uint8_t *data;
+   size_t len;
+   size_t pos = 0;
+   size_t i;
+   bool ok = true;
+
+   memset (&strm, 0, sizeof strm);
+   if (deflateInit (&strm, level) != Z_OK) {
+      return false;
+   }
+
+   strm.next_out = compressed;
+   strm.avail_out = (uInt) *compressed_len;
+
+   for (i = 0; ok && i < iovcnt; i++) {
+      if (_mongoc_compression_iovec_part (iov, i, skip, &pos, &data, &len)) {
+         strm.next_in = (Bytef *) data;
+         strm.avail_in = (uInt) len;
+         ok = deflate (&strm, Z_NO_FLUSH) == Z_OK && strm.avail_in == 0;
+      }
+   }
+
+   ok = ok && deflate (&strm, Z_FINISH) == Z_STREAM_END;
+   *compressed_len = strm.total_out;
+   deflateEnd (&strm);
+
+   return ok;
+}
+#endif
+
+
+#ifdef MONGOC_ENABLE_COMPRESSION_ZSTD
+static bool
+_mongoc_compress_iovec_zstd (mongoc_compression_scratch_t *scratch,
+                             int32_t level,
+                             const mongoc_iovec_t *iov,
+                             size_t iovcnt,
+                             size_t skip,
+                             size_t uncompressed_len,
+                             uint8_t *compressed,
+                             size_t *compressed_len)
+{
+   ZSTD_CCtx *cctx;
+   ZSTD_inBuffer in;
+   ZSTD_outBuffer out;
+   const uint8_t *data;
+   size_t len;
+   size_t pos = 0;
+   size_t ret;
+   size_t i;
+
+   if (!scratch->zstd_cctx) {
+      scratch->zstd_cctx = ZSTD_createCCtx ();
+      if (!scratch->zstd_cctx) {
+         return false;
+      }
+   }
+
+   cctx = (ZSTD_CCtx *) scratch->zstd_cctx;
+   ZSTD_CCtx_reset (cctx, ZSTD_reset_session_only);
+   if (ZSTD_isError (ZSTD_CCtx_setParameter (
+          cctx, ZSTD_c_compressionLevel, level)) ||
+       ZSTD_isError (ZSTD_CCtx_setPledgedSrcSize (cctx, uncompressed_len))) {
+      return false;
+   }
+
+   out.dst = compressed;
+   out.size = *compressed_len;
+   out.pos = 0;
+
+   for (i = 0; i < iovcnt; i++) {
+      if (!_mongoc_compression_iovec_part (iov, i, skip, &pos, &data, &len)) {
+         continue;
+      }
+
+      in.src = data;
+      in.size = len;
+      in.pos = 0;
+      while (in.pos < in.size) {
+         ret = ZSTD_compressStream2 (cctx, &out, &in, ZSTD_e_continue);
+         if (ZSTD_isError (ret) || out.pos == out.size) {
+            return false;
+         }
+      }
+   }
+
+   in.src = NULL;
+   in.size = 0;
+   in.pos = 0;
+   do {
+      ret = ZSTD_compressStream2 (cctx, &out, &in, ZSTD_e_end);
+      if (ZSTD_isError (ret)) {
+         return false;
+      }
+   } while (ret != 0 && out.pos < out.size);
+
+   *compressed_len = out.pos;
+
+   return ret == 0;
+}
+#endif
+
+
+/* copy the message in @iov, after its first @skip bytes, into
+ * scratch->uncompressed */
+static uint8_t *
+_mongoc_compression_gather (mongoc_compression_scratch_t *scratch,
+                            const mongoc_iovec_t *iov,
+                            size_t iovcnt,
+                            size_t skip,
+                            size_t uncompressed_len)
+{
+   uint8_t *uncompressed;
+   const uint8_t *data;
+   size_t gathered = 0;
+   size_t len;
+   size_t pos = 0;
+   size_t i;
+
+   uncompressed =
+      _mongoc_compression_scratch_uncompressed (scratch, uncompressed_len);
+
+   for (i = 0; i < iovcnt; i++) {
+      if (_mongoc_compression_iovec_part (iov, i, skip, &pos, &data, &len)) {
+         memcpy (uncompressed + gathered, data, len);
+         gathered += len;
+      }
+   }
+
+   return uncompressed;
+}
+
+
+#ifdef MONGOC_ENABLE_COMPRESSION_ZLIB
+typedef struct {
+   /* compressed length, 0 on error */
+   size_t len;
+   uLong adler;
+} mongoc_zlib_block_t;
+
+typedef struct {
+   int32_t level;
+   const uint8_t *in;
+   size_t in_len;
+   size_t block_size;
+   size_t n_blocks;
+   /* block i is compressed to out + i * out_size */
+   uint8_t *out;
+   size_t out_size;
+   mongoc_zlib_block_t *blocks;
+} mongoc_zlib_parallel_t;
+
+
+/* deflate block @i to raw deflate data that ends on a byte boundary, primed
+ * with the 32KB before it so it compresses as well as a single stream */
+static void
+_mongoc_zlib_parallel_block (void *ctx, size_t i)
+{
+   mongoc_zlib_parallel_t *p = (mongoc_zlib_parallel_t *) ctx;
+   mongoc_zlib_block_t *block = &p->blocks[i];
+   const uint8_t *in = p->in + i * p->block_size;
+   size_t len = BSON_MIN (p->block_size, p->in_len - i * p->block_size);
+   size_t dict_len = BSON_MIN (32 * 1024, i * p->block_size);
+   bool last = i == p->n_blocks - 1;
+   z_stream strm;
+   int ret;
+
+   block->len = 0;
+   block->adler = adler32 (adler32 (0L, Z_NULL, 0), in, (uInt) len);
+
+   memset (&strm, 0, sizeof strm);
+   if (deflateInit2 (
+          &strm, p->level, Z_DEFLATED, -15 /* raw */, 8, Z_DEFAULT_STRATEGY) !=
+       Z_OK) {
+      return;
+   }
+
+   if (dict_len &&
+       deflateSetDictionary (&strm, in - dict_len, (uInt) dict_len) != Z_OK) {
+      deflateEnd (&strm);
+      return;
+   }
+
+   strm.next_in = (Bytef *) in;
+   strm.avail_in = (uInt) len;
+   strm.next_out = p->out + i * p->out_size;
+   strm.avail_out = (uInt) p->out_size;
+
+   /* a sync flush ends the block with an empty stored block, without
+    * marking it final, so the next block's data can follow it */
+   ret = deflate (&strm, last ? Z_FINISH : Z_SYNC_FLUSH);
+   if (last ? ret == Z_STREAM_END
+            : ret == Z_OK && strm.avail_in == 0 && strm.avail_out > 0) {
+      block->len = strm.total_out;
+   }
+
+   deflateEnd (&strm);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_compress_zlib_parallel --
+ *
+ *       Compress @uncompressed into scratch->compressed as one zlib
+ *       stream at @level, like compress2, but split into blocks that are
+ *       deflated on up to scratch->zlib_threads threads of the worker
+ *       pool. The
+ *       blocks' deflate data is concatenated between the zlib header and
+ *       an Adler-32 checksum combined from the blocks' checksums.
+ *
+ * Returns:
+ *       true and sets @compressed_len if successful.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+_mongoc_compress_zlib_parallel (mongoc_compression_scratch_t *scratch,
+                                int32_t level,
+                                const uint8_t *uncompressed,
+                                size_t uncompressed_len,
+                                size_t *compressed_len)
+{
+   mongoc_zlib_parallel_t p;
+   uint32_t threads;
+   uint8_t *out;
+   size_t pos;
+   size_t block_len;
+   uLong adler;
+   unsigned level_flags;
+   unsigned header;
+   size_t i;
+   bool ok = true;
+
+   BSON_ASSERT (scratch);
+   BSON_ASSERT (uncompressed_len > 0);
+
+   threads = (uint32_t) BSON_MAX (scratch->zlib_threads, 1);
+
+   /* about four blocks per thread, to even out their speeds */
+   p.level = level;
+   p.in = uncompressed;
+   p.in_len = uncompressed_len;
+   p.block_size = BSON_MAX (uncompressed_len / (threads * 4),
+                            MONGOC_COMPRESSION_PARALLEL_BLOCK_SIZE);
+   p.n_blocks = (uncompressed_len + p.block_size - 1) / p.block_size;
+   /* room for an empty stored block after the data */
+   p.out_size = compressBound ((uLong) p.block_size) + 16;
+   p.blocks = bson_malloc (p.n_blocks * sizeof (mongoc_zlib_block_t));
+
+   /* the blocks are compressed after the header, then moved together */
+   out = _mongoc_compression_scratch_compressed (
+      scratch, 2 + p.n_blocks * p.out_size + 4);
+   p.out = out + 2;
+
+   _mongoc_worker_pool_run (
+      _mongoc_zlib_parallel_block, &p, p.n_blocks, threads);
+
+   /* the zlib header: deflate with a 32KB window, the level as zlib
+    * reports it, and a check value that makes it a multiple of 31 */
+   if (p.level == Z_DEFAULT_COMPRESSION || p.level == 6) {
+      level_flags = 2;
+   } else if (p.level < 2) {
+      level_flags = 0;
+   } else if (p.level < 6) {
+      level_flags = 1;
+   } else {
+      level_flags = 3;
+   }
+
+   header = ((Z_DEFLATED + (7 << 4)) << 8) | (level_flags << 6);
+   header += 31 - header % 31;
+   out[0] = (uint8_t) (header >> 8);
+   out[1] = (uint8_t) header;
+
+   pos = 2;
+   adler = adler32 (0L, Z_NULL, 0);
+   for (i = 0; i < p.n_blocks; i++) {
+      if (!p.blocks[i].len) {
+         ok = false;
+         break;
+      }
+
+      memmove (out + pos, p.out + i * p.out_size, p.blocks[i].len);
+      pos += p.blocks[i].len;
+      block_len = BSON_MIN (p.block_size, uncompressed_len - i * p.block_size);
+      adler = adler32_combine (adler, p.blocks[i].adler, (z_off_t) block_len);
+   }
+
+   if (ok) {
+      out[pos++] = (uint8_t) (adler >> 24);
+      out[pos++] = (uint8_t) (adler >> 16);
+      out[pos++] = (uint8_t) (adler >> 8);
+      out[pos++] = (uint8_t) adler;
+      *compressed_len = pos;
+   }
+
+   bson_free (p.blocks);
+
+   return ok;
+}
+#endif
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_compress_iovec --
+ *
+ *       Compress the message in @iov, except for its first @skip bytes,
+ *       into scratch->compressed at @level, which only zlib and zstd use.
+ *       zlib and zstd read the message straight from @iov; other
+ *       compressors, and zlib in parallel, need it gathered into
+ *       scratch->uncompressed first.
+ *
+ * Returns:
+ *       true and sets @compressed_len if successful.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+_mongoc_compress_iovec (mongoc_compression_scratch_t *scratch,
+                        int32_t compressor_id,
+                        int32_t level,
+                        const mongoc_iovec_t *iov,
+                        size_t iovcnt,
+                        size_t skip,
+                        size_t *compressed_len)
+{
+   uint8_t *compressed;
+   uint8_t *uncompressed;
+   size_t uncompressed_len = 0;
+   size_t i;
+
+   BSON_ASSERT (scratch);
+
+   for (i = 0; i < iovcnt; i++) {
+      uncompressed_len += iov[i].iov_len;
+   }
+
+   BSON_ASSERT (uncompressed_len > skip);
+   uncompressed_len -= skip;
+
+#ifdef MONGOC_ENABLE_COMPRESSION_ZLIB
+   if (compressor_id == MONGOC_COMPRESSOR_ZLIB_ID &&
+       scratch->zlib_threads > 1 &&
+       uncompressed_len >= MONGOC_COMPRESSION_PARALLEL_MIN_SIZE) {
+      uncompressed = _mongoc_compression_gather (
+         scratch, iov, iovcnt, skip, uncompressed_len);
+      return _mongoc_compress_zlib_parallel (
+         scratch, level, uncompressed, uncompressed_len, compressed_len);
+   }
+#endif
+
+   *compressed_len =
+      mongoc_compressor_max_compressed_length (compressor_id, uncompressed_len);
+   if (!*compressed_len) {
+      return false;
+   }
+
+   compressed =
+      _mongoc_compression_scratch_compressed (scratch, *compressed_len);
+
+   switch (compressor_id) {
+#ifdef MONGOC_ENABLE_COMPRESSION_ZLIB
+   case MONGOC_COMPRESSOR_ZLIB_ID:
+      return _mongoc_compress_iovec_zlib (
+         level, iov, iovcnt, skip, compressed, compressed_len);
+#endif
+
+#ifdef MONGOC_ENABLE_COMPRESSION_ZSTD
+   case MONGOC_COMPRESSOR_ZSTD_ID:
+      return _mongoc_compress_iovec_zstd (scratch,
+                                          level,
+                                          iov,
+                                          iovcnt,
+                                          skip,
+                                          uncompressed_len,
+                                          compressed,
+                                          compressed_len);
+#endif
+
+   default:
+      /* gather the message, then compress it in one call */
+      uncompressed = _mongoc_compression_gather (
+         scratch, iov, iovcnt, skip, uncompressed_len);
+
+      return mongoc_compress (compressor_id,
+                              0 /* compression level */,
+                              (char *) uncompressed,
+                              uncompressed_len,
+                              (char *) compressed,
+                              compressed_len);
+   }
+}
+
+
+static void
+_mongoc_compression_policy_add_codec (mongoc_compression_policy_t *policy,
+                                      int32_t compressor_id,
+                                      int32_t level)
+{
+   mongoc_compression_codec_stats_t *codec;
+
+   BSON_ASSERT (policy->n_codecs < MONGOC_COMPRESSION_CODECS_MAX);
+
+   codec = &policy->codecs[policy->n_codecs++];
+   codec->compressor_id = compressor_id;
+   codec->level = level;
+}
+
+
+void
+_mongoc_compression_policy_init (mongoc_compression_policy_t *policy)
+{
+   BSON_ASSERT (policy);
+
+   memset (policy, 0, sizeof *policy);
+
+   /* the choices for adaptiveCompression, each compressor's fastest level
+    * first: that is the one used before a server's link is measured */
+#ifdef MONGOC_ENABLE_COMPRESSION_SNAPPY
+   _mongoc_compression_policy_add_codec (
+      policy, MONGOC_COMPRESSOR_SNAPPY_ID, 0);
+#endif
+#ifdef MONGOC_ENABLE_COMPRESSION_ZLIB
+   _mongoc_compression_policy_add_codec (policy, MONGOC_COMPRESSOR_ZLIB_ID, 1);
+   _mongoc_compression_policy_add_codec (policy, MONGOC_COMPRESSOR_ZLIB_ID, 6);
+#endif
+#ifdef MONGOC_ENABLE_COMPRESSION_ZSTD
+   _mongoc_compression_policy_add_codec (policy, MONGOC_COMPRESSOR_ZSTD_ID, 1);
+   _mongoc_compression_policy_add_codec (policy, MONGOC_COMPRESSOR_ZSTD_ID, 3);
+   _mongoc_compression_policy_add_codec (policy, MONGOC_COMPRESSOR_ZSTD_ID, 9);
+#endif
+}
+
+
+static mongoc_compression_stats_t *
+_mongoc_compression_policy_find (mongoc_compression_policy_t *policy,
+                                 const char *command_name,
+                                 bool create)
+{
+   mongoc_compression_stats_t *stats;
+   int i;
+
+   if (!command_name) {
+      return NULL;
+   }
+
+   for (i = 0; i < policy->n_stats; i++) {
+      if (!strcasecmp (policy->stats[i].command_name, command_name)) {
+         return &policy->stats[i];
+      }
+   }
+
+   if (!create || policy->n_stats == MONGOC_COMPRESSION_STATS_MAX ||
+       strlen (command_name) >= sizeof (stats->command_name)) {
+      return NULL;
+   }
+
+   stats = &policy->stats[policy->n_stats++];
+   bson_strncpy (
+      stats->command_name, command_name, sizeof stats->command_name);
+
+   return stats;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_compression_looks_compressible --
+ *
+ *       Sample up to MONGOC_COMPRESSION_SAMPLE_SIZE bytes, evenly spaced,
+ *       from the message in @iov after its first @skip bytes, and estimate
+ *       the chance that two sampled bytes are equal. That is 1/256 for
+ *       random or already-compressed data, and far higher for BSON with
+ *       text, field names or small integers.
+ *
+ * Returns:
+ *       false if the sample looks like it won't compress.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_mongoc_compression_looks_compressible (const mongoc_iovec_t *iov,
+                                        size_t iovcnt,
+                                        size_t skip,
+                                        size_t len)
+{
+   uint32_t counts[256] = {0};
+   uint64_t n = 0;
+   uint64_t repeats = 0;
+   size_t stride;
+   size_t next;
+   size_t pos = 0;
+   size_t i;
+
+   stride = (len - skip) / MONGOC_COMPRESSION_SAMPLE_SIZE;
+   if (stride == 0) {
+      stride = 1;
+   }
+
+   next = skip;
+   for (i = 0; i < iovcnt; i++) {
+      while (next < pos + iov[i].iov_len) {
+         counts[((const uint8_t *) iov[i].iov_base)[next - pos]]++;
+         n++;
+         next += stride;
+      }
+
+      pos += iov[i].iov_len;
+   }
+
+   if (n < 2) {
+      return true;
+   }
+
+   for (i = 0; i < 256; i++) {
+      if (counts[i] > 1) {
+         repeats += (uint64_t) counts[i] * (counts[i] - 1);
+      }
+   }
+
+   /* compressible if the chance of a repeat is at least 1.5 / 256 */
+   return repeats * 256 * 2 >= 3 * n * (n - 1);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_compression_policy_should_compress --
+ *
+ *       Decide whether to compress the message in @iov, whose first @skip
+ *       bytes are the message header. Small messages and messages whose
+ *       sample looks incompressible are sent as-is, as are messages for a
+ *       @command_name whose recent messages didn't shrink, except for one
+ *       probe every MONGOC_COMPRESSION_PROBE_INTERVAL messages. Each
+ *       decision is counted.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+_mongoc_compression_policy_should_compress (
+   mongoc_compression_policy_t *policy,
+   const char *command_name,
+   const mongoc_iovec_t *iov,
+   size_t iovcnt,
+   size_t skip)
+{
+   mongoc_compression_stats_t *stats;
+   size_t len = 0;
+   size_t i;
+
+   BSON_ASSERT (policy);
+
+   for (i = 0; i < iovcnt; i++) {
+      len += iov[i].iov_len;
+   }
+
+   if (len < skip + MONGOC_COMPRESSION_MIN_SIZE) {
+      mongoc_counter_compression_skipped_small_inc ();
+      return false;
+   }
+
+   stats = _mongoc_compression_policy_find (policy, command_name, false);
+   if (stats && stats->samples >= MONGOC_COMPRESSION_MIN_SAMPLES &&
+       stats->ratio > MONGOC_COMPRESSION_MAX_RATIO) {
+      if (++stats->skipped < MONGOC_COMPRESSION_PROBE_INTERVAL) {
+         mongoc_counter_compression_skipped_ratio_inc ();
+         return false;
+      }
+
+      TRACE ("Probing compression for '%s'", command_name);
+      stats->skipped = 0;
+   }
+
+   if (!_mongoc_compression_looks_compressible (iov, iovcnt, skip, len)) {
+      mongoc_counter_compression_skipped_entropy_inc ();
+      return false;
+   }
+
+   return true;
+}
+
+
+/* record the result of compressing a message for @command_name */
+void
+_mongoc_compression_policy_record (mongoc_compression_policy_t *policy,
+                                   const char *command_name,
+                                   size_t uncompressed_len,
+                                   size_t compressed_len)
+{
+   mongoc_compression_stats_t *stats;
+   uint32_t ratio;
+
+   BSON_ASSERT (policy);
+
+   mongoc_counter_compression_compressed_inc ();
+
+   stats = _mongoc_compression_policy_find (policy, command_name, true);
+   if (!stats || !uncompressed_len) {
+      return;
+   }
+
+   ratio = (uint32_t) BSON_MIN (
+      (uint64_t) compressed_len * 1000 / uncompressed_len, UINT32_MAX / 4);
+
+   if (stats->samples == 0) {
+      stats->ratio = ratio;
+   } else {
+      stats->ratio = (stats->ratio * 3 + ratio) / 4;
+   }
+
+   stats->samples++;
+}
+
+
+static mongoc_compression_link_stats_t *
+_mongoc_compression_policy_link (mongoc_compression_policy_t *policy,
+                                 uint32_t server_id,
+                                 bool create)
+{
+   mongoc_compression_link_stats_t *link = NULL;
+   int i;
+
+   for (i = 0; i < policy->n_links; i++) {
+      if (policy->links[i].server_id == server_id) {
+         return &policy->links[i];
+      }
+   }
+
+   if (!create) {
+      return NULL;
+   }
+
+   if (policy->n_links < MONGOC_COMPRESSION_LINKS_MAX) {
+      link = &policy->links[policy->n_links++];
+   } else {
+      /* forget the server measured least recently */
+      link = &policy->links[0];
+      for (i = 1; i < policy->n_links; i++) {
+         if (policy->links[i].used < link->used) {
+            link = &policy->links[i];
+         }
+      }
+   }
+
+   memset (link, 0, sizeof *link);
+   link->server_id = server_id;
+
+   return link;
+}
+
+
+/* the estimated bytes per microsecond to a server, or 0 until a reply
+ * from it is measured. receiving is measured reliably, sending only when
+ * the write blocked, so the link is as fast as the slower of the two */
+static double
+_mongoc_compression_link_bandwidth (const mongoc_compression_link_stats_t *link)
+{
+   if (!link || !link->recv_samples) {
+      return 0;
+   }
+
+   if (link->send_samples) {
+      return BSON_MIN (link->send_bandwidth, link->recv_bandwidth);
+   }
+
+   return link->recv_bandwidth;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_compression_policy_select --
+ *
+ *       With adaptiveCompression, choose how to send a message of
+ *       @uncompressed_len bytes to the server @server_id, among the
+ *       codecs in @server_compressors, the names the server agreed to in
+ *       its isMaster reply. The choice minimizes the estimated time to
+ *       compress the message and send it over the server's link, or to
+ *       send it uncompressed.
+ *
+ *       Each codec is tried once before it is compared, and until the
+ *       server's link is measured its first codec is used at its fastest
+ *       level. Every MONGOC_COMPRESSION_PROBE_INTERVAL choices for a
+ *       server, its least-tried codec is used, to keep its speed and ratio
+ *       current.
+ *
+ * Returns:
+ *       true and sets @compressor_id and @level, or false to send the
+ *       message uncompressed.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+_mongoc_compression_policy_select (mongoc_compression_policy_t *policy,
+                                   uint32_t server_id,
+                                   const bson_t *server_compressors,
+                                   size_t uncompressed_len,
+                                   int32_t *compressor_id,
+                                   int32_t *level)
+{
+   mongoc_compression_link_stats_t *link;
+   mongoc_compression_codec_stats_t *codec;
+   mongoc_compression_codec_stats_t *first = NULL;
+   mongoc_compression_codec_stats_t *probe = NULL;
+   mongoc_compression_codec_stats_t *best = NULL;
+   double len = (double) uncompressed_len;
+   double bandwidth;
+   double best_usec = 0;
+   double usec;
+   bson_iter_t iter;
+   int32_t id;
+   int i;
+
+   BSON_ASSERT (policy);
+   BSON_ASSERT (server_compressors);
+
+   link = _mongoc_compression_policy_link (policy, server_id, false);
+   bandwidth = _mongoc_compression_link_bandwidth (link);
+   if (bandwidth > 0) {
+      best_usec = len / bandwidth;
+   } else {
+      link = NULL;
+   }
+
+   bson_iter_init (&iter, server_compressors);
+   while (bson_iter_next (&iter)) {
+      if (!BSON_ITER_HOLDS_UTF8 (&iter)) {
+         continue;
+      }
+
+      id = mongoc_compressor_name_to_id (bson_iter_utf8 (&iter, NULL));
+
+      for (i = 0; i < policy->n_codecs; i++) {
+         codec = &policy->codecs[i];
+         if (codec->compressor_id != id) {
+            continue;
+         }
+
+         if (!first) {
+            first = codec;
+         }
+
+         if (!probe || codec->samples < probe->samples) {
+            probe = codec;
+         }
+
+         if (link && codec->samples) {
+            usec =
+               len / codec->speed + len * codec->ratio / 1000.0 / bandwidth;
+            if (usec < best_usec) {
+               best = codec;
+               best_usec = usec;
+            }
+         }
+      }
+   }
+
+   if (!first) {
+      return false;
+   }
+
+   if (probe->samples == 0 ||
+       (link && ++link->choices >= MONGOC_COMPRESSION_PROBE_INTERVAL)) {
+      if (link) {
+         link->choices = 0;
+      }
+
+      codec = probe;
+   } else if (!link) {
+      codec = first;
+   } else if (best) {
+      codec = best;
+   } else {
+      mongoc_counter_compression_skipped_link_inc ();
+      return false;
+   }
+
+   *compressor_id = codec->compressor_id;
+   *level = codec->level;
+
+   return true;
+}
+
+
+/* record how long compressing a message with a codec and level took */
+void
+_mongoc_compression_policy_record_codec (mongoc_compression_policy_t *policy,
+                                         int32_t compressor_id,
+                                         int32_t level,
+                                         size_t uncompressed_len,
+                                         size_t compressed_len,
+                                         int64_t usec)
+{
+   mongoc_compression_codec_stats_t *codec;
+   double speed;
+   uint32_t ratio;
+   int i;
+
+   BSON_ASSERT (policy);
+
+   if (!uncompressed_len) {
+      return;
+   }
+
+   speed = (double) uncompressed_len / (double) BSON_MAX (usec, 1);
+   ratio = (uint32_t) BSON_MIN (
+      (uint64_t) compressed_len * 1000 / uncompressed_len, UINT32_MAX / 4);
+
+   for (i = 0; i < policy->n_codecs; i++) {
+      codec = &policy->codecs[i];
+      if (codec->compressor_id != compressor_id || codec->level != level) {
+         continue;
+      }
+
+      if (codec->samples == 0) {
+         codec->speed = speed;
+         codec->ratio = ratio;
+      } else {
+         codec->speed = (codec->speed * 3 + speed) / 4;
+         codec->ratio = (codec->ratio * 3 + ratio) / 4;
+      }
+
+      codec->samples++;
+      return;
+   }
+}
+
+
+/* record how long sending or receiving @len bytes from a server took, if
+ * that is enough bytes to measure its link */
+void
+_mongoc_compression_policy_record_link (mongoc_compression_policy_t *policy,
+                                        uint32_t server_id,
+                                        mongoc_compression_link_dir_t dir,
+                                        size_t len,
+                                        int64_t usec)
+{
+   mongoc_compression_link_stats_t *link;
+   double bandwidth;
+   double *avg;
+   uint32_t *samples;
+
+   BSON_ASSERT (policy);
+
+   if (len < MONGOC_COMPRESSION_LINK_MIN_SIZE) {
+      return;
+   }
+
+   link = _mongoc_compression_policy_link (policy, server_id, true);
+   bandwidth = (double) len / (double) BSON_MAX (usec, 1);
+
+   if (dir == MONGOC_COMPRESSION_LINK_SEND) {
+      avg = &link->send_bandwidth;
+      samples = &link->send_samples;
+   } else {
+      avg = &link->recv_bandwidth;
+      samples = &link->recv_samples;
+   }
+
+   if (*samples == 0) {
+      *avg = bandwidth;
+   } else {
+      *avg = (*avg * 3 + bandwidth) / 4;
+   }
+
+   (*samples)++;
+   link->used = ++policy->clock;
+}
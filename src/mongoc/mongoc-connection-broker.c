@@ -0,0 +1,914 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "mongoc-config.h"
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "mongoc-client-pool.h"
+#include "mongoc-client-private.h"
+#include "mongoc-cluster-private.h"
+#include "mongoc-connection-broker.h"
+#include "mongoc-error.h"
+#include "mongoc-host-list-private.h"
+#include "mongoc-socket-private.h"
+#include "mongoc-stream-buffered.h"
+#include "mongoc-stream-private.h"
+#include "mongoc-stream-socket.h"
+#include "mongoc-thread-private.h"
+#include "mongoc-trace-private.h"
+
+
+#undef MONGOC_LOG_DOMAIN
+#define MONGOC_LOG_DOMAIN "broker"
+
+
+/* requests and replies are small BSON documents */
+#define MONGOC_BROKER_MAX_MSG_SIZE 4096
+
+/* how often the broker thread checks for shutdown and finished requests */
+#define MONGOC_BROKER_ACCEPT_TIMEOUT_MSEC 100
+
+/* the most requests served at once. more wait in the listen backlog */
+#define MONGOC_BROKER_MAX_REQUESTS 64
+
+
+/* a worker's request, served on its own thread so that a slow server or
+ * a stalled worker delays no other request */
+typedef struct _mongoc_broker_request_t {
+   struct _mongoc_connection_broker_t *broker;
+   mongoc_socket_t *conn;
+   mongoc_thread_t thread;
+   bool done;
+   struct _mongoc_broker_request_t *next;
+} mongoc_broker_request_t;
+
+
+struct _mongoc_connection_broker_t {
+   mongoc_client_pool_t *pool;
+   mongoc_socket_t *listener;
+   char *path;
+   mongoc_thread_t thread;
+   mongoc_mutex_t mutex;
+   /* signaled when a request finishes */
+   mongoc_cond_t cond;
+   bool shutdown;
+   /* requests being served, or served and not yet joined */
+   mongoc_broker_request_t *requests;
+   int n_requests;
+};
+
+
+#ifndef _WIN32
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_broker_recv_all --
+ *
+ *       Read exactly @len bytes from @sock.
+ *
+ * Returns:
+ *       true if successful, false on error, timeout, or hangup.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_mongoc_broker_recv_all (mongoc_socket_t *sock,
+                         uint8_t *buf,
+                         size_t len,
+                         int64_t expire_at)
+{
+   ssize_t r;
+
+   while (len) {
+      r = mongoc_socket_recv (sock, buf, len, 0, expire_at);
+      if (r <= 0) {
+         return false;
+      }
+
+      buf += r;
+      len -= (size_t) r;
+   }
+
+   return true;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_broker_recv_doc --
+ *
+ *       Read a BSON document from @sock into @buf, of which the first
+ *       @have bytes have already been received. @buf must be at least
+ *       MONGOC_BROKER_MAX_MSG_SIZE bytes.
+ *
+ * Returns:
+ *       true and @doc points into @buf if successful, otherwise false.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_mongoc_broker_recv_doc (mongoc_socket_t *sock,
+                         uint8_t *buf,
+                         size_t have,
+                         bson_t *doc,
+                         int64_t expire_at)
+{
+   int32_t len;
+   size_t off;
+
+   if (have < 4 &&
+       !_mongoc_broker_recv_all (sock, buf + have, 4 - have, expire_at)) {
+      return false;
+   }
+
+   memcpy (&len, buf, 4);
+   len = BSON_UINT32_FROM_LE (len);
+   if (len < 5 || len > MONGOC_BROKER_MAX_MSG_SIZE || (size_t) len < have) {
+      return false;
+   }
+
+   off = BSON_MAX (have, 4);
+   if ((size_t) len > off &&
+       !_mongoc_broker_recv_all (sock, buf + off, len - off, expire_at)) {
+      return false;
+   }
+
+   return bson_init_static (doc, buf, (size_t) len);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_broker_send_reply --
+ *
+ *       Send a reply to a worker, passing @fd with SCM_RIGHTS if it is
+ *       not -1.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_mongoc_broker_send_reply (mongoc_socket_t *sock,
+                           const bson_t *reply,
+                           int fd,
+                           int64_t expire_at)
+{
+   struct msghdr msg;
+   struct iovec iov;
+   struct cmsghdr *cmsg;
+   char control[CMSG_SPACE (sizeof (int))];
+   const uint8_t *data;
+   ssize_t sent;
+
+   data = bson_get_data (reply);
+
+   if (fd == -1) {
+      return mongoc_socket_send (sock, data, reply->len, expire_at) ==
+             (ssize_t) reply->len;
+   }
+
+   memset (&msg, 0, sizeof msg);
+   memset (control, 0, sizeof control);
+
+   iov.iov_base = (void *) data;
+   iov.iov_len = reply->len;
+   msg.msg_iov = &iov;
+   msg.msg_iovlen = 1;
+   msg.msg_control = control;
+   msg.msg_controllen = sizeof control;
+
+   cmsg = CMSG_FIRSTHDR (&msg);
+   cmsg->cmsg_level = SOL_SOCKET;
+   cmsg->cmsg_type = SCM_RIGHTS;
+   cmsg->cmsg_len = CMSG_LEN (sizeof (int));
+   memcpy (CMSG_DATA (cmsg), &fd, sizeof (int));
+
+   /* the descriptor travels with the first byte, send the rest normally */
+   sent = sendmsg (sock->sd, &msg, 0);
+   if (sent <= 0) {
+      return false;
+   }
+
+   if ((size_t) sent < reply->len) {
+      return mongoc_socket_send (sock,
+                                 data + sent,
+                                 reply->len - (size_t) sent,
+                                 expire_at) == (ssize_t) reply->len - sent;
+   }
+
+   return true;
+}
+
+
+static bool
+_mongoc_broker_send_error (mongoc_socket_t *sock,
+                           const bson_error_t *error,
+                           int64_t expire_at)
+{
+   bson_t reply;
+   bool r;
+
+   bson_init (&reply);
+   BSON_APPEND_INT32 (&reply, "ok", 0);
+   BSON_APPEND_INT32 (&reply, "domain", (int32_t) error->domain);
+   BSON_APPEND_INT32 (&reply, "code", (int32_t) error->code);
+   BSON_APPEND_UTF8 (&reply, "errmsg", error->message);
+
+   r = _mongoc_broker_send_reply (sock, &reply, -1, expire_at);
+   bson_destroy (&reply);
+
+   return r;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_broker_find_server --
+ *
+ *       Find @host in the topology of @client, one of the broker's pooled
+ *       clients, waiting for the topology to be discovered if necessary.
+ *
+ * Returns:
+ *       A server description to free with
+ *       mongoc_server_description_destroy, or NULL and @error is set.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static mongoc_server_description_t *
+_mongoc_broker_find_server (mongoc_client_t *client,
+                            const mongoc_host_list_t *host,
+                            bson_error_t *error)
+{
+   mongoc_server_description_t **sds;
+   mongoc_server_description_t *sd = NULL;
+   mongoc_read_prefs_t *prefs;
+   size_t n;
+   size_t i;
+   int attempt;
+
+   for (attempt = 0; attempt < 2 && !sd; attempt++) {
+      if (attempt) {
+         /* unknown host, or not yet checked: wait for any server to be
+          * discovered, not necessarily a primary, and try again */
+         prefs = mongoc_read_prefs_new (MONGOC_READ_NEAREST);
+         sd = mongoc_client_select_server (client, false, prefs, error);
+         mongoc_read_prefs_destroy (prefs);
+         if (!sd) {
+            return NULL;
+         }
+
+         mongoc_server_description_destroy (sd);
+         sd = NULL;
+      }
+
+      sds = mongoc_client_get_server_descriptions (client, &n);
+      for (i = 0; i < n; i++) {
+         if (sds[i]->type != MONGOC_SERVER_UNKNOWN &&
+             !strcasecmp (sds[i]->host.host_and_port, host->host_and_port)) {
+            sd = mongoc_server_description_new_copy (sds[i]);
+            break;
+         }
+      }
+
+      mongoc_server_descriptions_destroy_all (sds, n);
+   }
+
+   if (!sd) {
+      bson_set_error (error,
+                      MONGOC_ERROR_SERVER_SELECTION,
+                      MONGOC_ERROR_SERVER_SELECTION_FAILURE,
+                      "\"%s\" is not an available server in the connection"
+                      " broker's topology",
+                      host->host_and_port);
+   }
+
+   return sd;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_broker_connect --
+ *
+ *       Open and authenticate a connection to @address with @client.
+ *
+ * Returns:
+ *       A socket stream, possibly wrapped in a buffered stream, or NULL
+ *       and @error is set.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static mongoc_stream_t *
+_mongoc_broker_connect (mongoc_client_t *client,
+                        const char *address,
+                        bson_error_t *error)
+{
+   mongoc_host_list_t host;
+   mongoc_server_description_t *sd;
+   mongoc_stream_t *stream;
+
+   if (!_mongoc_host_list_from_string (&host, address)) {
+      bson_set_error (error,
+                      MONGOC_ERROR_COMMAND,
+                      MONGOC_ERROR_COMMAND_INVALID_ARG,
+                      "Invalid host string in connection broker request: "
+                      "\"%s\"",
+                      address);
+      return NULL;
+   }
+
+   sd = _mongoc_broker_find_server (client, &host, error);
+   if (!sd) {
+      return NULL;
+   }
+
+   stream = _mongoc_client_create_stream (client, &host, error);
+   if (stream &&
+       !_mongoc_cluster_auth_stream (&client->cluster, stream, sd, error)) {
+      mongoc_stream_destroy (stream);
+      stream = NULL;
+   }
+
+   mongoc_server_description_destroy (sd);
+
+   return stream;
+}
+
+
+static void
+_mongoc_broker_serve (mongoc_connection_broker_t *broker,
+                      mongoc_socket_t *conn)
+{
+   uint8_t buf[MONGOC_BROKER_MAX_MSG_SIZE];
+   int64_t expire_at;
+   bson_t request;
+   bson_t reply;
+   bson_iter_t iter;
+   bson_error_t error;
+   mongoc_client_t *client;
+   mongoc_stream_t *stream;
+   mongoc_stream_t *root;
+   mongoc_socket_t *sock;
+
+   ENTRY;
+
+   expire_at =
+      bson_get_monotonic_time () + MONGOC_DEFAULT_CONNECTTIMEOUTMS * 1000;
+
+   if (!_mongoc_broker_recv_doc (conn, buf, 0, &request, expire_at)) {
+      MONGOC_WARNING ("Invalid connection broker request");
+      EXIT;
+   }
+
+   if (!bson_iter_init_find (&iter, &request, "host") ||
+       !BSON_ITER_HOLDS_UTF8 (&iter)) {
+      bson_set_error (&error,
+                      MONGOC_ERROR_COMMAND,
+                      MONGOC_ERROR_COMMAND_INVALID_ARG,
+                      "Connection broker request has no \"host\"");
+      _mongoc_broker_send_error (conn, &error, expire_at);
+      EXIT;
+   }
+
+   client = mongoc_client_pool_pop (broker->pool);
+   stream =
+      _mongoc_broker_connect (client, bson_iter_utf8 (&iter, NULL), &error);
+   mongoc_client_pool_push (broker->pool, client);
+   if (!stream) {
+      _mongoc_broker_send_error (conn, &error, expire_at);
+      EXIT;
+   }
+
+   root = mongoc_stream_get_root_stream (stream);
+   if (root->type != MONGOC_STREAM_SOCKET ||
+       mongoc_stream_get_tls_stream (stream)) {
+      bson_set_error (&error,
+                      MONGOC_ERROR_STREAM,
+                      MONGOC_ERROR_STREAM_INVALID_TYPE,
+                      "The connection broker can only hand off plain sockets");
+      _mongoc_broker_send_error (conn, &error, expire_at);
+      mongoc_stream_destroy (stream);
+      EXIT;
+   }
+
+   sock = mongoc_stream_socket_get_socket ((mongoc_stream_socket_t *) root);
+
+   bson_init (&reply);
+   BSON_APPEND_INT32 (&reply, "ok", 1);
+   if (!_mongoc_broker_send_reply (conn, &reply, sock->sd, expire_at)) {
+      MONGOC_WARNING ("Failed to hand off connection to worker");
+   }
+   bson_destroy (&reply);
+
+   /* close our copy without shutting down the worker's connection */
+   sock->pid = 0;
+   mongoc_stream_destroy (stream);
+
+   EXIT;
+}
+
+
+static void *
+_mongoc_broker_request_run (void *data)
+{
+   mongoc_broker_request_t *request = (mongoc_broker_request_t *) data;
+   mongoc_connection_broker_t *broker = request->broker;
+
+   _mongoc_broker_serve (broker, request->conn);
+   mongoc_socket_destroy (request->conn);
+   request->conn = NULL;
+
+   mongoc_mutex_lock (&broker->mutex);
+   request->done = true;
+   mongoc_cond_signal (&broker->cond);
+   mongoc_mutex_unlock (&broker->mutex);
+
+   return NULL;
+}
+
+
+/* join the threads of finished requests, or of all of them if @all */
+static void
+_mongoc_broker_join_requests (mongoc_connection_broker_t *broker, bool all)
+{
+   mongoc_broker_request_t **link;
+   mongoc_broker_request_t *request;
+   mongoc_broker_request_t *finished = NULL;
+
+   mongoc_mutex_lock (&broker->mutex);
+   link = &broker->requests;
+   while (*link) {
+      request = *link;
+      if (all || request->done) {
+         *link = request->next;
+         request->next = finished;
+         finished = request;
+         broker->n_requests--;
+      } else {
+         link = &request->next;
+      }
+   }
+
+   mongoc_mutex_unlock (&broker->mutex);
+
+   while (finished) {
+      request = finished;
+      finished = request->next;
+      mongoc_thread_join (request->thread);
+      bson_free (request);
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_broker_peer_trusted --
+ *
+ *       Is the process at the other end of @conn running as the same user
+ *       as the broker? Any process of that user could read the broker's
+ *       credentials anyway, so it may have their connections.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_mongoc_broker_peer_trusted (mongoc_socket_t *conn)
+{
+#ifdef SO_PEERCRED
+   struct ucred cred;
+   socklen_t len = sizeof cred;
+
+   if (getsockopt (conn->sd, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0) {
+      return false;
+   }
+
+   return cred.uid == geteuid ();
+#else
+   uid_t uid;
+   gid_t gid;
+
+   if (getpeereid (conn->sd, &uid, &gid) != 0) {
+      return false;
+   }
+
+   return uid == geteuid ();
+#endif
+}
+
+
+static void *
+_mongoc_broker_run (void *data)
+{
+   mongoc_connection_broker_t *broker = (mongoc_connection_broker_t *) data;
+   mongoc_broker_request_t *request;
+   mongoc_socket_t *conn;
+   bool shutdown;
+   bool busy;
+
+   for (;;) {
+      mongoc_mutex_lock (&broker->mutex);
+      shutdown = broker->shutdown;
+      busy = broker->n_requests >= MONGOC_BROKER_MAX_REQUESTS;
+      if (busy && !shutdown) {
+         /* leave new requests in the backlog until one finishes */
+         mongoc_cond_timedwait (
+            &broker->cond, &broker->mutex, MONGOC_BROKER_ACCEPT_TIMEOUT_MSEC);
+      }
+
+      mongoc_mutex_unlock (&broker->mutex);
+
+      if (shutdown) {
+         break;
+      }
+
+      if (busy) {
+         _mongoc_broker_join_requests (broker, false);
+         continue;
+      }
+
+      conn = mongoc_socket_accept (
+         broker->listener,
+         bson_get_monotonic_time () +
+            MONGOC_BROKER_ACCEPT_TIMEOUT_MSEC * 1000);
+      if (conn && !_mongoc_broker_peer_trusted (conn)) {
+         MONGOC_WARNING ("Refused connection broker request from another user");
+         mongoc_socket_destroy (conn);
+         conn = NULL;
+      }
+
+      if (conn) {
+         request = (mongoc_broker_request_t *) bson_malloc0 (sizeof *request);
+         request->broker = broker;
+         request->conn = conn;
+
+         mongoc_mutex_lock (&broker->mutex);
+         if (mongoc_thread_create (
+                &request->thread, _mongoc_broker_request_run, request)) {
+            MONGOC_WARNING ("Could not start a connection broker thread");
+            mongoc_socket_destroy (conn);
+            bson_free (request);
+         } else {
+            request->next = broker->requests;
+            broker->requests = request;
+            broker->n_requests++;
+         }
+
+         mongoc_mutex_unlock (&broker->mutex);
+      }
+
+      _mongoc_broker_join_requests (broker, false);
+   }
+
+   /* each request times out after connectTimeoutMS */
+   _mongoc_broker_join_requests (broker, true);
+
+   return NULL;
+}
+
+#endif /* _WIN32 */
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_connection_broker_new --
+ *
+ *       Start a connection broker for the deployment in @uri, listening
+ *       on the UNIX domain socket @path. The broker opens and
+ *       authenticates connections on behalf of worker processes and
+ *       passes them the file descriptors.
+ *
+ * Returns:
+ *       A new broker, or NULL and @error is set.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+mongoc_connection_broker_t *
+mongoc_connection_broker_new (const mongoc_uri_t *uri,
+                              const char *path,
+                              bson_error_t *error)
+{
+#ifdef _WIN32
+   bson_set_error (error,
+                   MONGOC_ERROR_STREAM,
+                   MONGOC_ERROR_STREAM_SOCKET,
+                   "The connection broker is not supported on win32.");
+   return NULL;
+#else
+   mongoc_connection_broker_t *broker;
+   struct sockaddr_un saddr;
+
+   ENTRY;
+
+   BSON_ASSERT (uri);
+   BSON_ASSERT (path);
+
+   if (mongoc_uri_get_ssl (uri)) {
+      bson_set_error (error,
+                      MONGOC_ERROR_COMMAND,
+                      MONGOC_ERROR_COMMAND_INVALID_ARG,
+                      "The connection broker cannot hand off TLS connections");
+      RETURN (NULL);
+   }
+
+   if (strlen (path) >= sizeof saddr.sun_path) {
+      bson_set_error (error,
+                      MONGOC_ERROR_COMMAND,
+                      MONGOC_ERROR_COMMAND_INVALID_ARG,
+                      "Connection broker path is too long: \"%s\"",
+                      path);
+      RETURN (NULL);
+   }
+
+   broker = (mongoc_connection_broker_t *) bson_malloc0 (sizeof *broker);
+   broker->path = bson_strdup (path);
+   mongoc_mutex_init (&broker->mutex);
+   mongoc_cond_init (&broker->cond);
+
+   /* one client per request being served */
+   broker->pool = mongoc_client_pool_new (uri);
+   if (!broker->pool) {
+      bson_set_error (error,
+                      MONGOC_ERROR_COMMAND,
+                      MONGOC_ERROR_COMMAND_INVALID_ARG,
+                      "Could not create a client pool for the connection"
+                      " broker");
+      GOTO (fail);
+   }
+
+   memset (&saddr, 0, sizeof saddr);
+   saddr.sun_family = AF_UNIX;
+   bson_snprintf (saddr.sun_path, sizeof saddr.sun_path, "%s", path);
+
+   /* remove a socket file left behind by a previous broker */
+   unlink (path);
+
+   /* only the broker's user may connect. nothing is accepted before
+    * listen, so the socket file's mode is set before anyone can use it */
+   broker->listener = mongoc_socket_new (AF_UNIX, SOCK_STREAM, 0);
+   if (!broker->listener ||
+       -1 == mongoc_socket_bind (
+                broker->listener, (struct sockaddr *) &saddr, sizeof saddr) ||
+       -1 == chmod (path, S_IRUSR | S_IWUSR) ||
+       -1 == mongoc_socket_listen (broker->listener,
+                                   MONGOC_BROKER_MAX_REQUESTS)) {
+      bson_set_error (error,
+                      MONGOC_ERROR_STREAM,
+                      MONGOC_ERROR_STREAM_SOCKET,
+                      "Could not listen on \"%s\": %s",
+                      path,
+                      strerror (errno));
+      GOTO (fail);
+   }
+
+   if (mongoc_thread_create (&broker->thread, _mongoc_broker_run, broker)) {
+      bson_set_error (error,
+                      MONGOC_ERROR_STREAM,
+                      MONGOC_ERROR_STREAM_SOCKET,
+                      "Could not start the connection broker thread");
+      GOTO (fail);
+   }
+
+   RETURN (broker);
+
+fail:
+   mongoc_socket_destroy (broker->listener); /* null ok */
+   if (broker->pool) {
+      mongoc_client_pool_destroy (broker->pool);
+   }
+   mongoc_cond_destroy (&broker->cond);
+   mongoc_mutex_destroy (&broker->mutex);
+   bson_free (broker->path);
+   bson_free (broker);
+
+   RETURN (NULL);
+#endif
+}
+
+
+void
+mongoc_connection_broker_destroy (mongoc_connection_broker_t *broker)
+{
+#ifndef _WIN32
+   if (!broker) {
+      return;
+   }
+
+   mongoc_mutex_lock (&broker->mutex);
+   broker->shutdown = true;
+   mongoc_mutex_unlock (&broker->mutex);
+
+   mongoc_thread_join (broker->thread);
+
+   mongoc_socket_destroy (broker->listener);
+   unlink (broker->path);
+   mongoc_client_pool_destroy (broker->pool);
+   mongoc_cond_destroy (&broker->cond);
+   mongoc_mutex_destroy (&broker->mutex);
+   bson_free (broker->path);
+   bson_free (broker);
+#endif
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_client_broker_stream_initiator --
+ *
+ *       A mongoc_stream_initiator_t that asks the connection broker
+ *       listening on the UNIX domain socket @user_data for a connected,
+ *       authenticated socket to @host.
+ *
+ * Returns:
+ *       A mongoc_stream_t if successful; otherwise NULL and @error is set.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+mongoc_stream_t *
+mongoc_client_broker_stream_initiator (const mongoc_uri_t *uri,
+                                       const mongoc_host_list_t *host,
+                                       void *user_data,
+                                       bson_error_t *error)
+{
+#ifdef _WIN32
+   bson_set_error (error,
+                   MONGOC_ERROR_STREAM,
+                   MONGOC_ERROR_STREAM_CONNECT,
+                   "The connection broker is not supported on win32.");
+   return NULL;
+#else
+   const char *path = (const char *) user_data;
+   struct sockaddr_un saddr;
+   struct sockaddr_storage peer;
+   socklen_t peer_len = sizeof peer;
+   mongoc_socket_t *sock;
+   mongoc_socket_t *conn;
+   uint8_t buf[MONGOC_BROKER_MAX_MSG_SIZE];
+   char control[CMSG_SPACE (sizeof (int))];
+   struct msghdr msg;
+   struct iovec iov;
+   struct cmsghdr *cmsg;
+   int32_t connecttimeoutms;
+   int64_t expire_at;
+   bson_t request;
+   bson_t reply;
+   bson_iter_t iter;
+   ssize_t r;
+   bool sent_ok;
+   int fd = -1;
+
+   ENTRY;
+
+   BSON_ASSERT (uri);
+   BSON_ASSERT (host);
+   BSON_ASSERT (path);
+
+   connecttimeoutms = mongoc_uri_get_option_as_int32 (
+      uri, MONGOC_URI_CONNECTTIMEOUTMS, MONGOC_DEFAULT_CONNECTTIMEOUTMS);
+   expire_at = bson_get_monotonic_time () + connecttimeoutms * 1000L;
+
+   memset (&saddr, 0, sizeof saddr);
+   saddr.sun_family = AF_UNIX;
+   bson_snprintf (saddr.sun_path, sizeof saddr.sun_path, "%s", path);
+
+   sock = mongoc_socket_new (AF_UNIX, SOCK_STREAM, 0);
+   if (!sock) {
+      bson_set_error (error,
+                      MONGOC_ERROR_STREAM,
+                      MONGOC_ERROR_STREAM_SOCKET,
+                      "Failed to create socket.");
+      RETURN (NULL);
+   }
+
+   if (-1 == mongoc_socket_connect (
+                sock, (struct sockaddr *) &saddr, sizeof saddr, expire_at)) {
+      bson_set_error (error,
+                      MONGOC_ERROR_STREAM,
+                      MONGOC_ERROR_STREAM_CONNECT,
+                      "Failed to connect to connection broker at \"%s\"",
+                      path);
+      GOTO (done);
+   }
+
+   bson_init (&request);
+   BSON_APPEND_UTF8 (&request, "host", host->host_and_port);
+   r = mongoc_socket_send (
+      sock, bson_get_data (&request), request.len, expire_at);
+   sent_ok = (r == (ssize_t) request.len);
+   bson_destroy (&request);
+
+   /* wait until the reply is readable, then take the descriptor with it */
+   if (!sent_ok ||
+       mongoc_socket_recv (sock, buf, 1, MSG_PEEK, expire_at) != 1) {
+      GOTO (failed_io);
+   }
+
+   memset (&msg, 0, sizeof msg);
+   iov.iov_base = buf;
+   iov.iov_len = sizeof buf;
+   msg.msg_iov = &iov;
+   msg.msg_iovlen = 1;
+   msg.msg_control = control;
+   msg.msg_controllen = sizeof control;
+
+   r = recvmsg (sock->sd, &msg, 0);
+   if (r <= 0) {
+      GOTO (failed_io);
+   }
+
+   for (cmsg = CMSG_FIRSTHDR (&msg); cmsg; cmsg = CMSG_NXTHDR (&msg, cmsg)) {
+      if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+         memcpy (&fd, CMSG_DATA (cmsg), sizeof (int));
+      }
+   }
+
+   if (!_mongoc_broker_recv_doc (sock, buf, (size_t) r, &reply, expire_at)) {
+      GOTO (failed_io);
+   }
+
+   if (fd == -1) {
+      if (bson_iter_init_find (&iter, &reply, "errmsg") &&
+          BSON_ITER_HOLDS_UTF8 (&iter)) {
+         uint32_t domain = MONGOC_ERROR_STREAM;
+         uint32_t code = MONGOC_ERROR_STREAM_CONNECT;
+         bson_iter_t child;
+
+         if (bson_iter_init_find (&child, &reply, "domain")) {
+            domain = (uint32_t) bson_iter_as_int64 (&child);
+         }
+
+         if (bson_iter_init_find (&child, &reply, "code")) {
+            code = (uint32_t) bson_iter_as_int64 (&child);
+         }
+
+         bson_set_error (
+            error, domain, code, "%s", bson_iter_utf8 (&iter, NULL));
+         GOTO (done);
+      }
+
+      GOTO (failed_io);
+   }
+
+   conn = (mongoc_socket_t *) bson_malloc0 (sizeof *conn);
+   conn->sd = fd;
+   conn->pid = (int) getpid ();
+   if (0 == getsockname (fd, (struct sockaddr *) &peer, &peer_len)) {
+      conn->domain = peer.ss_family;
+   }
+
+   mongoc_socket_destroy (sock);
+
+   RETURN (mongoc_stream_buffered_new (mongoc_stream_socket_new (conn), 1024));
+
+failed_io:
+   bson_set_error (error,
+                   MONGOC_ERROR_STREAM,
+                   MONGOC_ERROR_STREAM_CONNECT,
+                   "Failed to receive a connection from connection broker at"
+                   " \"%s\"",
+                   path);
+
+done:
+   if (fd != -1) {
+      close (fd);
+   }
+
+   mongoc_socket_destroy (sock);
+
+   RETURN (NULL);
+#endif
+}
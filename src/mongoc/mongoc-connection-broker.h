@@ -0,0 +1,54 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MONGOC_CONNECTION_BROKER_H
+#define MONGOC_CONNECTION_BROKER_H
+
+#if !defined(MONGOC_INSIDE) && !defined(MONGOC_COMPILATION)
+#error "Only <mongoc.h> can be included directly."
+#endif
+
+#include <bson.h>
+
+#include "mongoc-macros.h"
+#include "mongoc-host-list.h"
+#include "mongoc-stream.h"
+#include "mongoc-uri.h"
+
+
+BSON_BEGIN_DECLS
+
+
+typedef struct _mongoc_connection_broker_t mongoc_connection_broker_t;
+
+
+MONGOC_EXPORT (mongoc_connection_broker_t *)
+mongoc_connection_broker_new (const mongoc_uri_t *uri,
+                              const char *path,
+                              bson_error_t *error);
+MONGOC_EXPORT (void)
+mongoc_connection_broker_destroy (mongoc_connection_broker_t *broker);
+MONGOC_EXPORT (mongoc_stream_t *)
+mongoc_client_broker_stream_initiator (const mongoc_uri_t *uri,
+                                       const mongoc_host_list_t *host,
+                                       void *user_data,
+                                       bson_error_t *error);
+
+
+BSON_END_DECLS
+
+
+#endif /* MONGOC_CONNECTION_BROKER_H */
@@ -150,4 +150,43 @@ mongoc_crypto_cng_sha1 (mongoc_crypto_t *crypto,
    return _mongoc_crypto_cng_hmac_or_hash (
       algorithm, NULL, 0, input, input_len, output);
 }
+
+bool
+mongoc_crypto_cng_pbkdf2_hmac_sha1 (mongoc_crypto_t *crypto,
+                                    const char *password,
+                                    size_t password_len,
+                                    const uint8_t *salt,
+                                    size_t salt_len,
+                                    uint32_t iterations,
+                                    size_t output_len,
+                                    unsigned char *output /* OUT */)
+{
+   static BCRYPT_ALG_HANDLE algorithm = 0;
+   NTSTATUS status = STATUS_UNSUCCESSFUL;
+
+   if (!algorithm) {
+      status = BCryptOpenAlgorithmProvider (
+         &algorithm, BCRYPT_SHA1_ALGORITHM, NULL, BCRYPT_ALG_HANDLE_HMAC_FLAG);
+      if (!NT_SUCCESS (status)) {
+         MONGOC_ERROR ("BCryptOpenAlgorithmProvider(): %x", status);
+         return false;
+      }
+   }
+
+   status = BCryptDeriveKeyPBKDF2 (algorithm,
+                                   (PUCHAR) password,
+                                   (ULONG) password_len,
+                                   (PUCHAR) salt,
+                                   (ULONG) salt_len,
+                                   iterations,
+                                   output,
+                                   (ULONG) output_len,
+                                   0);
+   if (!NT_SUCCESS (status)) {
+      MONGOC_ERROR ("BCryptDeriveKeyPBKDF2(): %x", status);
+      return false;
+   }
+
+   return true;
+}
 #endif
@@ -44,6 +44,16 @@ mongoc_crypto_common_crypto_sha1 (mongoc_crypto_t *crypto,
                                   const size_t input_len,
                                   unsigned char *output /* OUT */);
 
+bool
+mongoc_crypto_common_crypto_pbkdf2_hmac_sha1 (mongoc_crypto_t *crypto,
+                                              const char *password,
+                                              size_t password_len,
+                                              const uint8_t *salt,
+                                              size_t salt_len,
+                                              uint32_t iterations,
+                                              size_t output_len,
+                                              unsigned char *output /* OUT */);
+
 BSON_END_DECLS
 
 #endif /* MONGOC_CRYPTO_COMMON_CRYPTO_PRIVATE_H */
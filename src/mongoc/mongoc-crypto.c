@@ -34,12 +34,15 @@ mongoc_crypto_init (mongoc_crypto_t *crypto)
 #ifdef MONGOC_ENABLE_CRYPTO_LIBCRYPTO
    crypto->hmac_sha1 = mongoc_crypto_openssl_hmac_sha1;
    crypto->sha1 = mongoc_crypto_openssl_sha1;
+   crypto->pbkdf2_hmac_sha1 = mongoc_crypto_openssl_pbkdf2_hmac_sha1;
 #elif defined(MONGOC_ENABLE_CRYPTO_COMMON_CRYPTO)
    crypto->hmac_sha1 = mongoc_crypto_common_crypto_hmac_sha1;
    crypto->sha1 = mongoc_crypto_common_crypto_sha1;
+   crypto->pbkdf2_hmac_sha1 = mongoc_crypto_common_crypto_pbkdf2_hmac_sha1;
 #elif defined(MONGOC_ENABLE_CRYPTO_CNG)
    crypto->hmac_sha1 = mongoc_crypto_cng_hmac_sha1;
    crypto->sha1 = mongoc_crypto_cng_sha1;
+   crypto->pbkdf2_hmac_sha1 = mongoc_crypto_cng_pbkdf2_hmac_sha1;
 #endif
 }
 
@@ -62,4 +65,31 @@ mongoc_crypto_sha1 (mongoc_crypto_t *crypto,
 {
    return crypto->sha1 (crypto, input, input_len, output);
 }
+
+/* PBKDF2 with HMAC-SHA1, the Hi() function of SCRAM-SHA-1. Returns false if
+ * the crypto library has no PBKDF2 or it failed, and the caller must
+ * compute it with mongoc_crypto_hmac_sha1 */
+bool
+mongoc_crypto_pbkdf2_hmac_sha1 (mongoc_crypto_t *crypto,
+                                const char *password,
+                                size_t password_len,
+                                const uint8_t *salt,
+                                size_t salt_len,
+                                uint32_t iterations,
+                                size_t output_len,
+                                unsigned char *output /* OUT */)
+{
+   if (!crypto->pbkdf2_hmac_sha1) {
+      return false;
+   }
+
+   return crypto->pbkdf2_hmac_sha1 (crypto,
+                                    password,
+                                    password_len,
+                                    salt,
+                                    salt_len,
+                                    iterations,
+                                    output_len,
+                                    output);
+}
 #endif
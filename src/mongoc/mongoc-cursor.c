@@ -1317,6 +1317,12 @@ _mongoc_cursor_run_command (mongoc_cursor_t *cursor,
    parts.read_prefs = cursor->read_prefs;
    parts.session = cursor->session;
    parts.assembled.operation_id = cursor->operation_id;
+   if (!cursor->server_id) {
+      /* the first read of a cursor that isn't pinned to a server may be
+       * repeated on another one */
+      parts.assembled.hedge_read_prefs = cursor->read_prefs;
+   }
+
    server_stream = _mongoc_cursor_fetch_stream (cursor);
 
    if (!server_stream) {
@@ -1354,6 +1360,9 @@ _mongoc_cursor_run_command (mongoc_cursor_t *cursor,
    ret = mongoc_cluster_run_command_monitored (
       cluster, &parts.assembled, reply, &cursor->error);
 
+   /* if the read was hedged, the server that answered owns the cursor */
+   cursor->server_id = server_stream->sd->id;
+
    /* Read and Write Concern Spec: "Drivers SHOULD parse server replies for a
     * "writeConcernError" field and report the error only in command-specific
     * helper methods that take a separate write concern parameter or an options
@@ -157,6 +157,10 @@ _get_config_bitfield (void)
    bf |= MONGOC_MD_FLAG_ENABLE_DNSAPI;
 #endif
 
+#ifdef MONGOC_ENABLE_COMPRESSION_ZSTD
+   bf |= MONGOC_MD_FLAG_ENABLE_COMPRESSION_ZSTD;
+#endif
+
    return bf;
 }
 
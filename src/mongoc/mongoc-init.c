@@ -18,10 +18,13 @@
 #include <bson.h>
 
 #include "mongoc-config.h"
+#include "mongoc-client-private.h"
 #include "mongoc-counters-private.h"
 #include "mongoc-init.h"
 
 #include "mongoc-handshake-private.h"
+#include "mongoc-shared-monitor-private.h"
+#include "mongoc-worker-pool-private.h"
 
 #ifdef MONGOC_ENABLE_SSL
 #include "mongoc-scram-private.h"
@@ -101,7 +104,7 @@ static MONGOC_ONCE_FUN (_mongoc_do_init)
    tls_init ();
 #endif
 
-#ifdef MONGOC_ENABLE_SSL
+#ifdef MONGOC_ENABLE_CRYPTO
    _mongoc_scram_startup ();
 #endif
 
@@ -136,6 +139,9 @@ static MONGOC_ONCE_FUN (_mongoc_do_init)
 #endif
 
    _mongoc_handshake_init ();
+   _mongoc_client_local_host_cache_init ();
+   _mongoc_shared_monitor_init ();
+   _mongoc_worker_pool_init ();
 
    MONGOC_ONCE_RETURN;
 }
@@ -153,6 +159,10 @@ static MONGOC_ONCE_FUN (_mongoc_do_cleanup)
    _mongoc_openssl_cleanup ();
 #endif
 
+#ifdef MONGOC_ENABLE_CRYPTO
+   _mongoc_scram_cleanup ();
+#endif
+
 #ifdef MONGOC_ENABLE_SASL_CYRUS
 #ifdef MONGOC_HAVE_SASL_CLIENT_DONE
    sasl_client_done ();
@@ -169,6 +179,9 @@ static MONGOC_ONCE_FUN (_mongoc_do_cleanup)
    _mongoc_counters_cleanup ();
 
    _mongoc_handshake_cleanup ();
+   _mongoc_client_local_host_cache_cleanup ();
+   _mongoc_shared_monitor_cleanup ();
+   _mongoc_worker_pool_cleanup ();
 
    MONGOC_ONCE_RETURN;
 }
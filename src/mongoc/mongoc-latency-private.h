@@ -0,0 +1,88 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MONGOC_LATENCY_PRIVATE_H
+#define MONGOC_LATENCY_PRIVATE_H
+
+#if !defined(MONGOC_COMPILATION)
+#error "Only <mongoc.h> can be included directly."
+#endif
+
+#include <bson.h>
+
+#include "mongoc-server-description.h"
+
+
+BSON_BEGIN_DECLS
+
+
+#define MONGOC_LATENCY_CLASSES 3
+/* two buckets per power of two microseconds, up to 2^24 usec (16 s) */
+#define MONGOC_LATENCY_BUCKETS 48
+#define MONGOC_LATENCY_PERCENTILE 90
+/* estimate nothing from fewer samples */
+#define MONGOC_LATENCY_MIN_SAMPLES 16
+/* recompute the estimate after this many samples, a power of two */
+#define MONGOC_LATENCY_UPDATE_SAMPLES 16
+/* halve the counts after this many samples, a power of two, so the
+ * estimate follows changes in a server's latency */
+#define MONGOC_LATENCY_DECAY_SAMPLES 512
+
+/* a histogram of one server's operation latencies per command class.
+ * threads record samples concurrently with atomic adds; the estimate is
+ * approximate while they do. */
+typedef struct _mongoc_latency_estimator_t {
+   uint32_t server_id;
+   /* nonzero while a thread resets the estimator for another server */
+   int32_t claiming;
+   int32_t samples[MONGOC_LATENCY_CLASSES];
+   int32_t counts[MONGOC_LATENCY_CLASSES][MONGOC_LATENCY_BUCKETS];
+   int64_t estimate_usec[MONGOC_LATENCY_CLASSES];
+   /* monotonic time of the latest sample */
+   int64_t last_sample_usec[MONGOC_LATENCY_CLASSES];
+} mongoc_latency_estimator_t;
+
+
+void
+_mongoc_latency_estimator_init (mongoc_latency_estimator_t *estimator,
+                                uint32_t server_id);
+
+bool
+_mongoc_latency_estimator_record (mongoc_latency_estimator_t *estimator,
+                                  uint32_t server_id,
+                                  mongoc_latency_class_t latency_class,
+                                  int64_t usec,
+                                  int64_t *estimate_usec);
+
+bool
+_mongoc_latency_estimator_expire (mongoc_latency_estimator_t *estimator,
+                                  mongoc_latency_class_t latency_class,
+                                  int64_t max_age_usec);
+
+int64_t
+_mongoc_latency_estimator_percentile (
+   const mongoc_latency_estimator_t *estimator,
+   mongoc_latency_class_t latency_class,
+   int percentile);
+
+mongoc_latency_class_t
+_mongoc_latency_class (const char *command_name);
+
+
+BSON_END_DECLS
+
+
+#endif /* MONGOC_LATENCY_PRIVATE_H */
@@ -0,0 +1,300 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <string.h>
+
+#include "mongoc-latency-private.h"
+#include "mongoc-trace-private.h"
+
+
+#undef MONGOC_LOG_DOMAIN
+#define MONGOC_LOG_DOMAIN "latency"
+
+
+void
+_mongoc_latency_estimator_init (mongoc_latency_estimator_t *estimator,
+                                uint32_t server_id)
+{
+   int i;
+
+   BSON_ASSERT (estimator);
+
+   memset (estimator, 0, sizeof *estimator);
+   estimator->server_id = server_id;
+   for (i = 0; i < MONGOC_LATENCY_CLASSES; i++) {
+      estimator->estimate_usec[i] = -1;
+   }
+}
+
+
+/* bucket 2k holds [2^k, 1.5 * 2^k) usec, bucket 2k + 1 [1.5 * 2^k, 2^(k+1)) */
+static int
+_mongoc_latency_bucket (int64_t usec)
+{
+   int64_t v;
+   int log2 = 0;
+   int bucket;
+
+   if (usec < 1) {
+      return 0;
+   }
+
+   for (v = usec; v > 1; v >>= 1) {
+      log2++;
+   }
+
+   bucket = 2 * log2;
+   if (log2 > 0 && ((usec >> (log2 - 1)) & 1)) {
+      bucket++;
+   }
+
+   return BSON_MIN (bucket, MONGOC_LATENCY_BUCKETS - 1);
+}
+
+
+/* the middle of a bucket's range */
+static int64_t
+_mongoc_latency_bucket_usec (int bucket)
+{
+   int64_t base = (int64_t) 1 << (bucket / 2);
+
+   return base + (bucket % 2 ? 3 * base / 4 : base / 4);
+}
+
+
+/* forget the samples of @latency_class. threads may be recording samples
+ * while we do, so counts are cleared with atomic adds; a sample added
+ * meanwhile is kept, and counted toward the next estimate */
+static void
+_mongoc_latency_estimator_clear (mongoc_latency_estimator_t *estimator,
+                                 mongoc_latency_class_t latency_class)
+{
+   int32_t *counts = estimator->counts[latency_class];
+   int i;
+
+   for (i = 0; i < MONGOC_LATENCY_BUCKETS; i++) {
+      bson_atomic_int_add (&counts[i], -counts[i]);
+   }
+
+   bson_atomic_int_add (&estimator->samples[latency_class],
+                        -estimator->samples[latency_class]);
+   estimator->estimate_usec[latency_class] = -1;
+}
+
+
+/* reset @estimator, which belonged to another server, for @server_id.
+ * returns false if another thread is resetting it, and then the caller
+ * drops its sample */
+static bool
+_mongoc_latency_estimator_claim (mongoc_latency_estimator_t *estimator,
+                                 uint32_t server_id)
+{
+   int i;
+
+   /* the thread that takes "claiming" from 0 to 1 owns the reset */
+   if (bson_atomic_int_add (&estimator->claiming, 1) != 1) {
+      bson_atomic_int_add (&estimator->claiming, -1);
+      return false;
+   }
+
+   if (estimator->server_id != server_id) {
+      for (i = 0; i < MONGOC_LATENCY_CLASSES; i++) {
+         _mongoc_latency_estimator_clear (estimator,
+                                          (mongoc_latency_class_t) i);
+         estimator->last_sample_usec[i] = 0;
+      }
+
+      /* threads that see the new owner see the cleared counts */
+      bson_memory_barrier ();
+      estimator->server_id = server_id;
+   }
+
+   bson_atomic_int_add (&estimator->claiming, -1);
+
+   return true;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_latency_estimator_record --
+ *
+ *       Count an operation of @latency_class that took @usec on the
+ *       server. If @estimator belonged to another server, it is reset
+ *       first; if another thread is resetting it, the sample is dropped.
+ *       Every MONGOC_LATENCY_UPDATE_SAMPLES samples, recompute the
+ *       percentile estimate.
+ *
+ * Returns:
+ *       True if the estimate changed, and then it is in @estimate_usec.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+_mongoc_latency_estimator_record (mongoc_latency_estimator_t *estimator,
+                                  uint32_t server_id,
+                                  mongoc_latency_class_t latency_class,
+                                  int64_t usec,
+                                  int64_t *estimate_usec)
+{
+   int32_t *counts;
+   uint32_t n;
+   int64_t estimate;
+   int i;
+
+   BSON_ASSERT (estimator);
+   BSON_ASSERT (latency_class < MONGOC_LATENCY_CLASSES);
+
+   if (estimator->server_id != server_id &&
+       !_mongoc_latency_estimator_claim (estimator, server_id)) {
+      return false;
+   }
+
+   estimator->last_sample_usec[latency_class] = bson_get_monotonic_time ();
+   counts = estimator->counts[latency_class];
+   bson_atomic_int_add (&counts[_mongoc_latency_bucket (usec)], 1);
+   n = (uint32_t) bson_atomic_int_add (&estimator->samples[latency_class], 1);
+
+   if (n % MONGOC_LATENCY_DECAY_SAMPLES == 0) {
+      for (i = 0; i < MONGOC_LATENCY_BUCKETS; i++) {
+         bson_atomic_int_add (&counts[i], -(counts[i] - counts[i] / 2));
+      }
+   }
+
+   if (n % MONGOC_LATENCY_UPDATE_SAMPLES != 0) {
+      return false;
+   }
+
+   estimate = _mongoc_latency_estimator_percentile (
+      estimator, latency_class, MONGOC_LATENCY_PERCENTILE);
+
+   if (estimate == estimator->estimate_usec[latency_class]) {
+      return false;
+   }
+
+   estimator->estimate_usec[latency_class] = estimate;
+   *estimate_usec = estimate;
+
+   return true;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_latency_estimator_expire --
+ *
+ *       Forget the samples of @latency_class if there are none newer than
+ *       @max_age_usec. A server whose estimate kept it out of the latency
+ *       window gets no samples to improve it, so its estimate must expire
+ *       for the server to be tried again.
+ *
+ * Returns:
+ *       True if there was an estimate and it expired.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+_mongoc_latency_estimator_expire (mongoc_latency_estimator_t *estimator,
+                                  mongoc_latency_class_t latency_class,
+                                  int64_t max_age_usec)
+{
+   BSON_ASSERT (estimator);
+   BSON_ASSERT (latency_class < MONGOC_LATENCY_CLASSES);
+
+   if (estimator->estimate_usec[latency_class] == -1 ||
+       bson_get_monotonic_time () -
+             estimator->last_sample_usec[latency_class] <=
+          max_age_usec) {
+      return false;
+   }
+
+   /* _mongoc_latency_estimator_record runs without the topology mutex, a
+    * thread may record a sample of this class while we clear it */
+   _mongoc_latency_estimator_clear (estimator, latency_class);
+
+   return true;
+}
+
+
+/* the @percentile latency of @latency_class, or -1 if too few samples */
+int64_t
+_mongoc_latency_estimator_percentile (
+   const mongoc_latency_estimator_t *estimator,
+   mongoc_latency_class_t latency_class,
+   int percentile)
+{
+   const int32_t *counts;
+   int64_t total = 0;
+   int64_t target;
+   int64_t seen = 0;
+   int i;
+
+   BSON_ASSERT (estimator);
+   BSON_ASSERT (latency_class < MONGOC_LATENCY_CLASSES);
+
+   counts = estimator->counts[latency_class];
+   for (i = 0; i < MONGOC_LATENCY_BUCKETS; i++) {
+      total += counts[i];
+   }
+
+   if (total < MONGOC_LATENCY_MIN_SAMPLES) {
+      return -1;
+   }
+
+   target = (total * percentile + 99) / 100;
+   for (i = 0; i < MONGOC_LATENCY_BUCKETS - 1; i++) {
+      seen += counts[i];
+      if (seen >= target) {
+         break;
+      }
+   }
+
+   return _mongoc_latency_bucket_usec (i);
+}
+
+
+mongoc_latency_class_t
+_mongoc_latency_class (const char *command_name)
+{
+   static const char *reads[] = {
+      "find", "getMore", "aggregate", "count", "distinct", "geoNear", NULL};
+   static const char *writes[] = {
+      "insert", "update", "delete", "findAndModify", NULL};
+   int i;
+
+   if (!command_name) {
+      return MONGOC_LATENCY_COMMAND;
+   }
+
+   for (i = 0; reads[i]; i++) {
+      if (!strcmp (command_name, reads[i])) {
+         return MONGOC_LATENCY_READ;
+      }
+   }
+
+   for (i = 0; writes[i]; i++) {
+      if (!strcmp (command_name, writes[i])) {
+         return MONGOC_LATENCY_WRITE;
+      }
+   }
+
+   return MONGOC_LATENCY_COMMAND;
+}
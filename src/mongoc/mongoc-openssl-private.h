@@ -32,18 +32,29 @@
 BSON_BEGIN_DECLS
 
 
+/* servers per cached client context whose last session is kept */
+#define MONGOC_OPENSSL_SESSION_CACHE_SIZE 64
+
 bool
 _mongoc_openssl_check_cert (SSL *ssl,
                             const char *host,
                             bool allow_invalid_hostname);
 SSL_CTX *
 _mongoc_openssl_ctx_new (mongoc_ssl_opt_t *opt);
+SSL_CTX *
+_mongoc_openssl_ctx_get (mongoc_ssl_opt_t *opt, bool client);
+void
+_mongoc_openssl_ctx_cache_clear (void);
+void
+_mongoc_openssl_session_set (SSL *ssl, const char *key);
 char *
 _mongoc_openssl_extract_subject (const char *filename, const char *passphrase);
 void
 _mongoc_openssl_init (void);
 void
 _mongoc_openssl_cleanup (void);
+void
+_mongoc_openssl_reset_after_fork (void);
 
 
 BSON_END_DECLS
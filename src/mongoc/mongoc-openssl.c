@@ -27,11 +27,16 @@
 #include <openssl/crypto.h>
 
 #include <string.h>
+#include <time.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
 
 #include "mongoc-init.h"
 #include "mongoc-socket.h"
 #include "mongoc-ssl.h"
 #include "mongoc-openssl-private.h"
+#include "mongoc-ssl-private.h"
 #include "mongoc-trace-private.h"
 #include "mongoc-thread-private.h"
 #include "mongoc-util-private.h"
@@ -52,6 +57,34 @@ _mongoc_openssl_thread_cleanup (void);
 #define ASN1_STRING_get0_data ASN1_STRING_data
 #endif
 
+/* the most recent session offered by each server, for resuming handshakes.
+ * members of a replica set may share a host, so servers are identified by
+ * "host:port" */
+typedef struct _mongoc_openssl_session_t {
+   char *key;
+   SSL_SESSION *session;
+   struct _mongoc_openssl_session_t *next;
+} mongoc_openssl_session_t;
+
+/* SSL_CTX objects, shared by every stream with the same options */
+typedef struct _mongoc_openssl_ctx_entry_t {
+   mongoc_ssl_opt_t opt;
+   bool client;
+   SSL_CTX *ctx;
+   /* most recently used first */
+   mongoc_openssl_session_t *sessions;
+   int n_sessions;
+   struct _mongoc_openssl_ctx_entry_t *next;
+} mongoc_openssl_ctx_entry_t;
+
+static mongoc_mutex_t gMongocOpenSslCtxMutex;
+static mongoc_openssl_ctx_entry_t *gMongocOpenSslCtxCache;
+/* SSL ex_data index of the session key, set by _mongoc_openssl_session_set */
+static int gMongocOpenSslSessionKeyIndex = -1;
+#ifndef _WIN32
+static int gMongocOpenSslPid;
+#endif
+
 /**
  * _mongoc_openssl_init:
  *
@@ -72,6 +105,13 @@ _mongoc_openssl_init (void)
 #if OPENSSL_VERSION_NUMBER < 0x10100000L
    _mongoc_openssl_thread_startup ();
 #endif
+   mongoc_mutex_init (&gMongocOpenSslCtxMutex);
+   gMongocOpenSslCtxCache = NULL;
+   gMongocOpenSslSessionKeyIndex =
+      SSL_get_ex_new_index (0, NULL, NULL, NULL, NULL);
+#ifndef _WIN32
+   gMongocOpenSslPid = (int) getpid ();
+#endif
 
    ctx = SSL_CTX_new (SSLv23_method ());
    if (!ctx) {
@@ -84,11 +124,34 @@ _mongoc_openssl_init (void)
 void
 _mongoc_openssl_cleanup (void)
 {
+   _mongoc_openssl_ctx_cache_clear ();
+   mongoc_mutex_destroy (&gMongocOpenSslCtxMutex);
+
 #if OPENSSL_VERSION_NUMBER < 0x10100000L
    _mongoc_openssl_thread_cleanup ();
 #endif
 }
 
+/**
+ * _mongoc_openssl_reset_after_fork:
+ *
+ * In a child process after fork(), reinitialize the context cache's mutex,
+ * which a parent thread may have held. The cached contexts and sessions
+ * remain usable. Called by mongoc_client_pool_reset_after_fork.
+ */
+void
+_mongoc_openssl_reset_after_fork (void)
+{
+#ifndef _WIN32
+   if (gMongocOpenSslPid == (int) getpid ()) {
+      return;
+   }
+
+   gMongocOpenSslPid = (int) getpid ();
+   mongoc_mutex_init (&gMongocOpenSslCtxMutex);
+#endif
+}
+
 static int
 _mongoc_openssl_password_cb (char *buf, int num, int rwflag, void *user_data)
 {
@@ -544,6 +607,347 @@ _mongoc_openssl_ctx_new (mongoc_ssl_opt_t *opt)
 }
 
 
+static void
+_mongoc_openssl_ctx_up_ref (SSL_CTX *ctx)
+{
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L && !defined(LIBRESSL_VERSION_NUMBER)
+   SSL_CTX_up_ref (ctx);
+#else
+   CRYPTO_add (&ctx->references, 1, CRYPTO_LOCK_SSL_CTX);
+#endif
+}
+
+
+static bool
+_mongoc_openssl_str_equal (const char *a, const char *b)
+{
+   if (!a || !b) {
+      return a == b;
+   }
+
+   return !strcmp (a, b);
+}
+
+
+/* options that change how the SSL_CTX is built; allow_invalid_hostname is
+ * applied to each SSL object instead */
+static bool
+_mongoc_openssl_ctx_opts_equal (const mongoc_ssl_opt_t *a,
+                                const mongoc_ssl_opt_t *b)
+{
+   return _mongoc_openssl_str_equal (a->pem_file, b->pem_file) &&
+          _mongoc_openssl_str_equal (a->pem_pwd, b->pem_pwd) &&
+          _mongoc_openssl_str_equal (a->ca_file, b->ca_file) &&
+          _mongoc_openssl_str_equal (a->ca_dir, b->ca_dir) &&
+          _mongoc_openssl_str_equal (a->crl_file, b->crl_file) &&
+          a->weak_cert_validation == b->weak_cert_validation;
+}
+
+
+static SSL_CTX *
+_mongoc_openssl_ctx_cache_find (const mongoc_ssl_opt_t *opt, bool client)
+{
+   mongoc_openssl_ctx_entry_t *entry;
+
+   for (entry = gMongocOpenSslCtxCache; entry; entry = entry->next) {
+      if (entry->client == client &&
+          _mongoc_openssl_ctx_opts_equal (&entry->opt, opt)) {
+         _mongoc_openssl_ctx_up_ref (entry->ctx);
+         return entry->ctx;
+      }
+   }
+
+   return NULL;
+}
+
+
+/* the entry for @ctx, called with gMongocOpenSslCtxMutex held */
+static mongoc_openssl_ctx_entry_t *
+_mongoc_openssl_ctx_entry_find (const SSL_CTX *ctx)
+{
+   mongoc_openssl_ctx_entry_t *entry;
+
+   for (entry = gMongocOpenSslCtxCache; entry; entry = entry->next) {
+      if (entry->ctx == ctx) {
+         return entry;
+      }
+   }
+
+   return NULL;
+}
+
+
+static void
+_mongoc_openssl_session_destroy (mongoc_openssl_session_t *session)
+{
+   SSL_SESSION_free (session->session);
+   bson_free (session->key);
+   bson_free (session);
+}
+
+
+static void
+_mongoc_openssl_sessions_destroy (mongoc_openssl_ctx_entry_t *entry)
+{
+   mongoc_openssl_session_t *session, *next;
+
+   for (session = entry->sessions; session; session = next) {
+      next = session->next;
+      _mongoc_openssl_session_destroy (session);
+   }
+
+   entry->sessions = NULL;
+   entry->n_sessions = 0;
+}
+
+
+/* unlink the session for @key and return it, or NULL */
+static mongoc_openssl_session_t *
+_mongoc_openssl_session_remove (mongoc_openssl_ctx_entry_t *entry,
+                                const char *key)
+{
+   mongoc_openssl_session_t **link;
+   mongoc_openssl_session_t *session;
+
+   for (link = &entry->sessions; *link; link = &(*link)->next) {
+      session = *link;
+      if (!strcasecmp (session->key, key)) {
+         *link = session->next;
+         session->next = NULL;
+         entry->n_sessions--;
+         return session;
+      }
+   }
+
+   return NULL;
+}
+
+
+/* called by OpenSSL when a server issues a session or session ticket. it
+ * is kept under the key that _mongoc_openssl_session_set stored on @ssl,
+ * streams without a key don't keep sessions */
+static int
+_mongoc_openssl_new_session_cb (SSL *ssl, SSL_SESSION *ssl_session)
+{
+   mongoc_openssl_ctx_entry_t *entry;
+   mongoc_openssl_session_t *session;
+   mongoc_openssl_session_t *last;
+   const char *key;
+   int ret = 0;
+
+   key = (const char *) SSL_get_ex_data (ssl, gMongocOpenSslSessionKeyIndex);
+   if (!key) {
+      return 0;
+   }
+
+   mongoc_mutex_lock (&gMongocOpenSslCtxMutex);
+   entry = _mongoc_openssl_ctx_entry_find (SSL_get_SSL_CTX (ssl));
+   if (entry) {
+      session = _mongoc_openssl_session_remove (entry, key);
+      if (session) {
+         SSL_SESSION_free (session->session);
+      } else {
+         session = (mongoc_openssl_session_t *) bson_malloc0 (sizeof *session);
+         session->key = bson_strdup (key);
+      }
+
+      /* take ownership of the caller's reference */
+      session->session = ssl_session;
+      session->next = entry->sessions;
+      entry->sessions = session;
+      entry->n_sessions++;
+      ret = 1;
+
+      if (entry->n_sessions > MONGOC_OPENSSL_SESSION_CACHE_SIZE) {
+         for (last = entry->sessions; last->next->next; last = last->next) {
+         }
+
+         _mongoc_openssl_session_destroy (last->next);
+         last->next = NULL;
+         entry->n_sessions--;
+      }
+   }
+   mongoc_mutex_unlock (&gMongocOpenSslCtxMutex);
+
+   return ret;
+}
+
+
+/**
+ * _mongoc_openssl_session_set:
+ *
+ * Offer the last session issued by the server at @key, its "host:port",
+ * on @ssl, so the handshake can resume it instead of running a full
+ * handshake, and keep the sessions the server issues on @ssl under @key,
+ * which must outlive @ssl. Expired sessions are dropped. Does nothing if
+ * @ssl does not use a cached client context.
+ */
+void
+_mongoc_openssl_session_set (SSL *ssl, const char *key)
+{
+   mongoc_openssl_ctx_entry_t *entry;
+   mongoc_openssl_session_t *session = NULL;
+
+   SSL_set_ex_data (ssl, gMongocOpenSslSessionKeyIndex, (void *) key);
+
+   mongoc_mutex_lock (&gMongocOpenSslCtxMutex);
+   entry = _mongoc_openssl_ctx_entry_find (SSL_get_SSL_CTX (ssl));
+   if (entry && entry->client) {
+      session = _mongoc_openssl_session_remove (entry, key);
+   }
+
+   if (session) {
+      if (SSL_SESSION_get_time (session->session) +
+             SSL_SESSION_get_timeout (session->session) <=
+          (long) time (NULL)) {
+         _mongoc_openssl_session_destroy (session);
+      } else {
+         /* SSL_set_session takes its own reference */
+         SSL_set_session (ssl, session->session);
+         session->next = entry->sessions;
+         entry->sessions = session;
+         entry->n_sessions++;
+      }
+   }
+   mongoc_mutex_unlock (&gMongocOpenSslCtxMutex);
+}
+
+
+static int
+_mongoc_openssl_sni_cb (SSL *ssl, int *ad, void *arg)
+{
+   const char *hostname;
+
+   if (ssl == NULL) {
+      TRACE ("%s", "No SNI hostname provided");
+      return SSL_TLSEXT_ERR_NOACK;
+   }
+
+   hostname = SSL_get_servername (ssl, TLSEXT_NAMETYPE_host_name);
+   /* This is intentionally debug since its only used by the mock test server */
+   MONGOC_DEBUG ("Got SNI: '%s'", hostname);
+
+   return SSL_TLSEXT_ERR_OK;
+}
+
+
+/* configure a new context, before it is shared */
+static void
+_mongoc_openssl_ctx_setup (SSL_CTX *ctx,
+                           const mongoc_ssl_opt_t *opt,
+                           bool client)
+{
+   if (opt->weak_cert_validation) {
+      SSL_CTX_set_verify (ctx, SSL_VERIFY_NONE, NULL);
+   } else {
+      SSL_CTX_set_verify (ctx, SSL_VERIFY_PEER, NULL);
+   }
+
+   if (client) {
+      /* sessions are kept per host in the cache entry */
+      SSL_CTX_set_session_cache_mode (
+         ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+      SSL_CTX_sess_set_new_cb (ctx, _mongoc_openssl_new_session_cb);
+   } else {
+      /* Only used by the Mock Server.
+       * Set a callback to get the SNI, if provided. A session id context
+       * is required to resume sessions when client certificates are
+       * verified */
+      SSL_CTX_set_tlsext_servername_callback (ctx, _mongoc_openssl_sni_cb);
+      SSL_CTX_set_session_id_context (
+         ctx, (const unsigned char *) "mongoc", 6);
+   }
+}
+
+
+/**
+ * _mongoc_openssl_ctx_get:
+ *
+ * Return a context for @opt, with a reference the caller releases with
+ * SSL_CTX_free. Contexts are cached, so the CA file, certificate and
+ * private key are read from disk once per set of options, until
+ * _mongoc_openssl_ctx_cache_clear is called. Cached contexts are shared
+ * between threads and must not be modified.
+ */
+SSL_CTX *
+_mongoc_openssl_ctx_get (mongoc_ssl_opt_t *opt, bool client)
+{
+   mongoc_openssl_ctx_entry_t *entry;
+   SSL_CTX *ctx;
+
+   mongoc_mutex_lock (&gMongocOpenSslCtxMutex);
+   ctx = _mongoc_openssl_ctx_cache_find (opt, client);
+   mongoc_mutex_unlock (&gMongocOpenSslCtxMutex);
+
+   if (ctx) {
+      return ctx;
+   }
+
+   /* load files without holding the lock, the entry owns a copy of the
+    * options so pem_pwd outlives the context */
+   entry = (mongoc_openssl_ctx_entry_t *) bson_malloc0 (sizeof *entry);
+   _mongoc_ssl_opts_copy_to (opt, &entry->opt);
+   entry->client = client;
+   entry->ctx = _mongoc_openssl_ctx_new (&entry->opt);
+
+   if (!entry->ctx) {
+      _mongoc_ssl_opts_cleanup (&entry->opt);
+      bson_free (entry);
+      return NULL;
+   }
+
+   _mongoc_openssl_ctx_setup (entry->ctx, opt, client);
+
+   mongoc_mutex_lock (&gMongocOpenSslCtxMutex);
+   /* another thread may have added the same options meanwhile */
+   ctx = _mongoc_openssl_ctx_cache_find (opt, client);
+   if (!ctx) {
+      entry->next = gMongocOpenSslCtxCache;
+      gMongocOpenSslCtxCache = entry;
+      _mongoc_openssl_ctx_up_ref (entry->ctx);
+      ctx = entry->ctx;
+      entry = NULL;
+   }
+   mongoc_mutex_unlock (&gMongocOpenSslCtxMutex);
+
+   if (entry) {
+      SSL_CTX_free (entry->ctx);
+      _mongoc_ssl_opts_cleanup (&entry->opt);
+      bson_free (entry);
+   }
+
+   return ctx;
+}
+
+
+/**
+ * _mongoc_openssl_ctx_cache_clear:
+ *
+ * Drop the cached contexts and sessions, so the next connections read the
+ * CA file, certificate, private key and CRL from disk again and run full
+ * handshakes. Streams keep their references to the contexts they were
+ * created with.
+ */
+void
+_mongoc_openssl_ctx_cache_clear (void)
+{
+   mongoc_openssl_ctx_entry_t *entry, *next;
+
+   mongoc_mutex_lock (&gMongocOpenSslCtxMutex);
+   entry = gMongocOpenSslCtxCache;
+   gMongocOpenSslCtxCache = NULL;
+   mongoc_mutex_unlock (&gMongocOpenSslCtxMutex);
+
+   for (; entry; entry = next) {
+      next = entry->next;
+      _mongoc_openssl_sessions_destroy (entry);
+      SSL_CTX_free (entry->ctx);
+      _mongoc_ssl_opts_cleanup (&entry->opt);
+      bson_free (entry);
+   }
+}
+
+
 char *
 _mongoc_openssl_extract_subject (const char *filename, const char *passphrase)
 {
@@ -167,9 +167,10 @@ _mongoc_cmd_check_ok (const bson_t *doc,
 bool
 _mongoc_rpc_decompress (mongoc_rpc_t *rpc_le, uint8_t *buf, size_t buflen);
 
-char *
+bool
 _mongoc_rpc_compress (struct _mongoc_cluster_t *cluster,
                       int32_t compressor_id,
+                      int32_t level,
                       mongoc_rpc_t *rpc_le,
                       bson_error_t *error);
 
@@ -824,87 +824,79 @@ _mongoc_rpc_decompress (mongoc_rpc_t *rpc_le, uint8_t *buf, size_t buflen)
  * _mongoc_rpc_compress --
  *
  *       Takes a (little endian) rpc struct and creates a OP_COMPRESSED
- *       compressed opcode based on the provided compressor_id.
+ *       compressed opcode based on the provided compressor_id and level.
  *       The in-place updated rpc struct remains little endian.
  *
+ *       The message is compressed straight from the cluster's iovec into
+ *       the cluster's compression scratch buffer, which the rpc points
+ *       into until the next message is compressed.
+ *
  * Side effects:
- *       Overwrites the RPC, and clears and overwrites the cluster buffer
+ *       Overwrites the RPC, and clears and overwrites the cluster iovec
  *       with the compressed results.
  *
  *--------------------------------------------------------------------------
  */
 
-char *
+bool
 _mongoc_rpc_compress (struct _mongoc_cluster_t *cluster,
                       int32_t compressor_id,
+                      int32_t level,
                       mongoc_rpc_t *rpc_le,
                       bson_error_t *error)
 {
-   char *output;
-   size_t output_length = 0;
-   size_t allocate = BSON_UINT32_FROM_LE (rpc_le->header.msg_len) - 16;
-   char *data;
-   int size;
-   int32_t compression_level = -1;
-
-   if (compressor_id == MONGOC_COMPRESSOR_ZLIB_ID) {
-      compression_level = mongoc_uri_get_option_as_int32 (
-         cluster->uri, MONGOC_URI_ZLIBCOMPRESSIONLEVEL, -1);
-   }
+   mongoc_compression_scratch_t *scratch = &cluster->compression_scratch;
+   size_t uncompressed_size = BSON_UINT32_FROM_LE (rpc_le->header.msg_len) - 16;
+   size_t compressed_len;
 
-   BSON_ASSERT (allocate > 0);
-   data = bson_malloc0 (allocate);
-   size = _mongoc_cluster_buffer_iovec (
-      cluster->iov.data, cluster->iov.len, 16, data);
-   BSON_ASSERT (size);
+   BSON_ASSERT (uncompressed_size > 0);
 
-   output_length =
-      mongoc_compressor_max_compressed_length (compressor_id, size);
-   if (!output_length) {
+   if (!mongoc_compressor_max_compressed_length (compressor_id,
+                                                 uncompressed_size)) {
       bson_set_error (error,
                       MONGOC_ERROR_COMMAND,
                       MONGOC_ERROR_COMMAND_INVALID_ARG,
                       "Could not determine compression bounds for %s",
                       mongoc_compressor_id_to_name (compressor_id));
-      bson_free (data);
-      return NULL;
+      return false;
    }
 
-   output = (char *) bson_malloc0 (output_length);
-   if (mongoc_compress (compressor_id,
-                        compression_level,
-                        data,
-                        size,
-                        output,
-                        &output_length)) {
-      rpc_le->header.msg_len = 0;
-      rpc_le->compressed.original_opcode =
-         BSON_UINT32_FROM_LE (rpc_le->header.opcode);
-      rpc_le->header.opcode = MONGOC_OPCODE_COMPRESSED;
-      rpc_le->header.request_id =
-         BSON_UINT32_FROM_LE (rpc_le->header.request_id);
-      rpc_le->header.response_to =
-         BSON_UINT32_FROM_LE (rpc_le->header.response_to);
-
-      rpc_le->compressed.uncompressed_size = size;
-      rpc_le->compressed.compressor_id = compressor_id;
-      rpc_le->compressed.compressed_message = (const uint8_t *) output;
-      rpc_le->compressed.compressed_message_len = output_length;
-      bson_free (data);
-
-
-      _mongoc_array_destroy (&cluster->iov);
-      _mongoc_array_init (&cluster->iov, sizeof (mongoc_iovec_t));
-      _mongoc_rpc_gather (rpc_le, &cluster->iov);
-      _mongoc_rpc_swab_to_le (rpc_le);
-      return output;
-   } else {
+   if (!_mongoc_compress_iovec (scratch,
+                                compressor_id,
+                                level,
+                                (const mongoc_iovec_t *) cluster->iov.data,
+                                cluster->iov.len,
+                                16,
+                                &compressed_len)) {
       MONGOC_WARNING ("Could not compress data with %s",
                       mongoc_compressor_id_to_name (compressor_id));
+      bson_set_error (error,
+                      MONGOC_ERROR_COMMAND,
+                      MONGOC_ERROR_COMMAND_INVALID_ARG,
+                      "Could not compress data with %s",
+                      mongoc_compressor_id_to_name (compressor_id));
+      return false;
    }
-   bson_free (data);
-   bson_free (output);
-   return NULL;
+
+   rpc_le->header.msg_len = 0;
+   rpc_le->compressed.original_opcode =
+      BSON_UINT32_FROM_LE (rpc_le->header.opcode);
+   rpc_le->header.opcode = MONGOC_OPCODE_COMPRESSED;
+   rpc_le->header.request_id = BSON_UINT32_FROM_LE (rpc_le->header.request_id);
+   rpc_le->header.response_to =
+      BSON_UINT32_FROM_LE (rpc_le->header.response_to);
+
+   rpc_le->compressed.uncompressed_size = (int32_t) uncompressed_size;
+   rpc_le->compressed.compressor_id = compressor_id;
+   rpc_le->compressed.compressed_message = scratch->compressed;
+   rpc_le->compressed.compressed_message_len = (int32_t) compressed_len;
+
+   /* reuse the iovec array */
+   cluster->iov.len = 0;
+   _mongoc_rpc_gather (rpc_le, &cluster->iov);
+   _mongoc_rpc_swab_to_le (rpc_le);
+
+   return true;
 }
 
 /*
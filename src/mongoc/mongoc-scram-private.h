@@ -32,6 +32,9 @@ BSON_BEGIN_DECLS
 
 #define MONGOC_SCRAM_HASH_SIZE 20
 
+/* salted passwords cached per process */
+#define MONGOC_SCRAM_CACHE_SIZE 64
+
 typedef struct _mongoc_scram_t {
    bool done;
    int step;
@@ -53,6 +56,12 @@ typedef struct _mongoc_scram_t {
 void
 _mongoc_scram_startup ();
 
+void
+_mongoc_scram_cleanup (void);
+
+void
+_mongoc_scram_reset_after_fork (void);
+
 void
 _mongoc_scram_init (mongoc_scram_t *scram);
 
@@ -89,6 +98,21 @@ _mongoc_scram_step (mongoc_scram_t *scram,
                     uint32_t *outbuflen,
                     bson_error_t *error);
 
+bool
+_mongoc_scram_cache_get (mongoc_scram_t *scram,
+                         const char *hashed_password,
+                         const uint8_t *salt,
+                         uint32_t iterations);
+
+void
+_mongoc_scram_cache_set (const mongoc_scram_t *scram,
+                         const char *hashed_password,
+                         const uint8_t *salt,
+                         uint32_t iterations);
+
+void
+_mongoc_scram_cache_clear (void);
+
 BSON_END_DECLS
 
 
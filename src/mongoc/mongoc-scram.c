@@ -18,6 +18,9 @@
 #ifdef MONGOC_ENABLE_CRYPTO
 
 #include <string.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
 
 #include "mongoc-error.h"
 #include "mongoc-scram-private.h"
@@ -29,6 +32,7 @@
 #include "mongoc-b64-private.h"
 
 #include "mongoc-memcmp-private.h"
+#include "mongoc-thread-private.h"
 
 #define MONGOC_SCRAM_SERVER_KEY "Server Key"
 #define MONGOC_SCRAM_CLIENT_KEY "Client Key"
@@ -38,11 +42,201 @@
 #define MONGOC_SCRAM_B64_HASH_SIZE \
    MONGOC_SCRAM_B64_ENCODED_SIZE (MONGOC_SCRAM_HASH_SIZE)
 
+/* the server always sends a 16 byte salt */
+#define MONGOC_SCRAM_SALT_SIZE 16
+
+
+/* the keys derived from a salted password, shared by every connection in
+ * the process that authenticates with the same credentials, salt and
+ * iteration count */
+typedef struct _mongoc_scram_cache_entry_t {
+   bool used;
+   char *user;
+   /* hex md5 of "user:mongo:pass" */
+   char hashed_password[33];
+   uint8_t salt[MONGOC_SCRAM_SALT_SIZE];
+   uint32_t iterations;
+   uint8_t salted_password[MONGOC_SCRAM_HASH_SIZE];
+   uint8_t client_key[MONGOC_SCRAM_HASH_SIZE];
+   uint8_t server_key[MONGOC_SCRAM_HASH_SIZE];
+} mongoc_scram_cache_entry_t;
+
+static mongoc_scram_cache_entry_t gScramCache[MONGOC_SCRAM_CACHE_SIZE];
+static int gScramCacheNext;
+static mongoc_mutex_t gScramCacheMutex;
+#ifndef _WIN32
+static int gScramCachePid;
+#endif
+
 
 void
 _mongoc_scram_startup ()
 {
    mongoc_b64_initialize_rmap ();
+   mongoc_mutex_init (&gScramCacheMutex);
+#ifndef _WIN32
+   gScramCachePid = (int) getpid ();
+#endif
+}
+
+
+/* in a child process after fork(), the mutex may have been held by a
+ * parent thread that doesn't exist here. the cached keys remain valid */
+void
+_mongoc_scram_reset_after_fork (void)
+{
+#ifndef _WIN32
+   if (gScramCachePid == (int) getpid ()) {
+      return;
+   }
+
+   gScramCachePid = (int) getpid ();
+   mongoc_mutex_init (&gScramCacheMutex);
+#endif
+}
+
+
+void
+_mongoc_scram_cleanup (void)
+{
+   _mongoc_scram_cache_clear ();
+   mongoc_mutex_destroy (&gScramCacheMutex);
+}
+
+
+static void
+_mongoc_scram_cache_entry_clear (mongoc_scram_cache_entry_t *entry)
+{
+   bson_free (entry->user);
+   /* zero the keys too */
+   memset (entry, 0, sizeof *entry);
+}
+
+
+static bool
+_mongoc_scram_cache_entry_matches (const mongoc_scram_cache_entry_t *entry,
+                                   const char *user,
+                                   const char *hashed_password,
+                                   const uint8_t *salt,
+                                   uint32_t iterations)
+{
+   return entry->used && entry->iterations == iterations &&
+          !strcmp (entry->user, user) &&
+          !mongoc_memcmp (entry->salt, salt, MONGOC_SCRAM_SALT_SIZE) &&
+          !mongoc_memcmp (entry->hashed_password,
+                          hashed_password,
+                          sizeof entry->hashed_password);
+}
+
+
+/**
+ * _mongoc_scram_cache_get:
+ *
+ * If the keys for @scram's user, @hashed_password, @salt and @iterations
+ * are cached, copy them into @scram and return true.
+ */
+bool
+_mongoc_scram_cache_get (mongoc_scram_t *scram,
+                         const char *hashed_password,
+                         const uint8_t *salt,
+                         uint32_t iterations)
+{
+   mongoc_scram_cache_entry_t *entry;
+   bool found = false;
+   int i;
+
+   BSON_ASSERT (scram);
+   BSON_ASSERT (hashed_password);
+
+   mongoc_mutex_lock (&gScramCacheMutex);
+   for (i = 0; i < MONGOC_SCRAM_CACHE_SIZE; i++) {
+      entry = &gScramCache[i];
+      if (_mongoc_scram_cache_entry_matches (
+             entry, scram->user, hashed_password, salt, iterations)) {
+         memcpy (scram->salted_password,
+                 entry->salted_password,
+                 sizeof scram->salted_password);
+         memcpy (
+            scram->client_key, entry->client_key, sizeof scram->client_key);
+         memcpy (
+            scram->server_key, entry->server_key, sizeof scram->server_key);
+         found = true;
+         break;
+      }
+   }
+   mongoc_mutex_unlock (&gScramCacheMutex);
+
+   return found;
+}
+
+
+/**
+ * _mongoc_scram_cache_set:
+ *
+ * Cache the keys in @scram for its user, @hashed_password, @salt and
+ * @iterations, replacing the oldest entry if the cache is full.
+ */
+void
+_mongoc_scram_cache_set (const mongoc_scram_t *scram,
+                         const char *hashed_password,
+                         const uint8_t *salt,
+                         uint32_t iterations)
+{
+   mongoc_scram_cache_entry_t *entry = NULL;
+   int i;
+
+   BSON_ASSERT (scram);
+   BSON_ASSERT (hashed_password);
+
+   if (strlen (hashed_password) != sizeof entry->hashed_password - 1) {
+      return;
+   }
+
+   mongoc_mutex_lock (&gScramCacheMutex);
+   for (i = 0; i < MONGOC_SCRAM_CACHE_SIZE; i++) {
+      if (_mongoc_scram_cache_entry_matches (&gScramCache[i],
+                                             scram->user,
+                                             hashed_password,
+                                             salt,
+                                             iterations)) {
+         entry = &gScramCache[i];
+         break;
+      }
+   }
+
+   if (!entry) {
+      entry = &gScramCache[gScramCacheNext];
+      gScramCacheNext = (gScramCacheNext + 1) % MONGOC_SCRAM_CACHE_SIZE;
+      _mongoc_scram_cache_entry_clear (entry);
+      entry->used = true;
+      entry->user = bson_strdup (scram->user);
+      memcpy (entry->hashed_password,
+              hashed_password,
+              sizeof entry->hashed_password);
+      memcpy (entry->salt, salt, MONGOC_SCRAM_SALT_SIZE);
+      entry->iterations = iterations;
+   }
+
+   memcpy (entry->salted_password,
+           scram->salted_password,
+           sizeof entry->salted_password);
+   memcpy (entry->client_key, scram->client_key, sizeof entry->client_key);
+   memcpy (entry->server_key, scram->server_key, sizeof entry->server_key);
+   mongoc_mutex_unlock (&gScramCacheMutex);
+}
+
+
+void
+_mongoc_scram_cache_clear (void)
+{
+   int i;
+
+   mongoc_mutex_lock (&gScramCacheMutex);
+   for (i = 0; i < MONGOC_SCRAM_CACHE_SIZE; i++) {
+      _mongoc_scram_cache_entry_clear (&gScramCache[i]);
+   }
+   gScramCacheNext = 0;
+   mongoc_mutex_unlock (&gScramCacheMutex);
 }
 
 
@@ -308,6 +502,18 @@ _mongoc_scram_salt_password (mongoc_scram_t *scram,
    int k;
    uint8_t *output = scram->salted_password;
 
+   /* Hi() is PBKDF2 with HMAC-SHA1, use the library's if it has one */
+   if (mongoc_crypto_pbkdf2_hmac_sha1 (&scram->crypto,
+                                       password,
+                                       password_len,
+                                       salt,
+                                       salt_len,
+                                       iterations,
+                                       MONGOC_SCRAM_HASH_SIZE,
+                                       output)) {
+      return;
+   }
+
    memcpy (start_key, salt, salt_len);
 
    start_key[salt_len] = 0;
@@ -341,6 +547,27 @@ _mongoc_scram_salt_password (mongoc_scram_t *scram,
 }
 
 
+/* ClientKey := HMAC(SaltedPassword, "Client Key")
+ * ServerKey := HMAC(SaltedPassword, "Server Key") */
+static void
+_mongoc_scram_derive_keys (mongoc_scram_t *scram)
+{
+   mongoc_crypto_hmac_sha1 (&scram->crypto,
+                            scram->salted_password,
+                            MONGOC_SCRAM_HASH_SIZE,
+                            (uint8_t *) MONGOC_SCRAM_CLIENT_KEY,
+                            strlen (MONGOC_SCRAM_CLIENT_KEY),
+                            scram->client_key);
+
+   mongoc_crypto_hmac_sha1 (&scram->crypto,
+                            scram->salted_password,
+                            MONGOC_SCRAM_HASH_SIZE,
+                            (uint8_t *) MONGOC_SCRAM_SERVER_KEY,
+                            strlen (MONGOC_SCRAM_SERVER_KEY),
+                            scram->server_key);
+}
+
+
 static bool
 _mongoc_scram_generate_client_proof (mongoc_scram_t *scram,
                                      uint8_t *outbuf,
@@ -589,7 +816,7 @@ _mongoc_scram_step2 (mongoc_scram_t *scram,
       goto FAIL;
    }
 
-   if (16 != decoded_salt_len) {
+   if (MONGOC_SCRAM_SALT_SIZE != decoded_salt_len) {
       bson_set_error (error,
                       MONGOC_ERROR_SCRAM,
                       MONGOC_ERROR_SCRAM_PROTOCOL_ERROR,
@@ -611,13 +838,18 @@ _mongoc_scram_step2 (mongoc_scram_t *scram,
       goto FAIL;
    }
 
-   if (!*scram->salted_password) {
+   if (!*scram->salted_password &&
+       !_mongoc_scram_cache_get (
+          scram, hashed_password, decoded_salt, (uint32_t) iterations)) {
       _mongoc_scram_salt_password (scram,
                                    hashed_password,
                                    (uint32_t) strlen (hashed_password),
                                    decoded_salt,
                                    decoded_salt_len,
                                    iterations);
+      _mongoc_scram_derive_keys (scram);
+      _mongoc_scram_cache_set (
+         scram, hashed_password, decoded_salt, (uint32_t) iterations);
    }
 
    _mongoc_scram_generate_client_proof (scram, outbuf, outbufmax, outbuflen);
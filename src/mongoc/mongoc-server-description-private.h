@@ -18,6 +18,7 @@
 #define MONGOC_SERVER_DESCRIPTION_PRIVATE_H
 
 #include "mongoc-server-description.h"
+#include "mongoc-latency-private.h"
 
 
 #define MONGOC_DEFAULT_WIRE_VERSION 0
@@ -46,6 +47,8 @@ struct _mongoc_server_description_t {
    uint32_t id;
    mongoc_host_list_t host;
    int64_t round_trip_time_msec;
+   /* percentile latency of operations per mongoc_latency_class_t, or -1 */
+   int64_t operation_rtt_msec[MONGOC_LATENCY_CLASSES];
    int64_t last_update_time_usec;
    bson_t last_is_master;
    bool has_is_master;
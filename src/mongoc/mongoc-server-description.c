@@ -100,6 +100,8 @@ mongoc_server_description_init (mongoc_server_description_t *sd,
                                 const char *address,
                                 uint32_t id)
 {
+   int i;
+
    ENTRY;
 
    BSON_ASSERT (sd);
@@ -108,6 +110,9 @@ mongoc_server_description_init (mongoc_server_description_t *sd,
    sd->id = id;
    sd->type = MONGOC_SERVER_UNKNOWN;
    sd->round_trip_time_msec = -1;
+   for (i = 0; i < MONGOC_LATENCY_CLASSES; i++) {
+      sd->operation_rtt_msec[i] = -1;
+   }
 
    if (!_mongoc_host_list_from_string (&sd->host, address)) {
       MONGOC_WARNING ("Failed to parse uri for %s", address);
@@ -294,6 +299,34 @@ mongoc_server_description_round_trip_time (
    return description->round_trip_time_msec;
 }
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_server_description_operation_latency --
+ *
+ *      Get the 90th percentile of the durations of recent operations of
+ *      @latency_class on this server, as measured by the client.
+ *
+ * Returns:
+ *      The latency in milliseconds, or -1 if there are too few samples.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+int64_t
+mongoc_server_description_operation_latency (
+   const mongoc_server_description_t *description,
+   mongoc_latency_class_t latency_class)
+{
+   BSON_ASSERT (description);
+
+   if ((int) latency_class < 0 || latency_class >= MONGOC_LATENCY_CLASSES) {
+      return -1;
+   }
+
+   return description->operation_rtt_msec[latency_class];
+}
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -674,6 +707,9 @@ mongoc_server_description_new_copy (
    copy->opened = description->opened;
    memcpy (&copy->host, &description->host, sizeof (copy->host));
    copy->round_trip_time_msec = -1;
+   memcpy (copy->operation_rtt_msec,
+           description->operation_rtt_msec,
+           sizeof copy->operation_rtt_msec);
 
    copy->connection_address = copy->host.host_and_port;
    bson_init (&copy->last_is_master);
@@ -27,6 +27,12 @@ BSON_BEGIN_DECLS
 
 typedef struct _mongoc_server_description_t mongoc_server_description_t;
 
+typedef enum {
+   MONGOC_LATENCY_READ,
+   MONGOC_LATENCY_WRITE,
+   MONGOC_LATENCY_COMMAND,
+} mongoc_latency_class_t;
+
 MONGOC_EXPORT (void)
 mongoc_server_description_destroy (mongoc_server_description_t *description);
 
@@ -44,6 +50,11 @@ MONGOC_EXPORT (int64_t)
 mongoc_server_description_round_trip_time (
    const mongoc_server_description_t *description);
 
+MONGOC_EXPORT (int64_t)
+mongoc_server_description_operation_latency (
+   const mongoc_server_description_t *description,
+   mongoc_latency_class_t latency_class);
+
 MONGOC_EXPORT (const char *)
 mongoc_server_description_type (const mongoc_server_description_t *description);
 
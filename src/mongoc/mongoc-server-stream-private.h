@@ -31,11 +31,15 @@
 
 BSON_BEGIN_DECLS
 
+struct _mongoc_topology_snapshot_t;
+
 typedef struct _mongoc_server_stream_t {
    mongoc_topology_description_type_t topology_type;
-   mongoc_server_description_t *sd; /* owned */
+   mongoc_server_description_t *sd; /* owned, or borrowed from snapshot */
    bson_t cluster_time;             /* owned */
    mongoc_stream_t *stream;         /* borrowed */
+   struct _mongoc_topology_snapshot_t *snapshot; /* owned ref, or NULL */
+   int32_t *in_flight; /* decremented on cleanup, or NULL */
 } mongoc_server_stream_t;
 
 
@@ -44,6 +48,13 @@ mongoc_server_stream_new (const mongoc_topology_description_t *td,
                           mongoc_server_description_t *sd,
                           mongoc_stream_t *stream);
 
+mongoc_server_stream_t *
+_mongoc_server_stream_new_from_snapshot (
+   struct _mongoc_topology_snapshot_t *snapshot,
+   mongoc_server_description_t *sd,
+   const bson_t *cluster_time,
+   mongoc_stream_t *stream);
+
 int32_t
 mongoc_server_stream_max_bson_obj_size (mongoc_server_stream_t *server_stream);
 
@@ -17,6 +17,7 @@
 
 #include "mongoc-cluster-private.h"
 #include "mongoc-server-stream-private.h"
+#include "mongoc-topology-snapshot-private.h"
 #include "mongoc-util-private.h"
 
 #undef MONGOC_LOG_DOMAIN
@@ -37,6 +38,43 @@ mongoc_server_stream_new (const mongoc_topology_description_t *td,
    bson_copy_to (&td->cluster_time, &server_stream->cluster_time);
    server_stream->sd = sd;         /* becomes owned */
    server_stream->stream = stream; /* merely borrowed */
+   server_stream->snapshot = NULL;
+   server_stream->in_flight = NULL;
+
+   return server_stream;
+}
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_server_stream_new_from_snapshot --
+ *
+ *      Like mongoc_server_stream_new, but @sd belongs to @snapshot: the
+ *      server stream takes ownership of a reference to @snapshot instead
+ *      of copying @sd. @cluster_time is copied.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+mongoc_server_stream_t *
+_mongoc_server_stream_new_from_snapshot (mongoc_topology_snapshot_t *snapshot,
+                                         mongoc_server_description_t *sd,
+                                         const bson_t *cluster_time,
+                                         mongoc_stream_t *stream)
+{
+   mongoc_server_stream_t *server_stream;
+
+   BSON_ASSERT (snapshot);
+   BSON_ASSERT (sd);
+   BSON_ASSERT (stream);
+
+   server_stream = bson_malloc (sizeof (mongoc_server_stream_t));
+   server_stream->topology_type = snapshot->td.type;
+   bson_copy_to (cluster_time, &server_stream->cluster_time);
+   server_stream->sd = sd;             /* borrowed from snapshot */
+   server_stream->stream = stream;     /* merely borrowed */
+   server_stream->snapshot = snapshot; /* becomes owned */
+   server_stream->in_flight = NULL;
 
    return server_stream;
 }
@@ -45,7 +83,16 @@ void
 mongoc_server_stream_cleanup (mongoc_server_stream_t *server_stream)
 {
    if (server_stream) {
-      mongoc_server_description_destroy (server_stream->sd);
+      if (server_stream->in_flight) {
+         bson_atomic_int_add (server_stream->in_flight, -1);
+      }
+
+      if (server_stream->snapshot) {
+         _mongoc_topology_snapshot_unref (server_stream->snapshot);
+      } else {
+         mongoc_server_description_destroy (server_stream->sd);
+      }
+
       bson_destroy (&server_stream->cluster_time);
       bson_free (server_stream);
    }
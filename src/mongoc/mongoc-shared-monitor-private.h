@@ -0,0 +1,69 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MONGOC_SHARED_MONITOR_PRIVATE_H
+#define MONGOC_SHARED_MONITOR_PRIVATE_H
+
+#if !defined(MONGOC_COMPILATION)
+#error "Only <mongoc.h> can be included directly."
+#endif
+
+#include <bson.h>
+
+
+BSON_BEGIN_DECLS
+
+
+struct _mongoc_topology_t;
+
+/* monitors a set of servers on behalf of every topology in the process that
+ * has the same monitoring settings: heartbeat frequency, connect timeout,
+ * appname, compressors, TLS options and stream initiator. each server is
+ * checked once per heartbeat and the ismaster result is passed to every
+ * topology that contains the server. */
+typedef struct _mongoc_shared_monitor_t mongoc_shared_monitor_t;
+
+void
+_mongoc_shared_monitor_init (void);
+
+void
+_mongoc_shared_monitor_cleanup (void);
+
+mongoc_shared_monitor_t *
+_mongoc_shared_monitor_attach (struct _mongoc_topology_t *topology);
+
+void
+_mongoc_shared_monitor_detach (mongoc_shared_monitor_t *monitor,
+                               struct _mongoc_topology_t *topology);
+
+void
+_mongoc_shared_monitor_sync (mongoc_shared_monitor_t *monitor,
+                             struct _mongoc_topology_t *topology);
+
+void
+_mongoc_shared_monitor_request_scan (mongoc_shared_monitor_t *monitor);
+
+void
+_mongoc_shared_monitor_reset_after_fork (void);
+
+size_t
+_mongoc_shared_monitor_count (void);
+
+
+BSON_END_DECLS
+
+
+#endif /* MONGOC_SHARED_MONITOR_PRIVATE_H */
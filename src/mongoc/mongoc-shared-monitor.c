@@ -0,0 +1,926 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "mongoc-config.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "mongoc-host-list-private.h"
+#include "mongoc-shared-monitor-private.h"
+#include "mongoc-thread-private.h"
+#include "mongoc-topology-private.h"
+#include "mongoc-trace-private.h"
+
+#ifdef MONGOC_ENABLE_SSL
+#include "mongoc-ssl-private.h"
+#endif
+
+#include "utlist.h"
+
+
+#undef MONGOC_LOG_DOMAIN
+#define MONGOC_LOG_DOMAIN "shared-monitor"
+
+
+/* a topology's interest in a server, by the id it uses for the server */
+typedef struct _mongoc_shared_monitor_sub_t {
+   mongoc_topology_t *topology;
+   uint32_t server_id;
+   /* deliver the last result to this topology without a new check */
+   bool replay;
+   struct _mongoc_shared_monitor_sub_t *next;
+} mongoc_shared_monitor_sub_t;
+
+typedef struct _mongoc_shared_monitor_server_t {
+   /* the id of this server's node in the monitor's own scanner */
+   uint32_t id;
+   mongoc_host_list_t host;
+   bool in_scanner;
+   /* no topology contains the server, the scanner node can be dropped */
+   bool removed;
+   mongoc_shared_monitor_sub_t *subs;
+
+   /* the result of the last check, written by the monitor thread only */
+   bool checked;
+   bool has_reply;
+   bson_t reply;
+   int64_t rtt_msec;
+   bson_error_t error;
+
+   struct _mongoc_shared_monitor_server_t *next;
+   struct _mongoc_shared_monitor_server_t *prev;
+} mongoc_shared_monitor_server_t;
+
+typedef struct _mongoc_shared_monitor_dispatch_t {
+   mongoc_topology_t *topology;
+   uint32_t server_id;
+   mongoc_shared_monitor_server_t *server;
+} mongoc_shared_monitor_dispatch_t;
+
+struct _mongoc_shared_monitor_t {
+   mongoc_uri_t *uri;
+   mongoc_topology_scanner_t *scanner;
+#ifdef MONGOC_ENABLE_SSL
+   mongoc_ssl_opt_t ssl_opts;
+#endif
+   int64_t heartbeat_msec;
+   int64_t connect_timeout_msec;
+   uint32_t next_id;
+   /* the number of attached topologies, protected by gSharedMonitorsMutex */
+   uint32_t refcount;
+
+   mongoc_shared_monitor_server_t *servers;
+
+   mongoc_mutex_t mutex;
+   /* wakes the monitor thread */
+   mongoc_cond_t cond_server;
+   /* signaled when the monitor thread finishes calling into topologies */
+   mongoc_cond_t cond_client;
+   mongoc_thread_t thread;
+
+   bool scan_requested;
+   bool replay_requested;
+   bool shutdown_requested;
+   bool dispatching;
+
+   struct _mongoc_shared_monitor_t *next;
+};
+
+
+static mongoc_mutex_t gSharedMonitorsMutex;
+static mongoc_shared_monitor_t *gSharedMonitors;
+#ifndef _WIN32
+static int gSharedMonitorsPid;
+#endif
+
+
+void
+_mongoc_shared_monitor_init (void)
+{
+   mongoc_mutex_init (&gSharedMonitorsMutex);
+   gSharedMonitors = NULL;
+#ifndef _WIN32
+   gSharedMonitorsPid = (int) getpid ();
+#endif
+}
+
+
+void
+_mongoc_shared_monitor_cleanup (void)
+{
+   /* every pool must be destroyed before mongoc_cleanup */
+   mongoc_mutex_destroy (&gSharedMonitorsMutex);
+}
+
+
+static bool
+_str_equal (const char *a, const char *b)
+{
+   if (!a || !b) {
+      return a == b;
+   }
+
+   return !strcmp (a, b);
+}
+
+
+#ifdef MONGOC_ENABLE_SSL
+static bool
+_ssl_opts_equal (const mongoc_ssl_opt_t *a, const mongoc_ssl_opt_t *b)
+{
+   if (!a || !b) {
+      return a == b;
+   }
+
+   return _str_equal (a->pem_file, b->pem_file) &&
+          _str_equal (a->pem_pwd, b->pem_pwd) &&
+          _str_equal (a->ca_file, b->ca_file) &&
+          _str_equal (a->ca_dir, b->ca_dir) &&
+          _str_equal (a->crl_file, b->crl_file) &&
+          a->weak_cert_validation == b->weak_cert_validation &&
+          a->allow_invalid_hostname == b->allow_invalid_hostname;
+}
+#endif
+
+
+/* can @monitor check servers on behalf of @topology? */
+static bool
+_mongoc_shared_monitor_matches (mongoc_shared_monitor_t *monitor,
+                                mongoc_topology_t *topology)
+{
+   mongoc_topology_scanner_t *ts;
+
+   ts = topology->scanner;
+
+   if (monitor->heartbeat_msec != topology->description.heartbeat_msec ||
+       monitor->connect_timeout_msec != topology->connect_timeout_msec ||
+       monitor->scanner->initiator != ts->initiator ||
+       monitor->scanner->initiator_context != ts->initiator_context ||
+       !_str_equal (monitor->scanner->appname, ts->appname)) {
+      return false;
+   }
+
+   /* compressors are negotiated in the monitoring handshake */
+   if (!bson_equal (mongoc_uri_get_compressors (monitor->uri),
+                    mongoc_uri_get_compressors (topology->uri))) {
+      return false;
+   }
+
+#ifdef MONGOC_ENABLE_SSL
+   if (!_ssl_opts_equal (monitor->scanner->ssl_opts, ts->ssl_opts)) {
+      return false;
+   }
+
+   /* kernel TLS is chosen by URI option, not in mongoc_ssl_opt_t */
+   if (mongoc_uri_get_option_as_bool (
+          monitor->uri, MONGOC_URI_SSLKERNELTLS, false) !=
+       mongoc_uri_get_option_as_bool (
+          topology->uri, MONGOC_URI_SSLKERNELTLS, false)) {
+      return false;
+   }
+#endif
+
+   return true;
+}
+
+
+static mongoc_shared_monitor_server_t *
+_find_server (mongoc_shared_monitor_t *monitor, const char *host_and_port)
+{
+   mongoc_shared_monitor_server_t *server;
+
+   DL_FOREACH (monitor->servers, server)
+   {
+      if (!strcasecmp (server->host.host_and_port, host_and_port)) {
+         return server;
+      }
+   }
+
+   return NULL;
+}
+
+
+static mongoc_shared_monitor_server_t *
+_find_server_by_id (mongoc_shared_monitor_t *monitor, uint32_t id)
+{
+   mongoc_shared_monitor_server_t *server;
+
+   DL_FOREACH (monitor->servers, server)
+   {
+      if (server->id == id) {
+         return server;
+      }
+   }
+
+   return NULL;
+}
+
+
+static void
+_server_destroy (mongoc_shared_monitor_server_t *server)
+{
+   mongoc_shared_monitor_sub_t *sub, *tmp;
+
+   LL_FOREACH_SAFE (server->subs, sub, tmp)
+   {
+      bson_free (sub);
+   }
+
+   bson_destroy (&server->reply);
+   bson_free (server);
+}
+
+
+static void
+_server_set_result (mongoc_shared_monitor_server_t *server,
+                    const bson_t *ismaster_response,
+                    int64_t rtt_msec,
+                    const bson_error_t *error)
+{
+   bson_reinit (&server->reply);
+
+   if (ismaster_response) {
+      bson_concat (&server->reply, ismaster_response);
+   }
+
+   server->checked = true;
+   server->has_reply = ismaster_response != NULL;
+   server->rtt_msec = rtt_msec;
+
+   if (error) {
+      memcpy (&server->error, error, sizeof (bson_error_t));
+   } else {
+      memset (&server->error, 0, sizeof (bson_error_t));
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_shared_monitor_snapshot --
+ *
+ *       Collect the topologies to notify: all subscribers of @server, or
+ *       if @server is NULL, all subscribers waiting for a replay. Marks
+ *       the monitor as dispatching so topologies are not detached while
+ *       the monitor thread calls into them.
+ *
+ *       NOTE: call this while holding @monitor's mutex.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static mongoc_shared_monitor_dispatch_t *
+_mongoc_shared_monitor_snapshot (mongoc_shared_monitor_t *monitor,
+                                 mongoc_shared_monitor_server_t *server,
+                                 size_t *n)
+{
+   mongoc_shared_monitor_server_t *s;
+   mongoc_shared_monitor_sub_t *sub;
+   mongoc_shared_monitor_dispatch_t *items;
+   size_t count = 0;
+
+   DL_FOREACH (monitor->servers, s)
+   {
+      LL_FOREACH (s->subs, sub)
+      {
+         if (s == server || (!server && sub->replay)) {
+            count++;
+         }
+      }
+   }
+
+   items = (mongoc_shared_monitor_dispatch_t *) bson_malloc0 (
+      BSON_MAX (count, 1) * sizeof *items);
+   *n = 0;
+
+   DL_FOREACH (monitor->servers, s)
+   {
+      LL_FOREACH (s->subs, sub)
+      {
+         if (s == server || (!server && sub->replay)) {
+            items[*n].topology = sub->topology;
+            items[*n].server_id = sub->server_id;
+            items[*n].server = s;
+            sub->replay = false;
+            (*n)++;
+         }
+      }
+   }
+
+   monitor->dispatching = true;
+
+   return items;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_shared_monitor_dispatch --
+ *
+ *       Pass the last result of each server in @items to the topologies
+ *       in @items. Only the monitor thread writes server results or
+ *       frees servers, so they are read without the mutex.
+ *
+ *       NOTE: this method uses @monitor's mutex and each topology's mutex.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_mongoc_shared_monitor_dispatch (mongoc_shared_monitor_t *monitor,
+                                 mongoc_shared_monitor_dispatch_t *items,
+                                 size_t n)
+{
+   mongoc_shared_monitor_server_t *server;
+   size_t i;
+
+   for (i = 0; i < n; i++) {
+      server = items[i].server;
+      _mongoc_topology_shared_monitor_cb (
+         items[i].topology,
+         items[i].server_id,
+         server->has_reply ? &server->reply : NULL,
+         server->rtt_msec,
+         &server->error);
+   }
+
+   mongoc_mutex_lock (&monitor->mutex);
+   monitor->dispatching = false;
+   mongoc_cond_broadcast (&monitor->cond_client);
+   mongoc_mutex_unlock (&monitor->mutex);
+
+   bson_free (items);
+}
+
+
+/* record a check result and pass it on, returns false if the server was
+ * known to be available before this result */
+static bool
+_mongoc_shared_monitor_report (mongoc_shared_monitor_t *monitor,
+                               uint32_t id,
+                               const bson_t *ismaster_response,
+                               int64_t rtt_msec,
+                               const bson_error_t *error)
+{
+   mongoc_shared_monitor_server_t *server;
+   mongoc_shared_monitor_dispatch_t *items;
+   size_t n;
+   bool was_known;
+
+   mongoc_mutex_lock (&monitor->mutex);
+   server = _find_server_by_id (monitor, id);
+   if (!server) {
+      /* removed since the scan started */
+      mongoc_mutex_unlock (&monitor->mutex);
+      return true;
+   }
+
+   was_known = server->has_reply;
+   _server_set_result (server, ismaster_response, rtt_msec, error);
+   items = _mongoc_shared_monitor_snapshot (monitor, server, &n);
+   mongoc_mutex_unlock (&monitor->mutex);
+
+   _mongoc_shared_monitor_dispatch (monitor, items, n);
+
+   return !was_known;
+}
+
+
+static void
+_mongoc_shared_monitor_setup_err_cb (uint32_t id,
+                                     void *data,
+                                     const bson_error_t *error)
+{
+   _mongoc_shared_monitor_report (
+      (mongoc_shared_monitor_t *) data, id, NULL, -1, error);
+}
+
+
+static void
+_mongoc_shared_monitor_cb (uint32_t id,
+                           const bson_t *ismaster_response,
+                           int64_t rtt_msec,
+                           void *data,
+                           const bson_error_t *error)
+{
+   mongoc_shared_monitor_t *monitor;
+   bool was_unknown;
+
+   monitor = (mongoc_shared_monitor_t *) data;
+   was_unknown = _mongoc_shared_monitor_report (
+      monitor, id, ismaster_response, rtt_msec, error);
+
+   /* Server Discovery and Monitoring Spec: "Once a server is connected, the
+    * client MUST change its type to Unknown only after it has retried the
+    * server once." */
+   if (!ismaster_response && !was_unknown) {
+      mongoc_topology_scanner_scan (
+         monitor->scanner, id, monitor->connect_timeout_msec);
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_shared_monitor_update_nodes --
+ *
+ *       Add scanner nodes for new servers and destroy the nodes of
+ *       servers no topology contains. Called between scans.
+ *
+ *       NOTE: call this while holding @monitor's mutex.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_mongoc_shared_monitor_update_nodes (mongoc_shared_monitor_t *monitor)
+{
+   mongoc_shared_monitor_server_t *server, *tmp;
+   mongoc_topology_scanner_node_t *node;
+
+   DL_FOREACH_SAFE (monitor->servers, server, tmp)
+   {
+      if (server->removed) {
+         node = mongoc_topology_scanner_get_node (monitor->scanner, server->id);
+         if (node) {
+            mongoc_topology_scanner_node_destroy (node, false);
+         }
+
+         DL_DELETE (monitor->servers, server);
+         _server_destroy (server);
+      } else if (!server->in_scanner) {
+         mongoc_topology_scanner_add (
+            monitor->scanner, &server->host, server->id);
+         server->in_scanner = true;
+      }
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_shared_monitor_run --
+ *
+ *       The monitor thread runs in this loop, like a topology's
+ *       background thread in _mongoc_topology_run_background.
+ *
+ *       NOTE: this method uses @monitor's mutex.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void *
+_mongoc_shared_monitor_run (void *data)
+{
+   mongoc_shared_monitor_t *monitor;
+   mongoc_shared_monitor_dispatch_t *items;
+   size_t n;
+   int64_t now;
+   int64_t last_scan;
+   int64_t timeout;
+   int64_t force_timeout;
+   int r;
+
+   monitor = (mongoc_shared_monitor_t *) data;
+   last_scan = 0;
+
+   for (;;) {
+      mongoc_mutex_lock (&monitor->mutex);
+
+      for (;;) {
+         if (monitor->shutdown_requested) {
+            goto DONE;
+         }
+
+         if (monitor->replay_requested) {
+            break;
+         }
+
+         now = bson_get_monotonic_time ();
+
+         if (last_scan == 0) {
+            last_scan = now - (monitor->heartbeat_msec * 1000);
+         }
+
+         timeout = monitor->heartbeat_msec - ((now - last_scan) / 1000);
+
+         if (monitor->scan_requested) {
+            force_timeout = MONGOC_TOPOLOGY_MIN_HEARTBEAT_FREQUENCY_MS -
+                            ((now - last_scan) / 1000);
+
+            timeout = BSON_MIN (timeout, force_timeout);
+         }
+
+         if (timeout <= 0) {
+            break;
+         }
+
+         r = mongoc_cond_timedwait (
+            &monitor->cond_server, &monitor->mutex, timeout);
+
+#ifdef _WIN32
+         if (!(r == 0 || r == WSAETIMEDOUT)) {
+#else
+         if (!(r == 0 || r == ETIMEDOUT)) {
+#endif
+            goto DONE;
+         }
+      }
+
+      if (monitor->replay_requested) {
+         /* give newly attached topologies the last results right away */
+         monitor->replay_requested = false;
+         items = _mongoc_shared_monitor_snapshot (monitor, NULL, &n);
+         mongoc_mutex_unlock (&monitor->mutex);
+
+         _mongoc_shared_monitor_dispatch (monitor, items, n);
+         continue;
+      }
+
+      monitor->scan_requested = false;
+      _mongoc_shared_monitor_update_nodes (monitor);
+      mongoc_mutex_unlock (&monitor->mutex);
+
+      /* results are passed to topologies as each check completes */
+      mongoc_topology_scanner_start (
+         monitor->scanner, monitor->connect_timeout_msec, false);
+      mongoc_topology_scanner_work (monitor->scanner);
+      _mongoc_topology_scanner_finish (monitor->scanner);
+      mongoc_topology_scanner_reset (monitor->scanner);
+
+      last_scan = bson_get_monotonic_time ();
+   }
+
+DONE:
+   mongoc_mutex_unlock (&monitor->mutex);
+
+   return NULL;
+}
+
+
+static mongoc_shared_monitor_t *
+_mongoc_shared_monitor_new (mongoc_topology_t *topology)
+{
+   mongoc_shared_monitor_t *monitor;
+   mongoc_topology_scanner_t *ts;
+   int r;
+
+   ts = topology->scanner;
+
+   monitor = (mongoc_shared_monitor_t *) bson_malloc0 (sizeof *monitor);
+   monitor->uri = mongoc_uri_copy (topology->uri);
+   monitor->heartbeat_msec = topology->description.heartbeat_msec;
+   monitor->connect_timeout_msec = topology->connect_timeout_msec;
+   monitor->next_id = 1;
+   monitor->scanner =
+      mongoc_topology_scanner_new (monitor->uri,
+                                   _mongoc_shared_monitor_setup_err_cb,
+                                   _mongoc_shared_monitor_cb,
+                                   monitor);
+
+   if (ts->appname) {
+      _mongoc_topology_scanner_set_appname (monitor->scanner, ts->appname);
+   }
+
+   mongoc_topology_scanner_set_stream_initiator (
+      monitor->scanner, ts->initiator, ts->initiator_context);
+
+#ifdef MONGOC_ENABLE_SSL
+   if (ts->ssl_opts) {
+      _mongoc_ssl_opts_copy_to (ts->ssl_opts, &monitor->ssl_opts);
+      mongoc_topology_scanner_set_ssl_opts (monitor->scanner,
+                                            &monitor->ssl_opts);
+   }
+#endif
+
+   mongoc_mutex_init (&monitor->mutex);
+   mongoc_cond_init (&monitor->cond_server);
+   mongoc_cond_init (&monitor->cond_client);
+
+   r = mongoc_thread_create (
+      &monitor->thread, _mongoc_shared_monitor_run, monitor);
+
+   if (r != 0) {
+      MONGOC_ERROR ("could not start shared monitor thread: %s",
+                    strerror (r));
+      abort ();
+   }
+
+   return monitor;
+}
+
+
+/* free a monitor whose thread has stopped, or does not exist after fork */
+static void
+_mongoc_shared_monitor_free (mongoc_shared_monitor_t *monitor)
+{
+   mongoc_shared_monitor_server_t *server, *tmp;
+
+   DL_FOREACH_SAFE (monitor->servers, server, tmp)
+   {
+      DL_DELETE (monitor->servers, server);
+      _server_destroy (server);
+   }
+
+   mongoc_topology_scanner_destroy (monitor->scanner);
+#ifdef MONGOC_ENABLE_SSL
+   _mongoc_ssl_opts_cleanup (&monitor->ssl_opts);
+#endif
+   mongoc_uri_destroy (monitor->uri);
+   bson_free (monitor);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_shared_monitor_attach --
+ *
+ *       Find or start the monitor for @topology's monitoring settings and
+ *       subscribe @topology to its servers.
+ *
+ *       NOTE: call this while holding @topology's mutex.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+mongoc_shared_monitor_t *
+_mongoc_shared_monitor_attach (mongoc_topology_t *topology)
+{
+   mongoc_shared_monitor_t *monitor;
+
+   ENTRY;
+
+   mongoc_mutex_lock (&gSharedMonitorsMutex);
+
+   LL_FOREACH (gSharedMonitors, monitor)
+   {
+      if (_mongoc_shared_monitor_matches (monitor, topology)) {
+         break;
+      }
+   }
+
+   if (!monitor) {
+      monitor = _mongoc_shared_monitor_new (topology);
+      LL_PREPEND (gSharedMonitors, monitor);
+   }
+
+   monitor->refcount++;
+   mongoc_mutex_unlock (&gSharedMonitorsMutex);
+
+   _mongoc_shared_monitor_sync (monitor, topology);
+
+   RETURN (monitor);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_shared_monitor_detach --
+ *
+ *       Unsubscribe @topology and wait until the monitor thread is no
+ *       longer calling into it. The last topology to detach stops the
+ *       monitor.
+ *
+ *       NOTE: do not hold @topology's mutex, the monitor thread may be
+ *       waiting for it.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_shared_monitor_detach (mongoc_shared_monitor_t *monitor,
+                               mongoc_topology_t *topology)
+{
+   mongoc_shared_monitor_server_t *server;
+   mongoc_shared_monitor_sub_t *sub, *tmp;
+   bool last;
+
+   ENTRY;
+
+   mongoc_mutex_lock (&monitor->mutex);
+
+   DL_FOREACH (monitor->servers, server)
+   {
+      LL_FOREACH_SAFE (server->subs, sub, tmp)
+      {
+         if (sub->topology == topology) {
+            LL_DELETE (server->subs, sub);
+            bson_free (sub);
+         }
+      }
+
+      if (!server->subs) {
+         server->removed = true;
+      }
+   }
+
+   while (monitor->dispatching) {
+      mongoc_cond_wait (&monitor->cond_client, &monitor->mutex);
+   }
+
+   mongoc_mutex_unlock (&monitor->mutex);
+
+   mongoc_mutex_lock (&gSharedMonitorsMutex);
+   last = --monitor->refcount == 0;
+   if (last) {
+      LL_DELETE (gSharedMonitors, monitor);
+   }
+   mongoc_mutex_unlock (&gSharedMonitorsMutex);
+
+   if (last) {
+      mongoc_mutex_lock (&monitor->mutex);
+      monitor->shutdown_requested = true;
+      mongoc_cond_signal (&monitor->cond_server);
+      mongoc_mutex_unlock (&monitor->mutex);
+
+      mongoc_thread_join (monitor->thread);
+
+      mongoc_cond_destroy (&monitor->cond_server);
+      mongoc_cond_destroy (&monitor->cond_client);
+      mongoc_mutex_destroy (&monitor->mutex);
+      _mongoc_shared_monitor_free (monitor);
+   }
+
+   EXIT;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_shared_monitor_sync --
+ *
+ *       Make @topology's subscriptions match the servers in its topology
+ *       description. Servers the monitor already knows are replayed to
+ *       @topology from their last result instead of being checked again.
+ *
+ *       NOTE: call this while holding @topology's mutex.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_shared_monitor_sync (mongoc_shared_monitor_t *monitor,
+                             mongoc_topology_t *topology)
+{
+   mongoc_topology_description_t *td;
+   mongoc_server_description_t *sd;
+   mongoc_shared_monitor_server_t *server;
+   mongoc_shared_monitor_sub_t *sub, *tmp;
+   size_t i;
+
+   td = &topology->description;
+
+   mongoc_mutex_lock (&monitor->mutex);
+
+   /* drop servers removed from the topology */
+   DL_FOREACH (monitor->servers, server)
+   {
+      LL_FOREACH_SAFE (server->subs, sub, tmp)
+      {
+         if (sub->topology == topology &&
+             !mongoc_topology_description_server_by_id (
+                td, sub->server_id, NULL)) {
+            LL_DELETE (server->subs, sub);
+            bson_free (sub);
+         }
+      }
+
+      if (!server->subs) {
+         server->removed = true;
+      }
+   }
+
+   /* subscribe to newly discovered servers */
+   for (i = 0; i < td->servers->items_len; i++) {
+      sd = (mongoc_server_description_t *) mongoc_set_get_item (td->servers,
+                                                                (int) i);
+
+      server = _find_server (monitor, sd->host.host_and_port);
+      if (!server) {
+         server = (mongoc_shared_monitor_server_t *) bson_malloc0 (
+            sizeof *server);
+         server->id = monitor->next_id++;
+         memcpy (&server->host, &sd->host, sizeof (mongoc_host_list_t));
+         server->host.next = NULL;
+         bson_init (&server->reply);
+         DL_APPEND (monitor->servers, server);
+
+         monitor->scan_requested = true;
+         mongoc_cond_signal (&monitor->cond_server);
+      }
+
+      server->removed = false;
+
+      LL_FOREACH (server->subs, sub)
+      {
+         if (sub->topology == topology && sub->server_id == sd->id) {
+            break;
+         }
+      }
+
+      if (!sub) {
+         sub = (mongoc_shared_monitor_sub_t *) bson_malloc0 (sizeof *sub);
+         sub->topology = topology;
+         sub->server_id = sd->id;
+         LL_PREPEND (server->subs, sub);
+
+         if (server->checked) {
+            sub->replay = true;
+            monitor->replay_requested = true;
+            mongoc_cond_signal (&monitor->cond_server);
+         }
+      }
+   }
+
+   mongoc_mutex_unlock (&monitor->mutex);
+}
+
+
+void
+_mongoc_shared_monitor_request_scan (mongoc_shared_monitor_t *monitor)
+{
+   mongoc_mutex_lock (&monitor->mutex);
+   monitor->scan_requested = true;
+   mongoc_cond_signal (&monitor->cond_server);
+   mongoc_mutex_unlock (&monitor->mutex);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_shared_monitor_reset_after_fork --
+ *
+ *       Called in a child process after fork() by each topology that was
+ *       attached to a shared monitor. The first call forgets the parent's
+ *       monitors: their threads do not exist in the child, so their
+ *       mutexes are abandoned, their monitoring connections are closed
+ *       without sending anything and their memory is freed. Topologies
+ *       then attach to new monitors when monitoring restarts.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_shared_monitor_reset_after_fork (void)
+{
+#ifndef _WIN32
+   mongoc_shared_monitor_t *monitor, *tmp;
+
+   if (gSharedMonitorsPid == (int) getpid ()) {
+      return;
+   }
+
+   gSharedMonitorsPid = (int) getpid ();
+   mongoc_mutex_init (&gSharedMonitorsMutex);
+
+   LL_FOREACH_SAFE (gSharedMonitors, monitor, tmp)
+   {
+      _mongoc_topology_scanner_close_inherited (monitor->scanner);
+      _mongoc_shared_monitor_free (monitor);
+   }
+
+   gSharedMonitors = NULL;
+#endif
+}
+
+
+/* the number of monitors running in this process */
+size_t
+_mongoc_shared_monitor_count (void)
+{
+   mongoc_shared_monitor_t *monitor;
+   size_t count = 0;
+
+   mongoc_mutex_lock (&gSharedMonitorsMutex);
+   LL_FOREACH (gSharedMonitors, monitor)
+   {
+      count++;
+   }
+   mongoc_mutex_unlock (&gSharedMonitorsMutex);
+
+   return count;
+}
@@ -53,6 +53,14 @@ mongoc_ssl_opt_get_default (void)
    return &gMongocSslOptDefault;
 }
 
+void
+mongoc_ssl_reload_certificates (void)
+{
+#if defined(MONGOC_ENABLE_SSL_OPENSSL)
+   _mongoc_openssl_ctx_cache_clear ();
+#endif
+}
+
 char *
 mongoc_ssl_extract_subject (const char *filename, const char *passphrase)
 {
@@ -39,13 +39,16 @@ struct _mongoc_ssl_opt_t {
    const char *crl_file;
    bool weak_cert_validation;
    bool allow_invalid_hostname;
-   void *padding[7];
+   void *padding[8];
 };
 
 
 MONGOC_EXPORT (const mongoc_ssl_opt_t *)
 mongoc_ssl_opt_get_default (void) BSON_GNUC_CONST;
 
+MONGOC_EXPORT (void)
+mongoc_ssl_reload_certificates (void);
+
 
 BSON_END_DECLS
 
@@ -33,6 +33,7 @@ typedef struct {
    mongoc_stream_t stream;
    mongoc_stream_t *base_stream;
    mongoc_buffer_t buffer;
+   size_t buffer_size;
 } mongoc_stream_buffered_t;
 
 
@@ -330,8 +331,61 @@ mongoc_stream_buffered_new (mongoc_stream_t *base_stream, /* IN */
    stream->base_stream = base_stream;
 
    _mongoc_buffer_init (&stream->buffer, NULL, buffer_size, NULL, NULL);
+   stream->buffer_size = stream->buffer.datalen;
 
    mongoc_counter_streams_active_inc ();
 
    return (mongoc_stream_t *) stream;
 }
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_stream_buffered_trim --
+ *
+ *       Shrink the read buffer of @stream back to its initial size if it
+ *       has grown beyond @max_size. Does nothing if @stream is not a
+ *       buffered stream.
+ *
+ * Returns:
+ *       The number of bytes released.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+size_t
+_mongoc_stream_buffered_trim (mongoc_stream_t *stream, /* IN */
+                              size_t max_size)         /* IN */
+{
+   mongoc_stream_buffered_t *buffered = (mongoc_stream_buffered_t *) stream;
+
+   if (!stream || stream->type != MONGOC_STREAM_BUFFERED) {
+      return 0;
+   }
+
+   return _mongoc_buffer_trim (
+      &buffered->buffer, max_size, buffered->buffer_size);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_stream_buffered_get_allocated --
+ *
+ *       The number of bytes currently allocated for the read buffer of
+ *       @stream, or 0 if @stream is not a buffered stream.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+size_t
+_mongoc_stream_buffered_get_allocated (mongoc_stream_t *stream) /* IN */
+{
+   if (!stream || stream->type != MONGOC_STREAM_BUFFERED) {
+      return 0;
+   }
+
+   return ((mongoc_stream_buffered_t *) stream)->buffer.datalen;
+}
@@ -34,9 +34,15 @@ BSON_BEGIN_DECLS
 #define MONGOC_STREAM_GRIDFS 4
 #define MONGOC_STREAM_TLS 5
 
+mongoc_stream_t *
+mongoc_stream_get_root_stream (mongoc_stream_t *stream);
+
 bool
 mongoc_stream_wait (mongoc_stream_t *stream, int64_t expire_at);
 
+void
+_mongoc_stream_close_inherited (mongoc_stream_t *stream);
+
 bool
 _mongoc_stream_writev_full (mongoc_stream_t *stream,
                             mongoc_iovec_t *iov,
@@ -44,6 +50,12 @@ _mongoc_stream_writev_full (mongoc_stream_t *stream,
                             int32_t timeout_msec,
                             bson_error_t *error);
 
+size_t
+_mongoc_stream_buffered_trim (mongoc_stream_t *stream, size_t max_size);
+
+size_t
+_mongoc_stream_buffered_get_allocated (mongoc_stream_t *stream);
+
 
 BSON_END_DECLS
 
@@ -23,9 +23,19 @@
 
 #ifdef MONGOC_ENABLE_SSL_OPENSSL
 #include <bson.h>
+#include <openssl/ssl.h>
+
+#include "mongoc-ssl.h"
+#include "mongoc-stream.h"
 
 BSON_BEGIN_DECLS
 
+/* OpenSSL 3 can hand record encryption to the Linux kernel, if the SSL
+ * object reads and writes a socket BIO */
+#if defined(__linux__) && defined(SSL_OP_ENABLE_KTLS)
+#define MONGOC_OPENSSL_KTLS 1
+#endif
+
 
 /**
  * mongoc_stream_tls_openssl_t:
@@ -36,9 +46,31 @@ typedef struct {
    BIO *bio;
    BIO_METHOD *meth;
    SSL_CTX *ctx;
+   bool client;
+   /* bio reads and writes the socket directly, for kernel TLS */
+   bool socket_bio;
+   /* the kernel encrypts records we write */
+   bool ktls_send;
+   /* "host:port" of the server, the key of its cached TLS sessions */
+   char *session_key;
 } mongoc_stream_tls_openssl_t;
 
 
+bool
+_mongoc_stream_tls_openssl_session_reused (mongoc_stream_t *stream);
+
+bool
+_mongoc_stream_tls_openssl_kernel_tls (mongoc_stream_t *stream);
+
+mongoc_stream_t *
+_mongoc_stream_tls_openssl_new (mongoc_stream_t *base_stream,
+                                const char *host,
+                                mongoc_ssl_opt_t *opt,
+                                int client,
+                                bool kernel_tls,
+                                const char *session_key);
+
+
 BSON_END_DECLS
 
 #endif /* MONGOC_ENABLE_SSL_OPENSSL */
@@ -29,6 +29,8 @@
 
 #include "mongoc-counters-private.h"
 #include "mongoc-errno-private.h"
+#include "mongoc-socket-private.h"
+#include "mongoc-stream-socket.h"
 #include "mongoc-stream-tls.h"
 #include "mongoc-stream-private.h"
 #include "mongoc-stream-tls-private.h"
@@ -43,7 +45,11 @@
 #undef MONGOC_LOG_DOMAIN
 #define MONGOC_LOG_DOMAIN "stream-tls-openssl"
 
-#define MONGOC_STREAM_TLS_OPENSSL_BUFFER_SIZE 4096
+/* the largest TLS record payload */
+#define MONGOC_STREAM_TLS_OPENSSL_BUFFER_SIZE 16384
+
+/* iovecs smaller than this are coalesced before they are encrypted */
+#define MONGOC_STREAM_TLS_OPENSSL_SMALL 1024
 
 #if OPENSSL_VERSION_NUMBER < 0x10100000L || defined(LIBRESSL_VERSION_NUMBER)
 static void
@@ -93,6 +99,7 @@ _mongoc_stream_tls_openssl_destroy (mongoc_stream_t *stream)
    SSL_CTX_free (openssl->ctx);
    openssl->ctx = NULL;
 
+   bson_free (openssl->session_key);
    bson_free (openssl);
    bson_free (stream);
 
@@ -187,6 +194,45 @@ _mongoc_stream_tls_openssl_flush (mongoc_stream_t *stream)
 }
 
 
+/* streams that use a socket BIO for kernel TLS see retries from the
+ * non-blocking socket, poll it until it is ready or @expire passes. the
+ * shim BIO waits in mongoc_stream_readv and mongoc_stream_writev instead */
+static bool
+_mongoc_stream_tls_openssl_wait (mongoc_stream_tls_t *tls, int64_t expire)
+{
+   mongoc_stream_tls_openssl_t *openssl =
+      (mongoc_stream_tls_openssl_t *) tls->ctx;
+   mongoc_stream_poll_t poller;
+   int64_t timeout_msec = -1;
+   ssize_t r;
+
+   if (!openssl->socket_bio || !BIO_should_retry (openssl->bio)) {
+      return false;
+   }
+
+   if (expire) {
+      timeout_msec =
+         BSON_MAX (0, (expire - bson_get_monotonic_time ()) / 1000L);
+   }
+
+   poller.stream = tls->base_stream;
+   poller.events = BIO_should_read (openssl->bio) ? POLLIN : POLLOUT;
+   poller.revents = 0;
+
+   r = mongoc_stream_poll (&poller, 1, (int32_t) timeout_msec);
+   if (r == 0) {
+      mongoc_counter_streams_timeout_inc ();
+#ifdef _WIN32
+      errno = WSAETIMEDOUT;
+#else
+      errno = ETIMEDOUT;
+#endif
+   }
+
+   return r > 0;
+}
+
+
 static ssize_t
 _mongoc_stream_tls_openssl_write (mongoc_stream_tls_t *tls,
                                   char *buf,
@@ -208,6 +254,9 @@ _mongoc_stream_tls_openssl_write (mongoc_stream_tls_t *tls,
    }
 
    ret = BIO_write (openssl->bio, buf, buf_len);
+   while (ret <= 0 && _mongoc_stream_tls_openssl_wait (tls, expire)) {
+      ret = BIO_write (openssl->bio, buf, buf_len);
+   }
 
    if (ret <= 0) {
       return ret;
@@ -246,7 +295,6 @@ _mongoc_stream_tls_openssl_write (mongoc_stream_tls_t *tls,
  * Side effects:
  *       None.
  *
- * This function is copied as _mongoc_stream_tls_secure_transport_writev
  *--------------------------------------------------------------------------
  */
 
@@ -261,109 +309,98 @@ _mongoc_stream_tls_openssl_writev (mongoc_stream_t *stream,
    ssize_t ret = 0;
    ssize_t child_ret;
    size_t i;
-   size_t iov_pos = 0;
-
-   /* There's a bit of a dance to coalesce vectorized writes into
-    * MONGOC_STREAM_TLS_OPENSSL_BUFFER_SIZE'd writes to avoid lots of small tls
-    * packets.
-    *
-    * The basic idea is that we want to combine writes in the buffer if they're
-    * smaller than the buffer, flushing as it gets full.  For larger writes, or
-    * the last write in the iovec array, we want to ignore the buffer and just
-    * write immediately.  We take care of doing buffer writes by re-invoking
-    * ourself with a single iovec_t, pointing at our stack buffer.
-    */
-   char *buf_head = buf;
-   char *buf_tail = buf;
-   char *buf_end = buf + MONGOC_STREAM_TLS_OPENSSL_BUFFER_SIZE;
+   size_t iov_pos;
+   size_t iov_len;
+   size_t buf_len = 0;
    size_t bytes;
 
-   char *to_write = NULL;
+   char *to_write;
    size_t to_write_len;
 
+   /* Small iovecs, such as message headers and small documents, are
+    * coalesced into a buffer of one full TLS record, to avoid lots of small
+    * TLS records. Large iovecs are passed to SSL_write directly, which
+    * splits them into full records without copying them first. Buffered
+    * bytes are topped up from the next large iovec, so the record they go
+    * out in is full too.
+    */
+
    BSON_ASSERT (tls);
    BSON_ASSERT (iov);
    BSON_ASSERT (iovcnt);
    ENTRY;
 
+   if (((mongoc_stream_tls_openssl_t *) tls->ctx)->ktls_send) {
+      /* the kernel encrypts what we send on the socket */
+      ret = mongoc_stream_writev (tls->base_stream, iov, iovcnt, timeout_msec);
+      if (ret >= 0) {
+         mongoc_counter_streams_egress_add (ret);
+      }
+
+      RETURN (ret);
+   }
+
    tls->timeout_msec = timeout_msec;
 
    for (i = 0; i < iovcnt; i++) {
       iov_pos = 0;
+      iov_len = iov[i].iov_len;
 
-      while (iov_pos < iov[i].iov_len) {
-         if (buf_head != buf_tail ||
-             ((i + 1 < iovcnt) &&
-              ((buf_end - buf_tail) > (iov[i].iov_len - iov_pos)))) {
-            /* If we have either of:
-             *   - buffered bytes already
-             *   - another iovec to send after this one and we don't have more
-             *     bytes to send than the size of the buffer.
-             *
-             * copy into the buffer */
-
-            bytes = BSON_MIN (iov[i].iov_len - iov_pos, buf_end - buf_tail);
-
-            memcpy (buf_tail, (char *) iov[i].iov_base + iov_pos, bytes);
-            buf_tail += bytes;
-            iov_pos += bytes;
+      while (iov_pos < iov_len) {
+         if (buf_len || iov_len - iov_pos < MONGOC_STREAM_TLS_OPENSSL_SMALL) {
+            bytes = BSON_MIN (iov_len - iov_pos,
+                              MONGOC_STREAM_TLS_OPENSSL_BUFFER_SIZE - buf_len);
 
-            if (buf_tail == buf_end) {
-               /* If we're full, request send */
-
-               to_write = buf_head;
-               to_write_len = buf_tail - buf_head;
+            memcpy (buf + buf_len, (char *) iov[i].iov_base + iov_pos, bytes);
+            buf_len += bytes;
+            iov_pos += bytes;
 
-               buf_tail = buf_head = buf;
+            if (buf_len < MONGOC_STREAM_TLS_OPENSSL_BUFFER_SIZE) {
+               continue;
             }
-         } else {
-            /* Didn't buffer, so just write it through */
 
+            /* a full record */
+            to_write = buf;
+            to_write_len = buf_len;
+            buf_len = 0;
+         } else {
+            /* write the rest of a large iovec through */
             to_write = (char *) iov[i].iov_base + iov_pos;
-            to_write_len = iov[i].iov_len - iov_pos;
-
-            iov_pos += to_write_len;
+            to_write_len = iov_len - iov_pos;
+            iov_pos = iov_len;
          }
 
-         if (to_write) {
-            /* We get here if we buffered some bytes and filled the buffer, or
-             * if we didn't buffer and have to send out of the iovec */
-
-            child_ret =
-               _mongoc_stream_tls_openssl_write (tls, to_write, to_write_len);
-            if (child_ret != to_write_len) {
-               TRACE ("Got child_ret: %ld while to_write_len is: %ld",
-                      child_ret,
-                      to_write_len);
-            }
-
-            if (child_ret < 0) {
-               TRACE ("Returning what I had (%ld) as apposed to the error "
-                      "(%ld, errno:%d)",
-                      ret,
-                      child_ret,
-                      errno);
-               RETURN (ret);
-            }
+         child_ret =
+            _mongoc_stream_tls_openssl_write (tls, to_write, to_write_len);
+         if (child_ret != to_write_len) {
+            TRACE ("Got child_ret: %ld while to_write_len is: %ld",
+                   child_ret,
+                   to_write_len);
+         }
 
-            ret += child_ret;
+         if (child_ret < 0) {
+            TRACE ("Returning what I had (%ld) as apposed to the error "
+                   "(%ld, errno:%d)",
+                   ret,
+                   child_ret,
+                   errno);
+            RETURN (ret);
+         }
 
-            if (child_ret < to_write_len) {
-               /* we timed out, so send back what we could send */
+         ret += child_ret;
 
-               RETURN (ret);
-            }
+         if (child_ret < to_write_len) {
+            /* we timed out, so send back what we could send */
 
-            to_write = NULL;
+            RETURN (ret);
          }
       }
    }
 
-   if (buf_head != buf_tail) {
+   if (buf_len) {
       /* If we have any bytes buffered, send */
 
-      child_ret =
-         _mongoc_stream_tls_openssl_write (tls, buf_head, buf_tail - buf_head);
+      child_ret = _mongoc_stream_tls_openssl_write (tls, buf, buf_len);
 
       if (child_ret < 0) {
          RETURN (child_ret);
@@ -395,8 +432,6 @@ _mongoc_stream_tls_openssl_writev (mongoc_stream_t *stream,
  * Side effects:
  *       iov buffers will be written to.
  *
- * This function is copied as _mongoc_stream_tls_secure_transport_readv
- *
  *--------------------------------------------------------------------------
  */
 
@@ -436,6 +471,14 @@ _mongoc_stream_tls_openssl_readv (mongoc_stream_t *stream,
                               (char *) iov[i].iov_base + iov_pos,
                               (int) (iov[i].iov_len - iov_pos));
 
+         if (read_ret <= 0 && openssl->socket_bio) {
+            if (_mongoc_stream_tls_openssl_wait (tls, expire)) {
+               continue;
+            }
+
+            RETURN (-1);
+         }
+
          /* https://www.openssl.org/docs/crypto/BIO_should_retry.html:
           *
           * If BIO_should_retry() returns false then the precise "error
@@ -537,6 +580,35 @@ _mongoc_stream_tls_openssl_check_closed (mongoc_stream_t *stream) /* IN */
 }
 
 
+/* true if the handshake on @stream resumed a previous session */
+bool
+_mongoc_stream_tls_openssl_session_reused (mongoc_stream_t *stream)
+{
+   mongoc_stream_tls_t *tls = (mongoc_stream_tls_t *) stream;
+   mongoc_stream_tls_openssl_t *openssl =
+      (mongoc_stream_tls_openssl_t *) tls->ctx;
+   SSL *ssl;
+
+   BSON_ASSERT (tls);
+
+   BIO_get_ssl (openssl->bio, &ssl);
+
+   return SSL_session_reused (ssl) ? true : false;
+}
+
+
+/* true if the kernel encrypts the records written on @stream */
+bool
+_mongoc_stream_tls_openssl_kernel_tls (mongoc_stream_t *stream)
+{
+   mongoc_stream_tls_t *tls = (mongoc_stream_tls_t *) stream;
+
+   BSON_ASSERT (tls);
+
+   return ((mongoc_stream_tls_openssl_t *) tls->ctx)->ktls_send;
+}
+
+
 /**
  * mongoc_stream_tls_openssl_handshake:
  */
@@ -560,6 +632,21 @@ mongoc_stream_tls_openssl_handshake (mongoc_stream_t *stream,
    if (BIO_do_handshake (openssl->bio) == 1) {
       if (_mongoc_openssl_check_cert (
              ssl, host, tls->ssl_opts.allow_invalid_hostname)) {
+#ifdef MONGOC_OPENSSL_KTLS
+         if (openssl->socket_bio && BIO_get_ktls_send (SSL_get_wbio (ssl))) {
+            openssl->ktls_send = true;
+            mongoc_counter_tls_kernel_offload_inc ();
+         }
+#endif
+
+         if (openssl->client) {
+            if (SSL_session_reused (ssl)) {
+               mongoc_counter_tls_handshakes_resumed_inc ();
+            } else {
+               mongoc_counter_tls_handshakes_full_inc ();
+            }
+         }
+
          RETURN (true);
       }
 
@@ -596,27 +683,6 @@ mongoc_stream_tls_openssl_handshake (mongoc_stream_t *stream,
    RETURN (false);
 }
 
-/* Callback to get the client provided SNI, if any
- * It is only called in SSL "server mode" (e.g. when using the Mock Server),
- * and we don't actually use the hostname for anything, just debug print it
- */
-static int
-_mongoc_stream_tls_openssl_sni (SSL *ssl, int *ad, void *arg)
-{
-   const char *hostname;
-
-   if (ssl == NULL) {
-      TRACE ("%s", "No SNI hostname provided");
-      return SSL_TLSEXT_ERR_NOACK;
-   }
-
-   hostname = SSL_get_servername (ssl, TLSEXT_NAMETYPE_host_name);
-   /* This is intentionally debug since its only used by the mock test server */
-   MONGOC_DEBUG ("Got SNI: '%s'", hostname);
-
-   return SSL_TLSEXT_ERR_OK;
-}
-
 static bool
 _mongoc_stream_tls_openssl_timed_out (mongoc_stream_t *stream)
 {
@@ -655,28 +721,87 @@ mongoc_stream_tls_openssl_new (mongoc_stream_t *base_stream,
                                const char *host,
                                mongoc_ssl_opt_t *opt,
                                int client)
+{
+   return _mongoc_stream_tls_openssl_new (
+      base_stream, host, opt, client, false, NULL);
+}
+
+
+/* with @kernel_tls, a client stream over a socket lets OpenSSL enable
+ * kernel TLS after the handshake if the kernel supports the cipher. with
+ * @session_key, a client stream resumes and keeps the sessions of the
+ * server at that "host:port" */
+mongoc_stream_t *
+_mongoc_stream_tls_openssl_new (mongoc_stream_t *base_stream,
+                                const char *host,
+                                mongoc_ssl_opt_t *opt,
+                                int client,
+                                bool kernel_tls,
+                                const char *session_key)
 {
    mongoc_stream_tls_t *tls;
    mongoc_stream_tls_openssl_t *openssl;
    SSL_CTX *ssl_ctx = NULL;
+   SSL *ssl;
    BIO *bio_ssl = NULL;
    BIO *bio_mongoc_shim = NULL;
-   BIO_METHOD *meth;
+   BIO_METHOD *meth = NULL;
+   int fd = -1;
 
    BSON_ASSERT (base_stream);
    BSON_ASSERT (opt);
    ENTRY;
 
-   ssl_ctx = _mongoc_openssl_ctx_new (opt);
+   /* shared with other streams, must not be modified */
+   ssl_ctx = _mongoc_openssl_ctx_get (opt, client ? true : false);
 
    if (!ssl_ctx) {
       RETURN (NULL);
    }
 
+#ifdef MONGOC_OPENSSL_KTLS
+   if (client && kernel_tls &&
+       base_stream->type == MONGOC_STREAM_SOCKET) {
+      fd = mongoc_stream_socket_get_socket (
+              (mongoc_stream_socket_t *) base_stream)
+              ->sd;
+   }
+#endif
+
+   bio_ssl = BIO_new_ssl (ssl_ctx, client);
+   if (!bio_ssl) {
+      SSL_CTX_free (ssl_ctx);
+      RETURN (NULL);
+   }
+
+   if (fd != -1) {
+      /* OpenSSL enables kernel TLS after the handshake if the kernel
+       * supports the negotiated cipher */
+      bio_mongoc_shim = BIO_new_socket (fd, BIO_NOCLOSE);
+   } else {
+      meth = mongoc_stream_tls_openssl_bio_meth_new ();
+      bio_mongoc_shim = BIO_new (meth);
+   }
+
+   if (!bio_mongoc_shim) {
+      BIO_free_all (bio_ssl);
+      BIO_meth_free (meth);
+      SSL_CTX_free (ssl_ctx);
+      RETURN (NULL);
+   }
+
+   BIO_get_ssl (bio_ssl, &ssl);
+
+#ifdef MONGOC_OPENSSL_KTLS
+   if (fd != -1) {
+      SSL_set_options (ssl, SSL_OP_ENABLE_KTLS);
+   }
+#endif
+
 #if OPENSSL_VERSION_NUMBER >= 0x10002000L && !defined(LIBRESSL_VERSION_NUMBER)
    if (!opt->allow_invalid_hostname) {
       struct in_addr addr;
-      X509_VERIFY_PARAM *param = X509_VERIFY_PARAM_new ();
+      X509_VERIFY_PARAM *param = SSL_get0_param (ssl);
 
       X509_VERIFY_PARAM_set_hostflags (param,
                                        X509_CHECK_FLAG_NO_PARTIAL_WILDCARDS);
@@ -686,54 +811,33 @@ mongoc_stream_tls_openssl_new (mongoc_stream_t *base_stream,
       } else {
          X509_VERIFY_PARAM_set1_host (param, host, 0);
       }
-      SSL_CTX_set1_param (ssl_ctx, param);
-      X509_VERIFY_PARAM_free (param);
    }
 #endif
 
-   if (!client) {
-      /* Only usd by the Mock Server.
-       * Set a callback to get the SNI, if provided */
-      SSL_CTX_set_tlsext_servername_callback (ssl_ctx,
-                                              _mongoc_stream_tls_openssl_sni);
-   }
-
-   if (opt->weak_cert_validation) {
-      SSL_CTX_set_verify (ssl_ctx, SSL_VERIFY_NONE, NULL);
-   } else {
-      SSL_CTX_set_verify (ssl_ctx, SSL_VERIFY_PEER, NULL);
-   }
-
-   bio_ssl = BIO_new_ssl (ssl_ctx, client);
-   if (!bio_ssl) {
-      SSL_CTX_free (ssl_ctx);
-      RETURN (NULL);
-   }
-   meth = mongoc_stream_tls_openssl_bio_meth_new ();
-   bio_mongoc_shim = BIO_new (meth);
-   if (!bio_mongoc_shim) {
-      BIO_free_all (bio_ssl);
-      BIO_meth_free (meth);
-      RETURN (NULL);
-   }
-
 /* Added in OpenSSL 0.9.8f, as a build time option */
 #ifdef SSL_CTRL_SET_TLSEXT_HOSTNAME
    if (client) {
-      SSL *ssl;
       /* Set the SNI hostname we are expecting certificate for */
-      BIO_get_ssl (bio_ssl, &ssl);
       SSL_set_tlsext_host_name (ssl, host);
-#endif
    }
-
+#endif
 
    BIO_push (bio_ssl, bio_mongoc_shim);
 
    openssl = (mongoc_stream_tls_openssl_t *) bson_malloc0 (sizeof *openssl);
+
+   if (client && session_key) {
+      /* resume the last session with this server, if any. the key must
+       * outlive @ssl, which stores new sessions under it */
+      openssl->session_key = bson_strdup (session_key);
+      _mongoc_openssl_session_set (ssl, openssl->session_key);
+   }
+
    openssl->bio = bio_ssl;
    openssl->meth = meth;
    openssl->ctx = ssl_ctx;
+   openssl->client = client ? true : false;
+   openssl->socket_bio = fd != -1;
 
    tls = (mongoc_stream_tls_t *) bson_malloc0 (sizeof *tls);
    tls->parent.type = MONGOC_STREAM_TLS;
@@ -752,7 +856,9 @@ mongoc_stream_tls_openssl_new (mongoc_stream_t *base_stream,
    tls->ctx = (void *) openssl;
    tls->timeout_msec = -1;
    tls->base_stream = base_stream;
-   mongoc_stream_tls_openssl_bio_set_data (bio_mongoc_shim, tls);
+   if (!openssl->socket_bio) {
+      mongoc_stream_tls_openssl_bio_set_data (bio_mongoc_shim, tls);
+   }
 
    mongoc_counter_streams_active_inc ();
 
@@ -48,6 +48,15 @@ struct _mongoc_stream_tls_t {
 };
 
 
+mongoc_stream_t *
+_mongoc_stream_tls_new_with_hostname (mongoc_stream_t *base_stream,
+                                      const char *host,
+                                      mongoc_ssl_opt_t *opt,
+                                      int client,
+                                      bool kernel_tls,
+                                      const char *session_key);
+
+
 BSON_END_DECLS
 
 #endif /* MONGOC_STREAM_TLS_PRIVATE_H */
@@ -157,7 +157,8 @@ _mongoc_stream_tls_secure_transport_write (mongoc_stream_t *stream,
    RETURN (write_ret);
 }
 
-/* This is copypasta from _mongoc_stream_tls_openssl_writev */
+/* This is copypasta from _mongoc_stream_tls_openssl_writev, from before it
+ * coalesced small iovecs into full TLS records */
 #define MONGOC_STREAM_TLS_BUFFER_SIZE 4096
 static ssize_t
 _mongoc_stream_tls_secure_transport_writev (mongoc_stream_t *stream,
@@ -281,7 +282,8 @@ _mongoc_stream_tls_secure_transport_writev (mongoc_stream_t *stream,
    RETURN (ret);
 }
 
-/* This function is copypasta of _mongoc_stream_tls_openssl_readv */
+/* This function is copypasta of _mongoc_stream_tls_openssl_readv, without
+ * polling the socket BIO it uses for kernel TLS */
 static ssize_t
 _mongoc_stream_tls_secure_transport_readv (mongoc_stream_t *stream,
                                            mongoc_iovec_t *iov,
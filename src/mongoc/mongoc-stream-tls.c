@@ -30,6 +30,7 @@
 #include "mongoc-stream-private.h"
 #if defined(MONGOC_ENABLE_SSL_OPENSSL)
 #include "mongoc-stream-tls-openssl.h"
+#include "mongoc-stream-tls-openssl-private.h"
 #include "mongoc-openssl-private.h"
 #elif defined(MONGOC_ENABLE_SSL_LIBRESSL)
 #include "mongoc-libressl-private.h"
@@ -200,6 +201,24 @@ mongoc_stream_tls_new_with_hostname (mongoc_stream_t *base_stream,
                                      const char *host,
                                      mongoc_ssl_opt_t *opt,
                                      int client)
+{
+   return _mongoc_stream_tls_new_with_hostname (
+      base_stream, host, opt, client, false, NULL);
+}
+
+
+/* like mongoc_stream_tls_new_with_hostname, and if @kernel_tls is set by
+ * the URI option "sslKernelTLS", an OpenSSL client stream lets the kernel
+ * encrypt records after the handshake. an OpenSSL client stream with a
+ * @session_key, the server's "host:port", resumes the last session with
+ * that server. other TLS libraries ignore both */
+mongoc_stream_t *
+_mongoc_stream_tls_new_with_hostname (mongoc_stream_t *base_stream,
+                                      const char *host,
+                                      mongoc_ssl_opt_t *opt,
+                                      int client,
+                                      bool kernel_tls,
+                                      const char *session_key)
 {
    BSON_ASSERT (base_stream);
 
@@ -217,7 +236,8 @@ mongoc_stream_tls_new_with_hostname (mongoc_stream_t *base_stream,
 #endif
 
 #if defined(MONGOC_ENABLE_SSL_OPENSSL)
-   return mongoc_stream_tls_openssl_new (base_stream, host, opt, client);
+   return _mongoc_stream_tls_openssl_new (
+      base_stream, host, opt, client, kernel_tls, session_key);
 #elif defined(MONGOC_ENABLE_SSL_LIBRESSL)
    return mongoc_stream_tls_libressl_new (base_stream, host, opt, client);
 #elif defined(MONGOC_ENABLE_SSL_SECURE_TRANSPORT)
@@ -25,8 +25,10 @@
 #include "mongoc-log.h"
 #include "mongoc-opcode.h"
 #include "mongoc-rpc-private.h"
+#include "mongoc-socket-private.h"
 #include "mongoc-stream.h"
 #include "mongoc-stream-private.h"
+#include "mongoc-stream-socket.h"
 #include "mongoc-trace-private.h"
 #include "mongoc-util-private.h"
 
@@ -312,9 +314,8 @@ mongoc_stream_get_base_stream (mongoc_stream_t *stream) /* IN */
 }
 
 
-static mongoc_stream_t *
+mongoc_stream_t *
 mongoc_stream_get_root_stream (mongoc_stream_t *stream)
-
 {
    BSON_ASSERT (stream);
 
@@ -325,6 +326,44 @@ mongoc_stream_get_root_stream (mongoc_stream_t *stream)
    return stream;
 }
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_stream_close_inherited --
+ *
+ *       Close the socket beneath @stream without sending anything on it,
+ *       for connections a child process inherited across fork(). The
+ *       parent may still be using the connection, so it is not shut
+ *       down. @stream must still be destroyed afterward; anything it
+ *       tries to send then, such as a TLS close_notify alert, fails.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_stream_close_inherited (mongoc_stream_t *stream) /* IN */
+{
+   mongoc_stream_t *root;
+   mongoc_socket_t *sock;
+
+   if (!stream) {
+      return;
+   }
+
+   root = mongoc_stream_get_root_stream (stream);
+   if (root->type != MONGOC_STREAM_SOCKET) {
+      return;
+   }
+
+   sock = mongoc_stream_socket_get_socket ((mongoc_stream_socket_t *) root);
+   if (sock) {
+      /* not owned by this process: close without shutdown () */
+      sock->pid = 0;
+      mongoc_socket_close (sock);
+   }
+}
+
+
 mongoc_stream_t *
 mongoc_stream_get_tls_stream (mongoc_stream_t *stream) /* IN */
 {
@@ -22,6 +22,7 @@
 #include "mongoc-array-private.h"
 #include "mongoc-topology-description.h"
 #include "mongoc-apm-private.h"
+#include "mongoc-thread-private.h"
 
 
 typedef enum {
@@ -33,11 +34,48 @@ typedef enum {
    MONGOC_TOPOLOGY_DESCRIPTION_TYPES
 } mongoc_topology_description_type_t;
 
+typedef enum { MONGOC_SS_READ, MONGOC_SS_WRITE } mongoc_ss_optype_t;
+
+#define MONGOC_TOPOLOGY_CANDIDATES_CACHE_SIZE 8
+
+/* the servers suitable for one kind of selection, see
+ * mongoc_topology_description_suitable_servers */
+typedef struct _mongoc_topology_candidates_t {
+   mongoc_ss_optype_t optype;
+   mongoc_read_mode_t read_mode;
+   bson_t tags;
+   int64_t max_staleness_seconds;
+   int64_t local_threshold_ms;
+   mongoc_array_t servers; /* of mongoc_server_description_t *, borrowed */
+} mongoc_topology_candidates_t;
+
+/* candidate lists computed since the description last changed. readers
+ * scan the first "len" entries without locking; entries are only added,
+ * under the mutex, until the generation changes, which a shared snapshot
+ * of the description never does. */
+typedef struct _mongoc_topology_candidates_cache_t {
+   mongoc_mutex_t mutex;
+   uint32_t generation;
+   int32_t len;
+   mongoc_topology_candidates_t entries[MONGOC_TOPOLOGY_CANDIDATES_CACHE_SIZE];
+} mongoc_topology_candidates_cache_t;
+
+#define MONGOC_TOPOLOGY_IN_FLIGHT_SLOTS 64
+
+/* operations in progress on each server, for least-outstanding-requests
+ * selection. servers whose ids are equal modulo the number of slots share
+ * a count. */
+typedef struct _mongoc_topology_in_flight_t {
+   int32_t counts[MONGOC_TOPOLOGY_IN_FLIGHT_SLOTS];
+} mongoc_topology_in_flight_t;
+
 struct _mongoc_topology_description_t {
    bson_oid_t topology_id;
    bool opened;
    mongoc_topology_description_type_t type;
    int64_t heartbeat_msec;
+   /* measure the latency window by operation latencies, not heartbeats */
+   bool operation_rtt;
    mongoc_set_t *servers;
    char *set_name;
    int64_t max_set_version;
@@ -47,6 +85,15 @@ struct _mongoc_topology_description_t {
    bool stale;
    unsigned int rand_seed;
 
+   /* incremented whenever the servers or their descriptions change */
+   uint32_t generation;
+   mongoc_topology_candidates_cache_t candidates;
+
+   /* incremented when a check fails after a success, a server's or the
+    * topology's type changes, or a server says it is no longer primary.
+    * adaptive monitoring checks again soon after */
+   uint32_t disruptions;
+
    /* the greatest seen cluster time, for a MongoDB 3.6+ sharded cluster.
     * see Driver Sessions Spec. */
    uint32_t cluster_time_t;
@@ -57,8 +104,6 @@ struct _mongoc_topology_description_t {
    void *apm_context;
 };
 
-typedef enum { MONGOC_SS_READ, MONGOC_SS_WRITE } mongoc_ss_optype_t;
-
 void
 mongoc_topology_description_init (mongoc_topology_description_t *description,
                                   int64_t heartbeat_msec);
@@ -85,6 +130,27 @@ mongoc_topology_description_select (mongoc_topology_description_t *description,
                                     const mongoc_read_prefs_t *read_pref,
                                     int64_t local_threshold_ms);
 
+mongoc_server_description_t *
+_mongoc_topology_description_select (
+   mongoc_topology_description_t *description,
+   mongoc_ss_optype_t optype,
+   const mongoc_read_prefs_t *read_pref,
+   int64_t local_threshold_ms,
+   unsigned int *rand_seed,
+   const mongoc_topology_in_flight_t *in_flight);
+
+mongoc_server_description_t *
+_mongoc_topology_description_select_hedge (
+   mongoc_topology_description_t *description,
+   const mongoc_read_prefs_t *read_pref,
+   int64_t local_threshold_ms,
+   unsigned int *rand_seed,
+   uint32_t exclude_id);
+
+int32_t *
+_mongoc_topology_in_flight_count (mongoc_topology_in_flight_t *in_flight,
+                                  uint32_t server_id);
+
 mongoc_server_description_t *
 mongoc_topology_description_server_by_id (
    mongoc_topology_description_t *description,
@@ -32,6 +32,31 @@ _mongoc_topology_server_dtor (void *server_, void *ctx_)
    mongoc_server_description_destroy ((mongoc_server_description_t *) server_);
 }
 
+static void
+_mongoc_topology_candidates_cache_init (
+   mongoc_topology_candidates_cache_t *cache, uint32_t generation)
+{
+   mongoc_mutex_init (&cache->mutex);
+   cache->generation = generation;
+   cache->len = 0;
+}
+
+
+static void
+_mongoc_topology_candidates_cache_clear (
+   mongoc_topology_candidates_cache_t *cache)
+{
+   int32_t i;
+
+   for (i = 0; i < cache->len; i++) {
+      bson_destroy (&cache->entries[i].tags);
+      _mongoc_array_destroy (&cache->entries[i].servers);
+   }
+
+   cache->len = 0;
+}
+
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -67,6 +92,9 @@ mongoc_topology_description_init (mongoc_topology_description_t *description,
    description->max_set_version = MONGOC_NO_SET_VERSION;
    description->stale = true;
    description->rand_seed = (unsigned int) bson_get_monotonic_time ();
+   description->generation = 0;
+   _mongoc_topology_candidates_cache_init (&description->candidates, 0);
+   description->disruptions = 0;
    description->cluster_time_t = 0;
    description->cluster_time_i = 0;
    bson_init (&description->cluster_time);
@@ -111,6 +139,7 @@ _mongoc_topology_description_copy_to (const mongoc_topology_description_t *src,
    dst->opened = src->opened;
    dst->type = src->type;
    dst->heartbeat_msec = src->heartbeat_msec;
+   dst->operation_rtt = src->operation_rtt;
 
    nitems = bson_next_power_of_two (src->servers->items_len);
    dst->servers = mongoc_set_new (nitems, _mongoc_topology_server_dtor, NULL);
@@ -127,6 +156,10 @@ _mongoc_topology_description_copy_to (const mongoc_topology_description_t *src,
            sizeof (bson_error_t));
    dst->max_server_id = src->max_server_id;
    dst->stale = src->stale;
+   /* the candidates point into src's servers, start with none */
+   dst->generation = src->generation;
+   _mongoc_topology_candidates_cache_init (&dst->candidates, dst->generation);
+   dst->disruptions = src->disruptions;
    memcpy (&dst->apm_callbacks,
            &src->apm_callbacks,
            sizeof (mongoc_apm_callbacks_t));
@@ -170,6 +203,8 @@ mongoc_topology_description_destroy (mongoc_topology_description_t *description)
       bson_free (description->set_name);
    }
 
+   _mongoc_topology_candidates_cache_clear (&description->candidates);
+   mongoc_mutex_destroy (&description->candidates.mutex);
    bson_destroy (&description->cluster_time);
 
    EXIT;
@@ -400,6 +435,28 @@ _mongoc_try_mode_secondary (mongoc_array_t *set, /* OUT */
 }
 
 
+/* the round trip time by which to compute the latency window: with
+ * operation_rtt, the server's percentile latency of reads or writes once
+ * it is known, otherwise the ismaster round trip time */
+static int64_t
+_mongoc_topology_description_rtt (mongoc_topology_description_t *topology,
+                                  mongoc_server_description_t *sd,
+                                  mongoc_ss_optype_t optype)
+{
+   int64_t rtt_msec;
+
+   if (!topology->operation_rtt) {
+      return sd->round_trip_time_msec;
+   }
+
+   rtt_msec = sd->operation_rtt_msec[optype == MONGOC_SS_READ
+                                        ? MONGOC_LATENCY_READ
+                                        : MONGOC_LATENCY_WRITE];
+
+   return rtt_msec == -1 ? sd->round_trip_time_msec : rtt_msec;
+}
+
+
 /* if any mongos are candidates, add them to the candidates array */
 static bool
 _mongoc_find_suitable_mongos_cb (void *item, void *ctx)
@@ -582,6 +639,7 @@ mongoc_topology_description_suitable_servers (
    mongoc_server_description_t **candidates;
    mongoc_server_description_t *server;
    int64_t nearest = -1;
+   int64_t rtt_msec;
    int i;
    mongoc_read_mode_t read_mode = mongoc_read_prefs_get_mode (read_pref);
 
@@ -697,15 +755,21 @@ mongoc_topology_description_suitable_servers (
     * Find the nearest, then select within the window */
 
    for (i = 0; i < data.candidates_len; i++) {
-      if (candidates[i] &&
-          (nearest == -1 || nearest > candidates[i]->round_trip_time_msec)) {
-         nearest = candidates[i]->round_trip_time_msec;
+      if (!candidates[i]) {
+         continue;
+      }
+
+      rtt_msec =
+         _mongoc_topology_description_rtt (topology, candidates[i], optype);
+      if (nearest == -1 || nearest > rtt_msec) {
+         nearest = rtt_msec;
       }
    }
 
    for (i = 0; i < data.candidates_len; i++) {
-      if (candidates[i] && (candidates[i]->round_trip_time_msec <=
-                            nearest + local_threshold_ms)) {
+      if (candidates[i] &&
+          (_mongoc_topology_description_rtt (topology, candidates[i], optype) <=
+           nearest + local_threshold_ms)) {
          _mongoc_array_append_val (set, candidates[i]);
       }
    }
@@ -746,10 +810,196 @@ mongoc_topology_description_select (mongoc_topology_description_t *topology,
                                     mongoc_ss_optype_t optype,
                                     const mongoc_read_prefs_t *read_pref,
                                     int64_t local_threshold_ms)
+{
+   return _mongoc_topology_description_select (topology,
+                                               optype,
+                                               read_pref,
+                                               local_threshold_ms,
+                                               &topology->rand_seed,
+                                               NULL);
+}
+
+
+/* the count of operations in progress on @server_id */
+int32_t *
+_mongoc_topology_in_flight_count (mongoc_topology_in_flight_t *in_flight,
+                                  uint32_t server_id)
+{
+   return &in_flight->counts[server_id % MONGOC_TOPOLOGY_IN_FLIGHT_SLOTS];
+}
+
+
+static bool
+_mongoc_topology_candidates_match (const mongoc_topology_candidates_t *entry,
+                                   mongoc_ss_optype_t optype,
+                                   const mongoc_read_prefs_t *read_pref,
+                                   int64_t local_threshold_ms)
+{
+   if (entry->optype != optype ||
+       entry->read_mode != mongoc_read_prefs_get_mode (read_pref) ||
+       entry->local_threshold_ms != local_threshold_ms) {
+      return false;
+   }
+
+   if (!read_pref) {
+      return entry->max_staleness_seconds == MONGOC_NO_MAX_STALENESS &&
+             bson_empty (&entry->tags);
+   }
+
+   return entry->max_staleness_seconds ==
+             mongoc_read_prefs_get_max_staleness_seconds (read_pref) &&
+          bson_equal (&entry->tags, mongoc_read_prefs_get_tags (read_pref));
+}
+
+
+/*
+ *-------------------------------------------------------------------------
+ *
+ * _mongoc_topology_description_candidates --
+ *
+ *      Return the servers suitable for @optype and @read_pref, from the
+ *      cache if they were found since @topology last changed. Otherwise
+ *      find them and add them to the cache.
+ *
+ *      Threads may call this concurrently on a snapshot of the topology
+ *      description. Otherwise, call it while holding the mutex on the
+ *      owning topology object.
+ *
+ * Returns:
+ *      A borrowed array of server descriptions, or NULL if the cache is
+ *      full: then the caller calls
+ *      mongoc_topology_description_suitable_servers itself.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+static const mongoc_array_t *
+_mongoc_topology_description_candidates (
+   mongoc_topology_description_t *topology,
+   mongoc_ss_optype_t optype,
+   const mongoc_read_prefs_t *read_pref,
+   int64_t local_threshold_ms)
+{
+   mongoc_topology_candidates_cache_t *cache = &topology->candidates;
+   mongoc_topology_candidates_t *entry;
+   const mongoc_array_t *servers = NULL;
+   int32_t len;
+   int32_t i;
+
+   if (cache->generation != topology->generation) {
+      /* only the owner of a description that changes gets here */
+      _mongoc_topology_candidates_cache_clear (cache);
+      cache->generation = topology->generation;
+   }
+
+   len = bson_atomic_int_add (&cache->len, 0);
+   for (i = 0; i < len; i++) {
+      if (_mongoc_topology_candidates_match (
+             &cache->entries[i], optype, read_pref, local_threshold_ms)) {
+         return &cache->entries[i].servers;
+      }
+   }
+
+   mongoc_mutex_lock (&cache->mutex);
+
+   /* another thread may have added it meanwhile */
+   for (i = len; i < cache->len; i++) {
+      if (_mongoc_topology_candidates_match (
+             &cache->entries[i], optype, read_pref, local_threshold_ms)) {
+         servers = &cache->entries[i].servers;
+         goto DONE;
+      }
+   }
+
+   if (cache->len == MONGOC_TOPOLOGY_CANDIDATES_CACHE_SIZE) {
+      goto DONE;
+   }
+
+   entry = &cache->entries[cache->len];
+   entry->optype = optype;
+   entry->read_mode = mongoc_read_prefs_get_mode (read_pref);
+   entry->local_threshold_ms = local_threshold_ms;
+   if (read_pref) {
+      entry->max_staleness_seconds =
+         mongoc_read_prefs_get_max_staleness_seconds (read_pref);
+      bson_copy_to (mongoc_read_prefs_get_tags (read_pref), &entry->tags);
+   } else {
+      entry->max_staleness_seconds = MONGOC_NO_MAX_STALENESS;
+      bson_init (&entry->tags);
+   }
+
+   _mongoc_array_init (&entry->servers, sizeof (mongoc_server_description_t *));
+   mongoc_topology_description_suitable_servers (&entry->servers,
+                                                 optype,
+                                                 topology,
+                                                 read_pref,
+                                                 (size_t) local_threshold_ms);
+
+   /* publish the entry before readers can see it */
+   bson_memory_barrier ();
+   cache->len++;
+   servers = &entry->servers;
+
+DONE:
+   mongoc_mutex_unlock (&cache->mutex);
+
+   return servers;
+}
+
+
+/* pick a random server from @servers. with @in_flight, pick two distinct
+ * servers at random and return the one with fewer operations in progress
+ * ("power of two choices"), which keeps a slow server's queue from growing
+ * without herding every client onto the least-loaded one */
+static mongoc_server_description_t *
+_mongoc_topology_description_pick (const mongoc_array_t *servers,
+                                   unsigned int *rand_seed,
+                                   const mongoc_topology_in_flight_t *in_flight)
+{
+   mongoc_server_description_t *sd;
+   mongoc_server_description_t *other;
+   size_t i;
+   size_t j;
+
+   i = (size_t) _mongoc_rand_simple (rand_seed) % servers->len;
+   sd = _mongoc_array_index (servers, mongoc_server_description_t *, i);
+
+   if (!in_flight || servers->len < 2) {
+      return sd;
+   }
+
+   j = (size_t) _mongoc_rand_simple (rand_seed) % (servers->len - 1);
+   if (j >= i) {
+      j++;
+   }
+
+   other = _mongoc_array_index (servers, mongoc_server_description_t *, j);
+
+   if (in_flight->counts[other->id % MONGOC_TOPOLOGY_IN_FLIGHT_SLOTS] <
+       in_flight->counts[sd->id % MONGOC_TOPOLOGY_IN_FLIGHT_SLOTS]) {
+      return other;
+   }
+
+   return sd;
+}
+
+
+/* like mongoc_topology_description_select, but draws the random choice
+ * from @rand_seed, so threads can select from a shared, immutable
+ * description with seeds of their own. if @in_flight is not NULL, prefer
+ * the less busy of two random suitable servers. */
+mongoc_server_description_t *
+_mongoc_topology_description_select (
+   mongoc_topology_description_t *topology,
+   mongoc_ss_optype_t optype,
+   const mongoc_read_prefs_t *read_pref,
+   int64_t local_threshold_ms,
+   unsigned int *rand_seed,
+   const mongoc_topology_in_flight_t *in_flight)
 {
    mongoc_array_t suitable_servers;
+   const mongoc_array_t *candidates;
    mongoc_server_description_t *sd = NULL;
-   int rand_n;
 
    ENTRY;
 
@@ -765,19 +1015,27 @@ mongoc_topology_description_select (mongoc_topology_description_t *topology,
       }
    }
 
-   _mongoc_array_init (&suitable_servers,
-                       sizeof (mongoc_server_description_t *));
+   candidates = _mongoc_topology_description_candidates (
+      topology, optype, read_pref, local_threshold_ms);
 
-   mongoc_topology_description_suitable_servers (
-      &suitable_servers, optype, topology, read_pref, local_threshold_ms);
-   if (suitable_servers.len != 0) {
-      rand_n = _mongoc_rand_simple (&topology->rand_seed);
-      sd = _mongoc_array_index (&suitable_servers,
-                                mongoc_server_description_t *,
-                                rand_n % suitable_servers.len);
-   }
+   if (candidates) {
+      if (candidates->len != 0) {
+         sd = _mongoc_topology_description_pick (
+            candidates, rand_seed, in_flight);
+      }
+   } else {
+      _mongoc_array_init (&suitable_servers,
+                          sizeof (mongoc_server_description_t *));
+
+      mongoc_topology_description_suitable_servers (
+         &suitable_servers, optype, topology, read_pref, local_threshold_ms);
+      if (suitable_servers.len != 0) {
+         sd = _mongoc_topology_description_pick (
+            &suitable_servers, rand_seed, in_flight);
+      }
 
-   _mongoc_array_destroy (&suitable_servers);
+      _mongoc_array_destroy (&suitable_servers);
+   }
 
    if (sd) {
       TRACE ("Topology type [%s], selected [%s] [%s]",
@@ -789,6 +1047,71 @@ mongoc_topology_description_select (mongoc_topology_description_t *topology,
    RETURN (sd);
 }
 
+
+/* choose a server to repeat a read on, after the read was sent to server
+ * @exclude_id: a random suitable server for @read_pref other than that
+ * one, or NULL if there is none */
+mongoc_server_description_t *
+_mongoc_topology_description_select_hedge (
+   mongoc_topology_description_t *topology,
+   const mongoc_read_prefs_t *read_pref,
+   int64_t local_threshold_ms,
+   unsigned int *rand_seed,
+   uint32_t exclude_id)
+{
+   mongoc_array_t suitable_servers;
+   const mongoc_array_t *candidates;
+   mongoc_server_description_t *sd = NULL;
+   mongoc_server_description_t *other;
+   size_t n = 0;
+   size_t i;
+
+   ENTRY;
+
+   if (topology->type == MONGOC_TOPOLOGY_SINGLE) {
+      RETURN (NULL);
+   }
+
+   candidates = _mongoc_topology_description_candidates (
+      topology, MONGOC_SS_READ, read_pref, local_threshold_ms);
+
+   if (!candidates) {
+      _mongoc_array_init (&suitable_servers,
+                          sizeof (mongoc_server_description_t *));
+
+      mongoc_topology_description_suitable_servers (
+         &suitable_servers,
+         MONGOC_SS_READ,
+         topology,
+         read_pref,
+         (size_t) local_threshold_ms);
+      candidates = &suitable_servers;
+   }
+
+   /* each of the n servers seen so far replaces the choice with chance 1/n */
+   for (i = 0; i < candidates->len; i++) {
+      other =
+         _mongoc_array_index (candidates, mongoc_server_description_t *, i);
+      if (other->id != exclude_id &&
+          _mongoc_rand_simple (rand_seed) % ++n == 0) {
+         sd = other;
+      }
+   }
+
+   if (candidates == &suitable_servers) {
+      _mongoc_array_destroy (&suitable_servers);
+   }
+
+   if (sd) {
+      TRACE ("Topology type [%s], hedging on [%s] [%s]",
+             mongoc_topology_description_type (topology),
+             mongoc_server_description_type (sd),
+             sd->host.host_and_port);
+   }
+
+   RETURN (sd);
+}
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -858,6 +1181,7 @@ _mongoc_topology_description_remove_server (
 
    _mongoc_topology_description_monitor_server_closed (description, server);
    mongoc_set_rm (description->servers, server->id);
+   description->generation++;
 }
 
 typedef struct _mongoc_address_and_id_t {
@@ -1125,6 +1449,7 @@ mongoc_topology_description_add_server (mongoc_topology_description_t *topology,
       mongoc_server_description_init (description, server, server_id);
 
       mongoc_set_add (topology->servers, server_id, description);
+      topology->generation++;
 
       /* if we're in topology_new then no callbacks are registered and this is
        * a no-op. later, if we discover a new RS member this sends an event. */
@@ -1842,6 +2167,9 @@ mongoc_topology_description_handle_ismaster (
    mongoc_topology_description_t *prev_td = NULL;
    mongoc_server_description_t *prev_sd = NULL;
    mongoc_server_description_t *sd;
+   mongoc_server_description_type_t prev_sd_type;
+   mongoc_topology_description_type_t prev_type;
+   bool prev_failed;
 
    BSON_ASSERT (topology);
    BSON_ASSERT (server_id != 0);
@@ -1851,6 +2179,11 @@ mongoc_topology_description_handle_ismaster (
       return; /* server already removed from topology */
    }
 
+   topology->generation++;
+   prev_sd_type = sd->type;
+   prev_type = topology->type;
+   prev_failed = sd->error.code != 0;
+
    if (topology->apm_callbacks.topology_changed) {
       prev_td = bson_malloc0 (sizeof (mongoc_topology_description_t));
       _mongoc_topology_description_copy_to (topology, prev_td);
@@ -1864,6 +2197,13 @@ mongoc_topology_description_handle_ismaster (
    mongoc_server_description_handle_ismaster (
       sd, ismaster_response, rtt_msec, error);
 
+   /* the first error after a success, or an election or other change of
+    * the server's role. a server that stays down is no new disruption */
+   if (sd->type != prev_sd_type ||
+       (!prev_failed && (!ismaster_response || (error && error->code)))) {
+      topology->disruptions++;
+   }
+
    mongoc_topology_description_update_cluster_time (topology,
                                                     ismaster_response);
    _mongoc_topology_description_monitor_server_changed (topology, prev_sd, sd);
@@ -1883,6 +2223,11 @@ mongoc_topology_description_handle_ismaster (
    if (ismaster_response && (!error || !error->code)) {
       _mongoc_topology_description_check_compatible (topology);
    }
+
+   if (topology->type != prev_type) {
+      topology->disruptions++;
+   }
+
    _mongoc_topology_description_monitor_changed (prev_td, topology);
 
    if (prev_td) {
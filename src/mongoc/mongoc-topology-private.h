@@ -18,8 +18,10 @@
 #define MONGOC_TOPOLOGY_PRIVATE_H
 
 #include "mongoc-topology-scanner-private.h"
+#include "mongoc-shared-monitor-private.h"
 #include "mongoc-server-description-private.h"
 #include "mongoc-topology-description-private.h"
+#include "mongoc-topology-snapshot-private.h"
 #include "mongoc-thread-private.h"
 #include "mongoc-uri.h"
 
@@ -30,6 +32,13 @@
 #define MONGOC_TOPOLOGY_SERVER_SELECTION_TIMEOUT_MS 30000
 #define MONGOC_TOPOLOGY_HEARTBEAT_FREQUENCY_MS_MULTI_THREADED 10000
 #define MONGOC_TOPOLOGY_HEARTBEAT_FREQUENCY_MS_SINGLE_THREADED 60000
+#define MONGOC_TOPOLOGY_LATENCY_SLOTS 64
+/* hedge a read that takes longer than this percentile of the server's
+ * recent reads */
+#define MONGOC_TOPOLOGY_HEDGE_PERCENTILE 95
+/* forget a server's operation latencies when no operation has sampled
+ * them for this many heartbeats */
+#define MONGOC_TOPOLOGY_LATENCY_MAX_AGE_HEARTBEATS 2
 
 typedef enum {
    MONGOC_TOPOLOGY_SCANNER_OFF,
@@ -45,6 +54,9 @@ typedef struct _mongoc_topology_t {
    bool server_selection_try_once;
 
    int64_t last_scan;
+   /* if not 0, the background scanner backs off from heartbeat_msec
+    * toward this interval while the topology is stable */
+   int64_t max_heartbeat_msec;
    int64_t local_threshold_msec;
    int64_t connect_timeout_msec;
    int64_t server_selection_timeout_msec;
@@ -53,12 +65,31 @@ typedef struct _mongoc_topology_t {
    mongoc_cond_t cond_client;
    mongoc_cond_t cond_server;
    mongoc_thread_t thread;
+   /* set instead of starting a thread if use_shared_monitor is true */
+   mongoc_shared_monitor_t *shared_monitor;
 
    mongoc_topology_scanner_state_t scanner_state;
    bool scan_requested;
    bool shutdown_requested;
    bool single_threaded;
+   bool use_shared_monitor;
    bool stale;
+
+   /* if least_outstanding, choose the less busy of two random servers in
+    * the latency window, by the operations in progress on each */
+   bool least_outstanding;
+   mongoc_topology_in_flight_t in_flight;
+
+   /* operation latencies per server, by server id modulo the number of
+    * slots. estimates are copied into the description when they change */
+   mongoc_latency_estimator_t latency[MONGOC_TOPOLOGY_LATENCY_SLOTS];
+
+   /* with a background scanner, the description as of its last change,
+    * and the latest cluster time. writers replace them while holding the
+    * mutex, readers use them without it */
+   mongoc_topology_rcu_t rcu;
+   mongoc_topology_snapshot_t *snapshot;
+   bson_t *cluster_time;
 } mongoc_topology_t;
 
 mongoc_topology_t *
@@ -89,6 +120,11 @@ mongoc_topology_select_server_id (mongoc_topology_t *topology,
                                   const mongoc_read_prefs_t *read_prefs,
                                   bson_error_t *error);
 
+uint32_t
+_mongoc_topology_select_hedge_server_id (mongoc_topology_t *topology,
+                                         const mongoc_read_prefs_t *read_prefs,
+                                         uint32_t exclude_id);
+
 mongoc_server_description_t *
 mongoc_topology_server_by_id (mongoc_topology_t *topology,
                               uint32_t id,
@@ -117,10 +153,48 @@ _mongoc_topology_get_type (mongoc_topology_t *topology);
 bool
 _mongoc_topology_start_background_scanner (mongoc_topology_t *topology);
 
+void
+_mongoc_topology_reset_after_fork (mongoc_topology_t *topology);
+
+bool
+_mongoc_topology_set_shared_monitoring (mongoc_topology_t *topology,
+                                        bool enabled);
+
+void
+_mongoc_topology_shared_monitor_cb (mongoc_topology_t *topology,
+                                    uint32_t id,
+                                    const bson_t *ismaster_response,
+                                    int64_t rtt_msec,
+                                    const bson_error_t *error);
+
 bool
 _mongoc_topology_set_appname (mongoc_topology_t *topology, const char *appname);
 
 void
 _mongoc_topology_update_cluster_time (mongoc_topology_t *topology,
                                       const bson_t *reply);
+
+void
+_mongoc_topology_publish (mongoc_topology_t *topology);
+
+mongoc_topology_snapshot_t *
+_mongoc_topology_get_snapshot (mongoc_topology_t *topology);
+
+void
+_mongoc_topology_record_latency (mongoc_topology_t *topology,
+                                 uint32_t server_id,
+                                 mongoc_latency_class_t latency_class,
+                                 int64_t usec);
+
+int64_t
+_mongoc_topology_hedge_delay_msec (mongoc_topology_t *topology,
+                                   uint32_t server_id);
+
+int64_t
+_mongoc_topology_next_heartbeat_msec (const mongoc_topology_t *topology,
+                                      int64_t interval_msec,
+                                      bool disrupted);
+
+void
+_mongoc_topology_handle_not_master (mongoc_topology_t *topology);
 #endif
@@ -146,6 +146,9 @@ mongoc_topology_scanner_get_error (mongoc_topology_scanner_t *ts,
 void
 mongoc_topology_scanner_reset (mongoc_topology_scanner_t *ts);
 
+void
+_mongoc_topology_scanner_close_inherited (mongoc_topology_scanner_t *ts);
+
 bool
 mongoc_topology_scanner_node_setup (mongoc_topology_scanner_node_t *node,
                                     bson_error_t *error);
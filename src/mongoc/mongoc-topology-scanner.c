@@ -18,9 +18,11 @@
 #include <bson-string.h>
 
 #include "mongoc-config.h"
+#include "mongoc-client-private.h"
 #include "mongoc-error.h"
 #include "mongoc-trace-private.h"
 #include "mongoc-topology-scanner-private.h"
+#include "mongoc-stream-private.h"
 #include "mongoc-stream-socket.h"
 
 #include "mongoc-handshake.h"
@@ -28,6 +30,7 @@
 
 #ifdef MONGOC_ENABLE_SSL
 #include "mongoc-stream-tls.h"
+#include "mongoc-stream-tls-private.h"
 #endif
 
 #include "mongoc-counters-private.h"
@@ -518,6 +521,8 @@ mongoc_topology_scanner_node_connect_tcp (mongoc_topology_scanner_node_t *node,
       RETURN (NULL);
    }
 
+   mongoc_counter_transport_tcp_inc ();
+
    return mongoc_stream_socket_new (sock);
 }
 
@@ -572,6 +577,7 @@ mongoc_topology_scanner_node_connect_unix (mongoc_topology_scanner_node_t *node,
       RETURN (NULL);
    }
 
+   mongoc_counter_transport_unix_inc ();
    ret = mongoc_stream_socket_new (sock);
 
    RETURN (ret);
@@ -613,15 +619,28 @@ mongoc_topology_scanner_node_setup (mongoc_topology_scanner_node_t *node,
       if (node->host.family == AF_UNIX) {
          sock_stream = mongoc_topology_scanner_node_connect_unix (node, error);
       } else {
-         sock_stream = mongoc_topology_scanner_node_connect_tcp (node, error);
+         sock_stream =
+            _mongoc_client_connect_local_unix (node->ts->uri, &node->host);
+         if (!sock_stream) {
+            sock_stream =
+               mongoc_topology_scanner_node_connect_tcp (node, error);
+         }
       }
 
 #ifdef MONGOC_ENABLE_SSL
       if (sock_stream && node->ts->ssl_opts) {
          mongoc_stream_t *original = sock_stream;
-
-         sock_stream = mongoc_stream_tls_new_with_hostname (
-            sock_stream, node->host.host, node->ts->ssl_opts, 1);
+         bool kernel_tls =
+            node->ts->uri && mongoc_uri_get_option_as_bool (
+                                node->ts->uri, MONGOC_URI_SSLKERNELTLS, false);
+
+         sock_stream =
+            _mongoc_stream_tls_new_with_hostname (sock_stream,
+                                                  node->host.host,
+                                                  node->ts->ssl_opts,
+                                                  1,
+                                                  kernel_tls,
+                                                  node->host.host_and_port);
          if (!sock_stream) {
             mongoc_stream_destroy (original);
          }
@@ -802,6 +821,39 @@ mongoc_topology_scanner_reset (mongoc_topology_scanner_t *ts)
    }
 }
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_topology_scanner_close_inherited --
+ *
+ *      Drop all monitoring connections a child process inherited across
+ *      fork() without sending anything on them. The nodes stay in the
+ *      scanner and reconnect, with a new handshake, on the next scan.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_topology_scanner_close_inherited (mongoc_topology_scanner_t *ts)
+{
+   mongoc_topology_scanner_node_t *node, *tmp;
+
+   DL_FOREACH_SAFE (ts->nodes, node, tmp)
+   {
+      _mongoc_stream_close_inherited (node->stream);
+
+      if (node->retired) {
+         mongoc_topology_scanner_node_destroy (node, false);
+      } else {
+         mongoc_topology_scanner_node_disconnect (node, false);
+         node->last_used = -1;
+         node->last_failed = -1;
+      }
+   }
+
+   ts->in_progress = false;
+}
+
 /*
  * Set a field in the topology scanner.
  */
@@ -0,0 +1,82 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MONGOC_TOPOLOGY_SNAPSHOT_PRIVATE_H
+#define MONGOC_TOPOLOGY_SNAPSHOT_PRIVATE_H
+
+#if !defined(MONGOC_COMPILATION)
+#error "Only <mongoc.h> can be included directly."
+#endif
+
+#include <bson.h>
+
+#include "mongoc-topology-description-private.h"
+#include "mongoc-topology-scanner-private.h"
+
+
+BSON_BEGIN_DECLS
+
+
+/* lets readers use data that writers replace, without locking. a reader
+ * counts itself in the current epoch while it reads; a writer replaces the
+ * data, starts the next epoch, and waits for the previous epoch's readers
+ * before freeing what it replaced. writers must be serialized. */
+typedef struct {
+   int32_t epoch;
+   int32_t readers[2];
+} mongoc_topology_rcu_t;
+
+/* an immutable, reference-counted copy of a topology description, which
+ * pooled clients select servers from without the topology's mutex */
+typedef struct _mongoc_topology_snapshot_t {
+   int32_t ref_count;
+   mongoc_topology_description_t td;
+   /* the scanner's timestamp for each of td.servers, in the same order */
+   int64_t *timestamps;
+} mongoc_topology_snapshot_t;
+
+
+void
+_mongoc_topology_rcu_init (mongoc_topology_rcu_t *rcu);
+
+int32_t
+_mongoc_topology_rcu_read_lock (mongoc_topology_rcu_t *rcu);
+
+void
+_mongoc_topology_rcu_read_unlock (mongoc_topology_rcu_t *rcu, int32_t epoch);
+
+void
+_mongoc_topology_rcu_synchronize (mongoc_topology_rcu_t *rcu);
+
+mongoc_topology_snapshot_t *
+_mongoc_topology_snapshot_new (const mongoc_topology_description_t *td,
+                               mongoc_topology_scanner_t *scanner);
+
+mongoc_topology_snapshot_t *
+_mongoc_topology_snapshot_ref (mongoc_topology_snapshot_t *snapshot);
+
+void
+_mongoc_topology_snapshot_unref (mongoc_topology_snapshot_t *snapshot);
+
+int64_t
+_mongoc_topology_snapshot_server_timestamp (
+   const mongoc_topology_snapshot_t *snapshot, uint32_t id);
+
+
+BSON_END_DECLS
+
+
+#endif /* MONGOC_TOPOLOGY_SNAPSHOT_PRIVATE_H */
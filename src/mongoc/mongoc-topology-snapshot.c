@@ -0,0 +1,196 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "mongoc-config.h"
+
+#include "mongoc-set-private.h"
+#include "mongoc-topology-snapshot-private.h"
+#include "mongoc-trace-private.h"
+#include "mongoc-util-private.h"
+
+
+#undef MONGOC_LOG_DOMAIN
+#define MONGOC_LOG_DOMAIN "topology-snapshot"
+
+
+void
+_mongoc_topology_rcu_init (mongoc_topology_rcu_t *rcu)
+{
+   BSON_ASSERT (rcu);
+
+   memset (rcu, 0, sizeof *rcu);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_topology_rcu_read_lock --
+ *
+ *       Begin reading data published under @rcu. Until the matching
+ *       _mongoc_topology_rcu_read_unlock, nothing a writer replaces is
+ *       freed. Never blocks: a reader that counts itself in an epoch that
+ *       a writer has just ended retries in the next one.
+ *
+ * Returns:
+ *       The epoch to pass to _mongoc_topology_rcu_read_unlock.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+int32_t
+_mongoc_topology_rcu_read_lock (mongoc_topology_rcu_t *rcu)
+{
+   int32_t epoch;
+
+   for (;;) {
+      epoch = rcu->epoch;
+      bson_atomic_int_add (&rcu->readers[epoch], 1);
+      bson_memory_barrier ();
+
+      if (rcu->epoch == epoch) {
+         return epoch;
+      }
+
+      bson_atomic_int_add (&rcu->readers[epoch], -1);
+   }
+}
+
+
+void
+_mongoc_topology_rcu_read_unlock (mongoc_topology_rcu_t *rcu, int32_t epoch)
+{
+   bson_memory_barrier ();
+   bson_atomic_int_add (&rcu->readers[epoch], -1);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_topology_rcu_synchronize --
+ *
+ *       Called by a writer after it publishes new data: start the next
+ *       epoch, then wait for readers of the previous one to finish, after
+ *       which no reader can still be using the data it replaced. Readers
+ *       hold no locks and do no I/O, so the wait is short.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_topology_rcu_synchronize (mongoc_topology_rcu_t *rcu)
+{
+   int32_t prev;
+   int spins = 0;
+
+   bson_memory_barrier ();
+   prev = rcu->epoch;
+   rcu->epoch = !prev;
+   bson_memory_barrier ();
+
+   while (bson_atomic_int_add (&rcu->readers[prev], 0) > 0) {
+      if (++spins > 100) {
+         _mongoc_usleep (10);
+      }
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_topology_snapshot_new --
+ *
+ *       Copy @td, and the @scanner's timestamp for each of its servers,
+ *       into a snapshot with a reference count of one. Call while holding
+ *       the topology's mutex.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+mongoc_topology_snapshot_t *
+_mongoc_topology_snapshot_new (const mongoc_topology_description_t *td,
+                               mongoc_topology_scanner_t *scanner)
+{
+   mongoc_topology_snapshot_t *snapshot;
+   mongoc_topology_scanner_node_t *node;
+   uint32_t id;
+   size_t i;
+
+   BSON_ASSERT (td);
+   BSON_ASSERT (scanner);
+
+   snapshot = (mongoc_topology_snapshot_t *) bson_malloc0 (sizeof *snapshot);
+   snapshot->ref_count = 1;
+   _mongoc_topology_description_copy_to (td, &snapshot->td);
+   snapshot->td.rand_seed = td->rand_seed;
+
+   snapshot->timestamps = (int64_t *) bson_malloc (
+      BSON_MAX (td->servers->items_len, 1) * sizeof (int64_t));
+
+   for (i = 0; i < td->servers->items_len; i++) {
+      mongoc_set_get_item_and_id (snapshot->td.servers, (int) i, &id);
+      node = mongoc_topology_scanner_get_node (scanner, id);
+      snapshot->timestamps[i] = node ? node->timestamp : -1;
+   }
+
+   return snapshot;
+}
+
+
+mongoc_topology_snapshot_t *
+_mongoc_topology_snapshot_ref (mongoc_topology_snapshot_t *snapshot)
+{
+   BSON_ASSERT (snapshot);
+
+   bson_atomic_int_add (&snapshot->ref_count, 1);
+
+   return snapshot;
+}
+
+
+void
+_mongoc_topology_snapshot_unref (mongoc_topology_snapshot_t *snapshot)
+{
+   if (snapshot && bson_atomic_int_add (&snapshot->ref_count, -1) == 0) {
+      mongoc_topology_description_destroy (&snapshot->td);
+      bson_free (snapshot->timestamps);
+      bson_free (snapshot);
+   }
+}
+
+
+/* the scanner's timestamp for server @id, or -1 if it had no node for it */
+int64_t
+_mongoc_topology_snapshot_server_timestamp (
+   const mongoc_topology_snapshot_t *snapshot, uint32_t id)
+{
+   uint32_t item_id;
+   size_t i;
+
+   BSON_ASSERT (snapshot);
+
+   for (i = 0; i < snapshot->td.servers->items_len; i++) {
+      mongoc_set_get_item_and_id (snapshot->td.servers, (int) i, &item_id);
+      if (item_id == id) {
+         return snapshot->timestamps[i];
+      }
+   }
+
+   return -1;
+}
@@ -62,6 +62,12 @@ mongoc_topology_reconcile (mongoc_topology_t *topology)
    mongoc_topology_description_t *description;
    mongoc_topology_scanner_t *scanner;
 
+   /* a shared monitor checks the servers instead of our scanner */
+   if (topology->shared_monitor) {
+      _mongoc_shared_monitor_sync (topology->shared_monitor, topology);
+      return;
+   }
+
    description = &topology->description;
    scanner = topology->scanner;
 
@@ -80,6 +86,132 @@ mongoc_topology_reconcile (mongoc_topology_t *topology)
 }
 
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_topology_publish --
+ *
+ *       With a background scanner, replace the snapshot that pooled
+ *       clients select servers from with a copy of the current topology
+ *       description, and wait until no reader can be using the previous
+ *       one before releasing it. Clients that hold the previous snapshot
+ *       in a server stream keep it until they're done with it.
+ *
+ *       NOTE: call this while holding @topology's mutex.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_topology_publish (mongoc_topology_t *topology)
+{
+   mongoc_topology_snapshot_t *prev_snapshot;
+   bson_t *prev_cluster_time;
+
+   if (topology->single_threaded) {
+      return;
+   }
+
+   prev_snapshot = topology->snapshot;
+   prev_cluster_time = topology->cluster_time;
+
+   topology->snapshot =
+      _mongoc_topology_snapshot_new (&topology->description, topology->scanner);
+   topology->cluster_time = bson_copy (&topology->description.cluster_time);
+
+   _mongoc_topology_rcu_synchronize (&topology->rcu);
+
+   _mongoc_topology_snapshot_unref (prev_snapshot);
+   if (prev_cluster_time) {
+      bson_destroy (prev_cluster_time);
+   }
+}
+
+
+/* like _mongoc_topology_publish, but only the cluster time changed */
+static void
+_mongoc_topology_publish_cluster_time (mongoc_topology_t *topology)
+{
+   bson_t *prev_cluster_time;
+
+   if (topology->single_threaded || !topology->snapshot) {
+      return;
+   }
+
+   prev_cluster_time = topology->cluster_time;
+   topology->cluster_time = bson_copy (&topology->description.cluster_time);
+
+   _mongoc_topology_rcu_synchronize (&topology->rcu);
+
+   bson_destroy (prev_cluster_time);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_topology_get_snapshot --
+ *
+ *       Get a reference to the latest snapshot of the topology
+ *       description, without locking. Release it with
+ *       _mongoc_topology_snapshot_unref.
+ *
+ * Returns:
+ *       A snapshot, or NULL if there is no background scanner or it
+ *       hasn't started.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+mongoc_topology_snapshot_t *
+_mongoc_topology_get_snapshot (mongoc_topology_t *topology)
+{
+   mongoc_topology_snapshot_t *snapshot;
+   int32_t epoch;
+
+   epoch = _mongoc_topology_rcu_read_lock (&topology->rcu);
+   snapshot = topology->snapshot;
+   if (snapshot) {
+      _mongoc_topology_snapshot_ref (snapshot);
+   }
+
+   _mongoc_topology_rcu_read_unlock (&topology->rcu, epoch);
+
+   return snapshot;
+}
+
+
+/* call this while already holding the lock. when a server's operation
+ * latency estimates are too old to describe it, fall back to its ismaster
+ * round trip time until operations measure it again */
+static void
+_mongoc_topology_expire_latency (mongoc_topology_t *topology, uint32_t id)
+{
+   mongoc_latency_estimator_t *estimator;
+   mongoc_server_description_t *sd;
+   int64_t max_age_usec;
+   int i;
+
+   estimator = &topology->latency[id % MONGOC_TOPOLOGY_LATENCY_SLOTS];
+   sd = mongoc_topology_description_server_by_id (
+      &topology->description, id, NULL);
+   if (estimator->server_id != id || !sd) {
+      return;
+   }
+
+   max_age_usec = MONGOC_TOPOLOGY_LATENCY_MAX_AGE_HEARTBEATS *
+                  topology->description.heartbeat_msec * 1000;
+
+   for (i = 0; i < MONGOC_LATENCY_CLASSES; i++) {
+      if (_mongoc_latency_estimator_expire (
+             estimator, (mongoc_latency_class_t) i, max_age_usec)) {
+         /* handle_ismaster bumps the generation */
+         sd->operation_rtt_msec[i] = -1;
+      }
+   }
+}
+
+
 /* call this while already holding the lock */
 static bool
 _mongoc_topology_update_no_lock (uint32_t id,
@@ -88,6 +220,7 @@ _mongoc_topology_update_no_lock (uint32_t id,
                                  mongoc_topology_t *topology,
                                  const bson_error_t *error /* IN */)
 {
+   _mongoc_topology_expire_latency (topology, id);
    mongoc_topology_description_handle_ismaster (
       &topology->description, id, ismaster_response, rtt_msec, error);
 
@@ -178,12 +311,49 @@ _mongoc_topology_scanner_cb (uint32_t id,
       _mongoc_topology_update_no_lock (
          id, ismaster_response, rtt_msec, topology, error);
 
+      _mongoc_topology_publish (topology);
       mongoc_cond_broadcast (&topology->cond_client);
    }
 
    mongoc_mutex_unlock (&topology->mutex);
 }
 
+
+/*
+ *-------------------------------------------------------------------------
+ *
+ * _mongoc_topology_shared_monitor_cb --
+ *
+ *       Called by a shared monitor with the result of checking one of
+ *       this topology's servers. The monitor retries failed checks
+ *       itself.
+ *
+ *       NOTE: This method locks the given topology's mutex.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+void
+_mongoc_topology_shared_monitor_cb (mongoc_topology_t *topology,
+                                    uint32_t id,
+                                    const bson_t *ismaster_response,
+                                    int64_t rtt_msec,
+                                    const bson_error_t *error)
+{
+   mongoc_mutex_lock (&topology->mutex);
+
+   if (mongoc_topology_description_server_by_id (
+          &topology->description, id, NULL)) {
+      _mongoc_topology_update_no_lock (
+         id, ismaster_response, rtt_msec, topology, error);
+      topology->last_scan = bson_get_monotonic_time ();
+      _mongoc_topology_publish (topology);
+   }
+
+   mongoc_cond_broadcast (&topology->cond_client);
+   mongoc_mutex_unlock (&topology->mutex);
+}
+
 /*
  *-------------------------------------------------------------------------
  *
@@ -204,6 +374,7 @@ mongoc_topology_new (const mongoc_uri_t *uri, bool single_threaded)
 {
    int64_t heartbeat_default;
    int64_t heartbeat;
+   int64_t max_heartbeat;
    mongoc_topology_t *topology;
    mongoc_topology_description_type_t init_type;
    const char *service;
@@ -224,6 +395,11 @@ mongoc_topology_new (const mongoc_uri_t *uri, bool single_threaded)
 
    mongoc_topology_description_init (&topology->description, heartbeat);
 
+   /* adaptive monitoring is off unless the maximum is above the minimum */
+   max_heartbeat = mongoc_uri_get_option_as_int32 (
+      uri, MONGOC_URI_MAXHEARTBEATFREQUENCYMS, 0);
+   topology->max_heartbeat_msec = max_heartbeat > heartbeat ? max_heartbeat : 0;
+
    topology->description.set_name =
       bson_strdup (mongoc_uri_get_replica_set (uri));
 
@@ -260,6 +436,12 @@ mongoc_topology_new (const mongoc_uri_t *uri, bool single_threaded)
    topology->local_threshold_msec =
       mongoc_uri_get_local_threshold_option (topology->uri);
 
+   topology->least_outstanding = mongoc_uri_get_option_as_bool (
+      topology->uri, MONGOC_URI_LEASTOUTSTANDINGREQUESTS, false);
+
+   topology->description.operation_rtt = mongoc_uri_get_option_as_bool (
+      topology->uri, MONGOC_URI_OPERATIONLATENCYWINDOW, false);
+
    /* Total time allowed to check a server is connectTimeoutMS.
     * Server Discovery And Monitoring Spec:
     *
@@ -275,6 +457,7 @@ mongoc_topology_new (const mongoc_uri_t *uri, bool single_threaded)
    mongoc_mutex_init (&topology->mutex);
    mongoc_cond_init (&topology->cond_client);
    mongoc_cond_init (&topology->cond_server);
+   _mongoc_topology_rcu_init (&topology->rcu);
 
    service = mongoc_uri_get_service (uri);
    if (service) {
@@ -373,6 +556,11 @@ mongoc_topology_destroy (mongoc_topology_t *topology)
    mongoc_uri_destroy (topology->uri);
    mongoc_topology_description_destroy (&topology->description);
    mongoc_topology_scanner_destroy (topology->scanner);
+   _mongoc_topology_snapshot_unref (topology->snapshot);
+   if (topology->cluster_time) {
+      bson_destroy (topology->cluster_time);
+   }
+
    mongoc_cond_destroy (&topology->cond_client);
    mongoc_cond_destroy (&topology->cond_server);
    mongoc_mutex_destroy (&topology->mutex);
@@ -539,6 +727,67 @@ mongoc_topology_select (mongoc_topology_t *topology,
    }
 }
 
+/*
+ *-------------------------------------------------------------------------
+ *
+ * _mongoc_topology_select_from_snapshot --
+ *
+ *       With a background scanner, select a server from the latest
+ *       snapshot of the topology description without taking the
+ *       topology's mutex.
+ *
+ * Returns:
+ *       True if selection is finished: either *server_id is set, or it is
+ *       zero and @error is set. False if there is no snapshot yet or no
+ *       suitable server in it; then the caller waits for a scan.
+ *
+ *-------------------------------------------------------------------------
+ */
+static bool
+_mongoc_topology_select_from_snapshot (mongoc_topology_t *topology,
+                                       mongoc_ss_optype_t optype,
+                                       const mongoc_read_prefs_t *read_prefs,
+                                       int64_t local_threshold_ms,
+                                       uint32_t *server_id,
+                                       bson_error_t *error)
+{
+   mongoc_topology_snapshot_t *snapshot;
+   mongoc_server_description_t *selected_server;
+   unsigned int rand_seed;
+
+   *server_id = 0;
+
+   snapshot = _mongoc_topology_get_snapshot (topology);
+   if (!snapshot) {
+      return false;
+   }
+
+   if (!mongoc_topology_compatible (&snapshot->td, read_prefs, error)) {
+      _mongoc_topology_snapshot_unref (snapshot);
+      return true;
+   }
+
+   /* the snapshot is shared, don't advance its seed */
+   rand_seed = (unsigned int) bson_get_monotonic_time () ^
+               (unsigned int) (size_t) &rand_seed;
+
+   selected_server = _mongoc_topology_description_select (
+      &snapshot->td,
+      optype,
+      read_prefs,
+      local_threshold_ms,
+      &rand_seed,
+      topology->least_outstanding ? &topology->in_flight : NULL);
+
+   if (selected_server) {
+      *server_id = selected_server->id;
+   }
+
+   _mongoc_topology_snapshot_unref (snapshot);
+
+   return *server_id != 0;
+}
+
 /*
  *-------------------------------------------------------------------------
  *
@@ -568,6 +817,7 @@ mongoc_topology_select_server_id (mongoc_topology_t *topology,
    bson_error_t scanner_error = {0};
    int64_t heartbeat_msec;
    uint32_t server_id;
+   const mongoc_topology_in_flight_t *in_flight;
 
    /* These names come from the Server Selection Spec pseudocode */
    int64_t loop_start;  /* when we entered this function */
@@ -586,6 +836,7 @@ mongoc_topology_select_server_id (mongoc_topology_t *topology,
 
    heartbeat_msec = topology->description.heartbeat_msec;
    local_threshold_ms = topology->local_threshold_msec;
+   in_flight = topology->least_outstanding ? &topology->in_flight : NULL;
    try_once = topology->server_selection_try_once;
    loop_start = loop_end = bson_get_monotonic_time ();
    expire_at =
@@ -636,8 +887,13 @@ mongoc_topology_select_server_id (mongoc_topology_t *topology,
             return 0;
          }
 
-         selected_server = mongoc_topology_description_select (
-            &topology->description, optype, read_prefs, local_threshold_ms);
+         selected_server = _mongoc_topology_description_select (
+            &topology->description,
+            optype,
+            read_prefs,
+            local_threshold_ms,
+            &topology->description.rand_seed,
+            in_flight);
 
          if (selected_server) {
             return selected_server->id;
@@ -669,6 +925,15 @@ mongoc_topology_select_server_id (mongoc_topology_t *topology,
    }
 
    /* With background thread */
+   if (_mongoc_topology_select_from_snapshot (topology,
+                                              optype,
+                                              read_prefs,
+                                              local_threshold_ms,
+                                              &server_id,
+                                              error)) {
+      return server_id;
+   }
+
    /* we break out when we've found a server or timed out */
    for (;;) {
       mongoc_mutex_lock (&topology->mutex);
@@ -679,8 +944,13 @@ mongoc_topology_select_server_id (mongoc_topology_t *topology,
          return 0;
       }
 
-      selected_server = mongoc_topology_description_select (
-         &topology->description, optype, read_prefs, local_threshold_ms);
+      selected_server = _mongoc_topology_description_select (
+         &topology->description,
+         optype,
+         read_prefs,
+         local_threshold_ms,
+         &topology->description.rand_seed,
+         in_flight);
 
       if (!selected_server) {
          _mongoc_topology_request_scan (topology);
@@ -726,6 +996,76 @@ mongoc_topology_select_server_id (mongoc_topology_t *topology,
    }
 }
 
+/*
+ *-------------------------------------------------------------------------
+ *
+ * _mongoc_topology_select_hedge_server_id --
+ *
+ *       Choose a second server for a read that was sent to server
+ *       @exclude_id and hasn't been answered yet. Unlike
+ *       mongoc_topology_select_server_id this never waits for a scan.
+ *
+ * Returns:
+ *       A server id, or 0 if there is no other suitable server.
+ *
+ *-------------------------------------------------------------------------
+ */
+uint32_t
+_mongoc_topology_select_hedge_server_id (mongoc_topology_t *topology,
+                                         const mongoc_read_prefs_t *read_prefs,
+                                         uint32_t exclude_id)
+{
+   mongoc_topology_snapshot_t *snapshot;
+   mongoc_server_description_t *sd;
+   unsigned int rand_seed;
+   uint32_t server_id;
+
+   BSON_ASSERT (topology);
+
+   if (topology->single_threaded) {
+      sd = _mongoc_topology_description_select_hedge (
+         &topology->description,
+         read_prefs,
+         topology->local_threshold_msec,
+         &topology->description.rand_seed,
+         exclude_id);
+
+      return sd ? sd->id : 0;
+   }
+
+   snapshot = _mongoc_topology_get_snapshot (topology);
+   if (snapshot) {
+      /* the snapshot is shared, don't advance its seed */
+      rand_seed = (unsigned int) bson_get_monotonic_time () ^
+                  (unsigned int) (size_t) &rand_seed;
+
+      sd = _mongoc_topology_description_select_hedge (
+         &snapshot->td,
+         read_prefs,
+         topology->local_threshold_msec,
+         &rand_seed,
+         exclude_id);
+
+      server_id = sd ? sd->id : 0;
+      _mongoc_topology_snapshot_unref (snapshot);
+
+      return server_id;
+   }
+
+   mongoc_mutex_lock (&topology->mutex);
+   sd = _mongoc_topology_description_select_hedge (
+      &topology->description,
+      read_prefs,
+      topology->local_threshold_msec,
+      &topology->description.rand_seed,
+      exclude_id);
+
+   server_id = sd ? sd->id : 0;
+   mongoc_mutex_unlock (&topology->mutex);
+
+   return server_id;
+}
+
 /*
  *-------------------------------------------------------------------------
  *
@@ -738,7 +1078,8 @@ mongoc_topology_select_server_id (mongoc_topology_t *topology,
  *      NOTE: this method returns a copy of the original server
  *      description. Callers must own and clean up this copy.
  *
- *      NOTE: this method locks and unlocks @topology's mutex.
+ *      NOTE: with a background scanner this method reads the latest
+ *      snapshot, otherwise it locks and unlocks @topology's mutex.
  *
  * Returns:
  *      A mongoc_server_description_t, or NULL.
@@ -754,8 +1095,19 @@ mongoc_topology_server_by_id (mongoc_topology_t *topology,
                               uint32_t id,
                               bson_error_t *error)
 {
+   mongoc_topology_snapshot_t *snapshot;
    mongoc_server_description_t *sd;
 
+   snapshot = _mongoc_topology_get_snapshot (topology);
+   if (snapshot) {
+      sd = mongoc_server_description_new_copy (
+         mongoc_topology_description_server_by_id (&snapshot->td, id, error));
+
+      _mongoc_topology_snapshot_unref (snapshot);
+
+      return sd;
+   }
+
    mongoc_mutex_lock (&topology->mutex);
 
    sd = mongoc_server_description_new_copy (
@@ -827,6 +1179,11 @@ _mongoc_topology_host_by_id (mongoc_topology_t *topology,
 static void
 _mongoc_topology_request_scan (mongoc_topology_t *topology)
 {
+   if (topology->shared_monitor) {
+      _mongoc_shared_monitor_request_scan (topology->shared_monitor);
+      return;
+   }
+
    topology->scan_requested = true;
 
    mongoc_cond_signal (&topology->cond_server);
@@ -854,6 +1211,43 @@ mongoc_topology_invalidate_server (mongoc_topology_t *topology,
    mongoc_mutex_lock (&topology->mutex);
    mongoc_topology_description_invalidate_server (
       &topology->description, id, error);
+   if (topology->snapshot) {
+      _mongoc_topology_publish (topology);
+   }
+
+   if (topology->max_heartbeat_msec) {
+      /* wake the background scanner to shorten its interval */
+      mongoc_cond_signal (&topology->cond_server);
+   }
+
+   mongoc_mutex_unlock (&topology->mutex);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_topology_handle_not_master --
+ *
+ *      An operation's reply said its server is not, or is no longer, the
+ *      primary. Count it as a disruption, so adaptive monitoring checks
+ *      the topology again soon.
+ *
+ *      NOTE: this method uses @topology's mutex.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_topology_handle_not_master (mongoc_topology_t *topology)
+{
+   mongoc_mutex_lock (&topology->mutex);
+   topology->description.disruptions++;
+
+   if (topology->max_heartbeat_msec) {
+      mongoc_cond_signal (&topology->cond_server);
+   }
+
    mongoc_mutex_unlock (&topology->mutex);
 }
 
@@ -884,6 +1278,7 @@ _mongoc_topology_update_from_handshake (mongoc_topology_t *topology,
 
    mongoc_mutex_lock (&topology->mutex);
 
+   _mongoc_topology_expire_latency (topology, sd->id);
    mongoc_topology_description_handle_ismaster (&topology->description,
                                                 sd->id,
                                                 &sd->last_is_master,
@@ -894,6 +1289,10 @@ _mongoc_topology_update_from_handshake (mongoc_topology_t *topology,
    has_server = mongoc_topology_description_server_by_id (
                    &topology->description, sd->id, NULL) != NULL;
 
+   if (topology->snapshot) {
+      _mongoc_topology_publish (topology);
+   }
+
    /* if pooled, wake threads waiting in mongoc_topology_server_by_id */
    mongoc_cond_broadcast (&topology->cond_client);
    mongoc_mutex_unlock (&topology->mutex);
@@ -909,7 +1308,8 @@ _mongoc_topology_update_from_handshake (mongoc_topology_t *topology,
  *      Return the topology's scanner's timestamp for the given server,
  *      or -1 if there is no scanner node for the given server.
  *
- *      NOTE: this method uses @topology's mutex.
+ *      NOTE: with a background scanner this method reads the latest
+ *      snapshot, otherwise it uses @topology's mutex.
  *
  * Returns:
  *      Timestamp, or -1
@@ -919,9 +1319,18 @@ _mongoc_topology_update_from_handshake (mongoc_topology_t *topology,
 int64_t
 mongoc_topology_server_timestamp (mongoc_topology_t *topology, uint32_t id)
 {
+   mongoc_topology_snapshot_t *snapshot;
    mongoc_topology_scanner_node_t *node;
    int64_t timestamp = -1;
 
+   snapshot = _mongoc_topology_get_snapshot (topology);
+   if (snapshot) {
+      timestamp = _mongoc_topology_snapshot_server_timestamp (snapshot, id);
+      _mongoc_topology_snapshot_unref (snapshot);
+
+      return timestamp;
+   }
+
    mongoc_mutex_lock (&topology->mutex);
 
    node = mongoc_topology_scanner_get_node (topology->scanner, id);
@@ -982,6 +1391,7 @@ _mongoc_topology_run_background (void *data)
    int64_t timeout;
    int64_t force_timeout;
    int64_t heartbeat_msec;
+   uint32_t disruptions;
    int r;
 
    BSON_ASSERT (data);
@@ -990,6 +1400,10 @@ _mongoc_topology_run_background (void *data)
    topology = (mongoc_topology_t *) data;
    heartbeat_msec = topology->description.heartbeat_msec;
 
+   mongoc_mutex_lock (&topology->mutex);
+   disruptions = topology->description.disruptions;
+   mongoc_mutex_unlock (&topology->mutex);
+
    /* we exit this loop when shutdown_requested, or on error */
    for (;;) {
       /* unlocked after starting a scan or after breaking out of the loop */
@@ -1008,6 +1422,13 @@ _mongoc_topology_run_background (void *data)
             last_scan = now - (heartbeat_msec * 1000);
          }
 
+         /* an operation saw an error or a server that isn't primary */
+         if (topology->description.disruptions != disruptions) {
+            disruptions = topology->description.disruptions;
+            heartbeat_msec = _mongoc_topology_next_heartbeat_msec (
+               topology, heartbeat_msec, true);
+         }
+
          timeout = heartbeat_msec - ((now - last_scan) / 1000);
 
          /* if someone's specifically asked for a scan, use a shorter interval
@@ -1060,6 +1481,13 @@ _mongoc_topology_run_background (void *data)
       mongoc_topology_scanner_reset (topology->scanner);
 
       topology->last_scan = bson_get_monotonic_time ();
+      _mongoc_topology_publish (topology);
+
+      heartbeat_msec = _mongoc_topology_next_heartbeat_msec (
+         topology,
+         heartbeat_msec,
+         topology->description.disruptions != disruptions);
+      disruptions = topology->description.disruptions;
       mongoc_mutex_unlock (&topology->mutex);
 
       last_scan = bson_get_monotonic_time ();
@@ -1071,6 +1499,36 @@ DONE:
    return NULL;
 }
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_topology_next_heartbeat_msec --
+ *
+ *       The background scanner's interval after a scan that came
+ *       @interval_msec after the one before. Without adaptive monitoring
+ *       it is always heartbeatFrequencyMS. Otherwise, after a @disrupted
+ *       scan it is the minimum heartbeat frequency, and after each stable
+ *       scan it doubles, up to maxHeartbeatFrequencyMS.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+int64_t
+_mongoc_topology_next_heartbeat_msec (const mongoc_topology_t *topology,
+                                      int64_t interval_msec,
+                                      bool disrupted)
+{
+   if (!topology->max_heartbeat_msec) {
+      return topology->description.heartbeat_msec;
+   }
+
+   if (disrupted) {
+      return MONGOC_TOPOLOGY_MIN_HEARTBEAT_FREQUENCY_MS;
+   }
+
+   return BSON_MIN (interval_msec * 2, topology->max_heartbeat_msec);
+}
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -1102,6 +1560,13 @@ _mongoc_topology_start_background_scanner (mongoc_topology_t *topology)
 
       _mongoc_handshake_freeze ();
       _mongoc_topology_description_monitor_opening (&topology->description);
+      _mongoc_topology_publish (topology);
+
+      if (topology->use_shared_monitor) {
+         topology->shared_monitor = _mongoc_shared_monitor_attach (topology);
+         mongoc_mutex_unlock (&topology->mutex);
+         return true;
+      }
 
       r = mongoc_thread_create (
          &topology->thread, _mongoc_topology_run_background, topology);
@@ -1133,6 +1598,7 @@ _mongoc_topology_start_background_scanner (mongoc_topology_t *topology)
 static void
 _mongoc_topology_background_thread_stop (mongoc_topology_t *topology)
 {
+   mongoc_shared_monitor_t *monitor;
    bool join_thread = false;
 
    if (topology->single_threaded) {
@@ -1140,6 +1606,17 @@ _mongoc_topology_background_thread_stop (mongoc_topology_t *topology)
    }
 
    mongoc_mutex_lock (&topology->mutex);
+   if (topology->shared_monitor) {
+      /* the monitor may be waiting for our mutex to deliver a result */
+      monitor = topology->shared_monitor;
+      topology->shared_monitor = NULL;
+      topology->scanner_state = MONGOC_TOPOLOGY_SCANNER_OFF;
+      mongoc_mutex_unlock (&topology->mutex);
+
+      _mongoc_shared_monitor_detach (monitor, topology);
+      return;
+   }
+
    if (topology->scanner_state == MONGOC_TOPOLOGY_SCANNER_BG_RUNNING) {
       /* if the background thread is running, request a shutdown and signal the
        * thread */
@@ -1167,6 +1644,78 @@ _mongoc_topology_background_thread_stop (mongoc_topology_t *topology)
    }
 }
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_topology_reset_after_fork --
+ *
+ *       Called in a child process after fork(). The background thread
+ *       does not exist in the child and may have held @topology's mutex,
+ *       so the mutex and conditions are reinitialized and the thread is
+ *       forgotten, not joined. Inherited monitoring connections are closed
+ *       without sending anything on them. The topology description is
+ *       kept, so the child can select servers without waiting for a scan,
+ *       but counts of operations in progress are zeroed. Monitoring is
+ *       restarted if it was running in the parent.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_topology_reset_after_fork (mongoc_topology_t *topology)
+{
+   bool was_running;
+
+   BSON_ASSERT (!topology->single_threaded);
+
+   mongoc_mutex_init (&topology->mutex);
+   mongoc_cond_init (&topology->cond_client);
+   mongoc_cond_init (&topology->cond_server);
+   /* readers in the parent's other threads are gone */
+   _mongoc_topology_rcu_init (&topology->rcu);
+   mongoc_mutex_init (&topology->description.candidates.mutex);
+   if (topology->snapshot) {
+      /* a fresh snapshot, whose candidates cache is unlocked */
+      _mongoc_topology_publish (topology);
+   }
+
+   was_running = topology->scanner_state == MONGOC_TOPOLOGY_SCANNER_BG_RUNNING;
+   topology->scanner_state = MONGOC_TOPOLOGY_SCANNER_OFF;
+   topology->shutdown_requested = false;
+   topology->scan_requested = false;
+
+   if (topology->shared_monitor) {
+      _mongoc_shared_monitor_reset_after_fork ();
+      topology->shared_monitor = NULL;
+   }
+
+   /* the operations the parent's threads had in progress never end here */
+   memset (&topology->in_flight, 0, sizeof topology->in_flight);
+
+   _mongoc_topology_scanner_close_inherited (topology->scanner);
+
+   if (was_running) {
+      _mongoc_topology_start_background_scanner (topology);
+   }
+}
+
+bool
+_mongoc_topology_set_shared_monitoring (mongoc_topology_t *topology,
+                                        bool enabled)
+{
+   bool ret = false;
+   mongoc_mutex_lock (&topology->mutex);
+
+   if (topology->scanner_state == MONGOC_TOPOLOGY_SCANNER_OFF) {
+      topology->use_shared_monitor = enabled;
+      ret = true;
+   } else {
+      MONGOC_ERROR ("Cannot set shared monitoring after monitoring started");
+   }
+   mongoc_mutex_unlock (&topology->mutex);
+   return ret;
+}
+
 bool
 _mongoc_topology_set_appname (mongoc_topology_t *topology, const char *appname)
 {
@@ -1182,6 +1731,80 @@ _mongoc_topology_set_appname (mongoc_topology_t *topology, const char *appname)
    return ret;
 }
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_topology_record_latency --
+ *
+ *       Record that an operation of @latency_class took @usec on server
+ *       @server_id. When the server's percentile latency estimate changes,
+ *       copy it into the topology description, where server selection and
+ *       mongoc_server_description_operation_latency find it. Only if the
+ *       latency window uses the estimates is the description republished;
+ *       otherwise snapshots see the estimate after the next heartbeat.
+ *
+ *       NOTE: this method uses @topology's mutex when the estimate changes.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_topology_record_latency (mongoc_topology_t *topology,
+                                 uint32_t server_id,
+                                 mongoc_latency_class_t latency_class,
+                                 int64_t usec)
+{
+   mongoc_latency_estimator_t *estimator;
+   mongoc_server_description_t *sd;
+   int64_t estimate_usec;
+   int64_t estimate_msec;
+
+   estimator = &topology->latency[server_id % MONGOC_TOPOLOGY_LATENCY_SLOTS];
+   if (!_mongoc_latency_estimator_record (
+          estimator, server_id, latency_class, usec, &estimate_usec)) {
+      return;
+   }
+
+   estimate_msec = estimate_usec == -1 ? -1 : estimate_usec / 1000;
+
+   mongoc_mutex_lock (&topology->mutex);
+   sd = mongoc_topology_description_server_by_id (
+      &topology->description, server_id, NULL);
+
+   if (sd && sd->operation_rtt_msec[latency_class] != estimate_msec) {
+      sd->operation_rtt_msec[latency_class] = estimate_msec;
+      if (topology->description.operation_rtt) {
+         topology->description.generation++;
+         if (topology->snapshot) {
+            _mongoc_topology_publish (topology);
+         }
+      }
+   }
+
+   mongoc_mutex_unlock (&topology->mutex);
+}
+
+/* how long to wait for a read from server @server_id before hedging it:
+ * the MONGOC_TOPOLOGY_HEDGE_PERCENTILE latency of its recent reads, or -1
+ * while too few of them are recorded */
+int64_t
+_mongoc_topology_hedge_delay_msec (mongoc_topology_t *topology,
+                                   uint32_t server_id)
+{
+   mongoc_latency_estimator_t *estimator;
+   int64_t usec;
+
+   estimator = &topology->latency[server_id % MONGOC_TOPOLOGY_LATENCY_SLOTS];
+   if (estimator->server_id != server_id) {
+      return -1;
+   }
+
+   usec = _mongoc_latency_estimator_percentile (
+      estimator, MONGOC_LATENCY_READ, MONGOC_TOPOLOGY_HEDGE_PERCENTILE);
+
+   return usec == -1 ? -1 : BSON_MAX (usec / 1000, 1);
+}
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -1198,8 +1821,19 @@ void
 _mongoc_topology_update_cluster_time (mongoc_topology_t *topology,
                                       const bson_t *reply)
 {
+   uint32_t prev_t;
+   uint32_t prev_i;
+
    mongoc_mutex_lock (&topology->mutex);
+   prev_t = topology->description.cluster_time_t;
+   prev_i = topology->description.cluster_time_i;
    mongoc_topology_description_update_cluster_time (&topology->description,
                                                     reply);
+
+   if (topology->description.cluster_time_t != prev_t ||
+       topology->description.cluster_time_i != prev_i) {
+      _mongoc_topology_publish_cluster_time (topology);
+   }
+
    mongoc_mutex_unlock (&topology->mutex);
 }
@@ -637,10 +637,12 @@ mongoc_uri_option_is_int32 (const char *key)
 {
    return !strcasecmp (key, MONGOC_URI_CONNECTTIMEOUTMS) ||
           !strcasecmp (key, MONGOC_URI_HEARTBEATFREQUENCYMS) ||
+          !strcasecmp (key, MONGOC_URI_HEDGEDELAYMS) ||
           !strcasecmp (key, MONGOC_URI_SERVERSELECTIONTIMEOUTMS) ||
           !strcasecmp (key, MONGOC_URI_SOCKETCHECKINTERVALMS) ||
           !strcasecmp (key, MONGOC_URI_SOCKETTIMEOUTMS) ||
           !strcasecmp (key, MONGOC_URI_LOCALTHRESHOLDMS) ||
+          !strcasecmp (key, MONGOC_URI_MAXHEARTBEATFREQUENCYMS) ||
           !strcasecmp (key, MONGOC_URI_MAXPOOLSIZE) ||
           !strcasecmp (key, MONGOC_URI_MAXSTALENESSSECONDS) ||
           !strcasecmp (key, MONGOC_URI_MINPOOLSIZE) ||
@@ -648,20 +650,28 @@ mongoc_uri_option_is_int32 (const char *key)
           !strcasecmp (key, MONGOC_URI_WAITQUEUEMULTIPLE) ||
           !strcasecmp (key, MONGOC_URI_WAITQUEUETIMEOUTMS) ||
           !strcasecmp (key, MONGOC_URI_WTIMEOUTMS) ||
-          !strcasecmp (key, MONGOC_URI_ZLIBCOMPRESSIONLEVEL);
+          !strcasecmp (key, MONGOC_URI_ZLIBCOMPRESSIONLEVEL) ||
+          !strcasecmp (key, MONGOC_URI_ZLIBCOMPRESSIONTHREADS) ||
+          !strcasecmp (key, MONGOC_URI_ZSTDCOMPRESSIONLEVEL);
 }
 
 bool
 mongoc_uri_option_is_bool (const char *key)
 {
-   return !strcasecmp (key, MONGOC_URI_CANONICALIZEHOSTNAME) ||
+   return !strcasecmp (key, MONGOC_URI_ADAPTIVECOMPRESSION) ||
+          !strcasecmp (key, MONGOC_URI_CANONICALIZEHOSTNAME) ||
+          !strcasecmp (key, MONGOC_URI_HEDGEDREADS) ||
           !strcasecmp (key, MONGOC_URI_JOURNAL) ||
+          !strcasecmp (key, MONGOC_URI_LEASTOUTSTANDINGREQUESTS) ||
+          !strcasecmp (key, MONGOC_URI_LOCALUNIXSOCKET) ||
+          !strcasecmp (key, MONGOC_URI_OPERATIONLATENCYWINDOW) ||
           !strcasecmp (key, MONGOC_URI_SAFE) ||
           !strcasecmp (key, MONGOC_URI_SERVERSELECTIONTRYONCE) ||
           !strcasecmp (key, MONGOC_URI_SLAVEOK) ||
           !strcasecmp (key, MONGOC_URI_SSL) ||
           !strcasecmp (key, MONGOC_URI_SSLALLOWINVALIDCERTIFICATES) ||
-          !strcasecmp (key, MONGOC_URI_SSLALLOWINVALIDHOSTNAMES);
+          !strcasecmp (key, MONGOC_URI_SSLALLOWINVALIDHOSTNAMES) ||
+          !strcasecmp (key, MONGOC_URI_SSLKERNELTLS);
 }
 
 bool
@@ -1953,6 +1963,22 @@ mongoc_uri_set_option_as_int32 (mongoc_uri_t *uri,
       return false;
    }
 
+   /* the worker pool runs at most 32 threads, including the caller's */
+   if (!bson_strcasecmp (option, MONGOC_URI_ZLIBCOMPRESSIONTHREADS) &&
+       (value < 1 || value > 32)) {
+      MONGOC_WARNING (
+         "Invalid \"%s\" of %d: must be between 1 and 32", option, value);
+      return false;
+   }
+
+   /* zstd levels are from 0 (default) through 22 (best compression) */
+   if (!bson_strcasecmp (option, MONGOC_URI_ZSTDCOMPRESSIONLEVEL) &&
+       (value < 0 || value > 22)) {
+      MONGOC_WARNING (
+         "Invalid \"%s\" of %d: must be between 0 and 22", option, value);
+      return false;
+   }
+
    return _mongoc_uri_set_option_as_int32 (uri, option, value);
 }
 
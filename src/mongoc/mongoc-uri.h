@@ -35,6 +35,7 @@
 #define MONGOC_DEFAULT_PORT 27017
 #endif
 
+#define MONGOC_URI_ADAPTIVECOMPRESSION "adaptivecompression"
 #define MONGOC_URI_APPNAME "appname"
 #define MONGOC_URI_AUTHMECHANISM "authmechanism"
 #define MONGOC_URI_AUTHMECHANISMPROPERTIES "authmechanismproperties"
@@ -44,12 +45,18 @@
 #define MONGOC_URI_COMPRESSORS "compressors"
 #define MONGOC_URI_GSSAPISERVICENAME "gssapiservicename"
 #define MONGOC_URI_HEARTBEATFREQUENCYMS "heartbeatfrequencyms"
+#define MONGOC_URI_HEDGEDELAYMS "hedgedelayms"
+#define MONGOC_URI_HEDGEDREADS "hedgedreads"
 #define MONGOC_URI_JOURNAL "journal"
+#define MONGOC_URI_LEASTOUTSTANDINGREQUESTS "leastoutstandingrequests"
 #define MONGOC_URI_LOCALTHRESHOLDMS "localthresholdms"
+#define MONGOC_URI_LOCALUNIXSOCKET "localunixsocket"
+#define MONGOC_URI_MAXHEARTBEATFREQUENCYMS "maxheartbeatfrequencyms"
 #define MONGOC_URI_MAXIDLETIMEMS "maxidletimems"
 #define MONGOC_URI_MAXPOOLSIZE "maxpoolsize"
 #define MONGOC_URI_MAXSTALENESSSECONDS "maxstalenessseconds"
 #define MONGOC_URI_MINPOOLSIZE "minpoolsize"
+#define MONGOC_URI_OPERATIONLATENCYWINDOW "operationlatencywindow"
 #define MONGOC_URI_READCONCERNLEVEL "readconcernlevel"
 #define MONGOC_URI_READPREFERENCE "readpreference"
 #define MONGOC_URI_READPREFERENCETAGS "readpreferencetags"
@@ -67,11 +74,14 @@
 #define MONGOC_URI_SSLCERTIFICATEAUTHORITYFILE "sslcertificateauthorityfile"
 #define MONGOC_URI_SSLALLOWINVALIDCERTIFICATES "sslallowinvalidcertificates"
 #define MONGOC_URI_SSLALLOWINVALIDHOSTNAMES "sslallowinvalidhostnames"
+#define MONGOC_URI_SSLKERNELTLS "sslkerneltls"
 #define MONGOC_URI_W "w"
 #define MONGOC_URI_WAITQUEUEMULTIPLE "waitqueuemultiple"
 #define MONGOC_URI_WAITQUEUETIMEOUTMS "waitqueuetimeoutms"
 #define MONGOC_URI_WTIMEOUTMS "wtimeoutms"
 #define MONGOC_URI_ZLIBCOMPRESSIONLEVEL "zlibcompressionlevel"
+#define MONGOC_URI_ZLIBCOMPRESSIONTHREADS "zlibcompressionthreads"
+#define MONGOC_URI_ZSTDCOMPRESSIONLEVEL "zstdcompressionlevel"
 
 BSON_BEGIN_DECLS
 
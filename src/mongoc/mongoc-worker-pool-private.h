@@ -0,0 +1,56 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MONGOC_WORKER_POOL_PRIVATE_H
+#define MONGOC_WORKER_POOL_PRIVATE_H
+
+#if !defined(MONGOC_COMPILATION)
+#error "Only <mongoc.h> can be included directly."
+#endif
+
+#include <bson.h>
+
+
+/* the most threads, including the caller's, that a batch can run on */
+#define MONGOC_WORKER_POOL_MAX_THREADS 32
+
+
+BSON_BEGIN_DECLS
+
+
+/* runs job @i of a batch */
+typedef void (*mongoc_worker_fn_t) (void *ctx, size_t i);
+
+void
+_mongoc_worker_pool_init (void);
+
+void
+_mongoc_worker_pool_cleanup (void);
+
+void
+_mongoc_worker_pool_run (mongoc_worker_fn_t fn,
+                         void *ctx,
+                         size_t n_jobs,
+                         uint32_t max_threads);
+
+uint32_t
+_mongoc_worker_pool_size (void);
+
+
+BSON_END_DECLS
+
+
+#endif /* MONGOC_WORKER_POOL_PRIVATE_H */
@@ -0,0 +1,259 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "mongoc-config.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "mongoc-log.h"
+#include "mongoc-thread-private.h"
+#include "mongoc-trace-private.h"
+#include "mongoc-worker-pool-private.h"
+
+#include "utlist.h"
+
+
+#undef MONGOC_LOG_DOMAIN
+#define MONGOC_LOG_DOMAIN "worker-pool"
+
+
+/* a caller's jobs, on the caller's stack until they're all done */
+typedef struct _mongoc_worker_batch_t {
+   mongoc_worker_fn_t fn;
+   void *ctx;
+   size_t n_jobs;
+   /* the next job to start, and the number finished */
+   size_t next;
+   size_t done;
+   /* pool threads that may work on the batch, and those that are */
+   uint32_t max_workers;
+   uint32_t workers;
+   struct _mongoc_worker_batch_t *next_batch;
+} mongoc_worker_batch_t;
+
+
+/* a process-wide pool of threads, started on demand by the first batch
+ * that asks for them, that run batches of independent jobs such as
+ * compressing the blocks of a large message. the caller's thread works on
+ * its own batch too, so a batch finishes even if no thread can start. */
+static mongoc_mutex_t gWorkerPoolMutex;
+/* wakes pool threads when a batch is added or the pool shuts down */
+static mongoc_cond_t gWorkerPoolCondWork;
+/* wakes callers when a batch finishes */
+static mongoc_cond_t gWorkerPoolCondDone;
+static mongoc_thread_t gWorkerPoolThreads[MONGOC_WORKER_POOL_MAX_THREADS];
+static uint32_t gWorkerPoolSize;
+static mongoc_worker_batch_t *gWorkerPoolBatches;
+static bool gWorkerPoolShutdown;
+#ifndef _WIN32
+static int gWorkerPoolPid;
+#endif
+
+
+static void
+_mongoc_worker_pool_reset_after_fork (void);
+
+
+void
+_mongoc_worker_pool_init (void)
+{
+   mongoc_mutex_init (&gWorkerPoolMutex);
+   mongoc_cond_init (&gWorkerPoolCondWork);
+   mongoc_cond_init (&gWorkerPoolCondDone);
+   gWorkerPoolSize = 0;
+   gWorkerPoolBatches = NULL;
+   gWorkerPoolShutdown = false;
+#ifndef _WIN32
+   gWorkerPoolPid = (int) getpid ();
+#endif
+}
+
+
+void
+_mongoc_worker_pool_cleanup (void)
+{
+   uint32_t i;
+
+   _mongoc_worker_pool_reset_after_fork ();
+
+   mongoc_mutex_lock (&gWorkerPoolMutex);
+   gWorkerPoolShutdown = true;
+   mongoc_cond_broadcast (&gWorkerPoolCondWork);
+   mongoc_mutex_unlock (&gWorkerPoolMutex);
+
+   for (i = 0; i < gWorkerPoolSize; i++) {
+      mongoc_thread_join (gWorkerPoolThreads[i]);
+   }
+
+   gWorkerPoolSize = 0;
+   mongoc_cond_destroy (&gWorkerPoolCondWork);
+   mongoc_cond_destroy (&gWorkerPoolCondDone);
+   mongoc_mutex_destroy (&gWorkerPoolMutex);
+}
+
+
+/* run jobs of @batch until none are left to start. call with the mutex */
+static void
+_mongoc_worker_pool_work (mongoc_worker_batch_t *batch)
+{
+   size_t i;
+
+   while (batch->next < batch->n_jobs) {
+      i = batch->next++;
+      mongoc_mutex_unlock (&gWorkerPoolMutex);
+      batch->fn (batch->ctx, i);
+      mongoc_mutex_lock (&gWorkerPoolMutex);
+      batch->done++;
+   }
+
+   if (batch->done == batch->n_jobs) {
+      mongoc_cond_broadcast (&gWorkerPoolCondDone);
+   }
+}
+
+
+static void *
+_mongoc_worker_pool_thread (void *data)
+{
+   mongoc_worker_batch_t *batch;
+
+   mongoc_mutex_lock (&gWorkerPoolMutex);
+
+   while (!gWorkerPoolShutdown) {
+      LL_FOREACH2 (gWorkerPoolBatches, batch, next_batch)
+      {
+         if (batch->next < batch->n_jobs &&
+             batch->workers < batch->max_workers) {
+            break;
+         }
+      }
+
+      if (!batch) {
+         mongoc_cond_wait (&gWorkerPoolCondWork, &gWorkerPoolMutex);
+         continue;
+      }
+
+      /* the caller can't return before done == n_jobs, which we only see
+       * after our last job, so @batch is valid until we leave it */
+      batch->workers++;
+      _mongoc_worker_pool_work (batch);
+      batch->workers--;
+   }
+
+   mongoc_mutex_unlock (&gWorkerPoolMutex);
+
+   return NULL;
+}
+
+
+/* forget the threads of the parent process. they don't exist in a child,
+ * and no batch of the child's can be running yet */
+static void
+_mongoc_worker_pool_reset_after_fork (void)
+{
+#ifndef _WIN32
+   if (gWorkerPoolPid == (int) getpid ()) {
+      return;
+   }
+
+   _mongoc_worker_pool_init ();
+#endif
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_worker_pool_run --
+ *
+ *       Call @fn with @ctx and each job index from 0 to @n_jobs - 1, on
+ *       up to @max_threads threads including this one, and return when
+ *       all jobs are done. Jobs run in no particular order. The pool grows
+ *       to @max_threads - 1 threads, which stay running until
+ *       mongoc_cleanup, and its threads are shared by concurrent batches.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_worker_pool_run (mongoc_worker_fn_t fn,
+                         void *ctx,
+                         size_t n_jobs,
+                         uint32_t max_threads)
+{
+   mongoc_worker_batch_t batch = {0};
+   size_t i;
+
+   BSON_ASSERT (fn);
+
+   max_threads = BSON_MIN (max_threads, MONGOC_WORKER_POOL_MAX_THREADS);
+   if (max_threads <= 1 || n_jobs <= 1) {
+      for (i = 0; i < n_jobs; i++) {
+         fn (ctx, i);
+      }
+
+      return;
+   }
+
+   _mongoc_worker_pool_reset_after_fork ();
+
+   batch.fn = fn;
+   batch.ctx = ctx;
+   batch.n_jobs = n_jobs;
+   batch.max_workers = max_threads - 1;
+
+   mongoc_mutex_lock (&gWorkerPoolMutex);
+
+   while (gWorkerPoolSize < batch.max_workers) {
+      if (mongoc_thread_create (&gWorkerPoolThreads[gWorkerPoolSize],
+                                _mongoc_worker_pool_thread,
+                                NULL)) {
+         MONGOC_WARNING ("Could not start a worker thread");
+         break;
+      }
+
+      gWorkerPoolSize++;
+   }
+
+   LL_APPEND2 (gWorkerPoolBatches, &batch, next_batch);
+   mongoc_cond_broadcast (&gWorkerPoolCondWork);
+
+   _mongoc_worker_pool_work (&batch);
+   while (batch.done < batch.n_jobs) {
+      mongoc_cond_wait (&gWorkerPoolCondDone, &gWorkerPoolMutex);
+   }
+
+   LL_DELETE2 (gWorkerPoolBatches, &batch, next_batch);
+
+   mongoc_mutex_unlock (&gWorkerPoolMutex);
+}
+
+
+/* the number of threads in the pool */
+uint32_t
+_mongoc_worker_pool_size (void)
+{
+   uint32_t size;
+
+   mongoc_mutex_lock (&gWorkerPoolMutex);
+   size = gWorkerPoolSize;
+   mongoc_mutex_unlock (&gWorkerPoolMutex);
+
+   return size;
+}
@@ -30,6 +30,7 @@
 #include "mongoc-client-pool.h"
 #include "mongoc-collection.h"
 #include "mongoc-config.h"
+#include "mongoc-connection-broker.h"
 #include "mongoc-cursor.h"
 #include "mongoc-database.h"
 #include "mongoc-index.h"
@@ -1788,13 +1788,24 @@ _mock_server_reply_with_stream (mock_server_t *server,
    mongoc_mutex_unlock (&server->mutex);
    r.header.msg_len = 0;
    r.header.response_to = reply->response_to;
-   r.header.opcode = MONGOC_OPCODE_REPLY;
-   r.reply.flags = flags;
-   r.reply.cursor_id = cursor_id;
-   r.reply.start_from = 0;
-   r.reply.n_returned = 1;
-   r.reply.documents = buf;
-   r.reply.documents_len = (uint32_t) len;
+
+   if (reply->request_opcode == MONGOC_OPCODE_MSG) {
+      /* the reply document is the command's whole result */
+      BSON_ASSERT (n_docs == 1);
+      r.header.opcode = MONGOC_OPCODE_MSG;
+      r.msg.flags = 0;
+      r.msg.n_sections = 1;
+      r.msg.sections[0].payload_type = 0;
+      r.msg.sections[0].payload.bson_document = buf;
+   } else {
+      r.header.opcode = MONGOC_OPCODE_REPLY;
+      r.reply.flags = flags;
+      r.reply.cursor_id = cursor_id;
+      r.reply.start_from = 0;
+      r.reply.n_returned = 1;
+      r.reply.documents = buf;
+      r.reply.documents_len = (uint32_t) len;
+   }
 
    _mongoc_rpc_gather (&r, &ar);
    _mongoc_rpc_swab_to_le (&r);
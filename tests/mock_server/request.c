@@ -44,6 +44,9 @@ request_from_killcursors (request_t *request, const mongoc_rpc_t *rpc);
 static void
 request_from_getmore (request_t *request, const mongoc_rpc_t *rpc);
 
+static void
+request_from_msg (request_t *request, const mongoc_rpc_t *rpc);
+
 static char *
 query_flags_str (uint32_t flags);
 static char *
@@ -112,8 +115,11 @@ request_new (const mongoc_buffer_t *buffer,
       request_from_delete (request, &request->request_rpc);
       break;
 
-   case MONGOC_OPCODE_REPLY:
    case MONGOC_OPCODE_MSG:
+      request_from_msg (request, &request->request_rpc);
+      break;
+
+   case MONGOC_OPCODE_REPLY:
    default:
       fprintf (stderr, "Unimplemented opcode %d\n", request->opcode);
       abort ();
@@ -920,3 +926,36 @@ request_from_getmore (request_t *request, const mongoc_rpc_t *rpc)
                           rpc->get_more.cursor_id,
                           rpc->get_more.n_return);
 }
+
+
+static void
+request_from_msg (request_t *request, const mongoc_rpc_t *rpc)
+{
+   const mongoc_rpc_section_t *section;
+   uint32_t len;
+   bson_t *doc;
+   bson_iter_t iter;
+   char *str;
+
+   /* only the command document, a document sequence is unimplemented */
+   BSON_ASSERT (rpc->msg.n_sections == 1);
+   section = &rpc->msg.sections[0];
+   BSON_ASSERT (section->payload_type == 0);
+
+   len = length_prefix ((void *) section->payload.bson_document);
+   doc = bson_new_from_data (section->payload.bson_document, len);
+   BSON_ASSERT (doc);
+   _mongoc_array_append_val (&request->docs, doc);
+
+   request->is_command = true;
+
+   if (bson_iter_init (&iter, doc) && bson_iter_next (&iter)) {
+      request->command_name = bson_strdup (bson_iter_key (&iter));
+   } else {
+      fprintf (stderr, "WARNING: no command name in OP_MSG\n");
+   }
+
+   str = bson_as_json (doc, NULL);
+   request->as_str = bson_strdup_printf ("OP_MSG %s", str);
+   bson_free (str);
+}
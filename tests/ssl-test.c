@@ -5,9 +5,11 @@
 #ifdef MONGOC_ENABLE_SSL_OPENSSL
 #include <openssl/ssl.h>
 #include <openssl/err.h>
+#include "mongoc-stream-tls-openssl-private.h"
 #endif
 
 #include "mongoc-stream-tls.h"
+#include "mongoc-stream-tls-private.h"
 
 #include "ssl-test.h"
 #include "TestSuite.h"
@@ -209,8 +211,12 @@ ssl_test_client (void *ptr)
 
    sock_stream = mongoc_stream_socket_new (conn_sock);
    BSON_ASSERT (sock_stream);
-   ssl_stream = mongoc_stream_tls_new_with_hostname (
-      sock_stream, data->host, data->client, 1);
+   ssl_stream = _mongoc_stream_tls_new_with_hostname (sock_stream,
+                                                      data->host,
+                                                      data->client,
+                                                      1,
+                                                      data->kernel_tls,
+                                                      data->session_key);
    if (!ssl_stream) {
 #ifdef MONGOC_ENABLE_SSL_OPENSSL
       unsigned long err = ERR_get_error ();
@@ -243,6 +249,13 @@ ssl_test_client (void *ptr)
       return NULL;
    }
 
+#ifdef MONGOC_ENABLE_SSL_OPENSSL
+   data->client_result->resumed =
+      _mongoc_stream_tls_openssl_session_reused (ssl_stream);
+   data->client_result->kernel_tls =
+      _mongoc_stream_tls_openssl_kernel_tls (ssl_stream);
+#endif
+
    len = 4 * NUM_IOVECS;
 
    wiov.iov_base = (void *) &len;
@@ -286,21 +299,27 @@ ssl_test_client (void *ptr)
  * client and server speak a simple echo protocol, so all we're really testing
  * here is that any given configuration succeeds or fails as it should
  */
-void
-ssl_test (mongoc_ssl_opt_t *client,
-          mongoc_ssl_opt_t *server,
-          const char *host,
-          ssl_test_result_t *client_result,
-          ssl_test_result_t *server_result)
+static void
+_ssl_test (mongoc_ssl_opt_t *client,
+           mongoc_ssl_opt_t *server,
+           const char *host,
+           const char *session_key,
+           bool kernel_tls,
+           ssl_test_result_t *client_result,
+           ssl_test_result_t *server_result)
 {
    ssl_test_data_t data = {0};
    mongoc_thread_t threads[2];
    int i, r;
 
+   data.kernel_tls = kernel_tls;
+   data.session_key = session_key;
    data.server = server;
    data.client = client;
    data.client_result = client_result;
    data.server_result = server_result;
+   client_result->resumed = false;
+   client_result->kernel_tls = false;
    data.host = host;
 
    mongoc_mutex_init (&data.cond_mutex);
@@ -320,3 +339,45 @@ ssl_test (mongoc_ssl_opt_t *client,
    mongoc_mutex_destroy (&data.cond_mutex);
    mongoc_cond_destroy (&data.cond);
 }
+
+
+void
+ssl_test (mongoc_ssl_opt_t *client,
+          mongoc_ssl_opt_t *server,
+          const char *host,
+          ssl_test_result_t *client_result,
+          ssl_test_result_t *server_result)
+{
+   _ssl_test (
+      client, server, host, host, false, client_result, server_result);
+}
+
+
+/* as ssl_test, with the client keeping TLS sessions under @session_key
+ * instead of @host. each test server listens on a new port, so the key
+ * stands for the server's "host:port" */
+void
+ssl_test_session_key (mongoc_ssl_opt_t *client,
+                      mongoc_ssl_opt_t *server,
+                      const char *host,
+                      const char *session_key,
+                      ssl_test_result_t *client_result,
+                      ssl_test_result_t *server_result)
+{
+   _ssl_test (
+      client, server, host, session_key, false, client_result, server_result);
+}
+
+
+/* as ssl_test, with the client opting in to kernel TLS as the URI option
+ * "sslKernelTLS" does */
+void
+ssl_test_kernel_tls (mongoc_ssl_opt_t *client,
+                     mongoc_ssl_opt_t *server,
+                     const char *host,
+                     ssl_test_result_t *client_result,
+                     ssl_test_result_t *server_result)
+{
+   _ssl_test (
+      client, server, host, host, true, client_result, server_result);
+}
@@ -20,6 +20,8 @@ typedef struct ssl_test_result {
    ssl_test_state_t result;
    int err;
    unsigned long ssl_err;
+   bool resumed;
+   bool kernel_tls;
 } ssl_test_result_t;
 
 typedef struct ssl_test_data {
@@ -27,6 +29,8 @@ typedef struct ssl_test_data {
    mongoc_ssl_opt_t *server;
    ssl_test_behavior_t behavior;
    int64_t handshake_stall_ms;
+   bool kernel_tls;
+   const char *session_key;
    const char *host;
    unsigned short server_port;
    mongoc_cond_t cond;
@@ -41,3 +45,18 @@ ssl_test (mongoc_ssl_opt_t *client,
           const char *host,
           ssl_test_result_t *client_result,
           ssl_test_result_t *server_result);
+
+void
+ssl_test_session_key (mongoc_ssl_opt_t *client,
+                      mongoc_ssl_opt_t *server,
+                      const char *host,
+                      const char *session_key,
+                      ssl_test_result_t *client_result,
+                      ssl_test_result_t *server_result);
+
+void
+ssl_test_kernel_tls (mongoc_ssl_opt_t *client,
+                     mongoc_ssl_opt_t *server,
+                     const char *host,
+                     ssl_test_result_t *client_result,
+                     ssl_test_result_t *server_result);
@@ -59,10 +59,14 @@ test_collection_find_install (TestSuite *suite);
 extern void
 test_collection_find_with_opts_install (TestSuite *suite);
 extern void
+test_connection_broker_install (TestSuite *suite);
+extern void
 test_connection_uri_install (TestSuite *suite);
 extern void
 test_command_monitoring_install (TestSuite *suite);
 extern void
+test_compression_install (TestSuite *suite);
+extern void
 test_cursor_install (TestSuite *suite);
 extern void
 test_database_install (TestSuite *suite);
@@ -95,6 +99,8 @@ test_rpc_install (TestSuite *suite);
 extern void
 test_samples_install (TestSuite *suite);
 extern void
+test_scram_install (TestSuite *suite);
+extern void
 test_sdam_install (TestSuite *suite);
 extern void
 test_sdam_monitoring_install (TestSuite *suite);
@@ -2005,8 +2011,10 @@ main (int argc, char *argv[])
    test_collection_install (&suite);
    test_collection_find_install (&suite);
    test_collection_find_with_opts_install (&suite);
+   test_connection_broker_install (&suite);
    test_connection_uri_install (&suite);
    test_command_monitoring_install (&suite);
+   test_compression_install (&suite);
    test_cursor_install (&suite);
    test_database_install (&suite);
    test_error_install (&suite);
@@ -2026,6 +2034,7 @@ main (int argc, char *argv[])
    test_topology_scanner_install (&suite);
    test_topology_reconcile_install (&suite);
    test_samples_install (&suite);
+   test_scram_install (&suite);
    test_sdam_install (&suite);
    test_sdam_monitoring_install (&suite);
    test_server_selection_install (&suite);
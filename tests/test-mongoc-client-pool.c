@@ -1,10 +1,20 @@
 #include <mongoc.h>
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 #include "mongoc-client-pool-private.h"
+#include "mongoc-client-private.h"
+#include "mongoc-counters-private.h"
 #include "mongoc-array-private.h"
+#include "mongoc-topology-private.h"
 
 
 #include "TestSuite.h"
+#include "test-conveniences.h"
 #include "test-libmongoc.h"
+#include "mock_server/future-functions.h"
+#include "mock_server/mock-server.h"
 
 
 static void
@@ -272,6 +282,529 @@ test_mongoc_client_pool_handshake (void)
    mongoc_client_pool_destroy (pool);
 }
 
+static void
+test_mongoc_client_pool_partition (void)
+{
+   mongoc_client_pool_t *pool;
+   mongoc_client_t *client;
+   mongoc_client_t *slow1;
+   mongoc_client_t *slow2;
+   mongoc_uri_t *uri;
+   bson_error_t error;
+   bson_t stats;
+
+   uri = mongoc_uri_new ("mongodb://127.0.0.1/?maxpoolsize=1");
+   pool = mongoc_client_pool_new (uri);
+
+   ASSERT_OR_PRINT (
+      mongoc_client_pool_add_partition (pool, "slow", 0, 2, &error), error);
+
+   /* duplicate names and bad limits are rejected */
+   BSON_ASSERT (!mongoc_client_pool_add_partition (pool, "slow", 0, 2, &error));
+   ASSERT_ERROR_CONTAINS (error,
+                          MONGOC_ERROR_COMMAND,
+                          MONGOC_ERROR_COMMAND_INVALID_ARG,
+                          "already exists");
+   BSON_ASSERT (!mongoc_client_pool_add_partition (pool, "x", 3, 2, &error));
+   ASSERT_ERROR_CONTAINS (error,
+                          MONGOC_ERROR_COMMAND,
+                          MONGOC_ERROR_COMMAND_INVALID_ARG,
+                          "Invalid size limits");
+
+   /* exhausting the "slow" partition doesn't affect the default one */
+   slow1 = mongoc_client_pool_pop_partition (pool, "slow");
+   slow2 = mongoc_client_pool_pop_partition (pool, "slow");
+   BSON_ASSERT (slow1);
+   BSON_ASSERT (slow2);
+   BSON_ASSERT (!mongoc_client_pool_try_pop_partition (pool, "slow"));
+
+   client = mongoc_client_pool_pop (pool);
+   BSON_ASSERT (client);
+   BSON_ASSERT (!mongoc_client_pool_try_pop (pool));
+   ASSERT_CMPSIZE_T (mongoc_client_pool_get_size (pool), ==, (size_t) 1);
+
+   ASSERT_OR_PRINT (
+      mongoc_client_pool_get_partition_stats (pool, "slow", &stats, &error),
+      error);
+   ASSERT_MATCH (&stats,
+                 "{'name': 'slow', 'maxPoolSize': 2, 'size': 2, 'inUse': 2,"
+                 " 'idle': 0, 'checkouts': 2, 'created': 2}");
+   bson_destroy (&stats);
+
+   /* clients go back to the partition they came from */
+   mongoc_client_pool_push (pool, slow1);
+   mongoc_client_pool_push (pool, slow2);
+   mongoc_client_pool_push (pool, client);
+   ASSERT_CMPSIZE_T (mongoc_client_pool_num_pushed (pool), ==, (size_t) 1);
+
+   ASSERT_OR_PRINT (
+      mongoc_client_pool_get_partition_stats (pool, NULL, &stats, &error),
+      error);
+   ASSERT_MATCH (&stats,
+                 "{'name': null, 'maxPoolSize': 1, 'size': 1, 'inUse': 0,"
+                 " 'idle': 1, 'checkouts': 1}");
+   bson_destroy (&stats);
+
+   BSON_ASSERT (
+      !mongoc_client_pool_get_partition_stats (pool, "bad", &stats, &error));
+   ASSERT_ERROR_CONTAINS (error,
+                          MONGOC_ERROR_COMMAND,
+                          MONGOC_ERROR_COMMAND_INVALID_ARG,
+                          "No client pool partition named \"bad\"");
+   bson_destroy (&stats);
+
+   capture_logs (true);
+   BSON_ASSERT (!mongoc_client_pool_try_pop_partition (pool, "bad"));
+   capture_logs (false);
+
+   mongoc_uri_destroy (uri);
+   mongoc_client_pool_destroy (pool);
+}
+
+typedef struct {
+   int created;
+   int closed;
+   int checkouts;
+   char last_reason[32];
+} connection_events_t;
+
+
+static void
+connection_created_cb (const mongoc_apm_connection_created_t *event)
+{
+   connection_events_t *events;
+
+   events = (connection_events_t *) mongoc_apm_connection_created_get_context (
+      event);
+
+   BSON_ASSERT (mongoc_apm_connection_created_get_host (event));
+   BSON_ASSERT (mongoc_apm_connection_created_get_server_id (event) == 1);
+   events->created++;
+}
+
+
+static void
+connection_closed_cb (const mongoc_apm_connection_closed_t *event)
+{
+   connection_events_t *events;
+
+   events =
+      (connection_events_t *) mongoc_apm_connection_closed_get_context (event);
+
+   BSON_ASSERT (mongoc_apm_connection_closed_get_age (event) >= 0);
+   bson_strncpy (events->last_reason,
+                 mongoc_apm_connection_closed_get_reason (event),
+                 sizeof events->last_reason);
+   events->closed++;
+}
+
+
+static void
+pool_checkout_cb (const mongoc_apm_pool_checkout_t *event)
+{
+   connection_events_t *events;
+
+   events =
+      (connection_events_t *) mongoc_apm_pool_checkout_get_context (event);
+
+   BSON_ASSERT (!mongoc_apm_pool_checkout_get_partition (event));
+   BSON_ASSERT (mongoc_apm_pool_checkout_get_duration (event) == 0);
+   events->checkouts++;
+}
+
+
+/* returns the client port of the connection that received the ping */
+static uint16_t
+ping (mock_server_t *server, mongoc_client_t *client)
+{
+   future_t *future;
+   request_t *request;
+   bson_error_t error;
+   uint16_t port;
+
+   future = future_client_command_simple (
+      client, "admin", tmp_bson ("{'ping': 1}"), NULL, NULL, &error);
+   request = mock_server_receives_command (
+      server, "admin", MONGOC_QUERY_SLAVE_OK, "{'ping': 1}");
+   port = request_get_client_port (request);
+   mock_server_replies_ok_and_destroys (request);
+   ASSERT_OR_PRINT (future_get_bool (future), error);
+   future_destroy (future);
+
+   return port;
+}
+
+
+static void
+test_mongoc_client_pool_connection_events (void)
+{
+   mock_server_t *server;
+   mongoc_uri_t *uri;
+   mongoc_client_pool_t *pool;
+   mongoc_apm_callbacks_t *callbacks;
+   connection_events_t events = {0};
+   mongoc_client_t *client1;
+   mongoc_client_t *client2;
+
+   server = mock_server_with_autoismaster (WIRE_VERSION_MIN);
+   mock_server_run (server);
+   uri = mongoc_uri_copy (mock_server_get_uri (server));
+   mongoc_uri_set_option_as_int32 (uri, MONGOC_URI_MINPOOLSIZE, 1);
+   pool = mongoc_client_pool_new (uri);
+
+   callbacks = mongoc_apm_callbacks_new ();
+   mongoc_apm_set_connection_created_cb (callbacks, connection_created_cb);
+   mongoc_apm_set_connection_closed_cb (callbacks, connection_closed_cb);
+   mongoc_apm_set_pool_checkout_cb (callbacks, pool_checkout_cb);
+   ASSERT (mongoc_client_pool_set_apm_callbacks (pool, callbacks, &events));
+
+   client1 = mongoc_client_pool_pop (pool);
+   client2 = mongoc_client_pool_pop (pool);
+   ASSERT_CMPINT (events.checkouts, ==, 2);
+
+   ping (server, client1);
+   ping (server, client2);
+   ASSERT_CMPINT (events.created, ==, 2);
+   ASSERT_CMPINT (events.closed, ==, 0);
+
+   /* minPoolSize is 1, so pushing the second client closes the idle one */
+   mongoc_client_pool_push (pool, client1);
+   mongoc_client_pool_push (pool, client2);
+   ASSERT_CMPINT (events.closed, ==, 1);
+   ASSERT_CMPSTR (events.last_reason, "idle");
+
+   mongoc_client_pool_destroy (pool);
+   ASSERT_CMPINT (events.closed, ==, 2);
+   ASSERT_CMPSTR (events.last_reason, "clientClosed");
+
+   mongoc_apm_callbacks_destroy (callbacks);
+   mongoc_uri_destroy (uri);
+   mock_server_destroy (server);
+}
+
+static void
+test_mongoc_client_pool_trim_idle (void)
+{
+   mock_server_t *server;
+   mongoc_client_pool_t *pool;
+   mongoc_client_t *client;
+   future_t *future;
+   request_t *request;
+   bson_error_t error;
+   char *big;
+   char *reply;
+
+   server = mock_server_with_autoismaster (WIRE_VERSION_MIN);
+   mock_server_run (server);
+   pool = mongoc_client_pool_new (mock_server_get_uri (server));
+   mongoc_client_pool_set_max_idle_buffer_size (pool, 16 * 1024);
+
+   /* a large reply grows the connection's read buffer */
+   big = bson_malloc (256 * 1024);
+   memset (big, 'a', 256 * 1024 - 1);
+   big[256 * 1024 - 1] = '\0';
+   reply = bson_strdup_printf ("{'ok': 1, 'data': '%s'}", big);
+
+   client = mongoc_client_pool_pop (pool);
+   future = future_client_command_simple (
+      client, "admin", tmp_bson ("{'ping': 1}"), NULL, NULL, &error);
+   request = mock_server_receives_command (
+      server, "admin", MONGOC_QUERY_SLAVE_OK, "{'ping': 1}");
+   mock_server_replies_simple (request, reply);
+   ASSERT_OR_PRINT (future_get_bool (future), error);
+   ASSERT_CMPSIZE_T (
+      _mongoc_cluster_get_retained (&client->cluster), >, (size_t) 256 * 1024);
+
+   /* pushing the client shrinks its buffers back to their initial size */
+   mongoc_client_pool_push (pool, client);
+   ASSERT_CMPSIZE_T (mongoc_client_pool_get_idle_retained_bytes (pool),
+                     <=,
+                     (size_t) 16 * 1024);
+
+   /* the connection is still usable */
+   client = mongoc_client_pool_pop (pool);
+   ping (server, client);
+   mongoc_client_pool_push (pool, client);
+
+   request_destroy (request);
+   future_destroy (future);
+   bson_free (reply);
+   bson_free (big);
+   mongoc_client_pool_destroy (pool);
+   mock_server_destroy (server);
+}
+
+#ifndef _WIN32
+static void
+test_mongoc_client_pool_reset_after_fork (void)
+{
+   mock_server_t *server;
+   mongoc_client_pool_t *pool;
+   mongoc_client_t *client;
+   mongoc_topology_t *topology;
+   mongoc_server_description_t **sds;
+   request_t *request;
+   uint16_t port;
+   int64_t idle;
+   size_t n;
+   pid_t pid;
+   int status;
+
+   server = mock_server_with_autoismaster (WIRE_VERSION_MIN);
+   mock_server_run (server);
+   pool = mongoc_client_pool_new (mock_server_get_uri (server));
+
+   client = mongoc_client_pool_pop (pool);
+   port = ping (server, client);
+   mongoc_client_pool_push (pool, client);
+
+   pid = fork ();
+   ASSERT_CMPINT (pid, !=, -1);
+
+   if (pid == 0) {
+      /* as if another thread of the parent had an operation in progress */
+      topology = _mongoc_client_pool_get_topology (pool);
+      topology->in_flight.counts[1] = 1;
+      idle = mongoc_counter_client_pool_idle_count ();
+      mongoc_client_pool_reset_after_fork (pool);
+      if (topology->in_flight.counts[1] != 0) {
+         _exit (3);
+      }
+
+      /* the idle client was discarded */
+      if (mongoc_counter_client_pool_idle_count () != idle - 1) {
+         _exit (4);
+      }
+
+      client = mongoc_client_pool_pop (pool);
+
+      /* the last known topology is kept, no need to wait for a scan */
+      sds = mongoc_client_get_server_descriptions (client, &n);
+      if (n != 1 || !strcmp (mongoc_server_description_type (sds[0]),
+                             "Unknown")) {
+         _exit (2);
+      }
+
+      mongoc_server_descriptions_destroy_all (sds, n);
+      _exit (mongoc_client_command_simple (
+                client, "admin", tmp_bson ("{'ping': 1}"), NULL, NULL, NULL)
+                ? 0
+                : 1);
+   }
+
+   /* the child opens its own connection */
+   request = mock_server_receives_command (
+      server, "admin", MONGOC_QUERY_SLAVE_OK, "{'ping': 1}");
+   ASSERT (request);
+   ASSERT_CMPINT ((int) request_get_client_port (request), !=, (int) port);
+   mock_server_replies_ok_and_destroys (request);
+
+   ASSERT_CMPINT ((int) waitpid (pid, &status, 0), ==, (int) pid);
+   ASSERT (WIFEXITED (status));
+   ASSERT_CMPINT (WEXITSTATUS (status), ==, 0);
+
+   /* the parent's connection was not disturbed by the child */
+   client = mongoc_client_pool_pop (pool);
+   ASSERT_CMPINT ((int) ping (server, client), ==, (int) port);
+   mongoc_client_pool_push (pool, client);
+
+   mongoc_client_pool_destroy (pool);
+   mock_server_destroy (server);
+}
+#endif
+
+
+/* the client ports of the connections that sent isMaster to a server */
+typedef struct {
+   mongoc_mutex_t mutex;
+   uint16_t ports[16];
+   int n_ports;
+} ismaster_ports_t;
+
+
+static bool
+_record_ismaster_port (request_t *request, void *data)
+{
+   ismaster_ports_t *ismaster_ports = (ismaster_ports_t *) data;
+   uint16_t port;
+   int i;
+
+   if (!request->is_command || strcasecmp (request->command_name, "ismaster")) {
+      return false;
+   }
+
+   port = request_get_client_port (request);
+
+   mongoc_mutex_lock (&ismaster_ports->mutex);
+   for (i = 0; i < ismaster_ports->n_ports; i++) {
+      if (ismaster_ports->ports[i] == port) {
+         break;
+      }
+   }
+
+   if (i == ismaster_ports->n_ports && i < 16) {
+      ismaster_ports->ports[ismaster_ports->n_ports++] = port;
+   }
+   mongoc_mutex_unlock (&ismaster_ports->mutex);
+
+   /* let the autoresponder reply */
+   return false;
+}
+
+
+/* how many connections sent isMaster, other than the @n_app application
+ * connections in @app_ports? */
+static int
+_count_monitoring_connections (ismaster_ports_t *ismaster_ports,
+                               const uint16_t *app_ports,
+                               int n_app)
+{
+   int count = 0;
+   int i, j;
+
+   mongoc_mutex_lock (&ismaster_ports->mutex);
+   for (i = 0; i < ismaster_ports->n_ports; i++) {
+      for (j = 0; j < n_app; j++) {
+         if (ismaster_ports->ports[i] == app_ports[j]) {
+            break;
+         }
+      }
+
+      if (j == n_app) {
+         count++;
+      }
+   }
+   mongoc_mutex_unlock (&ismaster_ports->mutex);
+
+   return count;
+}
+
+
+static void
+test_mongoc_client_pool_shared_monitoring (void)
+{
+   mock_server_t *server;
+   mongoc_uri_t *uri;
+   mongoc_client_pool_t *pools[3];
+   mongoc_client_t *clients[3];
+   ismaster_ports_t ismaster_ports = {0};
+   uint16_t app_ports[3];
+   size_t n_monitors;
+   int i;
+
+   mongoc_mutex_init (&ismaster_ports.mutex);
+   server = mock_server_with_autoismaster (WIRE_VERSION_MIN);
+   mock_server_autoresponds (
+      server, _record_ismaster_port, &ismaster_ports, NULL);
+   mock_server_run (server);
+   n_monitors = _mongoc_shared_monitor_count ();
+
+   /* the third pool checks servers more often, it can't share */
+   uri = mongoc_uri_copy (mock_server_get_uri (server));
+   mongoc_uri_set_option_as_int32 (uri, MONGOC_URI_HEARTBEATFREQUENCYMS, 600);
+   pools[0] = mongoc_client_pool_new (mock_server_get_uri (server));
+   pools[1] = mongoc_client_pool_new (mock_server_get_uri (server));
+   pools[2] = mongoc_client_pool_new (uri);
+
+   for (i = 0; i < 3; i++) {
+      ASSERT (mongoc_client_pool_set_shared_monitoring (pools[i], true));
+      clients[i] = mongoc_client_pool_pop (pools[i]);
+      app_ports[i] = ping (server, clients[i]);
+   }
+
+   /* the first two pools check the server on one connection */
+   ASSERT_CMPINT (
+      _count_monitoring_connections (&ismaster_ports, app_ports, 3), ==, 2);
+
+   ASSERT (_mongoc_client_pool_get_topology (pools[0])->shared_monitor);
+   ASSERT (_mongoc_client_pool_get_topology (pools[0])->shared_monitor ==
+           _mongoc_client_pool_get_topology (pools[1])->shared_monitor);
+   ASSERT (_mongoc_client_pool_get_topology (pools[0])->shared_monitor !=
+           _mongoc_client_pool_get_topology (pools[2])->shared_monitor);
+   ASSERT_CMPSIZE_T (_mongoc_shared_monitor_count (), ==, n_monitors + 2);
+
+   /* too late once monitoring started */
+   capture_logs (true);
+   ASSERT (!mongoc_client_pool_set_shared_monitoring (pools[0], false));
+   ASSERT_CAPTURED_LOG ("mongoc_client_pool_set_shared_monitoring",
+                        MONGOC_LOG_LEVEL_ERROR,
+                        "after monitoring started");
+
+   /* the monitor outlives the first pool that used it */
+   mongoc_client_pool_push (pools[0], clients[0]);
+   mongoc_client_pool_destroy (pools[0]);
+   ping (server, clients[1]);
+   ASSERT_CMPSIZE_T (_mongoc_shared_monitor_count (), ==, n_monitors + 2);
+
+   for (i = 1; i < 3; i++) {
+      mongoc_client_pool_push (pools[i], clients[i]);
+      mongoc_client_pool_destroy (pools[i]);
+   }
+
+   ASSERT_CMPSIZE_T (_mongoc_shared_monitor_count (), ==, n_monitors);
+
+   mongoc_uri_destroy (uri);
+   mock_server_destroy (server);
+   mongoc_mutex_destroy (&ismaster_ports.mutex);
+}
+
+
+#ifdef MONGOC_ENABLE_SSL_OPENSSL
+/* pools that differ only in sslKernelTLS don't share monitoring
+ * connections, since those are set up one way or the other */
+static void
+test_mongoc_client_pool_shared_monitoring_kernel_tls (void)
+{
+   mock_server_t *server;
+   mongoc_ssl_opt_t client_opts = {0};
+   mongoc_ssl_opt_t server_opts = {0};
+   mongoc_uri_t *uris[2];
+   mongoc_client_pool_t *pools[2];
+   mongoc_client_t *clients[2];
+   ismaster_ports_t ismaster_ports = {0};
+   uint16_t app_ports[2];
+   int i;
+
+   client_opts.ca_file = CERT_CA;
+   server_opts.weak_cert_validation = true;
+   server_opts.ca_file = CERT_CA;
+   server_opts.pem_file = CERT_SERVER;
+
+   mongoc_mutex_init (&ismaster_ports.mutex);
+   server = mock_server_with_autoismaster (WIRE_VERSION_MIN);
+   mock_server_set_ssl_opts (server, &server_opts);
+   mock_server_autoresponds (
+      server, _record_ismaster_port, &ismaster_ports, NULL);
+   mock_server_run (server);
+
+   for (i = 0; i < 2; i++) {
+      uris[i] = mongoc_uri_copy (mock_server_get_uri (server));
+      mongoc_uri_set_option_as_bool (uris[i], MONGOC_URI_SSL, true);
+      mongoc_uri_set_option_as_bool (
+         uris[i], MONGOC_URI_SSLKERNELTLS, i == 1);
+      pools[i] = mongoc_client_pool_new (uris[i]);
+      mongoc_client_pool_set_ssl_opts (pools[i], &client_opts);
+      ASSERT (mongoc_client_pool_set_shared_monitoring (pools[i], true));
+      clients[i] = mongoc_client_pool_pop (pools[i]);
+      app_ports[i] = ping (server, clients[i]);
+   }
+
+   ASSERT (_mongoc_client_pool_get_topology (pools[0])->shared_monitor !=
+           _mongoc_client_pool_get_topology (pools[1])->shared_monitor);
+   ASSERT_CMPINT (
+      _count_monitoring_connections (&ismaster_ports, app_ports, 2), ==, 2);
+
+   for (i = 0; i < 2; i++) {
+      mongoc_client_pool_push (pools[i], clients[i]);
+      mongoc_client_pool_destroy (pools[i]);
+      mongoc_uri_destroy (uris[i]);
+   }
+
+   mock_server_destroy (server);
+   mongoc_mutex_destroy (&ismaster_ports.mutex);
+}
+#endif
+
 void
 test_client_pool_install (TestSuite *suite)
 {
@@ -291,6 +824,27 @@ test_client_pool_install (TestSuite *suite)
 
    TestSuite_Add (
       suite, "/ClientPool/handshake", test_mongoc_client_pool_handshake);
+   TestSuite_Add (
+      suite, "/ClientPool/partition", test_mongoc_client_pool_partition);
+   TestSuite_AddMockServerTest (suite,
+                                "/ClientPool/connection_events",
+                                test_mongoc_client_pool_connection_events);
+   TestSuite_AddMockServerTest (
+      suite, "/ClientPool/trim_idle", test_mongoc_client_pool_trim_idle);
+#ifndef _WIN32
+   TestSuite_AddMockServerTest (suite,
+                                "/ClientPool/reset_after_fork",
+                                test_mongoc_client_pool_reset_after_fork);
+#endif
+   TestSuite_AddMockServerTest (suite,
+                                "/ClientPool/shared_monitoring",
+                                test_mongoc_client_pool_shared_monitoring);
+#ifdef MONGOC_ENABLE_SSL_OPENSSL
+   TestSuite_AddMockServerTest (
+      suite,
+      "/ClientPool/shared_monitoring/kernel_tls",
+      test_mongoc_client_pool_shared_monitoring_kernel_tls);
+#endif
 
 #ifndef MONGOC_ENABLE_SSL
    TestSuite_Add (
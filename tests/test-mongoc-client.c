@@ -23,6 +23,11 @@
 #include <strings.h>
 #endif
 
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #undef MONGOC_LOG_DOMAIN
 #define MONGOC_LOG_DOMAIN "client-test"
 
@@ -618,6 +623,244 @@ test_mongoc_client_authenticate_timeout (void *context)
 }
 
 
+/* reply to the monitor's ismasters, leave ismasters with speculative
+ * authentication to the test */
+static bool
+auto_ismaster_not_speculative (request_t *request, void *data)
+{
+   if (!request->is_command || strcasecmp (request->command_name, "ismaster") ||
+       bson_has_field (request_get_doc (request, 0),
+                       "speculativeAuthenticate")) {
+      return false;
+   }
+
+   mock_server_replies_simple (request,
+                               "{'ok': 1, 'ismaster': true,"
+                               " 'minWireVersion': 0, 'maxWireVersion': 5}");
+   request_destroy (request);
+
+   return true;
+}
+
+
+static mock_server_t *
+_speculative_auth_server_new (mongoc_client_pool_t **pool,
+                              const char *mechanism)
+{
+   mock_server_t *server;
+   mongoc_uri_t *uri;
+
+   server = mock_server_new ();
+   mock_server_autoresponds (
+      server, auto_ismaster_not_speculative, NULL, NULL);
+   mock_server_run (server);
+
+   uri = mongoc_uri_copy (mock_server_get_uri (server));
+   mongoc_uri_set_username (uri, "user");
+   if (mechanism) {
+      mongoc_uri_set_auth_mechanism (uri, mechanism);
+   } else {
+      mongoc_uri_set_password (uri, "password");
+   }
+
+   *pool = mongoc_client_pool_new (uri);
+   mongoc_uri_destroy (uri);
+
+   return server;
+}
+
+
+#ifdef MONGOC_ENABLE_CRYPTO
+static void
+test_mongoc_client_speculative_auth_scram (void)
+{
+   mock_server_t *server;
+   mongoc_client_pool_t *pool;
+   mongoc_client_t *client;
+   bson_error_t error;
+   future_t *future;
+   request_t *request;
+   bson_iter_t iter;
+   bson_iter_t payload;
+   bson_subtype_t subtype;
+   uint32_t len;
+   const uint8_t *data;
+   char *client_first;
+   const char *nonce;
+   char *server_first;
+   bson_t speculative;
+   bson_t reply = BSON_INITIALIZER;
+
+   capture_logs (true);
+
+   server = _speculative_auth_server_new (&pool, NULL);
+   client = mongoc_client_pool_pop (pool);
+
+   future = future_client_command_simple (
+      client, "admin", tmp_bson ("{'ping': 1}"), NULL, NULL, &error);
+
+   /* the new connection's ismaster begins the SCRAM conversation */
+   request = mock_server_receives_command (
+      server,
+      "admin",
+      MONGOC_QUERY_SLAVE_OK,
+      "{'isMaster': 1,"
+      " 'speculativeAuthenticate': {'saslStart': 1,"
+      "                             'mechanism': 'SCRAM-SHA-1',"
+      "                             'db': 'admin'}}");
+
+   ASSERT (bson_iter_init (&iter, request_get_doc (request, 0)));
+   ASSERT (bson_iter_find_descendant (
+      &iter, "speculativeAuthenticate.payload", &payload));
+   ASSERT (BSON_ITER_HOLDS_BINARY (&payload));
+   bson_iter_binary (&payload, &subtype, &len, &data);
+   client_first = bson_strndup ((const char *) data, len);
+   nonce = strstr (client_first, ",r=");
+   ASSERT (nonce);
+
+   server_first = bson_strdup_printf (
+      "r=%sserver,s=AAECAwQFBgcICQoLDA0ODw==,i=4096", nonce + 3);
+
+   bson_init (&speculative);
+   BSON_APPEND_INT32 (&speculative, "conversationId", 1);
+   BSON_APPEND_BOOL (&speculative, "done", false);
+   bson_append_binary (&speculative,
+                       "payload",
+                       7,
+                       BSON_SUBTYPE_BINARY,
+                       (const uint8_t *) server_first,
+                       (uint32_t) strlen (server_first));
+
+   BSON_APPEND_INT32 (&reply, "ok", 1);
+   BSON_APPEND_BOOL (&reply, "ismaster", true);
+   BSON_APPEND_INT32 (&reply, "minWireVersion", 0);
+   BSON_APPEND_INT32 (&reply, "maxWireVersion", 5);
+   BSON_APPEND_DOCUMENT (&reply, "speculativeAuthenticate", &speculative);
+   mock_server_reply_multi (request, MONGOC_REPLY_NONE, &reply, 1, 0);
+   request_destroy (request);
+
+   /* the client continues the conversation, no saslStart */
+   request = mock_server_receives_command (
+      server,
+      "admin",
+      MONGOC_QUERY_SLAVE_OK,
+      "{'saslContinue': 1, 'conversationId': 1}");
+
+   mock_server_replies_simple (
+      request, "{'ok': 0, 'code': 18, 'errmsg': 'auth failed'}");
+
+   ASSERT (!future_get_bool (future));
+   ASSERT_ERROR_CONTAINS (error,
+                          MONGOC_ERROR_CLIENT,
+                          MONGOC_ERROR_CLIENT_AUTHENTICATE,
+                          "auth failed");
+
+   bson_free (client_first);
+   bson_free (server_first);
+   bson_destroy (&speculative);
+   bson_destroy (&reply);
+   future_destroy (future);
+   request_destroy (request);
+   mongoc_client_pool_push (pool, client);
+   mongoc_client_pool_destroy (pool);
+   mock_server_destroy (server);
+}
+
+
+static void
+test_mongoc_client_speculative_auth_unsupported (void)
+{
+   mock_server_t *server;
+   mongoc_client_pool_t *pool;
+   mongoc_client_t *client;
+   bson_error_t error;
+   future_t *future;
+   request_t *request;
+
+   capture_logs (true);
+
+   server = _speculative_auth_server_new (&pool, NULL);
+   client = mongoc_client_pool_pop (pool);
+
+   future = future_client_command_simple (
+      client, "admin", tmp_bson ("{'ping': 1}"), NULL, NULL, &error);
+
+   /* a server without speculative authentication ignores the field */
+   request = mock_server_receives_ismaster (server);
+   mock_server_replies_simple (request,
+                               "{'ok': 1, 'ismaster': true,"
+                               " 'minWireVersion': 0, 'maxWireVersion': 5}");
+   request_destroy (request);
+
+   /* the client authenticates the usual way */
+   request = mock_server_receives_command (
+      server, "admin", MONGOC_QUERY_SLAVE_OK, "{'saslStart': 1}");
+   mock_server_replies_simple (
+      request, "{'ok': 0, 'code': 18, 'errmsg': 'auth failed'}");
+
+   ASSERT (!future_get_bool (future));
+   ASSERT_ERROR_CONTAINS (error,
+                          MONGOC_ERROR_CLIENT,
+                          MONGOC_ERROR_CLIENT_AUTHENTICATE,
+                          "auth failed");
+
+   future_destroy (future);
+   request_destroy (request);
+   mongoc_client_pool_push (pool, client);
+   mongoc_client_pool_destroy (pool);
+   mock_server_destroy (server);
+}
+#endif
+
+
+#ifdef MONGOC_ENABLE_SSL
+static void
+test_mongoc_client_speculative_auth_x509 (void)
+{
+   mock_server_t *server;
+   mongoc_client_pool_t *pool;
+   mongoc_client_t *client;
+   bson_error_t error;
+   future_t *future;
+   request_t *request;
+
+   server = _speculative_auth_server_new (&pool, "MONGODB-X509");
+   client = mongoc_client_pool_pop (pool);
+
+   future = future_client_command_simple (
+      client, "admin", tmp_bson ("{'ping': 1}"), NULL, NULL, &error);
+
+   request = mock_server_receives_command (
+      server,
+      "admin",
+      MONGOC_QUERY_SLAVE_OK,
+      "{'isMaster': 1,"
+      " 'speculativeAuthenticate': {'authenticate': 1,"
+      "                             'mechanism': 'MONGODB-X509',"
+      "                             'user': 'user',"
+      "                             'db': '$external'}}");
+
+   mock_server_replies_simple (
+      request,
+      "{'ok': 1, 'ismaster': true, 'minWireVersion': 0, 'maxWireVersion': 5,"
+      " 'speculativeAuthenticate': {'dbname': '$external', 'user': 'user'}}");
+   request_destroy (request);
+
+   /* authenticated by the ismaster, no "authenticate" command */
+   request = mock_server_receives_command (
+      server, "admin", MONGOC_QUERY_SLAVE_OK, "{'ping': 1}");
+   mock_server_replies_ok_and_destroys (request);
+
+   ASSERT_OR_PRINT (future_get_bool (future), error);
+
+   future_destroy (future);
+   mongoc_client_pool_push (pool, client);
+   mongoc_client_pool_destroy (pool);
+   mock_server_destroy (server);
+}
+#endif
+
+
 static void
 test_wire_version (void)
 {
@@ -3137,6 +3380,76 @@ test_set_ssl_opts (void)
 }
 #endif
 
+#ifndef _WIN32
+static void
+test_local_unix_socket (void)
+{
+   mongoc_uri_t *uri;
+   mongoc_host_list_t host;
+   mongoc_socket_t *listener;
+   mongoc_socket_t *conn;
+   mongoc_stream_t *stream;
+   struct sockaddr_un saddr;
+   struct stat st;
+   uint16_t port;
+   char host_and_port[64];
+
+   /* find a port with no server socket file */
+   memset (&saddr, 0, sizeof saddr);
+   saddr.sun_family = AF_UNIX;
+   port = (uint16_t) (20000 + getpid () % 20000);
+   do {
+      port++;
+      bson_snprintf (saddr.sun_path,
+                     sizeof saddr.sun_path,
+                     "/tmp/mongodb-%hu.sock",
+                     port);
+   } while (stat (saddr.sun_path, &st) == 0);
+
+   listener = mongoc_socket_new (AF_UNIX, SOCK_STREAM, 0);
+   ASSERT (listener);
+   ASSERT_CMPINT (mongoc_socket_bind (listener,
+                                      (struct sockaddr *) &saddr,
+                                      (mongoc_socklen_t) sizeof saddr),
+                  ==,
+                  0);
+   ASSERT_CMPINT (mongoc_socket_listen (listener, 10), ==, 0);
+
+   bson_snprintf (host_and_port, sizeof host_and_port, "localhost:%hu", port);
+   ASSERT (_mongoc_host_list_from_string (&host, host_and_port));
+
+   /* off by default */
+   uri = mongoc_uri_new ("mongodb://localhost");
+   ASSERT (!_mongoc_client_connect_local_unix (uri, &host));
+   mongoc_uri_destroy (uri);
+
+   uri = mongoc_uri_new ("mongodb://localhost/?localUnixSocket=true");
+   stream = _mongoc_client_connect_local_unix (uri, &host);
+   ASSERT (stream);
+   conn = mongoc_socket_accept (listener, bson_get_monotonic_time () + 1000000);
+   ASSERT (conn);
+   mongoc_socket_destroy (conn);
+   mongoc_stream_destroy (stream);
+
+   /* a remote host with the same port uses TCP */
+   bson_snprintf (host_and_port, sizeof host_and_port, "192.0.2.1:%hu", port);
+   ASSERT (_mongoc_host_list_from_string (&host, host_and_port));
+   ASSERT (!_mongoc_client_connect_local_unix (uri, &host));
+   mongoc_uri_destroy (uri);
+
+   /* TLS is not used over the socket file */
+   bson_snprintf (host_and_port, sizeof host_and_port, "localhost:%hu", port);
+   ASSERT (_mongoc_host_list_from_string (&host, host_and_port));
+   uri = mongoc_uri_new ("mongodb://localhost/?localUnixSocket=true&ssl=true");
+   ASSERT (!_mongoc_client_connect_local_unix (uri, &host));
+   mongoc_uri_destroy (uri);
+
+   mongoc_socket_destroy (listener);
+   unlink (saddr.sun_path);
+}
+#endif
+
+
 void
 test_client_install (TestSuite *suite)
 {
@@ -3180,6 +3493,20 @@ test_client_install (TestSuite *suite)
                       NULL,
                       NULL,
                       test_framework_skip_if_no_auth);
+#ifdef MONGOC_ENABLE_CRYPTO
+   TestSuite_AddMockServerTest (suite,
+                                "/Client/speculative_auth/scram",
+                                test_mongoc_client_speculative_auth_scram);
+   TestSuite_AddMockServerTest (
+      suite,
+      "/Client/speculative_auth/unsupported",
+      test_mongoc_client_speculative_auth_unsupported);
+#endif
+#ifdef MONGOC_ENABLE_SSL
+   TestSuite_AddMockServerTest (suite,
+                                "/Client/speculative_auth/x509",
+                                test_mongoc_client_speculative_auth_x509);
+#endif
    TestSuite_AddLive (suite, "/Client/command", test_mongoc_client_command);
    TestSuite_AddLive (
       suite, "/Client/command_defaults", test_mongoc_client_command_defaults);
@@ -3378,4 +3705,7 @@ test_client_install (TestSuite *suite)
                       NULL,
                       NULL,
                       test_framework_skip_if_slow);
+#ifndef _WIN32
+   TestSuite_Add (suite, "/Client/local_unix_socket", test_local_unix_socket);
+#endif
 }
@@ -2,8 +2,10 @@
 #include <mongoc.h>
 
 #include "mongoc-client-private.h"
+#include "mongoc-counters-private.h"
 #include "mongoc-uri-private.h"
 
+#include "mock_server/mock-rs.h"
 #include "mock_server/mock-server.h"
 #include "mock_server/future.h"
 #include "mock_server/future-functions.h"
@@ -1085,6 +1087,151 @@ dollar_query_test_t tests[] = {
    {NULL}};
 
 
+typedef enum {
+   HEDGE_WINS,
+   FIRST_WINS,
+   HEDGE_NOT_CONNECTED,
+} hedge_test_t;
+
+
+static void
+_test_hedged_read (hedge_test_t test)
+{
+   mock_rs_t *rs;
+   mongoc_uri_t *uri;
+   mongoc_client_pool_t *pool = NULL;
+   mongoc_client_t *client;
+   mongoc_collection_t *collection;
+   mongoc_read_prefs_t *prefs;
+   mongoc_cursor_t *cursor;
+   mongoc_server_description_t **sds;
+   mongoc_host_list_t host;
+   const bson_t *doc;
+   future_t *future;
+   request_t *first;
+   request_t *hedge = NULL;
+   request_t *winner;
+   int64_t fired;
+   int64_t won;
+   size_t n;
+   size_t i;
+
+   rs = mock_rs_with_autoismaster (WIRE_VERSION_OP_MSG, true, 2, 0);
+   mock_rs_run (rs);
+   uri = mongoc_uri_copy (mock_rs_get_uri (rs));
+   mongoc_uri_set_option_as_bool (uri, MONGOC_URI_HEDGEDREADS, true);
+   mongoc_uri_set_option_as_int32 (uri, MONGOC_URI_HEDGEDELAYMS, 100);
+
+   /* a single client shares the scanner's connections to every server, a
+    * pooled client has none to the secondary it hasn't used */
+   if (test == HEDGE_NOT_CONNECTED) {
+      pool = mongoc_client_pool_new (uri);
+      client = mongoc_client_pool_pop (pool);
+   } else {
+      client = mongoc_client_new_from_uri (uri);
+   }
+
+   collection = mongoc_client_get_collection (client, "db", "collection");
+   prefs = mongoc_read_prefs_new (MONGOC_READ_SECONDARY);
+   cursor = mongoc_collection_find_with_opts (
+      collection, tmp_bson ("{}"), NULL, prefs);
+
+   fired = mongoc_counter_hedge_fired_count ();
+   won = mongoc_counter_hedge_won_count ();
+
+   future = future_cursor_next (cursor, &doc);
+   first = mock_rs_receives_request (rs);
+   ASSERT (first);
+   ASSERT_CMPSTR (first->command_name, "find");
+   ASSERT (mock_rs_request_is_to_secondary (rs, first));
+
+   if (test == HEDGE_NOT_CONNECTED) {
+      /* past hedgeDelayMS, nothing is sent to the other secondary */
+      _mongoc_usleep (300 * 1000);
+      winner = first;
+   } else {
+      /* the first secondary is slow, the find goes to the other too */
+      hedge = mock_rs_receives_request (rs);
+      ASSERT (hedge);
+      ASSERT_CMPSTR (hedge->command_name, "find");
+      ASSERT (mock_rs_request_is_to_secondary (rs, hedge));
+      ASSERT_CMPUINT16 (request_get_server_port (first),
+                        !=,
+                        request_get_server_port (hedge));
+      winner = test == HEDGE_WINS ? hedge : first;
+   }
+
+   mock_rs_replies_simple (winner,
+                           "{'ok': 1,"
+                           " 'cursor': {"
+                           "    'id': 0,"
+                           "    'ns': 'db.collection',"
+                           "    'firstBatch': [{'a': 1}]}}");
+   ASSERT (future_get_bool (future));
+   ASSERT_MATCH (doc, "{'a': 1}");
+
+   /* the cursor is pinned to the server that answered */
+   mongoc_cursor_get_host (cursor, &host);
+   ASSERT_CMPUINT16 (host.port, ==, request_get_server_port (winner));
+
+   ASSERT_CMPINT64 (mongoc_counter_hedge_fired_count () - fired,
+                    ==,
+                    (int64_t) (test == HEDGE_NOT_CONNECTED ? 0 : 1));
+   ASSERT_CMPINT64 (mongoc_counter_hedge_won_count () - won,
+                    ==,
+                    (int64_t) (test == HEDGE_WINS ? 1 : 0));
+
+   /* neither a lost race nor a missing connection marks a server unknown */
+   sds = mongoc_client_get_server_descriptions (client, &n);
+   ASSERT_CMPSIZE_T (n, ==, (size_t) 3);
+   for (i = 0; i < n; i++) {
+      ASSERT (strcmp (mongoc_server_description_type (sds[i]), "Unknown"));
+   }
+
+   mongoc_server_descriptions_destroy_all (sds, n);
+   future_destroy (future);
+   request_destroy (first);
+   if (hedge) {
+      request_destroy (hedge);
+   }
+
+   mongoc_cursor_destroy (cursor);
+   mongoc_read_prefs_destroy (prefs);
+   mongoc_collection_destroy (collection);
+
+   if (pool) {
+      mongoc_client_pool_push (pool, client);
+      mongoc_client_pool_destroy (pool);
+   } else {
+      mongoc_client_destroy (client);
+   }
+
+   mongoc_uri_destroy (uri);
+   mock_rs_destroy (rs);
+}
+
+
+static void
+test_hedged_read_hedge_wins (void)
+{
+   _test_hedged_read (HEDGE_WINS);
+}
+
+
+static void
+test_hedged_read_first_wins (void)
+{
+   _test_hedged_read (FIRST_WINS);
+}
+
+
+static void
+test_hedged_read_not_connected (void)
+{
+   _test_hedged_read (HEDGE_NOT_CONNECTED);
+}
+
+
 void
 test_cluster_install (TestSuite *suite)
 {
@@ -1168,6 +1315,15 @@ test_cluster_install (TestSuite *suite)
    TestSuite_AddLive (suite,
                       "/Cluster/cluster_time/insert/pooled",
                       test_cluster_time_insert_pooled);
+   TestSuite_AddMockServerTest (suite,
+                                "/Cluster/hedged_read/hedge_wins",
+                                test_hedged_read_hedge_wins);
+   TestSuite_AddMockServerTest (suite,
+                                "/Cluster/hedged_read/first_wins",
+                                test_hedged_read_first_wins);
+   TestSuite_AddMockServerTest (suite,
+                                "/Cluster/hedged_read/not_connected",
+                                test_hedged_read_not_connected);
 #ifdef TODO_MOCK_SERVER_OP_MSG
    TestSuite_AddMockServerTest (suite,
                                 "/Cluster/cluster_time/comparison/single",
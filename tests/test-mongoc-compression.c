@@ -0,0 +1,543 @@
+#include <mongoc.h>
+
+#include "mongoc-compression-private.h"
+
+#include "TestSuite.h"
+#include "test-libmongoc.h"
+
+
+#define HEADER_SIZE 16
+
+
+/* BSON-like text, which compresses well */
+static void
+_fill_compressible (uint8_t *buf, size_t len)
+{
+   const char *pattern = "\x02name\x00\x07\x00\x00\x00widget\x00"
+                         "\x10qty\x00\x05\x00\x00\x00";
+   size_t pattern_len = 26;
+   size_t i;
+
+   for (i = 0; i < len; i++) {
+      buf[i] = (uint8_t) pattern[i % pattern_len];
+   }
+}
+
+
+/* pseudo-random bytes, like already-compressed data */
+static void
+_fill_random (uint8_t *buf, size_t len)
+{
+   uint32_t state = 12345;
+   size_t i;
+
+   for (i = 0; i < len; i++) {
+      state = state * 1103515245u + 12345u;
+      buf[i] = (uint8_t) (state >> 16);
+   }
+}
+
+
+static bool
+_should_compress (mongoc_compression_policy_t *policy,
+                  const char *command_name,
+                  uint8_t *buf,
+                  size_t len)
+{
+   mongoc_iovec_t iov[2];
+
+   /* split the message to exercise sampling across iovecs */
+   iov[0].iov_base = (void *) buf;
+   iov[0].iov_len = HEADER_SIZE;
+   iov[1].iov_base = (void *) (buf + HEADER_SIZE);
+   iov[1].iov_len = len - HEADER_SIZE;
+
+   return _mongoc_compression_policy_should_compress (
+      policy, command_name, iov, 2, HEADER_SIZE);
+}
+
+
+static void
+test_compression_policy_small (void)
+{
+   mongoc_compression_policy_t policy;
+   uint8_t buf[HEADER_SIZE + MONGOC_COMPRESSION_MIN_SIZE];
+
+   _mongoc_compression_policy_init (&policy);
+   _fill_compressible (buf, sizeof buf);
+
+   ASSERT (!_should_compress (&policy, "find", buf, 100));
+   ASSERT (!_should_compress (&policy, "find", buf, sizeof buf - 1));
+   ASSERT (_should_compress (&policy, "find", buf, sizeof buf));
+}
+
+
+static void
+test_compression_policy_entropy (void)
+{
+   mongoc_compression_policy_t policy;
+   uint8_t buf[4096];
+
+   _mongoc_compression_policy_init (&policy);
+
+   _fill_random (buf, sizeof buf);
+   ASSERT (!_should_compress (&policy, "insert", buf, sizeof buf));
+
+   _fill_compressible (buf, sizeof buf);
+   ASSERT (_should_compress (&policy, "insert", buf, sizeof buf));
+}
+
+
+static void
+test_compression_policy_ratio (void)
+{
+   mongoc_compression_policy_t policy;
+   uint8_t buf[4096];
+   int i;
+
+   _mongoc_compression_policy_init (&policy);
+   _fill_compressible (buf, sizeof buf);
+
+   /* too few samples to give up on "insert" */
+   for (i = 0; i < MONGOC_COMPRESSION_MIN_SAMPLES - 1; i++) {
+      _mongoc_compression_policy_record (&policy, "insert", 1000, 990);
+      ASSERT (_should_compress (&policy, "insert", buf, sizeof buf));
+   }
+
+   _mongoc_compression_policy_record (&policy, "insert", 1000, 990);
+
+   /* skipped, except for one probe per interval */
+   for (i = 0; i < MONGOC_COMPRESSION_PROBE_INTERVAL - 1; i++) {
+      ASSERT (!_should_compress (&policy, "insert", buf, sizeof buf));
+   }
+
+   ASSERT (_should_compress (&policy, "insert", buf, sizeof buf));
+   ASSERT (!_should_compress (&policy, "INSERT", buf, sizeof buf));
+
+   /* other commands are unaffected */
+   ASSERT (_should_compress (&policy, "find", buf, sizeof buf));
+   ASSERT (_should_compress (&policy, NULL, buf, sizeof buf));
+
+   /* once "insert" messages shrink again, they're compressed */
+   for (i = 0; i < 8; i++) {
+      _mongoc_compression_policy_record (&policy, "insert", 1000, 200);
+   }
+
+   ASSERT (_should_compress (&policy, "insert", buf, sizeof buf));
+}
+
+
+static bool
+_select (mongoc_compression_policy_t *policy,
+         uint32_t server_id,
+         const bson_t *server_compressors,
+         int32_t *compressor_id,
+         int32_t *level)
+{
+   return _mongoc_compression_policy_select (policy,
+                                             server_id,
+                                             server_compressors,
+                                             1024 * 1024,
+                                             compressor_id,
+                                             level);
+}
+
+
+/* codecs that compress 1MB to 40% in 2ms, or to 20% in 20ms */
+static void
+_record_codecs (mongoc_compression_policy_t *policy, int32_t compressor_id)
+{
+   int i;
+
+   for (i = 0; i < policy->n_codecs; i++) {
+      if (policy->codecs[i].compressor_id != compressor_id) {
+         continue;
+      }
+
+      if (policy->codecs[i].level <= 1) {
+         _mongoc_compression_policy_record_codec (
+            policy, compressor_id, policy->codecs[i].level, 1000, 400, 2);
+      } else {
+         _mongoc_compression_policy_record_codec (
+            policy, compressor_id, policy->codecs[i].level, 1000, 200, 20);
+      }
+   }
+}
+
+
+static void
+_test_policy_select (int32_t compressor_id)
+{
+   mongoc_compression_policy_t policy;
+   bson_t *compressors;
+   int32_t id;
+   int32_t level;
+   int32_t fastest_level = -2;
+   int i;
+
+   _mongoc_compression_policy_init (&policy);
+   policy.adaptive = true;
+   compressors = BCON_NEW (
+      "0", "bogus", "1", mongoc_compressor_id_to_name (compressor_id));
+
+   /* each codec is tried once, fastest level first */
+   for (i = 0; i < policy.n_codecs; i++) {
+      if (policy.codecs[i].compressor_id != compressor_id) {
+         continue;
+      }
+
+      ASSERT (_select (&policy, 1, compressors, &id, &level));
+      ASSERT_CMPINT (id, ==, compressor_id);
+      ASSERT_CMPINT (level, ==, policy.codecs[i].level);
+      if (fastest_level == -2) {
+         fastest_level = level;
+      }
+
+      _mongoc_compression_policy_record_codec (
+         &policy, id, level, 1000, 400, 2);
+   }
+
+   _record_codecs (&policy, compressor_id);
+
+   /* before the link is measured, the fastest level is used */
+   ASSERT (_select (&policy, 1, compressors, &id, &level));
+   ASSERT_CMPINT (id, ==, compressor_id);
+   ASSERT_CMPINT (level, ==, fastest_level);
+
+   /* too few bytes to measure the link */
+   _mongoc_compression_policy_record_link (&policy,
+                                           1,
+                                           MONGOC_COMPRESSION_LINK_RECV,
+                                           MONGOC_COMPRESSION_LINK_MIN_SIZE - 1,
+                                           1);
+   ASSERT (_select (&policy, 1, compressors, &id, &level));
+   ASSERT_CMPINT (level, ==, fastest_level);
+
+   /* a write that only filled the socket buffer doesn't measure the link */
+   _mongoc_compression_policy_record_link (
+      &policy, 1, MONGOC_COMPRESSION_LINK_SEND, 1000 * 1000, 100);
+   ASSERT (_select (&policy, 1, compressors, &id, &level));
+   ASSERT_CMPINT (level, ==, fastest_level);
+
+   /* 10 GB/s: sending 1MB takes 0.1ms, faster than compressing it */
+   _mongoc_compression_policy_record_link (
+      &policy, 1, MONGOC_COMPRESSION_LINK_RECV, 1000 * 1000, 100);
+   ASSERT (!_select (&policy, 1, compressors, &id, &level));
+
+   /* another server's link is unmeasured */
+   ASSERT (_select (&policy, 2, compressors, &id, &level));
+   ASSERT_CMPINT (level, ==, fastest_level);
+
+   /* fast sends don't hide a slow link: 1 MB/s receiving, so compressing
+    * harder pays off */
+   _mongoc_compression_policy_record_link (
+      &policy, 2, MONGOC_COMPRESSION_LINK_SEND, 1000 * 1000, 100);
+   _mongoc_compression_policy_record_link (
+      &policy, 2, MONGOC_COMPRESSION_LINK_RECV, 1000 * 1000, 1000000);
+   ASSERT (_select (&policy, 2, compressors, &id, &level));
+   ASSERT_CMPINT (id, ==, compressor_id);
+   if (compressor_id != MONGOC_COMPRESSOR_SNAPPY_ID) {
+      ASSERT_CMPINT (level, !=, fastest_level);
+   }
+
+   bson_destroy (compressors);
+
+   /* nothing is compressed with codecs the server didn't agree to */
+   compressors = BCON_NEW ("0", "bogus");
+   ASSERT (!_select (&policy, 1, compressors, &id, &level));
+   bson_destroy (compressors);
+}
+
+
+static void
+test_compression_policy_select (void)
+{
+#ifdef MONGOC_ENABLE_COMPRESSION_SNAPPY
+   _test_policy_select (MONGOC_COMPRESSOR_SNAPPY_ID);
+#endif
+#ifdef MONGOC_ENABLE_COMPRESSION_ZLIB
+   _test_policy_select (MONGOC_COMPRESSOR_ZLIB_ID);
+#endif
+#ifdef MONGOC_ENABLE_COMPRESSION_ZSTD
+   _test_policy_select (MONGOC_COMPRESSOR_ZSTD_ID);
+#endif
+}
+
+
+static void
+_test_roundtrip (int32_t compressor_id, int32_t level)
+{
+   char uncompressed[4096];
+   char *compressed;
+   uint8_t out[4096];
+   size_t compressed_len;
+   size_t out_len = sizeof out;
+
+   _fill_compressible ((uint8_t *) uncompressed, sizeof uncompressed);
+
+   compressed_len = mongoc_compressor_max_compressed_length (
+      compressor_id, sizeof uncompressed);
+   compressed = bson_malloc (compressed_len);
+
+   ASSERT (mongoc_compress (compressor_id,
+                            level,
+                            uncompressed,
+                            sizeof uncompressed,
+                            compressed,
+                            &compressed_len));
+   ASSERT_CMPSIZE_T (compressed_len, <, sizeof uncompressed);
+
+   ASSERT (mongoc_uncompress (compressor_id,
+                              (const uint8_t *) compressed,
+                              compressed_len,
+                              out,
+                              &out_len));
+   ASSERT_CMPSIZE_T (out_len, ==, sizeof uncompressed);
+   ASSERT (!memcmp (out, uncompressed, sizeof uncompressed));
+
+   bson_free (compressed);
+}
+
+
+static void
+test_compression_roundtrip (void)
+{
+#ifdef MONGOC_ENABLE_COMPRESSION_SNAPPY
+   _test_roundtrip (MONGOC_COMPRESSOR_SNAPPY_ID, 0);
+#endif
+#ifdef MONGOC_ENABLE_COMPRESSION_ZLIB
+   _test_roundtrip (MONGOC_COMPRESSOR_ZLIB_ID, -1);
+#endif
+#ifdef MONGOC_ENABLE_COMPRESSION_ZSTD
+   _test_roundtrip (MONGOC_COMPRESSOR_ZSTD_ID, 0);
+#endif
+}
+
+
+static void
+_test_iovec (int32_t compressor_id)
+{
+   mongoc_compression_scratch_t scratch;
+   uint8_t message[HEADER_SIZE + 4096];
+   mongoc_iovec_t iov[4];
+   uint8_t out[4096];
+   size_t out_len;
+   size_t compressed_len;
+   uint8_t *compressed = NULL;
+   int i;
+
+   _mongoc_compression_scratch_init (&scratch, -1, 1, 0);
+   memset (message, 'h', HEADER_SIZE);
+   _fill_compressible (message + HEADER_SIZE, sizeof message - HEADER_SIZE);
+
+   /* the header ends partway through the second iovec */
+   iov[0].iov_base = (void *) message;
+   iov[0].iov_len = 10;
+   iov[1].iov_base = (void *) (message + 10);
+   iov[1].iov_len = 100;
+   iov[2].iov_base = (void *) (message + 110);
+   iov[2].iov_len = 0;
+   iov[3].iov_base = (void *) (message + 110);
+   iov[3].iov_len = sizeof message - 110;
+
+   for (i = 0; i < 2; i++) {
+      ASSERT (_mongoc_compress_iovec (
+         &scratch, compressor_id, 1, iov, 4, HEADER_SIZE, &compressed_len));
+
+      /* the second message reuses the first one's buffer */
+      if (i == 0) {
+         compressed = scratch.compressed;
+      } else {
+         ASSERT (scratch.compressed == compressed);
+      }
+
+      out_len = sizeof out;
+      ASSERT (mongoc_uncompress (
+         compressor_id, scratch.compressed, compressed_len, out, &out_len));
+      ASSERT_CMPSIZE_T (out_len, ==, sizeof out);
+      ASSERT (!memcmp (out, message + HEADER_SIZE, sizeof out));
+   }
+
+   _mongoc_compression_scratch_destroy (&scratch);
+}
+
+
+static void
+test_compression_iovec (void)
+{
+   _test_iovec (MONGOC_COMPRESSOR_NOOP_ID);
+#ifdef MONGOC_ENABLE_COMPRESSION_SNAPPY
+   _test_iovec (MONGOC_COMPRESSOR_SNAPPY_ID);
+#endif
+#ifdef MONGOC_ENABLE_COMPRESSION_ZLIB
+   _test_iovec (MONGOC_COMPRESSOR_ZLIB_ID);
+#endif
+#ifdef MONGOC_ENABLE_COMPRESSION_ZSTD
+   _test_iovec (MONGOC_COMPRESSOR_ZSTD_ID);
+#endif
+}
+
+
+#ifdef MONGOC_ENABLE_COMPRESSION_ZLIB
+/* mostly text, with some noise, so blocks don't compress the same */
+static void
+_fill_mixed (uint8_t *buf, size_t len)
+{
+   const char *alphabet = "abcdefgh{}:\"12345";
+   uint32_t state = 1;
+   size_t i;
+
+   for (i = 0; i < len; i++) {
+      state = state * 1103515245u + 12345u;
+      buf[i] = (uint8_t) (i % 100 < 30 ? 'x' : alphabet[(state >> 16) % 17]);
+   }
+}
+
+
+static void
+test_compression_zlib_parallel (void)
+{
+   mongoc_compression_scratch_t scratch;
+   mongoc_iovec_t iov[2];
+   size_t len = 3 * 1024 * 1024 + 7;
+   uint8_t *message;
+   uint8_t *out;
+   size_t out_len;
+   size_t compressed_len;
+   int32_t levels[] = {-1, 0, 1, 9};
+   size_t i;
+
+   message = bson_malloc (HEADER_SIZE + len);
+   out = bson_malloc (len);
+   memset (message, 'h', HEADER_SIZE);
+   _fill_mixed (message + HEADER_SIZE, len);
+
+   iov[0].iov_base = (void *) message;
+   iov[0].iov_len = HEADER_SIZE + 1000;
+   iov[1].iov_base = (void *) (message + HEADER_SIZE + 1000);
+   iov[1].iov_len = len - 1000;
+
+   /* the blocks form one zlib stream that zlib decompresses, at any level */
+   for (i = 0; i < sizeof levels / sizeof levels[0]; i++) {
+      _mongoc_compression_scratch_init (&scratch, -1, 4, 0);
+
+      ASSERT (_mongoc_compress_iovec (&scratch,
+                                      MONGOC_COMPRESSOR_ZLIB_ID,
+                                      levels[i],
+                                      iov,
+                                      2,
+                                      HEADER_SIZE,
+                                      &compressed_len));
+
+      out_len = len;
+      ASSERT (mongoc_uncompress (MONGOC_COMPRESSOR_ZLIB_ID,
+                                 scratch.compressed,
+                                 compressed_len,
+                                 out,
+                                 &out_len));
+      ASSERT_CMPSIZE_T (out_len, ==, len);
+      ASSERT (!memcmp (out, message + HEADER_SIZE, len));
+
+      _mongoc_compression_scratch_destroy (&scratch);
+   }
+
+   bson_free (message);
+   bson_free (out);
+}
+
+
+/* time compressing a 48MB message with zlib on 1 to 8 threads */
+static void
+test_compression_zlib_parallel_benchmark (void *ctx)
+{
+   mongoc_compression_scratch_t scratch;
+   size_t len = 48 * 1024 * 1024;
+   uint8_t *data;
+   size_t compressed_len;
+   int64_t start;
+   int64_t usec;
+   int32_t threads;
+
+   data = bson_malloc (len);
+   _fill_mixed (data, len);
+
+   for (threads = 1; threads <= 8; threads *= 2) {
+      _mongoc_compression_scratch_init (&scratch, -1, threads, 0);
+      start = bson_get_monotonic_time ();
+      ASSERT (_mongoc_compress_zlib_parallel (
+         &scratch, -1, data, len, &compressed_len));
+      usec = bson_get_monotonic_time () - start;
+      _mongoc_compression_scratch_destroy (&scratch);
+
+      fprintf (stderr,
+               "      %d threads: %.1f MB/s, %.1f%% of original size\n",
+               threads,
+               len / (double) usec,
+               100.0 * compressed_len / len);
+   }
+
+   bson_free (data);
+}
+#endif
+
+
+#ifdef MONGOC_ENABLE_COMPRESSION_ZSTD
+static void
+test_compression_zstd (void)
+{
+   uint8_t uncompressed[4096];
+   uint8_t compressed[64];
+   uint8_t out[4096];
+   size_t out_len = sizeof out;
+
+   ASSERT (mongoc_compressor_supported ("zstd"));
+   ASSERT_CMPINT (mongoc_compressor_name_to_id ("zstd"),
+                  ==,
+                  MONGOC_COMPRESSOR_ZSTD_ID);
+   ASSERT_CMPSTR (mongoc_compressor_id_to_name (MONGOC_COMPRESSOR_ZSTD_ID),
+                  "zstd");
+
+   /* the library default, the fastest and the strongest level */
+   _test_roundtrip (MONGOC_COMPRESSOR_ZSTD_ID, 0);
+   _test_roundtrip (MONGOC_COMPRESSOR_ZSTD_ID, 1);
+   _test_roundtrip (MONGOC_COMPRESSOR_ZSTD_ID, 22);
+
+   /* garbage isn't a zstd frame */
+   _fill_compressible (uncompressed, sizeof uncompressed);
+   memcpy (compressed, uncompressed, sizeof compressed);
+   ASSERT (!mongoc_uncompress (MONGOC_COMPRESSOR_ZSTD_ID,
+                               compressed,
+                               sizeof compressed,
+                               out,
+                               &out_len));
+}
+#endif
+
+
+void
+test_compression_install (TestSuite *suite)
+{
+   TestSuite_Add (
+      suite, "/compression/policy/small", test_compression_policy_small);
+   TestSuite_Add (
+      suite, "/compression/policy/entropy", test_compression_policy_entropy);
+   TestSuite_Add (
+      suite, "/compression/policy/ratio", test_compression_policy_ratio);
+   TestSuite_Add (
+      suite, "/compression/policy/select", test_compression_policy_select);
+   TestSuite_Add (suite, "/compression/roundtrip", test_compression_roundtrip);
+   TestSuite_Add (suite, "/compression/iovec", test_compression_iovec);
+#ifdef MONGOC_ENABLE_COMPRESSION_ZLIB
+   TestSuite_Add (
+      suite, "/compression/zlib_parallel", test_compression_zlib_parallel);
+   TestSuite_AddFull (suite,
+                      "/compression/zlib_parallel_benchmark",
+                      test_compression_zlib_parallel_benchmark,
+                      NULL,
+                      NULL,
+                      test_framework_skip_if_slow);
+#endif
+#ifdef MONGOC_ENABLE_COMPRESSION_ZSTD
+   TestSuite_Add (suite, "/compression/zstd", test_compression_zstd);
+#endif
+}
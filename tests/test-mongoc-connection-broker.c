@@ -0,0 +1,225 @@
+#include <mongoc.h>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "mongoc-host-list-private.h"
+#include "mongoc-socket-private.h"
+
+#include "mock_server/mock-rs.h"
+#include "mock_server/mock-server.h"
+#include "mock_server/future.h"
+#include "mock_server/future-functions.h"
+#include "TestSuite.h"
+#include "test-libmongoc.h"
+#include "test-conveniences.h"
+
+
+#undef MONGOC_LOG_DOMAIN
+#define MONGOC_LOG_DOMAIN "connection-broker-test"
+
+
+#ifndef _WIN32
+static void
+broker_path (char *path, size_t len)
+{
+   bson_snprintf (
+      path, len, "/tmp/mongoc-broker-test-%d.sock", (int) getpid ());
+}
+
+
+static uint16_t
+ping (mock_server_t *server, mongoc_client_t *client)
+{
+   future_t *future;
+   request_t *request;
+   bson_error_t error;
+   uint16_t port;
+
+   future = future_client_command_simple (
+      client, "admin", tmp_bson ("{'ping': 1}"), NULL, NULL, &error);
+   request = mock_server_receives_command (
+      server, "admin", MONGOC_QUERY_SLAVE_OK, "{'ping': 1}");
+   port = request_get_client_port (request);
+   mock_server_replies_ok_and_destroys (request);
+   ASSERT_OR_PRINT (future_get_bool (future), error);
+   future_destroy (future);
+
+   return port;
+}
+
+
+static void
+test_connection_broker_handoff (void)
+{
+   mock_server_t *server;
+   mongoc_connection_broker_t *broker;
+   mongoc_client_t *client;
+   bson_error_t error;
+   char path[128];
+   uint16_t port;
+
+   broker_path (path, sizeof path);
+   server = mock_server_with_autoismaster (WIRE_VERSION_MIN);
+   mock_server_run (server);
+
+   broker =
+      mongoc_connection_broker_new (mock_server_get_uri (server), path, &error);
+   ASSERT_OR_PRINT (broker, error);
+
+   client = mongoc_client_new_from_uri (mock_server_get_uri (server));
+   mongoc_client_set_stream_initiator (
+      client, mongoc_client_broker_stream_initiator, path);
+   port = ping (server, client);
+
+   /* the worker's connection outlives the broker's copy of it */
+   mongoc_connection_broker_destroy (broker);
+   ASSERT_CMPINT ((int) port, ==, (int) ping (server, client));
+
+   mongoc_client_destroy (client);
+   mock_server_destroy (server);
+}
+
+
+/* a secondary is handed out while the replica set has no primary */
+static void
+test_connection_broker_secondary (void)
+{
+   mock_rs_t *rs;
+   mongoc_connection_broker_t *broker;
+   const mongoc_host_list_t *host;
+   mongoc_stream_t *stream;
+   bson_error_t error;
+   char path[128];
+
+   broker_path (path, sizeof path);
+   rs = mock_rs_with_autoismaster (WIRE_VERSION_MIN,
+                                   false /* has primary */,
+                                   1 /* secondary   */,
+                                   0 /* arbiters    */);
+   mock_rs_run (rs);
+
+   broker = mongoc_connection_broker_new (mock_rs_get_uri (rs), path, &error);
+   ASSERT_OR_PRINT (broker, error);
+
+   host = mongoc_uri_get_hosts (mock_rs_get_uri (rs));
+   stream = mongoc_client_broker_stream_initiator (
+      mock_rs_get_uri (rs), host, path, &error);
+   ASSERT_OR_PRINT (stream, error);
+
+   mongoc_stream_destroy (stream);
+   mongoc_connection_broker_destroy (broker);
+   mock_rs_destroy (rs);
+}
+
+
+static void
+test_connection_broker_errors (void)
+{
+   mock_server_t *server;
+   mongoc_connection_broker_t *broker;
+   mongoc_host_list_t host;
+   mongoc_stream_t *stream;
+   bson_error_t error;
+   char path[128];
+
+   broker_path (path, sizeof path);
+   server = mock_server_with_autoismaster (WIRE_VERSION_MIN);
+   mock_server_run (server);
+   ASSERT (_mongoc_host_list_from_string (&host, "doesnotexist.com:27017"));
+
+   /* no broker listening */
+   stream = mongoc_client_broker_stream_initiator (
+      mock_server_get_uri (server), &host, path, &error);
+   ASSERT (!stream);
+   ASSERT_ERROR_CONTAINS (error,
+                          MONGOC_ERROR_STREAM,
+                          MONGOC_ERROR_STREAM_CONNECT,
+                          "Failed to connect to connection broker");
+
+   /* the broker only connects to servers in its own topology */
+   broker =
+      mongoc_connection_broker_new (mock_server_get_uri (server), path, &error);
+   ASSERT_OR_PRINT (broker, error);
+   stream = mongoc_client_broker_stream_initiator (
+      mock_server_get_uri (server), &host, path, &error);
+   ASSERT (!stream);
+   ASSERT_ERROR_CONTAINS (error,
+                          MONGOC_ERROR_SERVER_SELECTION,
+                          MONGOC_ERROR_SERVER_SELECTION_FAILURE,
+                          "not an available server");
+
+   mongoc_connection_broker_destroy (broker);
+   mock_server_destroy (server);
+}
+
+
+static void
+test_connection_broker_concurrent (void)
+{
+   mock_server_t *server;
+   mongoc_connection_broker_t *broker;
+   mongoc_socket_t *stalled;
+   struct sockaddr_un saddr;
+   mongoc_uri_t *uri;
+   mongoc_client_t *client;
+   bson_error_t error;
+   char path[128];
+
+   broker_path (path, sizeof path);
+   server = mock_server_with_autoismaster (WIRE_VERSION_MIN);
+   mock_server_run (server);
+
+   broker =
+      mongoc_connection_broker_new (mock_server_get_uri (server), path, &error);
+   ASSERT_OR_PRINT (broker, error);
+
+   /* a worker connects to the broker and never sends its request */
+   memset (&saddr, 0, sizeof saddr);
+   saddr.sun_family = AF_UNIX;
+   bson_snprintf (saddr.sun_path, sizeof saddr.sun_path, "%s", path);
+   stalled = mongoc_socket_new (AF_UNIX, SOCK_STREAM, 0);
+   ASSERT (stalled);
+   ASSERT_CMPINT (mongoc_socket_connect (stalled,
+                                         (struct sockaddr *) &saddr,
+                                         sizeof saddr,
+                                         bson_get_monotonic_time () +
+                                            1000 * 1000),
+                  ==,
+                  0);
+
+   /* another worker is served long before the stalled request times out */
+   uri = mongoc_uri_copy (mock_server_get_uri (server));
+   mongoc_uri_set_option_as_int32 (uri, MONGOC_URI_CONNECTTIMEOUTMS, 1000);
+   client = mongoc_client_new_from_uri (uri);
+   mongoc_client_set_stream_initiator (
+      client, mongoc_client_broker_stream_initiator, path);
+   ping (server, client);
+
+   mongoc_client_destroy (client);
+   mongoc_socket_destroy (stalled);
+   mongoc_connection_broker_destroy (broker);
+   mongoc_uri_destroy (uri);
+   mock_server_destroy (server);
+}
+#endif
+
+
+void
+test_connection_broker_install (TestSuite *suite)
+{
+#ifndef _WIN32
+   TestSuite_AddMockServerTest (
+      suite, "/ConnectionBroker/handoff", test_connection_broker_handoff);
+   TestSuite_AddMockServerTest (
+      suite, "/ConnectionBroker/secondary", test_connection_broker_secondary);
+   TestSuite_AddMockServerTest (
+      suite, "/ConnectionBroker/errors", test_connection_broker_errors);
+   TestSuite_AddMockServerTest (suite,
+                                "/ConnectionBroker/concurrent",
+                                test_connection_broker_concurrent);
+#endif
+}
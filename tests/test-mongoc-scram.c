@@ -0,0 +1,218 @@
+#include <mongoc.h>
+
+#include "mongoc-util-private.h"
+#ifdef MONGOC_ENABLE_CRYPTO
+#include "mongoc-scram-private.h"
+#endif
+
+#include "TestSuite.h"
+#include "test-libmongoc.h"
+
+#ifdef MONGOC_ENABLE_CRYPTO
+/* 16 byte salts, base64 encoded */
+#define SALT_A "AAECAwQFBgcICQoLDA0ODw=="
+#define SALT_B "EBESExQVFhcYGRobHB0eHw=="
+
+
+/* run the first two steps of a conversation, which salt the password */
+static void
+_scram_salt_full (mongoc_scram_t *scram,
+                  const char *pass,
+                  const char *salt,
+                  int iterations,
+                  bool native)
+{
+   uint8_t buf[4096];
+   uint32_t buflen = 0;
+   char *server_first;
+   bson_error_t error;
+
+   _mongoc_scram_init (scram);
+   _mongoc_scram_set_user (scram, "user");
+   _mongoc_scram_set_pass (scram, pass);
+   if (!native) {
+      /* use the HMAC loop */
+      scram->crypto.pbkdf2_hmac_sha1 = NULL;
+   }
+
+   ASSERT_OR_PRINT (
+      _mongoc_scram_step (scram, buf, 0, buf, sizeof buf, &buflen, &error),
+      error);
+
+   server_first = bson_strdup_printf ("r=%.*sserver,s=%s,i=%d",
+                                      scram->encoded_nonce_len,
+                                      scram->encoded_nonce,
+                                      salt,
+                                      iterations);
+
+   buflen = 0;
+   ASSERT_OR_PRINT (_mongoc_scram_step (scram,
+                                        (uint8_t *) server_first,
+                                        (uint32_t) strlen (server_first),
+                                        buf,
+                                        sizeof buf,
+                                        &buflen,
+                                        &error),
+                    error);
+
+   bson_free (server_first);
+}
+
+
+static void
+_scram_salt (mongoc_scram_t *scram,
+             const char *pass,
+             const char *salt,
+             int iterations)
+{
+   _scram_salt_full (scram, pass, salt, iterations, true);
+}
+
+
+static void
+test_scram_cache (void)
+{
+   mongoc_scram_t scram;
+   mongoc_scram_t poison;
+   uint8_t salted_a[MONGOC_SCRAM_HASH_SIZE];
+   uint8_t salt_b[16];
+   char *hashed_password;
+   int i;
+
+   _mongoc_scram_cache_clear ();
+
+   _scram_salt (&scram, "pencil", SALT_A, 4096);
+   memcpy (salted_a, scram.salted_password, sizeof salted_a);
+   _mongoc_scram_destroy (&scram);
+
+   /* a cache hit returns the same keys */
+   _scram_salt (&scram, "pencil", SALT_A, 4096);
+   ASSERT (!memcmp (scram.salted_password, salted_a, sizeof salted_a));
+   _mongoc_scram_destroy (&scram);
+
+   /* plant keys for SALT_B, to see whether the cache is used */
+   _mongoc_scram_init (&poison);
+   _mongoc_scram_set_user (&poison, "user");
+   memset (poison.salted_password, 0xaa, sizeof poison.salted_password);
+   memset (poison.client_key, 0xbb, sizeof poison.client_key);
+   memset (poison.server_key, 0xcc, sizeof poison.server_key);
+   for (i = 0; i < 16; i++) {
+      salt_b[i] = (uint8_t) (16 + i);
+   }
+
+   hashed_password = _mongoc_hex_md5 ("user:mongo:pencil");
+   _mongoc_scram_cache_set (&poison, hashed_password, salt_b, 4096);
+   bson_free (hashed_password);
+
+   _scram_salt (&scram, "pencil", SALT_B, 4096);
+   ASSERT (!memcmp (scram.salted_password,
+                    poison.salted_password,
+                    sizeof poison.salted_password));
+   ASSERT (!memcmp (
+      scram.client_key, poison.client_key, sizeof poison.client_key));
+   _mongoc_scram_destroy (&scram);
+
+   /* another iteration count or password is a miss */
+   _scram_salt (&scram, "pencil", SALT_B, 10000);
+   ASSERT (memcmp (scram.salted_password,
+                   poison.salted_password,
+                   sizeof poison.salted_password));
+   _mongoc_scram_destroy (&scram);
+
+   _scram_salt (&scram, "pen", SALT_B, 4096);
+   ASSERT (memcmp (scram.salted_password,
+                   poison.salted_password,
+                   sizeof poison.salted_password));
+   _mongoc_scram_destroy (&scram);
+
+   _mongoc_scram_destroy (&poison);
+   _mongoc_scram_cache_clear ();
+}
+
+
+static void
+test_scram_pbkdf2 (void)
+{
+   mongoc_crypto_t crypto;
+   mongoc_scram_t native;
+   mongoc_scram_t loop;
+   unsigned char out[MONGOC_SCRAM_HASH_SIZE];
+   const unsigned char expected[MONGOC_SCRAM_HASH_SIZE] = {
+      0x4b, 0x00, 0x79, 0x01, 0xb7, 0x65, 0x48, 0x9a, 0xbe, 0xad,
+      0x49, 0xd9, 0x26, 0xf7, 0x21, 0xd0, 0x65, 0xa4, 0x29, 0xc1};
+
+   mongoc_crypto_init (&crypto);
+
+   /* RFC 6070 test vector, every crypto library we build with has PBKDF2 */
+   ASSERT (mongoc_crypto_pbkdf2_hmac_sha1 (&crypto,
+                                           "password",
+                                           8,
+                                           (const uint8_t *) "salt",
+                                           4,
+                                           4096,
+                                           sizeof out,
+                                           out));
+   ASSERT (!memcmp (out, expected, sizeof expected));
+
+   /* the library's PBKDF2 and the HMAC loop agree */
+   _mongoc_scram_cache_clear ();
+   _scram_salt_full (&native, "pencil", SALT_A, 4096, true);
+   _mongoc_scram_cache_clear ();
+   _scram_salt_full (&loop, "pencil", SALT_A, 4096, false);
+   ASSERT (!memcmp (native.salted_password,
+                    loop.salted_password,
+                    sizeof loop.salted_password));
+
+   _mongoc_scram_destroy (&native);
+   _mongoc_scram_destroy (&loop);
+   _mongoc_scram_cache_clear ();
+}
+
+
+/* time salting a password with the library's PBKDF2 and the HMAC loop */
+static void
+test_scram_pbkdf2_benchmark (void *ctx)
+{
+   mongoc_scram_t scram;
+   int iterations[] = {10000, 100000};
+   int64_t start;
+   int64_t usec[2];
+   size_t i;
+   int native;
+
+   for (i = 0; i < sizeof iterations / sizeof iterations[0]; i++) {
+      for (native = 0; native < 2; native++) {
+         _mongoc_scram_cache_clear ();
+         start = bson_get_monotonic_time ();
+         _scram_salt_full (
+            &scram, "pencil", SALT_A, iterations[i], (bool) native);
+         usec[native] = bson_get_monotonic_time () - start;
+         _mongoc_scram_destroy (&scram);
+      }
+
+      fprintf (stderr,
+               "      %d iterations: PBKDF2 %.1fms, HMAC loop %.1fms\n",
+               iterations[i],
+               usec[1] / 1000.0,
+               usec[0] / 1000.0);
+   }
+
+   _mongoc_scram_cache_clear ();
+}
+#endif
+
+
+void
+test_scram_install (TestSuite *suite)
+{
+#ifdef MONGOC_ENABLE_CRYPTO
+   TestSuite_Add (suite, "/scram/cache", test_scram_cache);
+   TestSuite_Add (suite, "/scram/pbkdf2", test_scram_pbkdf2);
+   TestSuite_AddFull (suite,
+                      "/scram/pbkdf2_benchmark",
+                      test_scram_pbkdf2_benchmark,
+                      NULL,
+                      NULL,
+                      test_framework_skip_if_slow);
+#endif
+}
@@ -3,6 +3,10 @@
 
 #ifdef MONGOC_ENABLE_SSL_OPENSSL
 #include <openssl/err.h>
+#include "mongoc-counters-private.h"
+#include "mongoc-openssl-private.h"
+#include "mongoc-ssl-private.h"
+#include "mongoc-stream-tls-openssl-private.h"
 #endif
 
 #include "ssl-test.h"
@@ -385,6 +389,540 @@ test_mongoc_tls_trust_dir (void)
 }
 #endif
 
+
+#ifdef MONGOC_ENABLE_SSL_OPENSSL
+static void
+test_mongoc_tls_ctx_cache (void)
+{
+   mongoc_ssl_opt_t opt = {0};
+   mongoc_ssl_opt_t copy = {0};
+   mongoc_ssl_opt_t weak = {0};
+   SSL_CTX *ctx;
+   SSL_CTX *ctx_copy;
+   SSL_CTX *ctx_weak;
+   SSL_CTX *ctx_reloaded;
+
+   opt.ca_file = CERT_CA;
+   opt.pem_file = CERT_CLIENT;
+   _mongoc_ssl_opts_copy_to (&opt, &copy);
+   weak = opt;
+   weak.weak_cert_validation = true;
+
+   /* equal options share a context, even with different string pointers */
+   ctx = _mongoc_openssl_ctx_get (&opt, true);
+   ASSERT (ctx);
+   ctx_copy = _mongoc_openssl_ctx_get (&copy, true);
+   ASSERT (ctx == ctx_copy);
+
+   ctx_weak = _mongoc_openssl_ctx_get (&weak, true);
+   ASSERT (ctx_weak);
+   ASSERT (ctx_weak != ctx);
+
+   /* files are read again after a reload, existing references stay valid */
+   mongoc_ssl_reload_certificates ();
+   ctx_reloaded = _mongoc_openssl_ctx_get (&opt, true);
+   ASSERT (ctx_reloaded);
+   ASSERT (ctx_reloaded != ctx);
+
+   SSL_CTX_free (ctx);
+   SSL_CTX_free (ctx_copy);
+   SSL_CTX_free (ctx_weak);
+   SSL_CTX_free (ctx_reloaded);
+   _mongoc_ssl_opts_cleanup (&copy);
+}
+
+
+static void
+test_mongoc_tls_session_resumption (void)
+{
+   mongoc_ssl_opt_t sopt = {0};
+   mongoc_ssl_opt_t copt = {0};
+   ssl_test_result_t sr;
+   ssl_test_result_t cr;
+
+   sopt.ca_file = CERT_CA;
+   sopt.pem_file = CERT_SERVER;
+
+   copt.ca_file = CERT_CA;
+   copt.pem_file = CERT_CLIENT;
+
+   /* forget sessions from other tests */
+   mongoc_ssl_reload_certificates ();
+
+   ssl_test (&copt, &sopt, "localhost", &cr, &sr);
+   ASSERT_CMPINT (cr.result, ==, SSL_TEST_SUCCESS);
+   ASSERT_CMPINT (sr.result, ==, SSL_TEST_SUCCESS);
+   ASSERT (!cr.resumed);
+
+   /* the second connection offers the session from the first */
+   ssl_test (&copt, &sopt, "localhost", &cr, &sr);
+   ASSERT_CMPINT (cr.result, ==, SSL_TEST_SUCCESS);
+   ASSERT_CMPINT (sr.result, ==, SSL_TEST_SUCCESS);
+   ASSERT (cr.resumed);
+
+   /* another server on the same host doesn't get the first one's session */
+   ssl_test_session_key (
+      &copt, &sopt, "localhost", "localhost:27018", &cr, &sr);
+   ASSERT_CMPINT (cr.result, ==, SSL_TEST_SUCCESS);
+   ASSERT_CMPINT (sr.result, ==, SSL_TEST_SUCCESS);
+   ASSERT (!cr.resumed);
+
+   ssl_test_session_key (
+      &copt, &sopt, "localhost", "localhost:27018", &cr, &sr);
+   ASSERT_CMPINT (cr.result, ==, SSL_TEST_SUCCESS);
+   ASSERT_CMPINT (sr.result, ==, SSL_TEST_SUCCESS);
+   ASSERT (cr.resumed);
+
+   /* reloading certificates drops the sessions */
+   mongoc_ssl_reload_certificates ();
+   ssl_test (&copt, &sopt, "localhost", &cr, &sr);
+   ASSERT_CMPINT (cr.result, ==, SSL_TEST_SUCCESS);
+   ASSERT_CMPINT (sr.result, ==, SSL_TEST_SUCCESS);
+   ASSERT (!cr.resumed);
+}
+
+
+/* skip unless the kernel has loaded its TLS module, if the driver is built
+ * to use it */
+static int
+_skip_if_no_kernel_tls (void)
+{
+#ifdef MONGOC_OPENSSL_KTLS
+   char ulps[256] = {0};
+   FILE *f;
+   bool found;
+
+   f = fopen ("/proc/sys/net/ipv4/tcp_available_ulp", "r");
+   if (!f) {
+      return 0;
+   }
+
+   found = fgets (ulps, sizeof ulps, f) && strstr (ulps, "tls");
+   fclose (f);
+
+   return found ? 1 : 0;
+#else
+   return 1;
+#endif
+}
+
+
+static void
+test_mongoc_tls_kernel_tls (void *ctx)
+{
+   mongoc_ssl_opt_t sopt = {0};
+   mongoc_ssl_opt_t copt = {0};
+   ssl_test_result_t sr;
+   ssl_test_result_t cr;
+   int64_t offloaded;
+
+   sopt.ca_file = CERT_CA;
+   sopt.pem_file = CERT_SERVER;
+
+   copt.ca_file = CERT_CA;
+   copt.pem_file = CERT_CLIENT;
+
+   offloaded = mongoc_counter_tls_kernel_offload_count ();
+   ssl_test_kernel_tls (&copt, &sopt, "localhost", &cr, &sr);
+
+   ASSERT_CMPINT (cr.result, ==, SSL_TEST_SUCCESS);
+   ASSERT_CMPINT (sr.result, ==, SSL_TEST_SUCCESS);
+
+#ifdef MONGOC_OPENSSL_KTLS
+   /* the kernel encrypted the echo messages the client wrote */
+   ASSERT (cr.kernel_tls);
+   ASSERT_CMPINT64 (
+      mongoc_counter_tls_kernel_offload_count (), ==, offloaded + 1);
+#else
+   /* OpenSSL can't offload, so the client fell back to userspace TLS */
+   ASSERT (!cr.kernel_tls);
+   ASSERT_CMPINT64 (mongoc_counter_tls_kernel_offload_count (), ==, offloaded);
+#endif
+}
+
+#define TIMEOUT 10 * 1000
+
+/* a full TLS record */
+#define RECORD_SIZE 16384
+
+
+/* a stream between a client TLS stream and its socket. it counts the TLS
+ * records written once recording starts, OpenSSL writes one per call, and
+ * fails the records after the first "fail_after" as if they timed out */
+typedef struct {
+   mongoc_stream_t vtable;
+   mongoc_stream_t *wrapped;
+   bool recording;
+   int n_records;
+   int fail_after;
+} record_stream_t;
+
+
+static void
+record_stream_destroy (mongoc_stream_t *stream)
+{
+   mongoc_stream_destroy (((record_stream_t *) stream)->wrapped);
+   bson_free (stream);
+}
+
+
+static int
+record_stream_close (mongoc_stream_t *stream)
+{
+   return mongoc_stream_close (((record_stream_t *) stream)->wrapped);
+}
+
+
+static ssize_t
+record_stream_readv (mongoc_stream_t *stream,
+                     mongoc_iovec_t *iov,
+                     size_t iovcnt,
+                     size_t min_bytes,
+                     int32_t timeout_msec)
+{
+   return mongoc_stream_readv (((record_stream_t *) stream)->wrapped,
+                               iov,
+                               iovcnt,
+                               min_bytes,
+                               timeout_msec);
+}
+
+
+static ssize_t
+record_stream_writev (mongoc_stream_t *stream,
+                      mongoc_iovec_t *iov,
+                      size_t iovcnt,
+                      int32_t timeout_msec)
+{
+   record_stream_t *rstream = (record_stream_t *) stream;
+
+   if (rstream->recording) {
+      if (rstream->n_records == rstream->fail_after) {
+         errno = ETIMEDOUT;
+         return -1;
+      }
+
+      rstream->n_records++;
+   }
+
+   return mongoc_stream_writev (rstream->wrapped, iov, iovcnt, timeout_msec);
+}
+
+
+static mongoc_stream_t *
+record_stream_get_base_stream (mongoc_stream_t *stream)
+{
+   return ((record_stream_t *) stream)->wrapped;
+}
+
+
+static record_stream_t *
+record_stream_new (mongoc_stream_t *wrapped)
+{
+   record_stream_t *stream;
+
+   stream = (record_stream_t *) bson_malloc0 (sizeof *stream);
+   stream->vtable.type = 999;
+   stream->vtable.destroy = record_stream_destroy;
+   stream->vtable.close = record_stream_close;
+   stream->vtable.readv = record_stream_readv;
+   stream->vtable.writev = record_stream_writev;
+   stream->vtable.get_base_stream = record_stream_get_base_stream;
+   stream->wrapped = wrapped;
+   stream->fail_after = -1;
+
+   return stream;
+}
+
+
+/* a TLS connection over loopback. the server reads what the client writes
+ * on a thread, until it has "len" bytes or the connection fails */
+typedef struct {
+   mongoc_ssl_opt_t sopt;
+   mongoc_ssl_opt_t copt;
+   mongoc_stream_t *client;
+   record_stream_t *record;
+   mongoc_stream_t *server;
+   mongoc_thread_t thread;
+   uint8_t *received;
+   size_t len;
+   size_t n_received;
+} tls_pair_t;
+
+
+static void *
+_tls_pair_serve (void *data)
+{
+   tls_pair_t *pair = (tls_pair_t *) data;
+   bson_error_t error;
+   mongoc_iovec_t iov;
+   ssize_t r;
+
+   ASSERT_OR_PRINT (mongoc_stream_tls_handshake_block (
+                       pair->server, "localhost", TIMEOUT, &error),
+                    error);
+
+   while (pair->n_received < pair->len) {
+      iov.iov_base = pair->received + pair->n_received;
+      iov.iov_len = pair->len - pair->n_received;
+      r = mongoc_stream_readv (pair->server, &iov, 1, 1, TIMEOUT);
+      if (r <= 0) {
+         break;
+      }
+
+      pair->n_received += (size_t) r;
+   }
+
+   return NULL;
+}
+
+
+/* connect, handshake, and start recording the client's TLS records */
+static void
+_tls_pair_start (tls_pair_t *pair, size_t len)
+{
+   mongoc_socket_t *listen_sock;
+   mongoc_socket_t *client_sock;
+   mongoc_socket_t *server_sock;
+   struct sockaddr_in addr = {0};
+   mongoc_socklen_t addr_len = sizeof addr;
+   bson_error_t error;
+
+   memset (pair, 0, sizeof *pair);
+   pair->sopt.ca_file = CERT_CA;
+   pair->sopt.pem_file = CERT_SERVER;
+   pair->copt.ca_file = CERT_CA;
+   pair->copt.pem_file = CERT_CLIENT;
+   pair->received = (uint8_t *) bson_malloc (len);
+   pair->len = len;
+
+   listen_sock = mongoc_socket_new (AF_INET, SOCK_STREAM, 0);
+   BSON_ASSERT (listen_sock);
+   addr.sin_family = AF_INET;
+   addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+   ASSERT_CMPINT (mongoc_socket_bind (
+                     listen_sock, (struct sockaddr *) &addr, sizeof addr),
+                  ==,
+                  0);
+   ASSERT_CMPINT (mongoc_socket_getsockname (
+                     listen_sock, (struct sockaddr *) &addr, &addr_len),
+                  ==,
+                  0);
+   ASSERT_CMPINT (mongoc_socket_listen (listen_sock, 1), ==, 0);
+
+   client_sock = mongoc_socket_new (AF_INET, SOCK_STREAM, 0);
+   BSON_ASSERT (client_sock);
+   ASSERT_CMPINT (mongoc_socket_connect (
+                     client_sock, (struct sockaddr *) &addr, sizeof addr, -1),
+                  ==,
+                  0);
+   server_sock = mongoc_socket_accept (listen_sock, -1);
+   BSON_ASSERT (server_sock);
+   mongoc_socket_destroy (listen_sock);
+
+   pair->server = mongoc_stream_tls_new_with_hostname (
+      mongoc_stream_socket_new (server_sock), NULL, &pair->sopt, 0);
+   BSON_ASSERT (pair->server);
+   ASSERT_CMPINT (
+      mongoc_thread_create (&pair->thread, _tls_pair_serve, pair), ==, 0);
+
+   pair->record = record_stream_new (mongoc_stream_socket_new (client_sock));
+   pair->client = mongoc_stream_tls_new_with_hostname (
+      (mongoc_stream_t *) pair->record, "localhost", &pair->copt, 1);
+   BSON_ASSERT (pair->client);
+   ASSERT_OR_PRINT (mongoc_stream_tls_handshake_block (
+                       pair->client, "localhost", TIMEOUT, &error),
+                    error);
+
+   pair->record->recording = true;
+}
+
+
+/* close the client and wait for the server to read what it was sent */
+static void
+_tls_pair_finish (tls_pair_t *pair)
+{
+   mongoc_stream_destroy (pair->client);
+   ASSERT_CMPINT (mongoc_thread_join (pair->thread), ==, 0);
+   mongoc_stream_destroy (pair->server);
+   bson_free (pair->received);
+}
+
+
+/* writev @iov, check that it wrote @expected bytes in @n_records records,
+ * and that the server received exactly those bytes */
+static void
+_test_tls_writev (mongoc_iovec_t *iov,
+                  size_t iovcnt,
+                  const uint8_t *data,
+                  int fail_after,
+                  ssize_t expected,
+                  int n_records)
+{
+   tls_pair_t pair;
+   size_t len = 0;
+   size_t i;
+   ssize_t r;
+
+   for (i = 0; i < iovcnt; i++) {
+      len += iov[i].iov_len;
+   }
+
+   _tls_pair_start (&pair, len);
+   pair.record->fail_after = fail_after;
+
+   r = mongoc_stream_writev (pair.client, iov, iovcnt, TIMEOUT);
+   ASSERT_CMPSSIZE_T (r, ==, expected);
+   ASSERT_CMPINT (pair.record->n_records, ==, n_records);
+
+   _tls_pair_finish (&pair);
+
+   ASSERT_CMPSIZE_T (pair.n_received, ==, (size_t) expected);
+   ASSERT (!memcmp (pair.received, data, pair.n_received));
+}
+
+
+static void
+_fill_pattern (uint8_t *data, size_t len)
+{
+   size_t i;
+
+   for (i = 0; i < len; i++) {
+      data[i] = (uint8_t) (i % 251);
+   }
+}
+
+
+/* more iovecs than a writev system call takes, all coalesced */
+static void
+test_mongoc_tls_writev_many_iovecs (void)
+{
+   uint8_t data[2000 * 10];
+   mongoc_iovec_t iov[2000];
+   size_t i;
+
+   _fill_pattern (data, sizeof data);
+   for (i = 0; i < 2000; i++) {
+      iov[i].iov_base = data + i * 10;
+      iov[i].iov_len = 10;
+   }
+
+   /* one full record and the rest */
+   _test_tls_writev (iov, 2000, data, -1, sizeof data, 2);
+}
+
+
+/* buffered bytes are topped up from the next, large iovec */
+static void
+test_mongoc_tls_writev_top_up (void)
+{
+   uint8_t *data;
+   mongoc_iovec_t iov[3];
+   size_t len = 100 + 40000 + 50;
+
+   data = (uint8_t *) bson_malloc (len);
+   _fill_pattern (data, len);
+
+   iov[0].iov_base = data;
+   iov[0].iov_len = 100;
+   iov[1].iov_base = data + 100;
+   iov[1].iov_len = 40000;
+   iov[2].iov_base = data + 100 + 40000;
+   iov[2].iov_len = 50;
+
+   /* 100 + 16284 bytes, then the rest of the large iovec in a full record
+    * and a short one, then the last 50 bytes */
+   _test_tls_writev (iov, 3, data, -1, (ssize_t) len, 4);
+
+   /* a large iovec first is written through, the small ones after it go
+    * out in one record */
+   iov[0].iov_base = data;
+   iov[0].iov_len = 40000;
+   iov[1].iov_base = data + 40000;
+   iov[1].iov_len = 100;
+   iov[2].iov_base = data + 40000 + 100;
+   iov[2].iov_len = 50;
+   _test_tls_writev (iov, 3, data, -1, (ssize_t) len, 4);
+
+   bson_free (data);
+}
+
+
+/* a write that times out returns the bytes of the records sent before */
+static void
+test_mongoc_tls_writev_timeout (void)
+{
+   uint8_t *data;
+   mongoc_iovec_t iov[2];
+   size_t len = 100 + 40000;
+
+   data = (uint8_t *) bson_malloc (len);
+   _fill_pattern (data, len);
+
+   iov[0].iov_base = data;
+   iov[0].iov_len = 100;
+   iov[1].iov_base = data + 100;
+   iov[1].iov_len = 40000;
+
+   /* the first record, the buffer topped up to a full record, is sent */
+   _test_tls_writev (iov, 2, data, 1, RECORD_SIZE, 1);
+
+   /* nothing is sent */
+   _test_tls_writev (iov, 2, data, 0, 0, 0);
+
+   bson_free (data);
+}
+
+
+/* time writing 48MB over TLS, as a bulk insert of 48MB of documents does,
+ * in iovecs of 16 bytes to 64KB */
+static void
+test_mongoc_tls_writev_benchmark (void *ctx)
+{
+   size_t len = 48 * 1024 * 1024;
+   uint8_t *data;
+   mongoc_iovec_t *iov;
+   size_t iov_len;
+   size_t iovcnt;
+   size_t i;
+   tls_pair_t pair;
+   int64_t start;
+   int64_t usec;
+
+   data = (uint8_t *) bson_malloc (len);
+   _fill_pattern (data, len);
+
+   for (iov_len = 16; iov_len <= 64 * 1024; iov_len *= 8) {
+      iovcnt = len / iov_len;
+      iov = (mongoc_iovec_t *) bson_malloc (iovcnt * sizeof *iov);
+      for (i = 0; i < iovcnt; i++) {
+         iov[i].iov_base = data + i * iov_len;
+         iov[i].iov_len = iov_len;
+      }
+
+      _tls_pair_start (&pair, len);
+
+      start = bson_get_monotonic_time ();
+      ASSERT_CMPSSIZE_T (mongoc_stream_writev (pair.client, iov, iovcnt, -1),
+                         ==,
+                         (ssize_t) len);
+      usec = bson_get_monotonic_time () - start;
+
+      fprintf (stderr,
+               "      %d byte iovecs: %.1f MB/s in %d records\n",
+               (int) iov_len,
+               len / (double) usec,
+               pair.record->n_records);
+
+      _tls_pair_finish (&pair);
+      ASSERT_CMPSIZE_T (pair.n_received, ==, len);
+      bson_free (iov);
+   }
+
+   bson_free (data);
+}
+#endif
+
 #endif /* !MONGOC_ENABLE_SSL_SECURE_CHANNEL && !MONGOC_ENABLE_SSL_LIBRESSL */
 
 void
@@ -412,6 +950,26 @@ test_stream_tls_install (TestSuite *suite)
    TestSuite_Add (
       suite, "/TLS/weak_cert_validation", test_mongoc_tls_weak_cert_validation);
    TestSuite_Add (suite, "/TLS/crl", test_mongoc_tls_crl);
+   TestSuite_Add (suite, "/TLS/ctx_cache", test_mongoc_tls_ctx_cache);
+   TestSuite_Add (
+      suite, "/TLS/session_resumption", test_mongoc_tls_session_resumption);
+   TestSuite_AddFull (suite,
+                      "/TLS/kernel_tls",
+                      test_mongoc_tls_kernel_tls,
+                      NULL,
+                      NULL,
+                      _skip_if_no_kernel_tls);
+   TestSuite_Add (
+      suite, "/TLS/writev/many_iovecs", test_mongoc_tls_writev_many_iovecs);
+   TestSuite_Add (suite, "/TLS/writev/top_up", test_mongoc_tls_writev_top_up);
+   TestSuite_Add (
+      suite, "/TLS/writev/timeout", test_mongoc_tls_writev_timeout);
+   TestSuite_AddFull (suite,
+                      "/TLS/writev/benchmark",
+                      test_mongoc_tls_writev_benchmark,
+                      NULL,
+                      NULL,
+                      test_framework_skip_if_slow);
 #endif
 
 #if !defined(__APPLE__) && !defined(_WIN32) && \
@@ -141,6 +141,445 @@ test_get_servers (void)
 }
 
 
+static void
+test_candidates_cache (void)
+{
+   mongoc_uri_t *uri;
+   mongoc_topology_t *topology;
+   mongoc_topology_description_t *td;
+   mongoc_server_description_t *sd_a;
+   mongoc_server_description_t *sd_b;
+   mongoc_server_description_t *sd;
+   mongoc_read_prefs_t *prefs;
+   bson_error_t error;
+   uint32_t generation;
+   int i;
+
+   uri = mongoc_uri_new ("mongodb://a,b");
+   topology = mongoc_topology_new (uri, true /* single-threaded */);
+   td = &topology->description;
+
+   sd_a = _sd_for_host (td, "a");
+   mongoc_topology_description_handle_ismaster (
+      td, sd_a->id, tmp_bson ("{'ok': 1, 'msg': 'isdbgrid'}"), 10, NULL);
+   sd_b = _sd_for_host (td, "b");
+   mongoc_topology_description_handle_ismaster (
+      td, sd_b->id, tmp_bson ("{'ok': 1, 'msg': 'isdbgrid'}"), 10, NULL);
+
+   generation = td->generation;
+   ASSERT_CMPINT (td->candidates.len, ==, 0);
+
+   /* the same kind of selection reuses one list */
+   for (i = 0; i < 10; i++) {
+      sd = mongoc_topology_description_select (td, MONGOC_SS_READ, NULL, 15);
+      ASSERT (sd);
+   }
+
+   ASSERT_CMPINT (td->candidates.len, ==, 1);
+   ASSERT_CMPSIZE_T (td->candidates.entries[0].servers.len, ==, (size_t) 2);
+
+   /* another read preference, optype, or window gets its own */
+   prefs = mongoc_read_prefs_new (MONGOC_READ_NEAREST);
+   mongoc_read_prefs_add_tag (prefs, tmp_bson ("{'dc': 'ny'}"));
+   ASSERT (mongoc_topology_description_select (td, MONGOC_SS_READ, prefs, 15));
+   ASSERT (mongoc_topology_description_select (td, MONGOC_SS_WRITE, NULL, 15));
+   ASSERT (mongoc_topology_description_select (td, MONGOC_SS_READ, NULL, 5));
+   ASSERT_CMPINT (td->candidates.len, ==, 4);
+   ASSERT_CMPUINT32 (generation, ==, td->generation);
+
+   /* a change to the topology empties the cache */
+   bson_set_error (
+      &error, MONGOC_ERROR_STREAM, MONGOC_ERROR_STREAM_SOCKET, "failure");
+   mongoc_topology_description_invalidate_server (td, sd_a->id, &error);
+   ASSERT_CMPUINT32 (generation, <, td->generation);
+
+   for (i = 0; i < 10; i++) {
+      sd = mongoc_topology_description_select (td, MONGOC_SS_READ, NULL, 15);
+      ASSERT_CMPUINT32 (sd->id, ==, sd_b->id);
+   }
+
+   ASSERT_CMPINT (td->candidates.len, ==, 1);
+   ASSERT_CMPSIZE_T (td->candidates.entries[0].servers.len, ==, (size_t) 1);
+
+   mongoc_read_prefs_destroy (prefs);
+   mongoc_topology_destroy (topology);
+   mongoc_uri_destroy (uri);
+}
+
+
+static void
+test_least_outstanding (void)
+{
+   mongoc_uri_t *uri;
+   mongoc_topology_t *topology;
+   mongoc_topology_description_t *td;
+   mongoc_topology_in_flight_t in_flight = {{0}};
+   mongoc_server_description_t *sd_a;
+   mongoc_server_description_t *sd;
+   const char *hosts[] = {"a", "b", "c"};
+   int counts[3] = {0};
+   int i;
+
+   uri = mongoc_uri_new ("mongodb://a,b,c");
+   topology = mongoc_topology_new (uri, true /* single-threaded */);
+   td = &topology->description;
+
+   for (i = 0; i < 3; i++) {
+      sd = _sd_for_host (td, hosts[i]);
+      mongoc_topology_description_handle_ismaster (
+         td, sd->id, tmp_bson ("{'ok': 1, 'msg': 'isdbgrid'}"), 10, NULL);
+   }
+
+   /* "a" is busy: of any two servers, the other one is chosen */
+   sd_a = _sd_for_host (td, "a");
+   *_mongoc_topology_in_flight_count (&in_flight, sd_a->id) = 10;
+
+   for (i = 0; i < 300; i++) {
+      sd = _mongoc_topology_description_select (
+         td, MONGOC_SS_READ, NULL, 15, &td->rand_seed, &in_flight);
+      ASSERT (sd);
+      ASSERT_CMPUINT32 (sd->id, !=, sd_a->id);
+      counts[sd->id == _sd_for_host (td, "b")->id]++;
+   }
+
+   /* and the idle servers share the load */
+   ASSERT_CMPINT (counts[0], >, 100);
+   ASSERT_CMPINT (counts[1], >, 100);
+
+   mongoc_topology_destroy (topology);
+   mongoc_uri_destroy (uri);
+}
+
+
+static void
+test_latency_estimator (void)
+{
+   mongoc_latency_estimator_t estimator;
+   int64_t estimate_usec = -1;
+   bool changed = false;
+   int i;
+
+   _mongoc_latency_estimator_init (&estimator, 1);
+
+   /* no estimate from a few samples */
+   for (i = 0; i < MONGOC_LATENCY_MIN_SAMPLES - 1; i++) {
+      ASSERT (!_mongoc_latency_estimator_record (
+         &estimator, 1, MONGOC_LATENCY_READ, 1000, &estimate_usec));
+   }
+
+   ASSERT_CMPINT64 (_mongoc_latency_estimator_percentile (
+                       &estimator, MONGOC_LATENCY_READ, 90),
+                    ==,
+                    (int64_t) -1);
+
+   /* 80% of reads take 1ms, 20% take 100ms: the 90th percentile is slow */
+   for (i = 0; i < 100; i++) {
+      changed |= _mongoc_latency_estimator_record (&estimator,
+                                                   1,
+                                                   MONGOC_LATENCY_READ,
+                                                   i % 5 ? 1000 : 100 * 1000,
+                                                   &estimate_usec);
+   }
+
+   ASSERT (changed);
+   ASSERT_CMPINT64 (estimate_usec, >, (int64_t) 75 * 1000);
+   ASSERT_CMPINT64 (estimate_usec, <, (int64_t) 130 * 1000);
+   ASSERT_CMPINT64 (_mongoc_latency_estimator_percentile (
+                       &estimator, MONGOC_LATENCY_READ, 50),
+                    <,
+                    (int64_t) 1500);
+
+   /* classes are separate */
+   ASSERT_CMPINT64 (_mongoc_latency_estimator_percentile (
+                       &estimator, MONGOC_LATENCY_WRITE, 90),
+                    ==,
+                    (int64_t) -1);
+
+   /* the estimate follows a server that becomes fast */
+   for (i = 0; i < 4 * MONGOC_LATENCY_DECAY_SAMPLES; i++) {
+      _mongoc_latency_estimator_record (
+         &estimator, 1, MONGOC_LATENCY_READ, 1000, &estimate_usec);
+   }
+
+   ASSERT_CMPINT64 (_mongoc_latency_estimator_percentile (
+                       &estimator, MONGOC_LATENCY_READ, 90),
+                    <,
+                    (int64_t) 1500);
+
+   /* another server's samples reset the estimator */
+   ASSERT (!_mongoc_latency_estimator_record (
+      &estimator, 2, MONGOC_LATENCY_READ, 1000, &estimate_usec));
+   ASSERT_CMPINT64 (_mongoc_latency_estimator_percentile (
+                       &estimator, MONGOC_LATENCY_READ, 90),
+                    ==,
+                    (int64_t) -1);
+   ASSERT_CMPUINT32 (estimator.server_id, ==, (uint32_t) 2);
+   ASSERT_CMPINT (estimator.samples[MONGOC_LATENCY_READ], ==, 1);
+
+   /* a sample is dropped while another thread resets the estimator */
+   estimator.claiming = 1;
+   ASSERT (!_mongoc_latency_estimator_record (
+      &estimator, 3, MONGOC_LATENCY_READ, 1000, &estimate_usec));
+   ASSERT_CMPUINT32 (estimator.server_id, ==, (uint32_t) 2);
+   ASSERT_CMPINT (estimator.samples[MONGOC_LATENCY_READ], ==, 1);
+   ASSERT_CMPINT (estimator.claiming, ==, 1);
+   estimator.claiming = 0;
+
+   ASSERT_CMPINT (_mongoc_latency_class ("find"), ==, MONGOC_LATENCY_READ);
+   ASSERT_CMPINT (_mongoc_latency_class ("insert"), ==, MONGOC_LATENCY_WRITE);
+   ASSERT_CMPINT (_mongoc_latency_class ("ping"), ==, MONGOC_LATENCY_COMMAND);
+}
+
+
+static void
+_test_operation_latency_window (bool operation_rtt)
+{
+   mongoc_uri_t *uri;
+   mongoc_topology_t *topology;
+   mongoc_topology_description_t *td;
+   mongoc_server_description_t *sd_a;
+   mongoc_server_description_t *sd_b;
+   mongoc_server_description_t *sd;
+   bool selected_a = false;
+   int64_t latency;
+   uint32_t generation;
+   int i;
+
+   uri = mongoc_uri_new ("mongodb://a,b");
+   mongoc_uri_set_option_as_bool (
+      uri, MONGOC_URI_OPERATIONLATENCYWINDOW, operation_rtt);
+   topology = mongoc_topology_new (uri, true /* single-threaded */);
+   td = &topology->description;
+
+   /* both servers answer ismaster in 10ms */
+   sd_a = _sd_for_host (td, "a");
+   mongoc_topology_description_handle_ismaster (
+      td, sd_a->id, tmp_bson ("{'ok': 1, 'msg': 'isdbgrid'}"), 10, NULL);
+   sd_b = _sd_for_host (td, "b");
+   mongoc_topology_description_handle_ismaster (
+      td, sd_b->id, tmp_bson ("{'ok': 1, 'msg': 'isdbgrid'}"), 10, NULL);
+
+   /* but reads on "a" take 50ms, and on "b" 1ms */
+   generation = td->generation;
+   for (i = 0; i < 4 * MONGOC_LATENCY_MIN_SAMPLES; i++) {
+      _mongoc_topology_record_latency (
+         topology, sd_a->id, MONGOC_LATENCY_READ, 50 * 1000);
+      _mongoc_topology_record_latency (
+         topology, sd_b->id, MONGOC_LATENCY_READ, 1000);
+   }
+
+   /* the description changes for selection only if the window uses it */
+   ASSERT_CMPINT (
+      (int) (td->generation != generation), ==, (int) operation_rtt);
+
+   latency =
+      mongoc_server_description_operation_latency (sd_a, MONGOC_LATENCY_READ);
+   ASSERT_CMPINT64 (latency, >=, (int64_t) 40);
+   ASSERT_CMPINT64 (latency, <=, (int64_t) 70);
+   ASSERT_CMPINT64 (
+      mongoc_server_description_operation_latency (sd_a, MONGOC_LATENCY_WRITE),
+      ==,
+      (int64_t) -1);
+
+   for (i = 0; i < 100; i++) {
+      sd = mongoc_topology_description_select (td, MONGOC_SS_READ, NULL, 15);
+      ASSERT (sd);
+      selected_a |= sd->id == sd_a->id;
+   }
+
+   /* "a" is outside the window only if measured by operations */
+   ASSERT_CMPINT ((int) selected_a, ==, (int) !operation_rtt);
+
+   /* no write latencies yet: both are within the window for writes */
+   selected_a = false;
+   for (i = 0; i < 100; i++) {
+      sd = mongoc_topology_description_select (td, MONGOC_SS_WRITE, NULL, 15);
+      selected_a |= sd->id == sd_a->id;
+   }
+
+   ASSERT (selected_a);
+
+   mongoc_topology_destroy (topology);
+   mongoc_uri_destroy (uri);
+}
+
+
+static void
+test_operation_latency_window (void)
+{
+   _test_operation_latency_window (true);
+}
+
+
+static void
+test_heartbeat_latency_window (void)
+{
+   _test_operation_latency_window (false);
+}
+
+
+static void
+test_operation_latency_expires (void)
+{
+   mongoc_uri_t *uri;
+   mongoc_topology_t *topology;
+   mongoc_topology_description_t *td;
+   mongoc_server_description_t *sd_a;
+   mongoc_server_description_t *sd_b;
+   mongoc_server_description_t *sd;
+   mongoc_latency_estimator_t *estimator;
+   bool selected_a;
+   int i;
+
+   uri = mongoc_uri_new ("mongodb://a,b/?operationLatencyWindow=true");
+   topology = mongoc_topology_new (uri, true /* single-threaded */);
+   td = &topology->description;
+
+   sd_a = _sd_for_host (td, "a");
+   mongoc_topology_description_handle_ismaster (
+      td, sd_a->id, tmp_bson ("{'ok': 1, 'msg': 'isdbgrid'}"), 10, NULL);
+   sd_b = _sd_for_host (td, "b");
+   mongoc_topology_description_handle_ismaster (
+      td, sd_b->id, tmp_bson ("{'ok': 1, 'msg': 'isdbgrid'}"), 10, NULL);
+
+   /* "a" was slow once, and is outside the window */
+   for (i = 0; i < MONGOC_LATENCY_MIN_SAMPLES; i++) {
+      _mongoc_topology_record_latency (
+         topology, sd_a->id, MONGOC_LATENCY_READ, 50 * 1000);
+      _mongoc_topology_record_latency (
+         topology, sd_b->id, MONGOC_LATENCY_READ, 1000);
+   }
+
+   for (i = 0; i < 100; i++) {
+      sd = mongoc_topology_description_select (td, MONGOC_SS_READ, NULL, 15);
+      ASSERT_CMPUINT32 (sd->id, ==, sd_b->id);
+   }
+
+   /* a heartbeat finds no reads on "a" for a while */
+   estimator = &topology->latency[sd_a->id % MONGOC_TOPOLOGY_LATENCY_SLOTS];
+   estimator->last_sample_usec[MONGOC_LATENCY_READ] -=
+      MONGOC_TOPOLOGY_LATENCY_MAX_AGE_HEARTBEATS * td->heartbeat_msec * 1000 +
+      1;
+   sd = mongoc_server_description_new_copy (sd_a);
+   ASSERT (_mongoc_topology_update_from_handshake (topology, sd));
+   mongoc_server_description_destroy (sd);
+
+   /* "a" is measured by its ismaster round trip time again */
+   ASSERT_CMPINT64 (
+      mongoc_server_description_operation_latency (sd_a, MONGOC_LATENCY_READ),
+      ==,
+      (int64_t) -1);
+
+   selected_a = false;
+   for (i = 0; i < 100; i++) {
+      sd = mongoc_topology_description_select (td, MONGOC_SS_READ, NULL, 15);
+      selected_a |= sd->id == sd_a->id;
+   }
+
+   ASSERT (selected_a);
+
+   /* "b" has recent samples and keeps its estimate */
+   ASSERT_CMPINT64 (
+      mongoc_server_description_operation_latency (sd_b, MONGOC_LATENCY_READ),
+      !=,
+      (int64_t) -1);
+
+   mongoc_topology_destroy (topology);
+   mongoc_uri_destroy (uri);
+}
+
+
+static void
+test_select_hedge (void)
+{
+   mongoc_uri_t *uri;
+   mongoc_topology_t *topology;
+   mongoc_topology_description_t *td;
+   mongoc_server_description_t *sd[3];
+   mongoc_server_description_t *hedge;
+   mongoc_read_prefs_t *prefs;
+   const char *hosts[] = {"a", "b", "c"};
+   bool hedged_on[3] = {false};
+   int64_t delay;
+   int i;
+
+   uri = mongoc_uri_new ("mongodb://a,b,c/?replicaSet=rs");
+   topology = mongoc_topology_new (uri, true /* single-threaded */);
+   td = &topology->description;
+
+   for (i = 0; i < 3; i++) {
+      sd[i] = _sd_for_host (td, hosts[i]);
+   }
+
+   mongoc_topology_description_handle_ismaster (
+      td,
+      sd[0]->id,
+      tmp_bson ("{'ok': 1, 'ismaster': true, 'setName': 'rs',"
+                " 'hosts': ['a', 'b', 'c']}"),
+      10,
+      NULL);
+
+   for (i = 1; i < 3; i++) {
+      mongoc_topology_description_handle_ismaster (
+         td,
+         sd[i]->id,
+         tmp_bson ("{'ok': 1, 'secondary': true, 'setName': 'rs',"
+                   " 'hosts': ['a', 'b', 'c']}"),
+         10,
+         NULL);
+   }
+
+   /* a read sent to one secondary is hedged on the other */
+   prefs = mongoc_read_prefs_new (MONGOC_READ_SECONDARY_PREFERRED);
+   for (i = 0; i < 10; i++) {
+      hedge = _mongoc_topology_description_select_hedge (
+         td, prefs, 15, &td->rand_seed, sd[1]->id);
+      ASSERT (hedge);
+      ASSERT_CMPUINT32 (hedge->id, ==, sd[2]->id);
+   }
+
+   ASSERT_CMPUINT32 (
+      _mongoc_topology_select_hedge_server_id (topology, prefs, sd[2]->id),
+      ==,
+      sd[1]->id);
+
+   /* with "nearest", on any other member */
+   mongoc_read_prefs_set_mode (prefs, MONGOC_READ_NEAREST);
+   for (i = 0; i < 100; i++) {
+      hedge = _mongoc_topology_description_select_hedge (
+         td, prefs, 15, &td->rand_seed, sd[0]->id);
+      ASSERT (hedge);
+      ASSERT_CMPUINT32 (hedge->id, !=, sd[0]->id);
+      hedged_on[hedge->id == sd[1]->id ? 1 : 2] = true;
+   }
+
+   ASSERT (hedged_on[1]);
+   ASSERT (hedged_on[2]);
+
+   /* only the primary can answer */
+   mongoc_read_prefs_set_mode (prefs, MONGOC_READ_PRIMARY);
+   ASSERT (!_mongoc_topology_description_select_hedge (
+      td, prefs, 15, &td->rand_seed, sd[0]->id));
+
+   /* no delay until enough reads are timed, then their 95th percentile */
+   delay = _mongoc_topology_hedge_delay_msec (topology, sd[1]->id);
+   ASSERT_CMPINT64 (delay, ==, (int64_t) -1);
+
+   for (i = 0; i < 100; i++) {
+      _mongoc_topology_record_latency (
+         topology, sd[1]->id, MONGOC_LATENCY_READ, i < 90 ? 1000 : 50 * 1000);
+   }
+
+   delay = _mongoc_topology_hedge_delay_msec (topology, sd[1]->id);
+   ASSERT_CMPINT64 (delay, >=, (int64_t) 40);
+   ASSERT_CMPINT64 (delay, <=, (int64_t) 70);
+
+   mongoc_read_prefs_destroy (prefs);
+   mongoc_topology_destroy (topology);
+   mongoc_uri_destroy (uri);
+}
+
+
 void
 test_topology_description_install (TestSuite *suite)
 {
@@ -151,4 +590,24 @@ test_topology_description_install (TestSuite *suite)
                       "/TopologyDescription/readable_writable/pooled",
                       test_has_readable_writable_server_pooled);
    TestSuite_Add (suite, "/TopologyDescription/get_servers", test_get_servers);
+   TestSuite_Add (suite,
+                  "/TopologyDescription/candidates_cache",
+                  test_candidates_cache);
+   TestSuite_Add (suite,
+                  "/TopologyDescription/least_outstanding",
+                  test_least_outstanding);
+   TestSuite_Add (suite,
+                  "/TopologyDescription/latency_estimator",
+                  test_latency_estimator);
+   TestSuite_Add (suite,
+                  "/TopologyDescription/latency_window/operation",
+                  test_operation_latency_window);
+   TestSuite_Add (suite,
+                  "/TopologyDescription/latency_window/heartbeat",
+                  test_heartbeat_latency_window);
+   TestSuite_Add (suite,
+                  "/TopologyDescription/latency_window/expires",
+                  test_operation_latency_expires);
+   TestSuite_Add (
+      suite, "/TopologyDescription/select_hedge", test_select_hedge);
 }
@@ -2,6 +2,8 @@
 #include <mongoc-uri-private.h>
 
 #include "mongoc-client-private.h"
+#include "mongoc-set-private.h"
+#include "mongoc-thread-private.h"
 #include "mongoc-util-private.h"
 #include "TestSuite.h"
 
@@ -1363,6 +1365,321 @@ test_ismaster_retry_pooled_timeout_fail (void)
    _test_ismaster_retry_pooled (false, 2);
 }
 
+/* make a pooled topology of three mongoses and publish a snapshot of it */
+static mongoc_topology_t *
+_pooled_topology_of_mongoses (mongoc_uri_t *uri)
+{
+   mongoc_topology_t *topology;
+   uint32_t id;
+   size_t i;
+
+   topology = mongoc_topology_new (uri, false /* pooled */);
+   ASSERT (!_mongoc_topology_get_snapshot (topology));
+
+   mongoc_mutex_lock (&topology->mutex);
+   for (i = 0; i < topology->description.servers->items_len; i++) {
+      mongoc_set_get_item_and_id (topology->description.servers, (int) i, &id);
+      mongoc_topology_description_handle_ismaster (
+         &topology->description,
+         id,
+         tmp_bson ("{'ok': 1, 'msg': 'isdbgrid', 'maxWireVersion': 6}"),
+         10,
+         NULL);
+   }
+
+   _mongoc_topology_publish (topology);
+   mongoc_mutex_unlock (&topology->mutex);
+
+   return topology;
+}
+
+
+static void
+test_topology_snapshot (void)
+{
+   mongoc_uri_t *uri;
+   mongoc_topology_t *topology;
+   mongoc_topology_snapshot_t *snapshot;
+   mongoc_topology_snapshot_t *next_snapshot;
+   mongoc_server_description_t *sd;
+   bson_error_t error;
+   uint32_t id;
+
+   uri = mongoc_uri_new ("mongodb://a,b,c");
+   topology = _pooled_topology_of_mongoses (uri);
+
+   snapshot = _mongoc_topology_get_snapshot (topology);
+   ASSERT (snapshot);
+   ASSERT_CMPINT (snapshot->ref_count, ==, 2);
+   ASSERT_CMPINT (snapshot->td.type, ==, MONGOC_TOPOLOGY_SHARDED);
+
+   id = mongoc_topology_select_server_id (
+      topology, MONGOC_SS_READ, NULL, &error);
+   ASSERT_OR_PRINT (id, error);
+
+   sd = mongoc_topology_server_by_id (topology, id, &error);
+   ASSERT_OR_PRINT (sd, error);
+   ASSERT_CMPINT (sd->type, ==, MONGOC_SERVER_MONGOS);
+   mongoc_server_description_destroy (sd);
+
+   /* a new snapshot is published, the old one stays valid while held */
+   bson_set_error (
+      &error, MONGOC_ERROR_STREAM, MONGOC_ERROR_STREAM_SOCKET, "failure");
+   mongoc_topology_invalidate_server (topology, id, &error);
+   next_snapshot = _mongoc_topology_get_snapshot (topology);
+   ASSERT (next_snapshot != snapshot);
+   ASSERT_CMPINT (snapshot->ref_count, ==, 1);
+
+   sd = mongoc_topology_description_server_by_id (&snapshot->td, id, NULL);
+   ASSERT_CMPINT (sd->type, ==, MONGOC_SERVER_MONGOS);
+   sd = mongoc_topology_description_server_by_id (
+      &next_snapshot->td, id, NULL);
+   ASSERT_CMPINT (sd->type, ==, MONGOC_SERVER_UNKNOWN);
+
+   /* selection from the new snapshot skips the invalidated server */
+   ASSERT_CMPUINT32 (id,
+                     !=,
+                     mongoc_topology_select_server_id (
+                        topology, MONGOC_SS_READ, NULL, &error));
+
+   _mongoc_topology_snapshot_unref (snapshot);
+   _mongoc_topology_snapshot_unref (next_snapshot);
+   mongoc_topology_destroy (topology);
+   mongoc_uri_destroy (uri);
+}
+
+
+#define SNAPSHOT_BENCHMARK_THREADS 128
+#define SNAPSHOT_BENCHMARK_SELECTIONS 2000
+
+typedef struct {
+   mongoc_topology_t *topology;
+   bool use_snapshot;
+   /* tells the republishing thread to stop, guarded by topology->mutex */
+   bool done;
+} snapshot_benchmark_ctx_t;
+
+
+/* select a server and look up its description, as fetching a server stream
+ * does: from the snapshot without locking, or the old way, under the mutex
+ * with a copy of the server description */
+static void *
+_snapshot_benchmark_thread (void *data)
+{
+   snapshot_benchmark_ctx_t *ctx;
+   mongoc_topology_t *topology;
+   mongoc_topology_snapshot_t *snapshot;
+   mongoc_server_description_t *sd;
+   bson_error_t error;
+   uint32_t id;
+   int i;
+
+   ctx = (snapshot_benchmark_ctx_t *) data;
+   topology = ctx->topology;
+
+   for (i = 0; i < SNAPSHOT_BENCHMARK_SELECTIONS; i++) {
+      if (ctx->use_snapshot) {
+         id = mongoc_topology_select_server_id (
+            topology, MONGOC_SS_READ, NULL, &error);
+         BSON_ASSERT (id);
+         snapshot = _mongoc_topology_get_snapshot (topology);
+         BSON_ASSERT (mongoc_topology_description_server_by_id (
+            &snapshot->td, id, &error));
+         _mongoc_topology_snapshot_unref (snapshot);
+      } else {
+         mongoc_mutex_lock (&topology->mutex);
+         sd = mongoc_topology_description_select (
+            &topology->description, MONGOC_SS_READ, NULL, 15);
+         BSON_ASSERT (sd);
+         sd = mongoc_server_description_new_copy (sd);
+         mongoc_mutex_unlock (&topology->mutex);
+         mongoc_server_description_destroy (sd);
+      }
+   }
+
+   return NULL;
+}
+
+
+/* republish while the threads select, as the scanner would */
+static void *
+_snapshot_benchmark_republish (void *data)
+{
+   snapshot_benchmark_ctx_t *ctx;
+   bool done;
+
+   ctx = (snapshot_benchmark_ctx_t *) data;
+
+   for (;;) {
+      mongoc_mutex_lock (&ctx->topology->mutex);
+      done = ctx->done;
+      if (!done) {
+         _mongoc_topology_publish (ctx->topology);
+      }
+      mongoc_mutex_unlock (&ctx->topology->mutex);
+
+      if (done) {
+         return NULL;
+      }
+
+      _mongoc_usleep (1000);
+   }
+}
+
+
+/* time server selection on 128 threads, with and without snapshots */
+static void
+test_topology_snapshot_benchmark (void *ctx)
+{
+   mongoc_uri_t *uri;
+   snapshot_benchmark_ctx_t bench;
+   mongoc_thread_t threads[SNAPSHOT_BENCHMARK_THREADS];
+   mongoc_thread_t republisher;
+   int64_t start;
+   int64_t usec;
+   int i;
+   int j;
+
+   uri = mongoc_uri_new ("mongodb://a,b,c");
+   bench.topology = _pooled_topology_of_mongoses (uri);
+
+   for (i = 0; i < 2; i++) {
+      bench.use_snapshot = (i == 1);
+      bench.done = false;
+      ASSERT_CMPINT (
+         0,
+         ==,
+         mongoc_thread_create (
+            &republisher, _snapshot_benchmark_republish, &bench));
+
+      /* time only the selecting threads */
+      start = bson_get_monotonic_time ();
+
+      for (j = 0; j < SNAPSHOT_BENCHMARK_THREADS; j++) {
+         ASSERT_CMPINT (
+            0,
+            ==,
+            mongoc_thread_create (
+               &threads[j], _snapshot_benchmark_thread, &bench));
+      }
+
+      for (j = 0; j < SNAPSHOT_BENCHMARK_THREADS; j++) {
+         mongoc_thread_join (threads[j]);
+      }
+
+      usec = bson_get_monotonic_time () - start;
+
+      mongoc_mutex_lock (&bench.topology->mutex);
+      bench.done = true;
+      mongoc_mutex_unlock (&bench.topology->mutex);
+      mongoc_thread_join (republisher);
+
+      fprintf (stderr,
+               "      %s: %.0f selections/s\n",
+               bench.use_snapshot ? "snapshot" : "mutex",
+               1e6 * SNAPSHOT_BENCHMARK_THREADS *
+                  SNAPSHOT_BENCHMARK_SELECTIONS / usec);
+   }
+
+   mongoc_topology_destroy (bench.topology);
+   mongoc_uri_destroy (uri);
+}
+
+
+static void
+test_adaptive_heartbeat (void)
+{
+   mongoc_uri_t *uri;
+   mongoc_topology_t *topology;
+   mongoc_topology_description_t *td;
+   const char *primary = "{'ok': 1, 'ismaster': true, 'setName': 'rs',"
+                         " 'hosts': ['a', 'b']}";
+   uint32_t disruptions;
+   uint32_t id;
+   bson_error_t error;
+   int64_t interval;
+   int i;
+
+   /* off unless the maximum is above heartbeatFrequencyMS */
+   uri = mongoc_uri_new (
+      "mongodb://a/?heartbeatFrequencyMS=1000&maxHeartbeatFrequencyMS=1000");
+   topology = mongoc_topology_new (uri, false /* pooled */);
+   ASSERT_CMPINT64 (topology->max_heartbeat_msec, ==, (int64_t) 0);
+   interval = _mongoc_topology_next_heartbeat_msec (topology, 1000, true);
+   ASSERT_CMPINT64 (interval, ==, (int64_t) 1000);
+   mongoc_topology_destroy (topology);
+   mongoc_uri_destroy (uri);
+
+   uri = mongoc_uri_new ("mongodb://a,b/?replicaSet=rs"
+                         "&heartbeatFrequencyMS=1000"
+                         "&maxHeartbeatFrequencyMS=6000");
+   topology = mongoc_topology_new (uri, false /* pooled */);
+   td = &topology->description;
+   ASSERT_CMPINT64 (topology->max_heartbeat_msec, ==, (int64_t) 6000);
+
+   /* stable scans back off to the maximum */
+   interval = _mongoc_topology_next_heartbeat_msec (topology, 1000, false);
+   ASSERT_CMPINT64 (interval, ==, (int64_t) 2000);
+   interval = _mongoc_topology_next_heartbeat_msec (topology, interval, false);
+   ASSERT_CMPINT64 (interval, ==, (int64_t) 4000);
+   interval = _mongoc_topology_next_heartbeat_msec (topology, interval, false);
+   ASSERT_CMPINT64 (interval, ==, (int64_t) 6000);
+   interval = _mongoc_topology_next_heartbeat_msec (topology, interval, false);
+   ASSERT_CMPINT64 (interval, ==, (int64_t) 6000);
+
+   /* a disrupted one drops to the minimum */
+   interval = _mongoc_topology_next_heartbeat_msec (topology, interval, true);
+   ASSERT_CMPINT64 (
+      interval, ==, (int64_t) MONGOC_TOPOLOGY_MIN_HEARTBEAT_FREQUENCY_MS);
+
+   /* discovering the primary is a disruption, the same reply again isn't */
+   mongoc_set_get_item_and_id (td->servers, 0, &id);
+   disruptions = td->disruptions;
+   mongoc_topology_description_handle_ismaster (
+      td, id, tmp_bson (primary), 10, NULL);
+   ASSERT_CMPUINT32 (td->disruptions, >, disruptions);
+
+   disruptions = td->disruptions;
+   mongoc_topology_description_handle_ismaster (
+      td, id, tmp_bson (primary), 10, NULL);
+   ASSERT_CMPUINT32 (td->disruptions, ==, disruptions);
+
+   /* a step down, a failed check, and a "not master" reply are too */
+   mongoc_topology_description_handle_ismaster (
+      td,
+      id,
+      tmp_bson ("{'ok': 1, 'secondary': true, 'setName': 'rs',"
+                " 'hosts': ['a', 'b']}"),
+      10,
+      NULL);
+   ASSERT_CMPUINT32 (td->disruptions, >, disruptions);
+
+   disruptions = td->disruptions;
+   bson_set_error (
+      &error, MONGOC_ERROR_STREAM, MONGOC_ERROR_STREAM_SOCKET, "failure");
+   mongoc_topology_description_handle_ismaster (td, id, NULL, -1, &error);
+   ASSERT_CMPUINT32 (td->disruptions, >, disruptions);
+
+   /* a server that stays down lets the interval back off */
+   disruptions = td->disruptions;
+   interval = MONGOC_TOPOLOGY_MIN_HEARTBEAT_FREQUENCY_MS;
+   for (i = 0; i < 5; i++) {
+      mongoc_topology_description_handle_ismaster (td, id, NULL, -1, &error);
+      interval = _mongoc_topology_next_heartbeat_msec (
+         topology, interval, td->disruptions != disruptions);
+      disruptions = td->disruptions;
+   }
+
+   ASSERT_CMPINT64 (interval, ==, (int64_t) 6000);
+
+   disruptions = td->disruptions;
+   _mongoc_topology_handle_not_master (topology);
+   ASSERT_CMPUINT32 (td->disruptions, ==, disruptions + 1);
+
+   mongoc_topology_destroy (topology);
+   mongoc_uri_destroy (uri);
+}
+
 
 void
 test_topology_install (TestSuite *suite)
@@ -1470,4 +1787,13 @@ test_topology_install (TestSuite *suite)
    TestSuite_AddMockServerTest (suite,
                                 "/Topology/ismaster_retry/pooled/timeout/fail",
                                 test_ismaster_retry_pooled_timeout_fail);
+   TestSuite_Add (suite, "/Topology/snapshot", test_topology_snapshot);
+   TestSuite_AddFull (suite,
+                      "/Topology/snapshot_benchmark",
+                      test_topology_snapshot_benchmark,
+                      NULL,
+                      NULL,
+                      test_framework_skip_if_slow);
+   TestSuite_Add (
+      suite, "/Topology/adaptive_heartbeat", test_adaptive_heartbeat);
 }
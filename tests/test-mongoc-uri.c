@@ -1075,6 +1075,43 @@ test_mongoc_uri_compressors (void)
       "Invalid \"zlibcompressionlevel\" of 10: must be between -1 and 9");
    mongoc_uri_destroy (uri);
 
+   uri = mongoc_uri_new (
+      "mongodb://localhost/?compressors=zlib&zlibCompressionThreads=4");
+   ASSERT_CMPINT32 (mongoc_uri_get_option_as_int32 (
+                       uri, MONGOC_URI_ZLIBCOMPRESSIONTHREADS, 1),
+                    ==,
+                    4);
+   mongoc_uri_destroy (uri);
+
+   capture_logs (true);
+   uri = mongoc_uri_new (
+      "mongodb://localhost/?compressors=zlib&zlibCompressionThreads=0");
+   ASSERT_CAPTURED_LOG (
+      "mongoc_uri_set_compressors",
+      MONGOC_LOG_LEVEL_WARNING,
+      "Invalid \"zlibcompressionthreads\" of 0: must be between 1 and 32");
+   mongoc_uri_destroy (uri);
+
+#endif
+
+#ifdef MONGOC_ENABLE_COMPRESSION_ZSTD
+   uri = mongoc_uri_new (
+      "mongodb://localhost/?compressors=zstd,zlib&zstdCompressionLevel=19");
+   ASSERT (bson_has_field (mongoc_uri_get_compressors (uri), "zstd"));
+   ASSERT_CMPINT32 (
+      mongoc_uri_get_option_as_int32 (uri, MONGOC_URI_ZSTDCOMPRESSIONLEVEL, 0),
+      ==,
+      19);
+   mongoc_uri_destroy (uri);
+
+   capture_logs (true);
+   uri = mongoc_uri_new (
+      "mongodb://localhost/?compressors=zstd&zstdCompressionLevel=23");
+   ASSERT_CAPTURED_LOG (
+      "mongoc_uri_set_compressors",
+      MONGOC_LOG_LEVEL_WARNING,
+      "Invalid \"zstdcompressionlevel\" of 23: must be between 0 and 22");
+   mongoc_uri_destroy (uri);
 #endif
 }
 